@@ -0,0 +1,285 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <openorbit/log.h>
+
+#include "common/task-pool.h"
+#include "common/palloc.h"
+
+// Each worker owns a queue of index ranges. The owner takes ranges from the
+// head of its own queue, and when it runs dry it steals from the tail of the
+// other queues. The queues are refilled by the issuing thread for every
+// parallel loop, ranges are never added while a loop is running.
+
+typedef struct {
+  size_t begin;
+  size_t end;
+} task_range_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head;
+  size_t tail;
+  size_t cap;
+  task_range_t *ranges;
+} task_queue_t;
+
+typedef struct {
+  task_pool_t *pool;
+  unsigned idx;
+  pthread_t thread;
+} task_worker_t;
+
+struct task_pool_t {
+  unsigned threads;
+  task_queue_t *queues;
+  task_worker_t *workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  unsigned generation; // Bumped for every parallel loop
+  bool shutdown;
+  size_t pending; // Ranges not yet completed
+
+  task_fn_t fn;
+  void *arg;
+};
+
+static bool
+task_queue_pop(task_queue_t *queue, task_range_t *range)
+{
+  bool found = false;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->head < queue->tail) {
+    *range = queue->ranges[queue->head ++];
+    found = true;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+static bool
+task_queue_steal(task_queue_t *queue, task_range_t *range)
+{
+  bool found = false;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->head < queue->tail) {
+    *range = queue->ranges[-- queue->tail];
+    found = true;
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return found;
+}
+
+// Run ranges until all queues are empty
+static void
+task_pool_work(task_pool_t *pool, unsigned idx)
+{
+  size_t completed = 0;
+  task_range_t range;
+
+  for (;;) {
+    bool found = task_queue_pop(&pool->queues[idx], &range);
+
+    for (unsigned i = 1 ; !found && i < pool->threads ; i ++) {
+      found = task_queue_steal(&pool->queues[(idx + i) % pool->threads],
+                               &range);
+    }
+
+    if (!found) break;
+
+    pool->fn(pool->arg, range.begin, range.end, idx);
+    completed ++;
+  }
+
+  if (completed) {
+    pthread_mutex_lock(&pool->lock);
+    pool->pending -= completed;
+    if (pool->pending == 0) {
+      pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+static void*
+task_worker_main(void *data)
+{
+  task_worker_t *worker = data;
+  task_pool_t *pool = worker->pool;
+  unsigned seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutdown && pool->generation == seen) {
+      pthread_cond_wait(&pool->work_cond, &pool->lock);
+    }
+
+    if (pool->shutdown) break;
+
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    task_pool_work(pool, worker->idx);
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+task_pool_t*
+task_pool_new(unsigned threads)
+{
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (cpus > 0) ? (unsigned)cpus : 1;
+  }
+
+  task_pool_t *pool = smalloc(sizeof(task_pool_t));
+  pool->threads = threads;
+  pool->generation = 0;
+  pool->shutdown = false;
+  pool->pending = 0;
+  pool->fn = NULL;
+  pool->arg = NULL;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+
+  pool->queues = scalloc(threads, sizeof(task_queue_t));
+  for (unsigned i = 0 ; i < threads ; i ++) {
+    pthread_mutex_init(&pool->queues[i].lock, NULL);
+  }
+
+  // Worker 0 is the thread issuing the work
+  pool->workers = scalloc(threads, sizeof(task_worker_t));
+  for (unsigned i = 1 ; i < threads ; i ++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].idx = i;
+    if (pthread_create(&pool->workers[i].thread, NULL,
+                       task_worker_main, &pool->workers[i])) {
+      log_fatal("could not create task pool worker %u", i);
+    }
+  }
+
+  log_info("task pool created with %u threads", threads);
+  return pool;
+}
+
+void
+task_pool_delete(task_pool_t *pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (unsigned i = 1 ; i < pool->threads ; i ++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  for (unsigned i = 0 ; i < pool->threads ; i ++) {
+    pthread_mutex_destroy(&pool->queues[i].lock);
+    free(pool->queues[i].ranges);
+  }
+
+  pthread_cond_destroy(&pool->done_cond);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_mutex_destroy(&pool->lock);
+
+  free(pool->queues);
+  free(pool->workers);
+  free(pool);
+}
+
+unsigned
+task_pool_thread_count(const task_pool_t *pool)
+{
+  return pool->threads;
+}
+
+void
+task_pool_parallel_for(task_pool_t *pool, size_t count, size_t grain,
+                       task_fn_t fn, void *arg)
+{
+  if (count == 0) return;
+
+  if (pool->threads == 1) {
+    fn(arg, 0, count, 0);
+    return;
+  }
+
+  if (grain == 0) {
+    grain = count / (pool->threads * 4);
+    if (grain == 0) grain = 1;
+  }
+
+  size_t chunks = (count + grain - 1) / grain;
+  size_t per_queue = (chunks + pool->threads - 1) / pool->threads;
+
+  pthread_mutex_lock(&pool->lock);
+  assert(pool->pending == 0 && "nested or concurrent parallel loops");
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->pending = chunks;
+  pthread_mutex_unlock(&pool->lock);
+
+  // Every queue gets a contiguous block of chunks, so that a worker that does
+  // not need to steal walks its part of the index space in order.
+  size_t chunk = 0;
+  for (unsigned i = 0 ; i < pool->threads ; i ++) {
+    task_queue_t *queue = &pool->queues[i];
+    pthread_mutex_lock(&queue->lock);
+    if (queue->cap < per_queue) {
+      free(queue->ranges);
+      queue->ranges = smalloc(per_queue * sizeof(task_range_t));
+      queue->cap = per_queue;
+    }
+    queue->head = 0;
+    queue->tail = 0;
+    for (size_t j = 0 ; j < per_queue && chunk < chunks ; j ++, chunk ++) {
+      size_t begin = chunk * grain;
+      size_t end = begin + grain;
+      if (end > count) end = count;
+      queue->ranges[queue->tail ++] = (task_range_t){begin, end};
+    }
+    pthread_mutex_unlock(&queue->lock);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->generation ++;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  task_pool_work(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done_cond, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
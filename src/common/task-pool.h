@@ -0,0 +1,66 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_task_pool_h
+#define orbit_task_pool_h
+
+#include <stddef.h>
+
+typedef struct task_pool_t task_pool_t;
+
+/*!
+ * Function executed for a range of a parallel loop.
+ *
+ * \param arg User argument given to task_pool_parallel_for.
+ * \param begin First index in range.
+ * \param end One past the last index in range.
+ * \param worker Index of the executing worker, in [0, thread count). The
+ *        calling thread is always worker 0. This can be used to index per
+ *        worker scratch buffers.
+ */
+typedef void (*task_fn_t)(void *arg, size_t begin, size_t end, unsigned worker);
+
+/*!
+ * Create a new work stealing task pool.
+ *
+ * The calling thread participates in the work, so a pool with n threads will
+ * spawn n - 1 worker threads. A pool with one thread does not spawn any
+ * threads and runs all work inline.
+ *
+ * \param threads Number of threads, 0 selects the number of online CPUs.
+ */
+task_pool_t* task_pool_new(unsigned threads);
+void task_pool_delete(task_pool_t *pool);
+
+unsigned task_pool_thread_count(const task_pool_t *pool);
+
+/*!
+ * Run fn over [0, count) split in chunks of at most grain indices. The chunks
+ * are distributed over the worker queues, idle workers steal chunks from the
+ * other queues. The function returns when all chunks have been executed.
+ *
+ * Calls must not be nested, and only one thread may issue work at a time.
+ *
+ * \param grain Chunk size, 0 selects a chunk size giving a few chunks per
+ *        worker.
+ */
+void task_pool_parallel_for(task_pool_t *pool, size_t count, size_t grain,
+                            task_fn_t fn, void *arg);
+
+#endif
@@ -20,6 +20,7 @@
 #include "physics.h"
 #include "areodynamics.h"
 #include <vmath/vmath.h>
+#include <float.h>
 #include <math.h>
 #include <string.h>
 #include <assert.h>
@@ -274,16 +275,12 @@ pl_compute_airvelocity(pl_object_t *obj)
   const double rot_vel_day = obj->dominator->cm_orbit->W_prime; // Rad / day
   const double rot_vel_s = rot_vel_day / (24.0*3600.0); // Rad / s
 
+  // The air rotates with the planet, w x r
   const double3 local_pos = lwc_relvec_d3(&obj->p, obj->dominator->cm_orbit->p);
-  const double3 rot_wind_dir = vd3_cross(up, local_pos);
+  const double3 rot_wind_vel = vd3_cross(up, local_pos) * rot_vel_s;
 
-  const double local_pos_len = vd3_abs(local_pos);
-  const double local_pos_circumference = local_pos_len * 2.0 * M_PI;
-
-  const double3 rot_wind_vel =
-    vd3_normalise(rot_wind_dir) * local_pos_circumference * rot_vel_s;
-
-  return (-obj->v) + rot_wind_vel; //(obj->v - obj->sys->orbitalBody->obj.v);
+  const double3 local_vel = obj->v - obj->dominator->cm_orbit->v;
+  return rot_wind_vel - local_vel;
 }
 
 double
@@ -300,10 +297,10 @@ pl_object_compute_airspeed(pl_object_t *obj)
 double3
 pl_compute_drag(double3 v, double p, double Cd, double A)
 {
-  double v_mag = vd3_abs(vd3_neg(v));
-  double fd = 0.5 * p * v_mag * v_mag * Cd * A;
-  double3 vf_dir = vd3_normalise(v);
-  return vd3_s_mul(vf_dir, fd);
+  double v_mag = vd3_abs(v);
+  if (v_mag == 0.0) return vd3_set(0.0, 0.0, 0.0);
+  // 0.5 p |v|^2 Cd A along v / |v|
+  return v * (0.5 * p * v_mag * Cd * A);
 }
 
 // Computing lift of airfoils using thin airfoil theory
@@ -357,58 +354,26 @@ pl_object_compute_drag(pl_object_t *obj)
 double
 pl_object_compute_airpressure(pl_object_t *obj)
 {
-  return 0.0;
-  // TODO: Update to new physics system.
-#if 0
-  pl_system_t *sys = obj->sys;
-  pl_atmosphere_t *atm = obj->sys->orbitalBody->atm;
-  float3 dist = lwc_dist(&obj->p, &sys->orbitalBody->obj.p);
-  //float g0 = sys->orbitalBody->GM / (sys->orbitalBody->eqRad * sys->orbitalBody->eqRad); // TODO: Cache g0
-  float h = vf3_abs(dist) - sys->orbitalBody->eqRad; // TODO: adjust for oblateness
-  double pressure = pl_atmosphere_pressure(atm, h);//plComputeSimpleAirpressure(atm, h);
-  //plPressureAtAltitude(atm->P0, atm->T0, g0, atm->M, h, 0.0);
-  //log_info("airpressure for %s = %f Pa", obj->name, pressure);
-
-  return pressure;
-#endif
+  if (obj->dominator == NULL || obj->dominator->atm == NULL) return 0.0;
+  return pl_atmosphere_pressure(obj->dominator->atm,
+                                pl_object_compute_altitude(obj));
 }
 
 double
 pl_object_compute_altitude(pl_object_t *obj)
 {
-  return 0.0;
-  // TODO: Fix for new physics system
-#if 0
-  pl_system_t *sys = obj->sys;
-  float3 dist = lwc_dist(&obj->p, &sys->orbitalBody->obj.p);
-  float h = vf3_abs(dist) - sys->orbitalBody->eqRad;
-  return h;
-#endif
+  if (obj->dominator == NULL) return INFINITY;
+
+  double3 dist = lwc_globald(&obj->p) - obj->dominator->cm_orbit->p;
+  return vd3_abs(dist) - obj->dominator->cm_orbit->radius;
 }
 
 double
 pl_object_compute_airdensity(pl_object_t *obj)
 {
-  return 0.0;
-  // TODO: Fix for new physics system
-
-#if 0
-  pl_system_t *sys = obj->sys;
-  pl_atmosphere_t *atm = obj->sys->orbitalBody->atm;
-  float3 dist = lwc_dist(&obj->p, &sys->orbitalBody->obj.p);
-  //float g0 = sys->orbitalBody->GM / (sys->orbitalBody->eqRad * sys->orbitalBody->eqRad); // TODO: Cache g0
-  float h = vf3_abs(dist) - sys->orbitalBody->eqRad; // TODO: adjust for oblateness
-  //double pressure = plComputeSimpleAirpressure(atm, h);
-
-  double density = pl_atmosphere_density(atm, h);
-  //log_info("altitude for %s = %f m above surface of %s", obj->name, h,
-  //          obj->sys->orbitalBody->name);
-  //log_info("atmosphere: P = %f Pa, h0 = %f m", atm->P0, atm->h0);
-  //log_info("airdensity for %s = %f kg/m**3", obj->name, density);
-  //plPressureAtAltitude(atm->p0, atm->T0, g0, atm->M, h, 0.0);
-  //return pressure * atm->M / (PL_UGC * atm->T0);
-  return density;
-#endif
+  if (obj->dominator == NULL || obj->dominator->atm == NULL) return 0.0;
+  return pl_atmosphere_density(obj->dominator->atm,
+                               pl_object_compute_altitude(obj));
 }
 
 
@@ -565,65 +530,84 @@ pl_new_atmosphere_template(size_t layers, double g0, double M, const double *p_b
 pl_atmosphere_t*
 pl_new_atmosphere(float sample_dist, float h, pl_atm_template_t *t)
 {
-  pl_atmosphere_t *atm = smalloc(sizeof(pl_atmosphere_t));
-  float_array_init(&atm->P);
-  float_array_init(&atm->p);
+  assert(sample_dist > 0.0f);
+  assert(h >= sample_dist);
 
-  size_t samples = (size_t) h / sample_dist;
+  pl_atmosphere_t *atm = smalloc(sizeof(pl_atmosphere_t));
+  atm->samples = (size_t)(h / sample_dist) + 1;
   atm->sample_distance = sample_dist;
-  for (size_t i = 0 ; i < samples ; i ++) {
+  atm->inv_sample_distance = 1.0f / sample_dist;
+  atm->h_max = (atm->samples - 1) * sample_dist;
+
+  // One extra sample so that rounding at h_max never reads past the table
+  atm->log_P = smalloc((atm->samples + 1) * sizeof(float));
+  atm->log_p = smalloc((atm->samples + 1) * sizeof(float));
+  for (size_t i = 0 ; i < atm->samples ; i ++) {
     float P = pl_atm_template_compute_airpressure(t, i*sample_dist);
     float p = pl_atm_template_compute_airdensity(t, i*sample_dist);
-    float_array_push(&atm->P, P);
-    float_array_push(&atm->p, p);
+    atm->log_P[i] = logf(fmaxf(P, FLT_MIN));
+    atm->log_p[i] = logf(fmaxf(p, FLT_MIN));
   }
+  atm->log_P[atm->samples] = atm->log_P[atm->samples - 1];
+  atm->log_p[atm->samples] = atm->log_p[atm->samples - 1];
+
+  atm->P0 = expf(atm->log_P[0]);
+  atm->p0 = expf(atm->log_p[0]);
   return atm;
 }
 
+void
+pl_atmosphere_delete(pl_atmosphere_t *atm)
+{
+  free(atm->log_P);
+  free(atm->log_p);
+  free(atm);
+}
+
+static inline float
+pl_atmosphere_sample(const pl_atmosphere_t *atm, const float *tab, float h)
+{
+  if (!(h < atm->h_max)) return 0.0f;
+
+  float x = fmaxf(h * atm->inv_sample_distance, 0.0f);
+  size_t i = (size_t)x;
+  float f = x - (float)i;
+  return expf(tab[i] + (tab[i+1] - tab[i]) * f);
+}
+
+// Same as pl_atmosphere_sample, but without branches in the loop body
+static void
+pl_atmosphere_sample_batch(const pl_atmosphere_t *atm, const float *tab,
+                           size_t n, const float *h, float *out)
+{
+  const float x_max = (float)(atm->samples - 1);
+  for (size_t k = 0 ; k < n ; k ++) {
+    float x = fminf(fmaxf(h[k] * atm->inv_sample_distance, 0.0f), x_max);
+    size_t i = (size_t)x;
+    float f = x - (float)i;
+    float vacuum = (h[k] < atm->h_max) ? 1.0f : 0.0f;
+    out[k] = vacuum * expf(tab[i] + (tab[i+1] - tab[i]) * f);
+  }
+}
+
 float
 pl_atmosphere_pressure(const pl_atmosphere_t *atm, float h)
 {
   if (atm == NULL) return 0.0;
-  if (h < 0.0) {
-    float P0 = ARRAY_ELEM(atm->P, 0);
-    float P1 = ARRAY_ELEM(atm->P, 1);
-    float P = P0 - (P0-P1)/atm->sample_distance * fabsf(h);
-    return P;
-  } else if (h > atm->sample_distance * atm->P.length-1) {
-    float P0 = ARRAY_ELEM(atm->P, atm->P.length-2);
-    float P1 = ARRAY_ELEM(atm->P, atm->P.length-1);
-    float P = fmaxf(P1+((P0-P1)/atm->sample_distance)*(h-atm->sample_distance *
-                                                       atm->P.length-1), 0.0f);
-    return P;
-  } else {
-    size_t idx = h / atm->sample_distance;
-    float f = fmodf(h, atm->sample_distance) / atm->sample_distance;
-    float P = ARRAY_ELEM(atm->P, idx) * (1.0f-f) +
-              ARRAY_ELEM(atm->P, idx+1) * f;
-    return P;
-  }
+  return pl_atmosphere_sample(atm, atm->log_P, h);
 }
 
 float
 pl_atmosphere_density(const pl_atmosphere_t *atm, float h)
 {
   if (atm == NULL) return 0.0;
-  if (h < 0.0) {
-    float p0 = ARRAY_ELEM(atm->p, 0);
-    float p1 = ARRAY_ELEM(atm->p, 1);
-    float p = p0 - (p0-p1)/atm->sample_distance * fabsf(h);
-    return p;
-  } else if (h > atm->sample_distance * atm->p.length-1) {
-    float p0 = ARRAY_ELEM(atm->p, atm->p.length-2);
-    float p1 = ARRAY_ELEM(atm->p, atm->p.length-1);
-    float p = fmaxf(p1+((p0-p1)/atm->sample_distance)*(h-atm->sample_distance *
-                                                       atm->p.length-1), 0.0f);
-    return p;
-  } else {
-    size_t idx = h / atm->sample_distance;
-    float f = fmodf(h, atm->sample_distance) / atm->sample_distance;
-    float p = ARRAY_ELEM(atm->p, idx) * (1.0f-f) +
-              ARRAY_ELEM(atm->p, idx+1) * f;
-    return p;
-  }
+  return pl_atmosphere_sample(atm, atm->log_p, h);
+}
+
+void
+pl_atmosphere_lookup(const pl_atmosphere_t *atm, size_t n, const float *h,
+                     float *P, float *p)
+{
+  if (P) pl_atmosphere_sample_batch(atm, atm->log_P, n, h, P);
+  if (p) pl_atmosphere_sample_batch(atm, atm->log_p, n, h, p);
 }
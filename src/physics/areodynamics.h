@@ -128,17 +128,26 @@ typedef struct pl_atmosphere_t {
   float p0; // Standard density at "ground"-level
   float h0; // Scale height of atmosphere
 
+  // Samples are uniformly spaced from the ground up to h_max and store the
+  // logarithm of the values, as both fall off roughly exponentially. Linear
+  // interpolation of the logarithms is then exact within isothermal layers.
   float sample_distance;
-  float_array_t P; // Pressure points
-  float_array_t p; // Density points
+  float inv_sample_distance;
+  float h_max; // Top of the atmosphere, vacuum above
+  size_t samples;
+  float *log_P; // Pressure samples, ln(Pa)
+  float *log_p; // Density samples, ln(kg / m^3)
 } pl_atmosphere_t;
 
+/*! Altitude of obj above the mean radius of its dominator, the dominator is
+    treated as a sphere. Infinite if obj has no dominator. */
 double pl_object_compute_altitude(pl_object_t *obj);
 double3 pl_compute_airvelocity(pl_object_t *obj);
 double pl_object_compute_airspeed(pl_object_t *obj);
 double pl_object_compute_airpressure(pl_object_t *obj);
 double pl_object_compute_airdensity(pl_object_t *obj);
 double3 pl_object_compute_drag(pl_object_t *obj);
+double3 pl_compute_drag(double3 v, double p, double Cd, double A);
 double pl_object_compute_airdensity_with_current_pressure(pl_object_t *obj);
 void pl_atmosphere_init(pl_atmosphere_t *atm, float groundPressure, float h0);
 
@@ -175,9 +184,19 @@ pl_new_atmosphere_template(size_t layers, double g0, double M,
                            const double *L_b);
 pl_atmosphere_t* pl_new_atmosphere(float sample_dist, float h,
                                 pl_atm_template_t *t);
+void pl_atmosphere_delete(pl_atmosphere_t *atm);
 float pl_atmosphere_density(const pl_atmosphere_t *atm, float h);
 float pl_atmosphere_pressure(const pl_atmosphere_t *atm, float h);
 
+/*! Look up pressure and density at n altitudes at once. Altitudes below the
+    ground get the ground values and altitudes above h_max are vacuum.
+    \param h Altitudes in m
+    \param P Output pressures in Pa, may be NULL
+    \param p Output densities in kg / m^3, may be NULL
+ */
+void pl_atmosphere_lookup(const pl_atmosphere_t *atm, size_t n, const float *h,
+                          float *P, float *p);
+
 
 typedef struct {
   double area;
@@ -0,0 +1,170 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "physics/bodystore.h"
+#include "physics/object.h"
+#include "common/palloc.h"
+
+static void
+pl_bodystore_free_arrays(pl_bodystore_t *store)
+{
+  free(store->objs);
+  free(store->h);
+  free(store->p);
+  free(store->v);
+  free(store->q);
+  free(store->angVel);
+  free(store->f_ack);
+  free(store->t_ack);
+  free(store->g_ack);
+  free(store->inv_m);
+  free(store->I_inv_world);
+}
+
+static void
+pl_bodystore_alloc_arrays(pl_bodystore_t *store, size_t cap)
+{
+  store->cap = cap;
+  store->objs = smalloc(cap * sizeof(pl_object_t*));
+  store->h = smalloc(cap * sizeof(double));
+  store->p = smalloc(cap * sizeof(lwcoord_t));
+  store->v = smalloc(cap * sizeof(double3));
+  store->q = smalloc(cap * sizeof(quatd_t));
+  store->angVel = smalloc(cap * sizeof(double3));
+  store->f_ack = smalloc(cap * sizeof(double3));
+  store->t_ack = smalloc(cap * sizeof(double3));
+  store->g_ack = smalloc(cap * sizeof(double3));
+  store->inv_m = smalloc(cap * sizeof(double));
+  store->I_inv_world = smalloc(cap * sizeof(double3x3));
+}
+
+pl_bodystore_t*
+pl_new_bodystore(size_t cap)
+{
+  pl_bodystore_t *store = smalloc(sizeof(pl_bodystore_t));
+  store->len = 0;
+  if (cap == 0) cap = 16;
+  pl_bodystore_alloc_arrays(store, cap);
+  return store;
+}
+
+void
+pl_bodystore_delete(pl_bodystore_t *store)
+{
+  pl_bodystore_free_arrays(store);
+  free(store);
+}
+
+void
+pl_bodystore_resize(pl_bodystore_t *store, size_t len)
+{
+  if (len > store->cap) {
+    // Slots are reloaded every step, so there is no need to keep them
+    size_t cap = store->cap;
+    while (cap < len) cap *= 2;
+    pl_bodystore_free_arrays(store);
+    pl_bodystore_alloc_arrays(store, cap);
+  }
+
+  store->len = len;
+  memset(store->h, 0, len * sizeof(double));
+}
+
+void
+pl_bodystore_load(pl_bodystore_t *store, size_t i, pl_object_t *obj,
+                  double dt)
+{
+  assert(i < store->len);
+#ifndef NDEBUG
+  PL_CHECK_OBJ(obj);
+#endif
+  store->objs[i] = obj;
+  store->h[i] = dt;
+  store->p[i] = obj->p;
+  store->v[i] = obj->v;
+  store->q[i] = obj->q;
+  store->angVel[i] = obj->angVel;
+  store->f_ack[i] = obj->f_ack;
+  store->t_ack[i] = obj->t_ack;
+  store->g_ack[i] = obj->g_ack;
+  store->inv_m[i] = 1.0 / obj->m.m;
+  for (int k = 0 ; k < 3 ; k ++) {
+    store->I_inv_world[i][k] = obj->I_inv_world[k];
+  }
+}
+
+void
+pl_bodystore_step(pl_bodystore_t *store)
+{
+  const size_t len = store->len;
+  const double *restrict h = store->h;
+  double3 *restrict v = store->v;
+  double3 *restrict angVel = store->angVel;
+  const double3 *restrict f = store->f_ack;
+  const double3 *restrict g = store->g_ack;
+  const double3 *restrict t = store->t_ack;
+  const double *restrict inv_m = store->inv_m;
+
+  // The loops are split so that each one streams over a few arrays only, this
+  // keeps the linear parts free of calls and lets them be vectorised. Slots
+  // that are not loaded have a zero step and may hold stale data, which is
+  // never written back.
+  for (size_t i = 0 ; i < len ; i ++) {
+    v[i] += (f[i] + g[i]) * (inv_m[i] * h[i]);
+  }
+
+  for (size_t i = 0 ; i < len ; i ++) {
+    store->p[i].offs += v[i] * h[i];
+  }
+
+  for (size_t i = 0 ; i < len ; i ++) {
+    angVel[i] += md3_v_mul(store->I_inv_world[i], t[i]) * h[i];
+  }
+
+  // Segment normalisation and quaternion updates do not vectorise
+  for (size_t i = 0 ; i < len ; i ++) {
+    if (h[i] == 0.0) continue;
+    lwc_normalise(&store->p[i]);
+    store->q[i] = qd_normalise(qd_vd3_rot(store->q[i], angVel[i], h[i]));
+  }
+}
+
+void
+pl_bodystore_store(pl_bodystore_t *store, size_t i)
+{
+  assert(i < store->len);
+  if (store->h[i] == 0.0) return;
+
+  pl_object_t *obj = store->objs[i];
+  obj->p = store->p[i];
+  obj->v = store->v[i];
+  obj->q = store->q[i];
+  obj->angVel = store->angVel[i];
+
+  pl_object_compute_derived(obj);
+  pl_object_clear(obj);
+
+  for (int j = 0 ; j < obj->children.length ; ++ j) {
+    pl_object_step_child(obj->children.elems[j], store->h[i]);
+  }
+}
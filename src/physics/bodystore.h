@@ -0,0 +1,76 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_pl_bodystore_h
+#define orbit_pl_bodystore_h
+
+#include <stddef.h>
+#include <vmath/vmath.h>
+#include <vmath/lwcoord.h>
+#include <gencds/array.h>
+
+#include "physics/reftypes.h"
+
+// The body store is a structure of arrays mirroring the hot integration state
+// of the root rigid bodies in a world. The pl_object_t structures remain the
+// public representation of the bodies. The world loads each body into its slot
+// in the pass that computes its gravity, integrates the store in a batch and
+// stores the bodies back in the pass that collects its statistics, so the
+// store adds no passes over the objects of its own.
+//
+// Element i in every array belongs to objs[i], slots with a zero step length
+// are left out of the batch.
+
+struct pl_bodystore_t {
+  size_t len;
+  size_t cap;
+
+  pl_object_t **objs;
+  double *h; // Step length, 0 if the slot is not stepped
+
+  lwcoord_t *p; // Position
+  double3 *v; // Velocity
+  quatd_t *q; // Rotation
+  double3 *angVel; // Angular velocity
+  double3 *f_ack; // Force accumulator
+  double3 *t_ack; // Torque accumulator
+  double3 *g_ack; // Gravity accumulator
+  double *inv_m; // Inverse mass
+  double3x3 *I_inv_world; // Inverse inertia tensor in world coordinates
+};
+
+pl_bodystore_t* pl_new_bodystore(size_t cap);
+void pl_bodystore_delete(pl_bodystore_t *store);
+
+/*! Set the number of slots, all slots are left out until loaded */
+void pl_bodystore_resize(pl_bodystore_t *store, size_t len);
+
+/*! Copy the integration state of obj into slot i, to be stepped by dt.
+    Different slots may be loaded concurrently. */
+void pl_bodystore_load(pl_bodystore_t *store, size_t i, pl_object_t *obj,
+                       double dt);
+
+/*! Integrate all loaded slots with semi-implicit Euler */
+void pl_bodystore_step(pl_bodystore_t *store);
+
+/*! Write the integrated state of slot i back to its object and step the
+    children of the object. Slots that were not loaded are ignored. */
+void pl_bodystore_store(pl_bodystore_t *store, size_t i);
+
+#endif
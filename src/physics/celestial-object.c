@@ -47,6 +47,13 @@ pl_new_celobject(pl_world_t *world, cm_orbit_t *cm_orbit)
   return celobj;
 }
 
+void
+pl_celobject_set_geopotential(pl_celobject_t *celobj, pl_geopotential_t *geo)
+{
+  if (celobj->geopotential) pl_geopotential_delete(celobj->geopotential);
+  celobj->geopotential = geo;
+}
+
 quatd_t
 pl_celobject_get_body_quat(pl_celobject_t *celobj)
 {
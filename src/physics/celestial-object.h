@@ -13,16 +13,36 @@
 #include "physics/reftypes.h"
 #include "physics/world.h"
 #include "physics/areodynamics.h"
+#include "physics/geopotential.h"
 
 struct pl_celobject_t {
   pl_octtree_t *tree;
+  size_t tree_slot; // Index in tree->celestial_bodies
+  double3 tree_p; // Position used for the last mass distribution update
   cm_orbit_t *cm_orbit;
   pl_atmosphere_t *atm;
+  pl_geopotential_t *geopotential; // Non-spherical gravity, NULL if none
+
+  // Sphere of influence, updated by the world when on-rails propagation,
+  // patched conic gravity or eclipses are on
+  pl_celobject_t *primary; // Body whose SOI contains this, NULL for the sun
+  double soi_radius; // Laplace SOI radius about the primary, INFINITY if none
+
+  // Patched conic gravity of bodies dominated by this object, updated by the
+  // world in PL_GRAVITY_PATCHED_CONIC mode
+  pl_celobject_t *perturbers[PL_MAX_PERTURBERS]; // Strongest tidal sources
+  unsigned perturber_count;
+  double3 patched_acc; // Acceleration of the object from the non-perturbers
 };
 
 void pl_celinit(pl_world_t *world);
 pl_celobject_t* pl_new_celobject(pl_world_t *world, cm_orbit_t *cm_orbit);
 
+/*! Set the non-spherical gravity field of celobj, the object takes ownership
+    of the field. Pass NULL to remove it. */
+void pl_celobject_set_geopotential(pl_celobject_t *celobj,
+                                   pl_geopotential_t *geo);
+
 quatd_t pl_celobject_get_body_quat(pl_celobject_t *celobj);
 quatd_t pl_celobject_get_orbit_quat(pl_celobject_t *celobj);
 float3 pl_celobject_get_vel(pl_celobject_t *celobj);
@@ -18,6 +18,7 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <openorbit/log.h>
@@ -30,6 +31,12 @@
 #define THRESHOLD 10
 #define TOLERANCE 0.1
 
+DEF_ARRAY(pl_collision_t, pl_collision);
+DEF_ARRAY(pl_contact_t, pl_contact);
+
+#define PL_SAP_PAIR_EMPTY UINT64_MAX
+#define PL_SAP_PAIR_REMOVED (UINT64_MAX - 1)
+
 pl_recgrid_t*
 pl_new_recgrid(pl_collisioncontext_t *ctxt, double size)
 {
@@ -53,33 +60,91 @@ pl_recgrid_delete(pl_recgrid_t *grid)
   pool_free(grid);
 }
 
+static void
+pl_recgrid_delete_tree(pl_recgrid_t *grid)
+{
+  if (grid == NULL) return;
+  for (int i = 0 ; i < 8 ; i ++) {
+    pl_recgrid_delete_tree(grid->children[i]);
+  }
+  pl_recgrid_delete(grid);
+}
+
+static void pl_sap_insert(pl_sweepprune_t *sap, pl_object_t *obj, double dt);
+static void pl_sap_clear(pl_sweepprune_t *sap);
+
 pl_collisioncontext_t*
-pl_new_collision_context(double size)
+pl_new_collision_context(double size, pl_broadphase_t broadphase)
 {
   pl_collisioncontext_t *ctxt = smalloc(sizeof(pl_collisioncontext_t));
   ctxt->pool = pool_create(sizeof(pl_recgrid_t));
-  obj_array_init(&ctxt->colls);
+  ctxt->broadphase = broadphase;
+  obj_array_init(&ctxt->objs);
+  pl_collision_array_init(&ctxt->colls);
+  pl_contact_array_init(&ctxt->contacts);
   ctxt->otree = pl_new_recgrid(ctxt, size); // Roughly the heliospause
   return ctxt;
 }
 
+void
+pl_collision_context_delete(pl_collisioncontext_t *ctxt)
+{
+  // NOTE: The pool allocator has no way to release the pool descriptor
+  pl_recgrid_delete_tree(ctxt->otree);
+
+  free(ctxt->sap.lo);
+  free(ctxt->sap.hi);
+  for (int k = 0 ; k < 3 ; k ++) {
+    free(ctxt->sap.axis[k]);
+  }
+  free(ctxt->sap.pairs);
+
+  obj_array_dispose(&ctxt->objs);
+  pl_collision_array_dispose(&ctxt->colls);
+  pl_contact_array_dispose(&ctxt->contacts);
+  free(ctxt->contact_index);
+  free(ctxt->collided);
+  free(ctxt);
+}
+
 void pl_collcontext_insert_object(pl_collisioncontext_t *ctxt, pl_recgrid_t *grid, pl_object_t *obj);
 
+// Bounding sphere of the volume swept by obj during the last step, obj is
+// assumed to have moved in a straight line with its current velocity
+static void
+sweep_sphere(const pl_collisioncontext_t *ctxt, const pl_object_t *obj,
+             lwcoord_t *centre, double *radius)
+{
+  *centre = obj->p;
+  lwc_translate3dv(centre, obj->v * (-0.5 * ctxt->dt));
+  *radius = obj->radius + 0.5 * ctxt->dt * vd3_abs(obj->v);
+}
+
 static int
-getoctant(const lwcoord_t *coord, const pl_object_t *obj)
+getoctant(const pl_collisioncontext_t *ctxt, const lwcoord_t *coord,
+          const pl_object_t *obj)
 {
-  double3 dist = lwc_dist(&obj->p, coord);
+  lwcoord_t centre;
+  double radius;
+  sweep_sphere(ctxt, obj, &centre, &radius);
+
+  double3 dist = lwc_dist(&centre, coord);
   int oct = vd3_octant(vd3_set(0, 0, 0), dist);
   return oct;
 }
 static bool
-fits(const pl_recgrid_t *grid, const pl_object_t *obj)
+fits(const pl_collisioncontext_t *ctxt, const pl_recgrid_t *grid,
+     const pl_object_t *obj)
 {
-  double3 dist = lwc_dist(&obj->p, &grid->centre);
+  lwcoord_t centre;
+  double radius;
+  sweep_sphere(ctxt, obj, &centre, &radius);
+
+  double3 dist = lwc_dist(&centre, &grid->centre);
 
-  if (fabs(dist.x) + obj->radius > grid->size
-      || fabs(dist.y) + obj->radius > grid->size
-      || fabs(dist.z) + obj->radius > grid->size) {
+  if (fabs(dist.x) + radius > grid->size
+      || fabs(dist.y) + radius > grid->size
+      || fabs(dist.z) + radius > grid->size) {
     return false;
   }
   return true;
@@ -91,6 +156,7 @@ split(pl_collisioncontext_t *ctxt, pl_recgrid_t *grid)
   if (grid->children[0] == NULL) {
     for (int i = 0 ; i < 8 ; i++) {
       grid->children[i] = pl_new_recgrid(ctxt, grid->size/2.0);
+      grid->children[i]->parent = grid;
       grid->children[i]->centre = grid->centre;
     }
     lwc_translate3f(&grid->children[0]->centre,
@@ -113,8 +179,8 @@ split(pl_collisioncontext_t *ctxt, pl_recgrid_t *grid)
 
   for (int i = 0 ; i < grid->objs.length ; i++) {
     pl_object_t *obj = grid->objs.elems[i];
-    int octant = getoctant(&grid->centre, obj);
-    if (fits(grid->children[octant], obj)) {
+    int octant = getoctant(ctxt, &grid->centre, obj);
+    if (fits(ctxt, grid->children[octant], obj)) {
       pl_collcontext_insert_object(ctxt, grid->children[octant], obj);
       obj_array_remove(&grid->objs, i);
       i --;
@@ -125,8 +191,8 @@ split(pl_collisioncontext_t *ctxt, pl_recgrid_t *grid)
 void
 pl_collcontext_insert_object(pl_collisioncontext_t *ctxt, pl_recgrid_t *grid, pl_object_t *obj)
 {
-  int octant = getoctant(&grid->centre, obj);
-  if (grid->children[octant] && fits(grid->children[octant], obj)){
+  int octant = getoctant(ctxt, &grid->centre, obj);
+  if (grid->children[octant] && fits(ctxt, grid->children[octant], obj)){
     pl_collcontext_insert_object(ctxt, grid->children[octant], obj);
   } else {
     obj_array_push(&grid->objs, obj);
@@ -178,7 +244,6 @@ pl_collide_coarse(pl_collisioncontext_t *coll,
   if (vd3_abs(dist) > (obj_a->radius + obj_b->radius)) {
     return false;
   }
-  log_warn("collision test succeeded %s : %s", obj_a->name, obj_b->name);
 
   return true;
 }
@@ -190,10 +255,187 @@ pl_collide_fine(pl_collisioncontext_t *coll,
   return true;
 }
 
+bool
+pl_collide_sweep(pl_collisioncontext_t *coll,
+                 pl_object_t * restrict obj_a, pl_object_t * restrict obj_b,
+                 double *toi)
+{
+  double3 da = obj_a->v * coll->dt;
+  double3 db = obj_b->v * coll->dt;
+  lwcoord_t a = obj_a->p;
+  lwcoord_t b = obj_b->p;
+  lwc_translate3dv(&a, -da);
+  lwc_translate3dv(&b, -db);
+
+  return pl_lwc_intersection_point(&a, da, obj_a->radius,
+                                   &b, db, obj_b->radius, toi);
+}
+
+static inline size_t
+pl_contact_hash(const pl_object_t *a, const pl_object_t *b, size_t cap)
+{
+  uint64_t key = (uint64_t)(uintptr_t)a * UINT64_C(0x9e3779b97f4a7c15)
+               ^ (uint64_t)(uintptr_t)b;
+  key ^= key >> 33;
+  key *= UINT64_C(0xff51afd7ed558ccd);
+  key ^= key >> 33;
+  return key & (cap - 1);
+}
+
+// Rebuild the contact index from the contact array, leaving room for as many
+// contacts again before the next rebuild
+static void
+pl_contact_reindex(pl_collisioncontext_t *coll)
+{
+  size_t cap = 64;
+  while (cap < 4 * (coll->contacts.length + 1)) cap *= 2;
+
+  if (cap != coll->contact_index_cap) {
+    free(coll->contact_index);
+    free(coll->collided);
+    coll->contact_index = smalloc(cap * sizeof(size_t));
+    coll->collided = smalloc(cap * sizeof(pl_object_t*));
+    coll->contact_index_cap = cap;
+  } else {
+    memset(coll->contact_index, 0, cap * sizeof(size_t));
+  }
+
+  for (size_t i = 0 ; i < coll->contacts.length ; i ++) {
+    pl_contact_t *c = &coll->contacts.elems[i];
+    size_t h = pl_contact_hash(c->a, c->b, cap);
+    while (coll->contact_index[h]) h = (h + 1) & (cap - 1);
+    coll->contact_index[h] = i + 1;
+  }
+}
+
+// Add pair reported by the broadphase to the contact cache, pairs reported
+// more than once in a step and pairs with sleeping objects are ignored
+static void
+pl_collide_pair(pl_collisioncontext_t *coll,
+                pl_object_t * restrict obj_a, pl_object_t * restrict obj_b)
+{
+  if (obj_a->lod == PL_LOD_SLEEPING || obj_b->lod == PL_LOD_SLEEPING) return;
+
+  if (obj_b < obj_a) {
+    pl_object_t *tmp = obj_a;
+    obj_a = obj_b;
+    obj_b = tmp;
+  }
+
+  if (2 * (coll->contacts.length + 1) > coll->contact_index_cap) {
+    pl_contact_reindex(coll);
+  }
+
+  size_t cap = coll->contact_index_cap;
+  size_t h = pl_contact_hash(obj_a, obj_b, cap);
+  while (coll->contact_index[h]) {
+    pl_contact_t *c = &coll->contacts.elems[coll->contact_index[h] - 1];
+    if (c->a == obj_a && c->b == obj_b) {
+      c->stamp = coll->stamp;
+      return;
+    }
+    h = (h + 1) & (cap - 1);
+  }
+
+  pl_contact_t c = {obj_a, obj_b, coll->stamp, false};
+  pl_contact_array_push(&coll->contacts, c);
+  coll->contact_index[h] = coll->contacts.length;
+}
+
+// Drop cached pairs that the broadphase did not report in this step
+static void
+pl_contact_evict(pl_collisioncontext_t *coll)
+{
+  size_t n = 0;
+  for (size_t i = 0 ; i < coll->contacts.length ; i ++) {
+    if (coll->contacts.elems[i].stamp == coll->stamp) {
+      coll->contacts.elems[n ++] = coll->contacts.elems[i];
+    }
+  }
+
+  if (n != coll->contacts.length) {
+    coll->contacts.length = n;
+    pl_contact_reindex(coll);
+  }
+}
+
+// Narrowphase for a range of contacts, each contact is only written by the
+// worker testing it
+static void
+pl_collide_narrow(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_collisioncontext_t *coll = arg;
+
+  for (size_t i = begin ; i < end ; i ++) {
+    pl_contact_t *c = &coll->contacts.elems[i];
+    double3 rel_p = lwc_dist(&c->b->p, &c->a->p);
+    double3 rel_v = c->b->v - c->a->v;
+
+    c->reused = c->cached
+             && vd3_abs(rel_p - c->rel_p) < TOLERANCE
+             && vd3_abs(rel_v - c->rel_v) * coll->dt < TOLERANCE;
+    if (c->reused) continue;
+
+    c->rel_p = rel_p;
+    c->rel_v = rel_v;
+    c->hit = pl_collide_sweep(coll, c->a, c->b, &c->toi)
+          && pl_collide_fine(coll, c->a, c->b);
+    c->cached = true;
+  }
+}
+
+void
+pl_collide_set_tasks(pl_collisioncontext_t *coll, task_pool_t *tasks)
+{
+  coll->tasks = tasks;
+}
+
 void
 pl_collide_insert_object(pl_collisioncontext_t *ctxt, pl_object_t *obj)
 {
-  pl_collcontext_insert_object(ctxt, ctxt->otree, obj);
+  obj_array_push(&ctxt->objs, obj);
+
+  switch (ctxt->broadphase) {
+  case PL_BROADPHASE_RECGRID:
+    pl_collcontext_insert_object(ctxt, ctxt->otree, obj);
+    break;
+  case PL_BROADPHASE_SWEEP_PRUNE:
+    pl_sap_insert(&ctxt->sap, obj, ctxt->dt);
+    break;
+  default:
+    assert(0 && "invalid broadphase");
+  }
+}
+
+void
+pl_collide_set_broadphase(pl_collisioncontext_t *ctxt,
+                          pl_broadphase_t broadphase)
+{
+  if (broadphase == ctxt->broadphase) return;
+
+  // Empty the old broadphase
+  switch (ctxt->broadphase) {
+  case PL_BROADPHASE_RECGRID: {
+    double size = ctxt->otree->size;
+    pl_recgrid_delete_tree(ctxt->otree);
+    ctxt->otree = pl_new_recgrid(ctxt, size);
+    break;
+  }
+  case PL_BROADPHASE_SWEEP_PRUNE:
+    pl_sap_clear(&ctxt->sap);
+    break;
+  default:
+    assert(0 && "invalid broadphase");
+  }
+
+  ctxt->broadphase = broadphase;
+
+  obj_array_t objs = ctxt->objs;
+  obj_array_init(&ctxt->objs);
+  ARRAY_FOR_EACH(i, objs) {
+    pl_collide_insert_object(ctxt, ARRAY_ELEM(objs, i));
+  }
+  obj_array_dispose(&objs);
 }
 
 static void
@@ -203,8 +445,11 @@ pl_collide_promote_step(pl_collisioncontext_t *ctxt, pl_recgrid_t *otree)
     if (otree->children[i]) pl_collide_promote_step(ctxt, otree->children[i]);
   }
 
+  // Objects leaving the root stay in the root
+  if (otree->parent == NULL) return;
+
   for (int i = 0 ; i < otree->objs.length ; ++i) {
-    if (!fits(otree, otree->objs.elems[i])) {
+    if (!fits(ctxt, otree, otree->objs.elems[i])) {
       pl_collcontext_insert_object(ctxt, otree->parent, otree->objs.elems[i]);
       obj_array_remove(&otree->objs, i);
       i --;
@@ -222,13 +467,7 @@ pl_collide_tree_node(pl_collisioncontext_t *coll, pl_recgrid_t *otree)
 
   for (int i = 0 ; i < otree->objs.length ; ++i) {
     for (int j = i+1 ; j < otree->objs.length ; ++j) {
-      if (pl_collide_coarse(coll, otree->objs.elems[i], otree->objs.elems[j])) {
-        if (pl_collide_fine(coll, otree->objs.elems[i], otree->objs.elems[j])) {
-          // TODO: Pair objects
-          obj_array_push(&coll->colls, otree->objs.elems[i]);
-          obj_array_push(&coll->colls, otree->objs.elems[j]);
-        }
-      }
+      pl_collide_pair(coll, otree->objs.elems[i], otree->objs.elems[j]);
     }
 
     // Check against parent objects
@@ -236,14 +475,7 @@ pl_collide_tree_node(pl_collisioncontext_t *coll, pl_recgrid_t *otree)
     while (higher_grid) {
       // Check against local objects
       for (int j = 0 ; j < higher_grid->objs.length ; ++j) {
-        pl_object_t *obj_b = higher_grid->objs.elems[j];
-        if (pl_collide_coarse(coll, otree->objs.elems[i], obj_b)) {
-          if (pl_collide_fine(coll, otree->objs.elems[i], obj_b)) {
-            // TODO: Pair objects
-            obj_array_push(&coll->colls, otree->objs.elems[i]);
-            obj_array_push(&coll->colls, obj_b);
-          }
-        }
+        pl_collide_pair(coll, otree->objs.elems[i], higher_grid->objs.elems[j]);
       }
 
       higher_grid = higher_grid->parent;
@@ -251,17 +483,313 @@ pl_collide_tree_node(pl_collisioncontext_t *coll, pl_recgrid_t *otree)
   }
 }
 
+static inline uint64_t
+pl_sap_pair_key(uint32_t a, uint32_t b)
+{
+  return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+}
+
+static inline size_t
+pl_sap_pair_hash(uint64_t key, size_t cap)
+{
+  key ^= key >> 33;
+  key *= UINT64_C(0xff51afd7ed558ccd);
+  key ^= key >> 33;
+  return key & (cap - 1);
+}
+
+static void pl_sap_add_pair(pl_sweepprune_t *sap, uint64_t key);
+
+// Rebuild the pair set, dropping removed slots and resizing it to at least
+// four times the number of pairs
+static void
+pl_sap_rehash(pl_sweepprune_t *sap)
+{
+  uint64_t *old = sap->pairs;
+  size_t old_cap = sap->pair_cap;
+
+  size_t cap = 64;
+  while (sap->pair_count * 4 >= cap) cap *= 2;
+
+  sap->pairs = smalloc(cap * sizeof(uint64_t));
+  memset(sap->pairs, 0xff, cap * sizeof(uint64_t));
+  sap->pair_cap = cap;
+  sap->pair_count = 0;
+  sap->pair_used = 0;
+
+  for (size_t i = 0 ; i < old_cap ; i ++) {
+    if (old[i] < PL_SAP_PAIR_REMOVED) pl_sap_add_pair(sap, old[i]);
+  }
+  free(old);
+}
+
+static void
+pl_sap_add_pair(pl_sweepprune_t *sap, uint64_t key)
+{
+  if ((sap->pair_used + 1) * 2 > sap->pair_cap) pl_sap_rehash(sap);
+
+  size_t i = pl_sap_pair_hash(key, sap->pair_cap);
+  size_t removed = SIZE_MAX;
+  while (sap->pairs[i] != PL_SAP_PAIR_EMPTY) {
+    if (sap->pairs[i] == key) return;
+    if (sap->pairs[i] == PL_SAP_PAIR_REMOVED && removed == SIZE_MAX) {
+      removed = i;
+    }
+    i = (i + 1) & (sap->pair_cap - 1);
+  }
+
+  if (removed != SIZE_MAX) {
+    i = removed;
+  } else {
+    sap->pair_used ++;
+  }
+  sap->pairs[i] = key;
+  sap->pair_count ++;
+}
+
+static void
+pl_sap_remove_pair(pl_sweepprune_t *sap, uint64_t key)
+{
+  if (sap->pair_count == 0) return;
+
+  size_t i = pl_sap_pair_hash(key, sap->pair_cap);
+  while (sap->pairs[i] != PL_SAP_PAIR_EMPTY) {
+    if (sap->pairs[i] == key) {
+      sap->pairs[i] = PL_SAP_PAIR_REMOVED;
+      sap->pair_count --;
+      return;
+    }
+    i = (i + 1) & (sap->pair_cap - 1);
+  }
+}
+
+static inline bool
+pl_sap_overlap(const pl_sweepprune_t *sap, uint32_t a, uint32_t b)
+{
+  return sap->lo[a].x <= sap->hi[b].x && sap->lo[b].x <= sap->hi[a].x
+      && sap->lo[a].y <= sap->hi[b].y && sap->lo[b].y <= sap->hi[a].y
+      && sap->lo[a].z <= sap->hi[b].z && sap->lo[b].z <= sap->hi[a].z;
+}
+
+// Bounding box of the volume swept by obj during the last step
+static inline void
+pl_sap_bounds(pl_sweepprune_t *sap, size_t i, const pl_object_t *obj, double dt)
+{
+  double3 p1 = lwc_globald(&obj->p);
+  double3 p0 = p1 - obj->v * dt;
+  double r = obj->radius;
+  sap->lo[i] = vd3_set(fmin(p0.x, p1.x) - r, fmin(p0.y, p1.y) - r,
+                       fmin(p0.z, p1.z) - r);
+  sap->hi[i] = vd3_set(fmax(p0.x, p1.x) + r, fmax(p0.y, p1.y) + r,
+                       fmax(p0.z, p1.z) + r);
+}
+
+// Endpoint order, lower endpoints go first at equal values so that touching
+// boxes are ordered as overlapping, like in pl_sap_overlap
+static inline bool
+pl_sap_after(pl_sap_endpoint_t a, pl_sap_endpoint_t b)
+{
+  return a.value > b.value
+      || (a.value == b.value && (a.id & 1) && !(b.id & 1));
+}
+
+// Move endpoint i of axis k down to its sorted position, updating the pair set
+// for every lower / upper endpoint pair that changes order.
+static void
+pl_sap_sift(pl_sweepprune_t *sap, pl_sap_endpoint_t *axis, size_t i)
+{
+  pl_sap_endpoint_t e = axis[i];
+  uint32_t box = e.id >> 1;
+  bool upper = e.id & 1;
+
+  while (i > 0 && pl_sap_after(axis[i-1], e)) {
+    pl_sap_endpoint_t other = axis[i-1];
+    uint32_t other_box = other.id >> 1;
+
+    if (!upper && (other.id & 1)) {
+      if (pl_sap_overlap(sap, box, other_box)) {
+        pl_sap_add_pair(sap, pl_sap_pair_key(box, other_box));
+      }
+    } else if (upper && !(other.id & 1)) {
+      pl_sap_remove_pair(sap, pl_sap_pair_key(box, other_box));
+    }
+
+    axis[i] = other;
+    i --;
+  }
+  axis[i] = e;
+}
+
+static void
+pl_sap_insert(pl_sweepprune_t *sap, pl_object_t *obj, double dt)
+{
+  if (sap->len >= sap->cap) {
+    size_t cap = sap->cap ? sap->cap * 2 : 64;
+    sap->lo = realloc(sap->lo, cap * sizeof(double3));
+    sap->hi = realloc(sap->hi, cap * sizeof(double3));
+    for (int k = 0 ; k < 3 ; k ++) {
+      sap->axis[k] = realloc(sap->axis[k], 2 * cap * sizeof(pl_sap_endpoint_t));
+      if (!sap->axis[k]) log_fatal("out of memory when growing sweep and prune");
+    }
+    if (!sap->lo || !sap->hi) log_fatal("out of memory when growing sweep and prune");
+    sap->cap = cap;
+  }
+
+  uint32_t box = sap->len ++;
+  pl_sap_bounds(sap, box, obj, dt);
+
+  for (int k = 0 ; k < 3 ; k ++) {
+    pl_sap_endpoint_t *axis = sap->axis[k];
+    size_t n = 2 * box;
+    axis[n].value = sap->lo[box][k];
+    axis[n].id = box << 1;
+    axis[n+1].value = sap->hi[box][k];
+    axis[n+1].id = box << 1 | 1;
+    pl_sap_sift(sap, axis, n);
+    pl_sap_sift(sap, axis, n + 1);
+  }
+}
+
+static void
+pl_sap_clear(pl_sweepprune_t *sap)
+{
+  sap->len = 0;
+  if (sap->pair_cap) {
+    memset(sap->pairs, 0xff, sap->pair_cap * sizeof(uint64_t));
+  }
+  sap->pair_count = 0;
+  sap->pair_used = 0;
+}
+
+// Refresh the bounding boxes and restore the order of the endpoints, box i
+// belongs to object i in objs
+static void
+pl_sap_update(pl_sweepprune_t *sap, const obj_array_t *objs, double dt)
+{
+  // Pairs with sleeping objects are ignored, so their boxes can be stale
+  for (size_t i = 0 ; i < sap->len ; i ++) {
+    const pl_object_t *obj = objs->elems[i];
+    if (obj->lod != PL_LOD_SLEEPING) pl_sap_bounds(sap, i, obj, dt);
+  }
+
+  for (int k = 0 ; k < 3 ; k ++) {
+    pl_sap_endpoint_t *axis = sap->axis[k];
+    for (size_t i = 0 ; i < 2 * sap->len ; i ++) {
+      uint32_t box = axis[i].id >> 1;
+      axis[i].value = (axis[i].id & 1) ? sap->hi[box][k] : sap->lo[box][k];
+    }
+    for (size_t i = 1 ; i < 2 * sap->len ; i ++) {
+      pl_sap_sift(sap, axis, i);
+    }
+  }
+}
+
+static void
+pl_collide_sap(pl_collisioncontext_t *coll)
+{
+  pl_sweepprune_t *sap = &coll->sap;
+  pl_sap_update(sap, &coll->objs, coll->dt);
+
+  for (size_t i = 0 ; i < sap->pair_cap ; i ++) {
+    uint64_t key = sap->pairs[i];
+    if (key >= PL_SAP_PAIR_REMOVED) continue;
+
+    pl_collide_pair(coll, coll->objs.elems[key >> 32],
+                    coll->objs.elems[key & 0xffffffff]);
+  }
+}
+
+static int
+pl_collision_toi_cmp(const void *a, const void *b)
+{
+  const pl_collision_t *ca = a;
+  const pl_collision_t *cb = b;
+  if (ca->toi < cb->toi) return -1;
+  if (ca->toi > cb->toi) return 1;
+  return 0;
+}
+
+// Mark object as resolved in this step. Each resolved hit adds two objects
+// and there are no more hits than contacts, so the set never fills up the
+// capacity of the contact index.
+static void
+pl_collided_insert(pl_collisioncontext_t *coll, pl_object_t *obj)
+{
+  size_t cap = coll->contact_index_cap;
+  size_t h = pl_contact_hash(obj, NULL, cap);
+  while (coll->collided[h]) h = (h + 1) & (cap - 1);
+  coll->collided[h] = obj;
+}
+
+static bool
+pl_collided(const pl_collisioncontext_t *coll, const pl_object_t *obj)
+{
+  size_t cap = coll->contact_index_cap;
+  size_t h = pl_contact_hash(obj, NULL, cap);
+  while (coll->collided[h]) {
+    if (coll->collided[h] == obj) return true;
+    h = (h + 1) & (cap - 1);
+  }
+  return false;
+}
+
 void
-pl_collide_step(pl_collisioncontext_t *coll)
+pl_collide_step(pl_collisioncontext_t *coll, double dt)
 {
   coll->colls.length = 0; // Flush collission array
-  pl_collide_promote_step(coll, coll->otree);
-  pl_collide_tree_node(coll, coll->otree);
+  coll->dt = dt;
+  coll->stamp ++;
+
+  switch (coll->broadphase) {
+  case PL_BROADPHASE_RECGRID:
+    pl_collide_promote_step(coll, coll->otree);
+    pl_collide_tree_node(coll, coll->otree);
+    break;
+  case PL_BROADPHASE_SWEEP_PRUNE:
+    pl_collide_sap(coll);
+    break;
+  default:
+    assert(0 && "invalid broadphase");
+  }
+
+  pl_contact_evict(coll);
 
-  // Resolve computed collisions
-  for (int i = 0 ; i < coll->colls.length ; i += 2) {
-    pl_object_t *a = coll->colls.elems[i];
-    pl_object_t *b = coll->colls.elems[i+1];
+  if (coll->tasks) {
+    task_pool_parallel_for(coll->tasks, coll->contacts.length, 0,
+                           pl_collide_narrow, coll);
+  } else {
+    pl_collide_narrow(coll, 0, coll->contacts.length, 0);
+  }
+
+  coll->pairs_tested = coll->contacts.length;
+  coll->pairs_reused = 0;
+  for (size_t i = 0 ; i < coll->contacts.length ; i ++) {
+    pl_contact_t *c = &coll->contacts.elems[i];
+    if (c->reused) coll->pairs_reused ++;
+    if (c->hit) {
+      pl_collision_t hit = {c->a, c->b, c->toi};
+      pl_collision_array_push(&coll->colls, hit);
+      // The velocities change when the hit is resolved, so a cached hit
+      // would resolve the pair again in the next step
+      c->cached = false;
+    }
+  }
+
+  // Resolve computed collisions in order of impact. The trajectories of the
+  // objects change at the first impact, so later impacts of the same objects
+  // in this step are no longer valid and are dropped.
+  qsort(coll->colls.elems, coll->colls.length, sizeof(pl_collision_t),
+        pl_collision_toi_cmp);
+
+  if (coll->colls.length > 0) {
+    memset(coll->collided, 0, coll->contact_index_cap * sizeof(pl_object_t*));
+  }
+  for (size_t i = 0 ; i < coll->colls.length ; i ++) {
+    pl_object_t *a = coll->colls.elems[i].a;
+    pl_object_t *b = coll->colls.elems[i].b;
+    if (pl_collided(coll, a) || pl_collided(coll, b)) continue;
+    pl_collided_insert(coll, a);
+    pl_collided_insert(coll, b);
 
     double3 av = (a->m.m - b->m.m) / (a->m.m + b->m.m) * a->v +
                 (2.0f*b->m.m) / (a->m.m + b->m.m) * b->v;
@@ -269,8 +797,15 @@ pl_collide_step(pl_collisioncontext_t *coll)
                 (2.0f*a->m.m) / (a->m.m + b->m.m) * a->v;
 
 
+    // Move the objects along their new velocities for the rest of the step
+    double rest = (1.0 - coll->colls.elems[i].toi) * dt;
+    lwc_translate3dv(&a->p, (av - a->v) * rest);
+    lwc_translate3dv(&b->p, (bv - b->v) * rest);
+
     a->v = av;
     b->v = bv;
+    a->on_rails = false;
+    b->on_rails = false;
 
     // Compute post colission momentums
     log_info("collission between '%s' and '%s' (%f, %f)", a->name, b->name, a->radius, b->radius);
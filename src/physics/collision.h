@@ -21,11 +21,13 @@
 #define PHYSICS__COLLISION_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <gencds/array.h>
 #include "physics/physics.h"
 #include "physics/reftypes.h"
 #include <vmath/lwcoord.h>
 #include "common/palloc.h"
+#include "common/task-pool.h"
 
 
 struct pl_recgrid_t {
@@ -36,23 +38,125 @@ struct pl_recgrid_t {
   struct pl_recgrid_t *children[8];
 };
 
+typedef enum {
+  PL_BROADPHASE_RECGRID, // Recursive grid, all pairs in each node
+  PL_BROADPHASE_SWEEP_PRUNE, // Incremental sweep and prune
+} pl_broadphase_t;
+
+typedef struct {
+  double value;
+  uint32_t id; // Box index << 1, low bit set for the upper endpoint
+} pl_sap_endpoint_t;
+
+/*! Incremental sweep and prune. The endpoints of the bounding box of every
+    object are kept sorted along the three axes. Objects move little between
+    steps, so the arrays are nearly sorted and insertion sort fixes them in
+    close to linear time. Overlapping pairs are found from the swaps done by
+    the sort: a pair is added when a lower endpoint passes an upper endpoint
+    and the boxes overlap, and removed when an upper endpoint passes a lower
+    endpoint.
+ */
+typedef struct {
+  size_t len, cap;
+  double3 *lo, *hi; // Bounding box of each object
+  pl_sap_endpoint_t *axis[3];
+
+  // Overlapping pairs, open addressing hash set of (a << 32 | b), a < b
+  uint64_t *pairs;
+  size_t pair_count, pair_used, pair_cap;
+} pl_sweepprune_t;
+
+typedef struct {
+  pl_object_t *a, *b;
+  double toi; // Time of impact as fraction of the step
+} pl_collision_t;
+
+DECL_ARRAY(pl_collision_t, pl_collision);
+
+/*! Entry in the contact pair cache. The narrowphase result is stored together
+    with the relative state it was computed for, and reused while the pair
+    stays in the broadphase and its relative state does not change.
+ */
+typedef struct {
+  pl_object_t *a, *b;
+  uint32_t stamp; // Step in which the broadphase last reported the pair
+  bool cached; // The result below is valid
+  bool reused; // The result was reused in the last step
+  double3 rel_p, rel_v; // Relative state the result was computed for
+  bool hit;
+  double toi;
+} pl_contact_t;
+
+DECL_ARRAY(pl_contact_t, pl_contact);
+
 struct pl_collisioncontext_t {
   pool_t *pool;
+  pl_broadphase_t broadphase;
+  obj_array_t objs; // All objects, in insertion order
   pl_recgrid_t *otree;
-  obj_array_t colls;
+  pl_sweepprune_t sap;
+  pl_collision_array_t colls;
+  double dt; // Length of the step being checked
+
+  // Contact pair cache, after the broadphase it holds exactly the pairs
+  // reported in the current step
+  pl_contact_array_t contacts;
+  size_t *contact_index; // Open addressing, contact index + 1 or 0 if empty
+  size_t contact_index_cap;
+  pl_object_t **collided; // Objects resolved in this step, open addressing
+                          // with the same hash and capacity as contact_index
+  uint32_t stamp;
+
+  task_pool_t *tasks; // Non-NULL if the narrowphase runs multi-threaded
+
+  // Statistics of the last step, for profiling
+  size_t pairs_tested;
+  size_t pairs_reused;
 };
 
-pl_collisioncontext_t *pl_new_collision_context(double size);
+pl_collisioncontext_t *pl_new_collision_context(double size,
+                                                pl_broadphase_t broadphase);
+
+void pl_collision_context_delete(pl_collisioncontext_t *coll);
+
+/*! Set task pool used for the narrowphase, NULL runs it on the calling thread */
+void pl_collide_set_tasks(pl_collisioncontext_t *coll, task_pool_t *tasks);
+
+/*! Switch broadphase, the objects in the context are moved to the new one */
+void pl_collide_set_broadphase(pl_collisioncontext_t *coll,
+                               pl_broadphase_t broadphase);
 
 bool pl_collide_coarse(pl_collisioncontext_t *coll,
                      pl_object_t * restrict obj_a, pl_object_t * restrict obj_b);
 
+/*! Continuous collision test. The objects are assumed to have moved in a
+    straight line with their current velocities during the last step, and
+    the swept spheres are tested against each other.
+    \param toi Set to the time of impact as a fraction of the step
+    \return True if the objects hit each other during the step
+ */
+bool pl_collide_sweep(pl_collisioncontext_t *coll,
+                      pl_object_t * restrict obj_a, pl_object_t * restrict obj_b,
+                      double *toi);
+
 bool pl_collide_fine(pl_collisioncontext_t *coll,
                    pl_object_t * restrict obj_a, pl_object_t * restrict obj_b);
 
 void pl_collide_insert_object(pl_collisioncontext_t *coll, pl_object_t *obj);
 
-void pl_collide_step(pl_collisioncontext_t *coll);
+/*! Detect and resolve collisions of the step of length dt just taken */
+void pl_collide_step(pl_collisioncontext_t *coll, double dt);
+
+/*! Computes whether two spheres with radius wa and wb, starting at a and b and
+    moving da and db during a step, meet during the step. Spheres that already
+    overlap only hit if they are approaching each other.
+    \param t Set to the time of the first contact as a fraction of the step
+    \return True if the spheres meet
+ */
+bool pl_lwc_intersection_point(const lwcoord_t * restrict a, double3 da,
+                               double wa,
+                               const lwcoord_t * restrict b, double3 db,
+                               double wb, double *t);
 
 
 #endif /* !PHYSICS__COLLISION_H */
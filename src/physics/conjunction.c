@@ -0,0 +1,460 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openorbit/log.h>
+
+#include "common/palloc.h"
+#include "physics/conjunction.h"
+#include "physics/object.h"
+#include "physics/celestial-object.h"
+
+#define PL_CONJ_MAX_ITERS 32 // Newton iterations when refining an approach
+#define PL_CONJ_TIME_TOL 1.0e-3 // Time of closest approach tolerance in s
+
+DEF_ARRAY(pl_conjunction_t, pl_conjunction);
+
+typedef struct {
+  pl_conj_pair_t *pairs;
+  size_t len, cap;
+  pl_conjunction_array_t results;
+  size_t apsis_pairs;
+  size_t refinements;
+} pl_conj_worker_t;
+
+typedef struct {
+  pl_conj_screen_t *screen;
+  pl_conj_worker_t *workers;
+  double t; // Time of the current sweep step
+  double t_prev; // Time of the previous step, the last step may be shorter
+  bool first; // First step, there is no previous range rate
+  bool last; // Last step, at the end of the window
+} pl_conj_ctxt_t;
+
+typedef struct {
+  double perigee;
+  uint32_t idx;
+} pl_conj_sortkey_t;
+
+static int
+pl_conj_sortkey_cmp(const void *a, const void *b)
+{
+  const pl_conj_sortkey_t *ka = a;
+  const pl_conj_sortkey_t *kb = b;
+  if (ka->perigee < kb->perigee) return -1;
+  if (ka->perigee > kb->perigee) return 1;
+  return (ka->idx > kb->idx) - (ka->idx < kb->idx);
+}
+
+static int
+pl_conj_result_cmp(const void *a, const void *b)
+{
+  const pl_conjunction_t *ca = a;
+  const pl_conjunction_t *cb = b;
+  if (ca->tca < cb->tca) return -1;
+  if (ca->tca > cb->tca) return 1;
+  if (ca->a != cb->a) return (ca->a > cb->a) - (ca->a < cb->a);
+  return (ca->b > cb->b) - (ca->b < cb->b);
+}
+
+pl_conj_screen_t*
+pl_new_conj_screen(double threshold, double step)
+{
+  pl_conj_screen_t *screen = smalloc(sizeof(pl_conj_screen_t));
+  screen->threshold = threshold;
+  screen->step = step;
+  pl_conjunction_array_init(&screen->results);
+  return screen;
+}
+
+void
+pl_conj_screen_delete(pl_conj_screen_t *screen)
+{
+  free(screen->orbits);
+  free(screen->user);
+  free(screen->perigee);
+  free(screen->apogee);
+  free(screen->order);
+  free(screen->ecc);
+  free(screen->M);
+  free(screen->E);
+  free(screen->r);
+  free(screen->v);
+  free(screen->pairs);
+  pl_conjunction_array_dispose(&screen->results);
+  free(screen);
+}
+
+void
+pl_conj_set_tasks(pl_conj_screen_t *screen, task_pool_t *tasks)
+{
+  screen->tasks = tasks;
+}
+
+void
+pl_conj_clear(pl_conj_screen_t *screen)
+{
+  screen->len = 0;
+  screen->pair_count = 0;
+  screen->results.length = 0;
+}
+
+static void
+pl_conj_grow(pl_conj_screen_t *screen)
+{
+  size_t cap = screen->cap ? screen->cap * 2 : 64;
+  screen->orbits = realloc(screen->orbits, cap * sizeof(pl_kepler_orbit_t));
+  screen->user = realloc(screen->user, cap * sizeof(void*));
+  screen->perigee = realloc(screen->perigee, cap * sizeof(double));
+  screen->apogee = realloc(screen->apogee, cap * sizeof(double));
+  screen->ecc = realloc(screen->ecc, cap * sizeof(double));
+  if (!screen->orbits || !screen->user || !screen->perigee
+      || !screen->apogee || !screen->ecc) {
+    log_fatal("out of memory when growing conjunction catalogue");
+  }
+
+  // Scratch buffers are not preserved
+  free(screen->order);
+  free(screen->M);
+  free(screen->E);
+  free(screen->r);
+  free(screen->v);
+  screen->order = smalloc(cap * sizeof(uint32_t));
+  screen->M = smalloc(cap * sizeof(double));
+  screen->E = smalloc(cap * sizeof(double));
+  screen->r = smalloc(cap * sizeof(double3));
+  screen->v = smalloc(cap * sizeof(double3));
+  screen->cap = cap;
+}
+
+bool
+pl_conj_add(pl_conj_screen_t *screen, const pl_kepler_orbit_t *orbit,
+            void *user)
+{
+  if (!(orbit->ecc < 1.0) || orbit->a <= 0.0) return false;
+  if (screen->len >= screen->cap) pl_conj_grow(screen);
+
+  size_t i = screen->len ++;
+  screen->orbits[i] = *orbit;
+  screen->user[i] = user;
+  screen->perigee[i] = orbit->a * (1.0 - orbit->ecc);
+  screen->apogee[i] = orbit->a * (1.0 + orbit->ecc);
+  screen->ecc[i] = orbit->ecc;
+  return true;
+}
+
+size_t
+pl_conj_add_world(pl_conj_screen_t *screen, pl_world_t *world,
+                  pl_celobject_t *central, double t)
+{
+  size_t added = 0;
+  ARRAY_FOR_EACH(i, world->root_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+    if (obj->dominator != central) continue;
+
+    pl_kepler_orbit_t orbit;
+    double3 r = lwc_globald(&obj->p) - central->cm_orbit->p;
+    double3 v = obj->v - central->cm_orbit->v;
+    if (pl_kepler_from_state(&orbit, central->cm_orbit->GM, r, v, t)
+        && pl_conj_add(screen, &orbit, obj)) {
+      added ++;
+    }
+  }
+  return added;
+}
+
+// Radius of the orbit along the unit vector u in its plane
+static double
+pl_conj_radius_along(const pl_kepler_orbit_t *orbit, double3 u)
+{
+  double nu = atan2(vd3_dot(u, orbit->Q), vd3_dot(u, orbit->P));
+  double ecc = orbit->ecc;
+  return orbit->a * (1.0 - ecc * ecc) / (1.0 + ecc * cos(nu));
+}
+
+// Orbit path filter. Inclined orbits can only come within the threshold d
+// where the out of plane separation r sin(I) sin(delta) at an angle delta
+// from the line of mutual nodes is below d. Over that window the radius of an
+// orbit changes at most by a e (1 + e) / (1 - e) per radian, so the pair is
+// rejected if the radii at both nodes differ by more than d plus that change.
+static bool
+pl_conj_path_filter(const pl_conj_screen_t *screen, uint32_t a, uint32_t b)
+{
+  const pl_kepler_orbit_t *oa = &screen->orbits[a];
+  const pl_kepler_orbit_t *ob = &screen->orbits[b];
+  double d = screen->threshold;
+
+  double3 k = vd3_cross(vd3_cross(oa->P, oa->Q), vd3_cross(ob->P, ob->Q));
+  double sin_i = vd3_abs(k);
+  double r_min = fmin(screen->perigee[a], screen->perigee[b]);
+  if (d >= r_min * sin_i) return true; // Close everywhere along the orbits
+  k = k / sin_i;
+
+  double delta = asin(d / (r_min * sin_i));
+  double slope = oa->a * oa->ecc * (1.0 + oa->ecc) / (1.0 - oa->ecc)
+               + ob->a * ob->ecc * (1.0 + ob->ecc) / (1.0 - ob->ecc);
+  double margin = d + slope * delta;
+
+  if (fabs(pl_conj_radius_along(oa, k) - pl_conj_radius_along(ob, k))
+      <= margin) {
+    return true;
+  }
+  return fabs(pl_conj_radius_along(oa, -k) - pl_conj_radius_along(ob, -k))
+      <= margin;
+}
+
+static void
+pl_conj_push_pair(pl_conj_worker_t *w, uint32_t a, uint32_t b)
+{
+  if (w->len >= w->cap) {
+    w->cap = w->cap ? w->cap * 2 : 256;
+    w->pairs = realloc(w->pairs, w->cap * sizeof(pl_conj_pair_t));
+    if (!w->pairs) log_fatal("out of memory when growing conjunction pairs");
+  }
+  w->pairs[w->len].a = a < b ? a : b;
+  w->pairs[w->len].b = a < b ? b : a;
+  w->pairs[w->len].f = 0.0;
+  w->len ++;
+}
+
+// Apsis and path filters over a range of the perigee sorted catalogue. With
+// the catalogue sorted, the later orbits that can reach the apogee of an orbit
+// plus the threshold form a contiguous run.
+static void
+pl_conj_filter(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_conj_ctxt_t *ctxt = arg;
+  pl_conj_screen_t *screen = ctxt->screen;
+  pl_conj_worker_t *w = &ctxt->workers[worker];
+
+  for (size_t s = begin ; s < end ; s ++) {
+    uint32_t a = screen->order[s];
+    double reach = screen->apogee[a] + screen->threshold;
+
+    for (size_t s2 = s + 1 ; s2 < screen->len ; s2 ++) {
+      uint32_t b = screen->order[s2];
+      if (screen->perigee[b] > reach) break;
+
+      w->apsis_pairs ++;
+      if (pl_conj_path_filter(screen, a, b)) {
+        pl_conj_push_pair(w, a, b);
+      }
+    }
+  }
+}
+
+static void
+pl_conj_propagate(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_conj_ctxt_t *ctxt = arg;
+  pl_conj_screen_t *screen = ctxt->screen;
+
+  for (size_t i = begin ; i < end ; i ++) {
+    const pl_kepler_orbit_t *orbit = &screen->orbits[i];
+    screen->M[i] = orbit->M0 + orbit->n * (ctxt->t - orbit->t0);
+  }
+
+  pl_ecc_anomaly_batch(end - begin, screen->ecc + begin, screen->M + begin,
+                       screen->E + begin, NULL);
+
+  for (size_t i = begin ; i < end ; i ++) {
+    const pl_kepler_orbit_t *orbit = &screen->orbits[i];
+    double ecc = orbit->ecc;
+    double a = orbit->a;
+    double s = sqrt(1.0 - ecc * ecc);
+    double sE = sin(screen->E[i]), cE = cos(screen->E[i]);
+    double k = sqrt(orbit->GM * a) / (a * (1.0 - ecc * cE));
+
+    screen->r[i] = a * (cE - ecc) * orbit->P + a * s * sE * orbit->Q;
+    screen->v[i] = -k * sE * orbit->P + k * s * cE * orbit->Q;
+  }
+}
+
+// Range rate times range, and its time derivative
+static double
+pl_conj_range_rate(const pl_kepler_orbit_t *a, const pl_kepler_orbit_t *b,
+                   double t, double *df, double3 *dr)
+{
+  double3 ra, va, rb, vb;
+  pl_kepler_state_at(a, t, &ra, &va);
+  pl_kepler_state_at(b, t, &rb, &vb);
+
+  double da = vd3_abs(ra), db = vd3_abs(rb);
+  double3 acc = rb * (-b->GM / (db * db * db)) + ra * (a->GM / (da * da * da));
+  double3 dv = vb - va;
+  *dr = rb - ra;
+  *df = vd3_dot(dv, dv) + vd3_dot(*dr, acc);
+  return vd3_dot(*dr, dv);
+}
+
+// Newton's method on the range rate, safeguarded by the bracket [t0, t1] in
+// which it goes from closing to opening
+static double
+pl_conj_refine(const pl_kepler_orbit_t *a, const pl_kepler_orbit_t *b,
+               double t0, double t1, double f0, double f1, double *miss)
+{
+  double t = t0 - f0 * (t1 - t0) / (f1 - f0);
+  double3 dr;
+
+  for (int i = 0 ; i < PL_CONJ_MAX_ITERS ; i ++) {
+    double df;
+    double f = pl_conj_range_rate(a, b, t, &df, &dr);
+    if (f < 0.0) t0 = t;
+    else t1 = t;
+
+    double next = df > 0.0 ? t - f / df : 0.5 * (t0 + t1);
+    if (!(next > t0 && next < t1)) next = 0.5 * (t0 + t1);
+    if (fabs(next - t) < PL_CONJ_TIME_TOL) {
+      t = next;
+      break;
+    }
+    t = next;
+  }
+
+  double df;
+  pl_conj_range_rate(a, b, t, &df, &dr);
+  *miss = vd3_abs(dr);
+  return t;
+}
+
+// Track the range rate of the candidate pairs. A pair that was closing at the
+// previous step and is opening now has passed a close approach, which is
+// refined unless the pair is too far apart to have come within the threshold.
+// A pair that is opening at the start of the window, or still closing at its
+// end, is closest at that edge.
+static void
+pl_conj_sweep(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_conj_ctxt_t *ctxt = arg;
+  pl_conj_screen_t *screen = ctxt->screen;
+  pl_conj_worker_t *w = &ctxt->workers[worker];
+
+  for (size_t i = begin ; i < end ; i ++) {
+    pl_conj_pair_t *pair = &screen->pairs[i];
+    double3 dr = screen->r[pair->b] - screen->r[pair->a];
+    double3 dv = screen->v[pair->b] - screen->v[pair->a];
+    double f = vd3_dot(dr, dv);
+
+    if (!ctxt->first && pair->f < 0.0 && f >= 0.0
+        && vd3_abs(dr) <= screen->threshold + 2.0 * screen->step * vd3_abs(dv)) {
+      double miss;
+      double tca = pl_conj_refine(&screen->orbits[pair->a],
+                                  &screen->orbits[pair->b],
+                                  ctxt->t_prev, ctxt->t,
+                                  pair->f, f, &miss);
+      w->refinements ++;
+      if (miss < screen->threshold) {
+        pl_conjunction_t c = {pair->a, pair->b, tca, miss};
+        pl_conjunction_array_push(&w->results, c);
+      }
+    }
+
+    bool edge = (ctxt->first && f >= 0.0) || (ctxt->last && f < 0.0);
+    if (edge && vd3_abs(dr) < screen->threshold) {
+      pl_conjunction_t c = {pair->a, pair->b, ctxt->t, vd3_abs(dr)};
+      pl_conjunction_array_push(&w->results, c);
+    }
+    pair->f = f;
+  }
+}
+
+static void
+pl_conj_run(pl_conj_screen_t *screen, size_t count, task_fn_t fn,
+            pl_conj_ctxt_t *ctxt)
+{
+  if (screen->tasks) {
+    task_pool_parallel_for(screen->tasks, count, 0, fn, ctxt);
+  } else {
+    fn(ctxt, 0, count, 0);
+  }
+}
+
+size_t
+pl_conj_screen(pl_conj_screen_t *screen, double t0, double t1)
+{
+  unsigned nworkers = screen->tasks ? task_pool_thread_count(screen->tasks) : 1;
+  pl_conj_worker_t *workers = smalloc(nworkers * sizeof(pl_conj_worker_t));
+  for (unsigned i = 0 ; i < nworkers ; i ++) {
+    pl_conjunction_array_init(&workers[i].results);
+  }
+  pl_conj_ctxt_t ctxt = {screen, workers, t0, t0, true, false};
+
+  // Sort on perigee for the apsis filter
+  pl_conj_sortkey_t *keys = smalloc(screen->len * sizeof(pl_conj_sortkey_t));
+  for (size_t i = 0 ; i < screen->len ; i ++) {
+    keys[i].perigee = screen->perigee[i];
+    keys[i].idx = i;
+  }
+  qsort(keys, screen->len, sizeof(pl_conj_sortkey_t), pl_conj_sortkey_cmp);
+  for (size_t i = 0 ; i < screen->len ; i ++) {
+    screen->order[i] = keys[i].idx;
+  }
+  free(keys);
+
+  pl_conj_run(screen, screen->len, pl_conj_filter, &ctxt);
+
+  // Gather the candidate pairs of the workers
+  screen->pair_count = 0;
+  screen->apsis_pairs = 0;
+  for (unsigned i = 0 ; i < nworkers ; i ++) {
+    screen->pair_count += workers[i].len;
+    screen->apsis_pairs += workers[i].apsis_pairs;
+  }
+  if (screen->pair_count > screen->pair_cap) {
+    free(screen->pairs);
+    screen->pairs = smalloc(screen->pair_count * sizeof(pl_conj_pair_t));
+    screen->pair_cap = screen->pair_count;
+  }
+  size_t n = 0;
+  for (unsigned i = 0 ; i < nworkers ; i ++) {
+    memcpy(screen->pairs + n, workers[i].pairs,
+           workers[i].len * sizeof(pl_conj_pair_t));
+    n += workers[i].len;
+    free(workers[i].pairs);
+  }
+
+  // Time sweep, the last step is shortened to end at t1
+  size_t steps = (size_t)ceil((t1 - t0) / screen->step);
+  for (size_t k = 0 ; k <= steps && screen->pair_count > 0 ; k ++) {
+    ctxt.t = k < steps ? t0 + k * screen->step : t1;
+    ctxt.last = (k == steps);
+    pl_conj_run(screen, screen->len, pl_conj_propagate, &ctxt);
+    pl_conj_run(screen, screen->pair_count, pl_conj_sweep, &ctxt);
+    ctxt.first = false;
+    ctxt.t_prev = ctxt.t;
+  }
+
+  screen->results.length = 0;
+  screen->refinements = 0;
+  for (unsigned i = 0 ; i < nworkers ; i ++) {
+    ARRAY_FOR_EACH(j, workers[i].results) {
+      pl_conjunction_array_push(&screen->results,
+                                ARRAY_ELEM(workers[i].results, j));
+    }
+    screen->refinements += workers[i].refinements;
+    pl_conjunction_array_dispose(&workers[i].results);
+  }
+  free(workers);
+
+  qsort(screen->results.elems, screen->results.length,
+        sizeof(pl_conjunction_t), pl_conj_result_cmp);
+  return screen->results.length;
+}
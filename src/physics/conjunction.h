@@ -0,0 +1,122 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_conjunction_h
+#define orbit_conjunction_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <gencds/array.h>
+#include "common/task-pool.h"
+#include "physics/kepler.h"
+#include "physics/reftypes.h"
+
+// Close approach screening of a catalogue of elliptic orbits about the same
+// central body.
+//
+// Testing all pairs over the whole window is quadratic in the catalogue size,
+// so pairs go through a cascade of filters:
+//
+//  1. Apsis filter, the radial bands [perigee, apogee] of the orbits must come
+//     within the threshold of each other. With the catalogue sorted on
+//     perigee this is a sweep.
+//  2. Orbit path filter, for inclined pairs the orbits must come within the
+//     threshold near the line of mutual nodes, as that is where the paths
+//     cross.
+//  3. Time sweep, all orbits are propagated together with a fixed step and
+//     the range rate of each remaining pair is tracked. A sign change from
+//     closing to opening brackets a close approach, which is refined with
+//     Newton's method on the range rate. Pairs that are opening at the start
+//     of the window or closing at its end are reported at that edge.
+
+typedef struct {
+  uint32_t a, b; // Catalogue indices, a < b
+  double tca; // Time of closest approach in s
+  double miss; // Separation at closest approach in m
+} pl_conjunction_t;
+
+DECL_ARRAY(pl_conjunction_t, pl_conjunction);
+
+typedef struct {
+  uint32_t a, b;
+  double f; // Range rate times range at the previous step
+} pl_conj_pair_t;
+
+typedef struct {
+  double threshold; // Report approaches closer than this, in m
+  double step; // Step of the time sweep, in s
+  task_pool_t *tasks; // Non-NULL if the screening runs multi-threaded
+
+  // Catalogue
+  size_t len, cap;
+  pl_kepler_orbit_t *orbits;
+  void **user; // User data of each entry
+  double *perigee, *apogee;
+  uint32_t *order; // Catalogue sorted on perigee
+
+  // Propagation scratch, indexed as the catalogue
+  double *ecc, *M, *E;
+  double3 *r, *v;
+
+  // Candidate pairs after the filters
+  pl_conj_pair_t *pairs;
+  size_t pair_count, pair_cap;
+
+  pl_conjunction_array_t results; // Sorted on tca
+
+  // Statistics of the last screening, for profiling
+  size_t apsis_pairs; // Pairs passing the apsis filter
+  size_t refinements; // Brackets refined with Newton's method
+} pl_conj_screen_t;
+
+/*! Create a screening context
+    \param threshold Approaches closer than this are reported, in m
+    \param step Step of the time sweep in s, this must be well below the
+           shortest half orbit in the catalogue
+ */
+pl_conj_screen_t* pl_new_conj_screen(double threshold, double step);
+void pl_conj_screen_delete(pl_conj_screen_t *screen);
+
+/*! Set task pool used for screening, NULL runs it on the calling thread */
+void pl_conj_set_tasks(pl_conj_screen_t *screen, task_pool_t *tasks);
+
+/*! Drop all orbits from the catalogue */
+void pl_conj_clear(pl_conj_screen_t *screen);
+
+/*! Add orbit to the catalogue, its index is the number of orbits added before
+    \param user Data returned in screen->user, may be NULL
+    \return False if the orbit is not elliptic and was not added
+ */
+bool pl_conj_add(pl_conj_screen_t *screen, const pl_kepler_orbit_t *orbit,
+                 void *user);
+
+/*! Add the root bodies dominated by central to the catalogue, with the
+    bodies as user data. Bodies with degenerate or open orbits are skipped.
+    \param t Time of the current state in s, the time base of the screening
+    \return Number of bodies added
+ */
+size_t pl_conj_add_world(pl_conj_screen_t *screen, pl_world_t *world,
+                         pl_celobject_t *central, double t);
+
+/*! Screen the catalogue for close approaches between t0 and t1
+    \return Number of approaches found, they are stored in screen->results
+ */
+size_t pl_conj_screen(pl_conj_screen_t *screen, double t0, double t1);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <openorbit/log.h>
+
+#include "common/palloc.h"
+#include "physics/eclipse.h"
+#include "physics/world.h"
+#include "physics/celestial-object.h"
+
+pl_eclipse_t*
+pl_new_eclipse(void)
+{
+  pl_eclipse_t *eclipse = smalloc(sizeof(pl_eclipse_t));
+  return eclipse;
+}
+
+void
+pl_eclipse_delete(pl_eclipse_t *eclipse)
+{
+  free(eclipse->bodies);
+  free(eclipse->systems);
+  free(eclipse);
+}
+
+// The body orbiting the sun that cel belongs to, NULL for the sun itself
+static pl_celobject_t*
+pl_eclipse_system_of(pl_celobject_t *cel, pl_celobject_t *sun)
+{
+  if (cel == sun) return NULL;
+  while (cel->primary && cel->primary != sun) cel = cel->primary;
+  return cel->primary == sun ? cel : NULL;
+}
+
+void
+pl_eclipse_build(pl_eclipse_t *eclipse, pl_world_t *world)
+{
+  size_t n = ARRAY_LEN(world->celestial_objects);
+  if (n > eclipse->cap) {
+    free(eclipse->bodies);
+    free(eclipse->systems);
+    eclipse->bodies = smalloc(n * sizeof(pl_eclipse_body_t));
+    eclipse->systems = smalloc(n * sizeof(pl_eclipse_system_t));
+    eclipse->cap = n;
+  }
+
+  eclipse->sun = NULL;
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    if (cel->primary == NULL
+        && (eclipse->sun == NULL
+            || cel->cm_orbit->GM > eclipse->sun->cm_orbit->GM)) {
+      eclipse->sun = cel;
+    }
+  }
+
+  eclipse->body_count = 0;
+  eclipse->system_count = 0;
+  if (eclipse->sun == NULL) return;
+
+  eclipse->sun_p = eclipse->sun->cm_orbit->p;
+  eclipse->sun_radius = eclipse->sun->cm_orbit->radius;
+
+  // Members of a system are stored contiguously, starting with its centre
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *centre = ARRAY_ELEM(world->celestial_objects, i);
+    if (centre->primary != eclipse->sun) continue;
+
+    pl_eclipse_system_t *sys = &eclipse->systems[eclipse->system_count ++];
+    sys->p = centre->cm_orbit->p;
+    sys->radius = 0.0;
+    sys->first = eclipse->body_count;
+
+    ARRAY_FOR_EACH(j, world->celestial_objects) {
+      pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, j);
+      if (pl_eclipse_system_of(cel, eclipse->sun) != centre) continue;
+      if (cel->cm_orbit->radius <= 0.0) continue;
+
+      pl_eclipse_body_t *body = &eclipse->bodies[eclipse->body_count ++];
+      body->p = cel->cm_orbit->p;
+      body->radius = cel->cm_orbit->radius;
+      body->cel = cel;
+      sys->radius = fmax(sys->radius,
+                         vd3_abs(body->p - sys->p) + body->radius);
+    }
+
+    sys->count = eclipse->body_count - sys->first;
+    if (sys->count == 0) eclipse->system_count --;
+  }
+}
+
+// Visible fraction of a disc of angular radius a, behind a disc of angular
+// radius b with the centres c apart
+static inline double
+pl_eclipse_disc(double a, double b, double c)
+{
+  if (c >= a + b) return 1.0;
+  if (c <= b - a) return 0.0; // Umbra
+  if (c <= a - b) return 1.0 - (b * b) / (a * a); // Antumbra
+
+  // Penumbra, subtract the lens shaped overlap of the discs
+  double x = (c * c + a * a - b * b) / (2.0 * c);
+  double y = sqrt(fmax(a * a - x * x, 0.0));
+  double area = a * a * acos(fmin(fmax(x / a, -1.0), 1.0))
+              + b * b * acos(fmin(fmax((c - x) / b, -1.0), 1.0))
+              - c * y;
+  return 1.0 - area / (M_PI * a * a);
+}
+
+// Angle between d and the unit vector u
+static inline double
+pl_eclipse_angle(double3 d, double3 u)
+{
+  return atan2(vd3_abs(vd3_cross(d, u)), vd3_dot(d, u));
+}
+
+// Sunlight past one occluder, given the direction u and distance to the sun and
+// its apparent radius a_s
+static inline double
+pl_eclipse_occlude(double3 p, double3 u, double d_sun, double a_s,
+                   double3 occ_p, double occ_radius)
+{
+  double3 d = occ_p - p;
+  double dist = vd3_abs(d);
+  if (dist <= occ_radius) return 0.0; // Below the surface
+  if (dist - occ_radius >= d_sun) return 1.0; // Behind the sun
+
+  return pl_eclipse_disc(a_s, asin(occ_radius / dist),
+                         pl_eclipse_angle(d, u));
+}
+
+double
+pl_eclipse_shadow(double3 p, double3 sun_p, double sun_radius,
+                  double3 occ_p, double occ_radius)
+{
+  double3 ds = sun_p - p;
+  double d_sun = vd3_abs(ds);
+  if (d_sun <= sun_radius) return 1.0;
+
+  return pl_eclipse_occlude(p, ds / d_sun, d_sun, asin(sun_radius / d_sun),
+                            occ_p, occ_radius);
+}
+
+float
+pl_eclipse_sunlight(const pl_eclipse_t *eclipse, double3 p,
+                    pl_celobject_t **occluder)
+{
+  if (occluder) *occluder = NULL;
+  if (eclipse->sun == NULL) return 1.0f;
+
+  double3 ds = eclipse->sun_p - p;
+  double d_sun = vd3_abs(ds);
+  if (d_sun <= eclipse->sun_radius) return 1.0f;
+
+  double3 u = ds / d_sun;
+  double a_s = asin(eclipse->sun_radius / d_sun);
+  double light = 1.0;
+
+  for (size_t i = 0 ; i < eclipse->system_count ; i ++) {
+    const pl_eclipse_system_t *sys = &eclipse->systems[i];
+    double3 d = sys->p - p;
+    double dist = vd3_abs(d);
+
+    // Skip systems whose bounding sphere is behind the sun or outside the cone
+    // towards the solar disc
+    if (dist > sys->radius) {
+      if (dist - sys->radius >= d_sun) continue;
+      if (pl_eclipse_angle(d, u) >= a_s + asin(sys->radius / dist)) continue;
+    }
+
+    for (uint32_t j = sys->first ; j < sys->first + sys->count ; j ++) {
+      const pl_eclipse_body_t *body = &eclipse->bodies[j];
+      double f = pl_eclipse_occlude(p, u, d_sun, a_s, body->p, body->radius);
+      if (f < light) {
+        light = f;
+        if (occluder) *occluder = body->cel;
+      }
+    }
+  }
+
+  return light;
+}
@@ -0,0 +1,82 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_eclipse_h
+#define orbit_eclipse_h
+
+#include <stdint.h>
+#include <vmath/vmath.h>
+#include "physics/reftypes.h"
+
+// Sunlight and eclipses of the root bodies.
+//
+// The sun and the occluders are spheres of the celestial body radii. The
+// occluders are grouped in systems, a body orbiting the sun and everything
+// inside its sphere of influence, and each system has a bounding sphere. A
+// system is only tested member by member if its bounding sphere overlaps the
+// cone from the body towards the solar disc.
+//
+// The visible fraction of the sun is computed from the overlap of the
+// apparent discs of the sun and the occluder, which gives umbra, penumbra and
+// the annular antumbra.
+
+typedef struct {
+  double3 p;
+  double radius;
+  pl_celobject_t *cel;
+} pl_eclipse_body_t;
+
+typedef struct {
+  double3 p; // Centre of the bounding sphere, the body orbiting the sun
+  double radius; // Radius of the bounding sphere
+  uint32_t first, count; // Members in eclipse->bodies
+} pl_eclipse_system_t;
+
+typedef struct {
+  pl_celobject_t *sun;
+  double3 sun_p;
+  double sun_radius;
+
+  size_t body_count, system_count, cap;
+  pl_eclipse_body_t *bodies;
+  pl_eclipse_system_t *systems;
+} pl_eclipse_t;
+
+pl_eclipse_t* pl_new_eclipse(void);
+void pl_eclipse_delete(pl_eclipse_t *eclipse);
+
+/*! Rebuild the occluder hierarchy from the current celestial object states.
+    The primaries of the celestial objects must be up to date, see
+    pl_world_update_soi.
+ */
+void pl_eclipse_build(pl_eclipse_t *eclipse, pl_world_t *world);
+
+/*! Visible fraction of the solar disc at p, 1 in full sunlight and 0 in the
+    umbra of a body.
+    \param occluder Set to the body casting the deepest shadow, NULL if the sun
+           is fully visible. May be NULL.
+ */
+float pl_eclipse_sunlight(const pl_eclipse_t *eclipse, double3 p,
+                          pl_celobject_t **occluder);
+
+/*! Visible fraction of a sun at sun_p seen from p past a single occluder */
+double pl_eclipse_shadow(double3 p, double3 sun_p, double sun_radius,
+                         double3 occ_p, double occ_radius);
+
+#endif
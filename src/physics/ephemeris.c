@@ -0,0 +1,490 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <openorbit/log.h>
+
+#include "common/palloc.h"
+#include "physics/ephemeris.h"
+#include "physics/celestial-object.h"
+#include "physics/world.h"
+
+#define PL_EPHEM_MAGIC "OOEPHEM"
+#define PL_EPHEM_COEFS (PL_EPHEM_DEGREE + 1)
+#define PL_EPHEM_GRANULES_PER_PERIOD 4 // Granules per shortest body period
+#define PL_EPHEM_CHECK_TOL 1000.0 // Largest accepted model difference in m
+#define PL_EPHEM_SEC_PER_DAY 86400.0
+
+// Doubles used by one granule of a body
+#define PL_EPHEM_GRANULE_SIZE (PL_EPHEM_CHANNELS * PL_EPHEM_COEFS)
+
+static inline double
+pl_ephem_node(int j)
+{
+  return cos(M_PI * (j + 0.5) / PL_EPHEM_COEFS);
+}
+
+// Fit the Chebyshev series through f sampled at the nodes, the first
+// coefficient is halved so that the series is evaluated as a plain sum
+static void
+pl_ephem_fit(const double *f, double *c)
+{
+  for (int m = 0 ; m < PL_EPHEM_COEFS ; m ++) {
+    double s = 0.0;
+    for (int j = 0 ; j < PL_EPHEM_COEFS ; j ++) {
+      s += f[j] * cos(M_PI * m * (j + 0.5) / PL_EPHEM_COEFS);
+    }
+    c[m] = 2.0 * s / PL_EPHEM_COEFS;
+  }
+  c[0] *= 0.5;
+}
+
+// Evaluate the series at x in [-1, 1], and optionally its derivative
+static inline double
+pl_ephem_eval(const double *c, double x, double *dfdx)
+{
+  double T0 = 1.0, T1 = x;
+  double dT0 = 0.0, dT1 = 1.0;
+  double f = c[0] + c[1] * x;
+  double df = c[1];
+
+  for (int m = 2 ; m < PL_EPHEM_COEFS ; m ++) {
+    double T2 = 2.0 * x * T1 - T0;
+    double dT2 = 2.0 * T1 + 2.0 * x * dT1 - dT0;
+    f += c[m] * T2;
+    df += c[m] * dT2;
+    T0 = T1; T1 = T2;
+    dT0 = dT1; dT1 = dT2;
+  }
+
+  if (dfdx) *dfdx = df;
+  return f;
+}
+
+static void
+pl_ephem_read_channels(const cm_orbit_t *orbit, double *ch)
+{
+  ch[PL_EPHEM_PX] = orbit->p.x;
+  ch[PL_EPHEM_PY] = orbit->p.y;
+  ch[PL_EPHEM_PZ] = orbit->p.z;
+  ch[PL_EPHEM_W] = orbit->W;
+  ch[PL_EPHEM_RX] = orbit->r.x;
+  ch[PL_EPHEM_RY] = orbit->r.y;
+  ch[PL_EPHEM_QX] = orbit->q.x;
+  ch[PL_EPHEM_QY] = orbit->q.y;
+  ch[PL_EPHEM_QZ] = orbit->q.z;
+  ch[PL_EPHEM_QW] = orbit->q.w;
+}
+
+// Granules per record needed for a body, from its orbital period about its
+// primary and its rotation period
+static uint32_t
+pl_ephem_granules(const pl_celobject_t *cel)
+{
+  double period = INFINITY; // Days
+
+  if (cel->primary) {
+    double3 d = cel->cm_orbit->p - cel->primary->cm_orbit->p;
+    double r = vd3_abs(d);
+    double GM = cel->primary->cm_orbit->GM + cel->cm_orbit->GM;
+    period = 2.0 * M_PI * sqrt(r * r * r / GM) / PL_EPHEM_SEC_PER_DAY;
+  }
+  if (cel->cm_orbit->W_prime != 0.0) {
+    period = fmin(period, 2.0 * M_PI / fabs(cel->cm_orbit->W_prime));
+  }
+
+  uint32_t granules = 1;
+  while (granules < PL_EPHEM_MAX_GRANULES
+         && PL_EPHEM_RECORD_DAYS / granules
+            > period / PL_EPHEM_GRANULES_PER_PERIOD) {
+    granules *= 2;
+  }
+  return granules;
+}
+
+static size_t
+pl_ephem_data_offset(uint32_t body_count)
+{
+  return sizeof(pl_ephem_header_t) + body_count * sizeof(pl_ephem_body_t);
+}
+
+static bool
+pl_ephem_attach(pl_ephemeris_t *eph, const void *data, size_t len)
+{
+  if (data == NULL || len < sizeof(pl_ephem_header_t)) return false;
+
+  const pl_ephem_header_t *header = data;
+  if (memcmp(header->magic, PL_EPHEM_MAGIC, sizeof(PL_EPHEM_MAGIC))
+      || header->version != PL_EPHEM_VERSION
+      || header->degree != PL_EPHEM_DEGREE
+      || header->channels != PL_EPHEM_CHANNELS
+      || header->record_days != PL_EPHEM_RECORD_DAYS
+      || header->body_count != ARRAY_LEN(eph->world->celestial_objects)) {
+    return false;
+  }
+
+  size_t offset = pl_ephem_data_offset(header->body_count);
+  if (len != offset + (size_t)header->record_count * header->record_size
+                      * sizeof(double)) {
+    return false;
+  }
+
+  eph->header = header;
+  eph->bodies = (const pl_ephem_body_t*)(header + 1);
+  eph->records = (const double*)((const char*)data + offset);
+  eph->jd_end = header->jd_start + header->record_count * header->record_days;
+
+  for (uint32_t i = 0 ; i < header->body_count ; i ++) {
+    const pl_ephem_body_t *body = &eph->bodies[i];
+    char name[PL_EPHEM_NAME_LEN + 1] = {0};
+    memcpy(name, body->name, PL_EPHEM_NAME_LEN);
+
+    pl_celobject_t *cel = pl_world_get_celobject(eph->world, name);
+    if (cel == NULL || cel->cm_orbit->GM != body->GM
+        || body->granules == 0 || body->granules > PL_EPHEM_MAX_GRANULES
+        || body->offset + body->granules * PL_EPHEM_GRANULE_SIZE
+           > header->record_size) {
+      return false;
+    }
+    eph->celobjs[i] = cel;
+  }
+
+  return true;
+}
+
+// Coefficients of the granule of body at jde, x is set to the normalised time
+// in the granule and dxdt to its rate per second
+static inline const double*
+pl_ephem_granule(const pl_ephemeris_t *eph, uint32_t body, double jde,
+                 double *x, double *dxdt)
+{
+  const pl_ephem_header_t *header = eph->header;
+  double u = (jde - header->jd_start) / header->record_days;
+  uint32_t record = (uint32_t)u;
+  if (record >= header->record_count) record = header->record_count - 1;
+
+  const pl_ephem_body_t *b = &eph->bodies[body];
+  double g = (u - record) * b->granules;
+  uint32_t granule = (uint32_t)g;
+  if (granule >= b->granules) granule = b->granules - 1;
+
+  *x = 2.0 * (g - granule) - 1.0;
+  *dxdt = 2.0 * b->granules / (header->record_days * PL_EPHEM_SEC_PER_DAY);
+  return eph->records + (size_t)record * header->record_size + b->offset
+       + granule * PL_EPHEM_GRANULE_SIZE;
+}
+
+// Compare the cache with the model at jde, to detect changes of the model
+static bool
+pl_ephem_check(pl_ephemeris_t *eph, double jde)
+{
+  cm_orbit_compute(jde);
+
+  for (uint32_t i = 0 ; i < eph->header->body_count ; i ++) {
+    double x, dxdt;
+    const double *c = pl_ephem_granule(eph, i, jde, &x, &dxdt);
+    double3 p = vd3_set(pl_ephem_eval(c + PL_EPHEM_PX * PL_EPHEM_COEFS, x, NULL),
+                        pl_ephem_eval(c + PL_EPHEM_PY * PL_EPHEM_COEFS, x, NULL),
+                        pl_ephem_eval(c + PL_EPHEM_PZ * PL_EPHEM_COEFS, x, NULL));
+    if (!(vd3_abs(p - eph->celobjs[i]->cm_orbit->p) < PL_EPHEM_CHECK_TOL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Sample the model over the records and fit the coefficients. All bodies are
+// first fitted with the finest granularity used by any body, bodies that need
+// fewer granules are then refitted from the fine series.
+static void*
+pl_ephem_generate(pl_world_t *world, uint64_t source_hash,
+                  double jd0, double jd1, size_t *len)
+{
+  size_t body_count = ARRAY_LEN(world->celestial_objects);
+  double jd_start = floor(jd0 / PL_EPHEM_RECORD_DAYS) * PL_EPHEM_RECORD_DAYS;
+  uint32_t record_count = (uint32_t)ceil((jd1 - jd_start)
+                                         / PL_EPHEM_RECORD_DAYS);
+  if (record_count == 0) record_count = 1;
+
+  cm_orbit_compute(jd0);
+  pl_world_update_soi(world);
+
+  size_t offset = pl_ephem_data_offset(body_count);
+  uint32_t record_size = 0;
+  uint32_t max_granules = 1;
+  uint32_t *granules = smalloc(body_count * sizeof(uint32_t));
+  for (size_t i = 0 ; i < body_count ; i ++) {
+    granules[i] = pl_ephem_granules(ARRAY_ELEM(world->celestial_objects, i));
+    if (granules[i] > max_granules) max_granules = granules[i];
+    record_size += granules[i] * PL_EPHEM_GRANULE_SIZE;
+  }
+
+  *len = offset + (size_t)record_count * record_size * sizeof(double);
+  char *data = smalloc(*len);
+
+  pl_ephem_header_t *header = (pl_ephem_header_t*)data;
+  memcpy(header->magic, PL_EPHEM_MAGIC, sizeof(PL_EPHEM_MAGIC));
+  header->version = PL_EPHEM_VERSION;
+  header->body_count = body_count;
+  header->degree = PL_EPHEM_DEGREE;
+  header->channels = PL_EPHEM_CHANNELS;
+  header->source_hash = source_hash;
+  header->record_days = PL_EPHEM_RECORD_DAYS;
+  header->jd_start = jd_start;
+  header->record_count = record_count;
+  header->record_size = record_size;
+
+  pl_ephem_body_t *bodies = (pl_ephem_body_t*)(header + 1);
+  uint32_t body_offset = 0;
+  for (size_t i = 0 ; i < body_count ; i ++) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    strncpy(bodies[i].name, cel->cm_orbit->name, PL_EPHEM_NAME_LEN);
+    if (strlen(cel->cm_orbit->name) >= PL_EPHEM_NAME_LEN) {
+      log_warn("ephemeris: body name '%s' truncated", cel->cm_orbit->name);
+    }
+    bodies[i].GM = cel->cm_orbit->GM;
+    bodies[i].granules = granules[i];
+    bodies[i].offset = body_offset;
+    body_offset += granules[i] * PL_EPHEM_GRANULE_SIZE;
+  }
+
+  // Samples and fine coefficients, [body][granule][channel][node]
+  size_t fine_size = body_count * max_granules * PL_EPHEM_GRANULE_SIZE;
+  double *samples = smalloc(fine_size * sizeof(double));
+  double *fine = smalloc(fine_size * sizeof(double));
+
+  // Previous rotation angle and quaternion of each body, used to make the
+  // channels continuous over granules and records
+  double *prev = smalloc(body_count * PL_EPHEM_CHANNELS * sizeof(double));
+  bool first = true;
+
+  double *records = (double*)(data + offset);
+  for (uint32_t r = 0 ; r < record_count ; r ++) {
+    double rec_start = jd_start + r * PL_EPHEM_RECORD_DAYS;
+    double half = 0.5 * PL_EPHEM_RECORD_DAYS / max_granules;
+
+    for (uint32_t k = 0 ; k < max_granules ; k ++) {
+      // Nodes in increasing time order
+      for (int j = PL_EPHEM_COEFS - 1 ; j >= 0 ; j --) {
+        double jde = rec_start + (2 * k + 1) * half + pl_ephem_node(j) * half;
+        cm_orbit_compute(jde);
+
+        for (size_t i = 0 ; i < body_count ; i ++) {
+          pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+          double ch[PL_EPHEM_CHANNELS];
+          double *last = prev + i * PL_EPHEM_CHANNELS;
+          pl_ephem_read_channels(cel->cm_orbit, ch);
+
+          if (!first) {
+            ch[PL_EPHEM_W] += 2.0 * M_PI * nearbyint((last[PL_EPHEM_W]
+                                                      - ch[PL_EPHEM_W])
+                                                     / (2.0 * M_PI));
+            double dot = 0.0;
+            for (int c = PL_EPHEM_QX ; c <= PL_EPHEM_QW ; c ++) {
+              dot += ch[c] * last[c];
+            }
+            if (dot < 0.0) {
+              for (int c = PL_EPHEM_QX ; c <= PL_EPHEM_QW ; c ++) ch[c] = -ch[c];
+            }
+          }
+          memcpy(last, ch, sizeof(ch));
+
+          double *s = samples + (i * max_granules + k) * PL_EPHEM_GRANULE_SIZE;
+          for (int c = 0 ; c < PL_EPHEM_CHANNELS ; c ++) {
+            s[c * PL_EPHEM_COEFS + j] = ch[c];
+          }
+        }
+        first = false;
+      }
+    }
+
+    for (size_t n = 0 ; n < fine_size ; n += PL_EPHEM_COEFS) {
+      pl_ephem_fit(samples + n, fine + n);
+    }
+
+    double *rec = records + (size_t)r * record_size;
+    for (size_t i = 0 ; i < body_count ; i ++) {
+      double *fine_body = fine + i * max_granules * PL_EPHEM_GRANULE_SIZE;
+      double *out = rec + bodies[i].offset;
+      uint32_t g = granules[i];
+
+      if (g == max_granules) {
+        memcpy(out, fine_body, g * PL_EPHEM_GRANULE_SIZE * sizeof(double));
+        continue;
+      }
+
+      // Evaluate the fine series at the nodes of the coarse granules
+      uint32_t ratio = max_granules / g;
+      for (uint32_t k = 0 ; k < g ; k ++) {
+        double f[PL_EPHEM_CHANNELS][PL_EPHEM_COEFS];
+        for (int j = 0 ; j < PL_EPHEM_COEFS ; j ++) {
+          double u = (k + 0.5 * (pl_ephem_node(j) + 1.0)) * ratio;
+          uint32_t fk = (uint32_t)u;
+          if (fk >= max_granules) fk = max_granules - 1;
+          double x = 2.0 * (u - fk) - 1.0;
+          const double *fc = fine_body + fk * PL_EPHEM_GRANULE_SIZE;
+          for (int c = 0 ; c < PL_EPHEM_CHANNELS ; c ++) {
+            f[c][j] = pl_ephem_eval(fc + c * PL_EPHEM_COEFS, x, NULL);
+          }
+        }
+        for (int c = 0 ; c < PL_EPHEM_CHANNELS ; c ++) {
+          pl_ephem_fit(f[c], out + k * PL_EPHEM_GRANULE_SIZE
+                             + c * PL_EPHEM_COEFS);
+        }
+      }
+    }
+  }
+
+  free(prev);
+  free(fine);
+  free(samples);
+  free(granules);
+  return data;
+}
+
+pl_ephemeris_t*
+pl_ephemeris_open(pl_world_t *world, const char *path, uint64_t source_hash,
+                  double jd0, double jd1)
+{
+  assert(jd1 >= jd0);
+
+  pl_ephemeris_t *eph = smalloc(sizeof(pl_ephemeris_t));
+  eph->world = world;
+  eph->celobjs = smalloc(ARRAY_LEN(world->celestial_objects)
+                         * sizeof(pl_celobject_t*));
+
+  eph->file = map_file(path);
+  if (eph->file.data == MAP_FAILED) eph->file.data = NULL;
+
+  if (pl_ephem_attach(eph, eph->file.data, eph->file.fileLenght)
+      && eph->header->source_hash == source_hash
+      && eph->header->jd_start <= jd0 && eph->jd_end >= jd1
+      && pl_ephem_check(eph, jd0)) {
+    log_info("ephemeris: using cache '%s', jd %f to %f", path,
+             eph->header->jd_start, eph->jd_end);
+    pl_ephemeris_update(eph, jd0);
+    return eph;
+  }
+
+  if (eph->file.data) unmap_file(&eph->file);
+
+  log_info("ephemeris: generating cache for jd %f to %f", jd0, jd1);
+  size_t len;
+  void *data = pl_ephem_generate(world, source_hash, jd0, jd1, &len);
+  eph->generated = true;
+
+  FILE *file = fopen(path, "wb");
+  bool written = file && fwrite(data, len, 1, file) == 1;
+  if (file && fclose(file) != 0) written = false;
+
+  if (written) {
+    eph->file = map_file(path);
+    if (eph->file.data == MAP_FAILED) eph->file.data = NULL;
+  }
+  if (written && pl_ephem_attach(eph, eph->file.data, eph->file.fileLenght)) {
+    free(data);
+  } else {
+    log_warn("ephemeris: could not write '%s', keeping cache in memory", path);
+    if (eph->file.data) unmap_file(&eph->file);
+    eph->mem = data;
+    bool ok = pl_ephem_attach(eph, data, len);
+    assert(ok && "generated ephemeris invalid");
+    (void)ok;
+  }
+
+  pl_ephemeris_update(eph, jd0);
+  return eph;
+}
+
+void
+pl_ephemeris_close(pl_ephemeris_t *eph)
+{
+  if (eph->file.data) unmap_file(&eph->file);
+  free(eph->mem);
+  free(eph->celobjs);
+  free(eph);
+}
+
+bool
+pl_ephemeris_update(pl_ephemeris_t *eph, double jde)
+{
+  if (jde < eph->header->jd_start || jde > eph->jd_end) {
+    if (!eph->warned) {
+      log_warn("ephemeris: jd %f outside of cache (%f to %f), using model",
+               jde, eph->header->jd_start, eph->jd_end);
+      eph->warned = true;
+    }
+    return false;
+  }
+
+  for (uint32_t i = 0 ; i < eph->header->body_count ; i ++) {
+    cm_orbit_t *orbit = eph->celobjs[i]->cm_orbit;
+    double x, dxdt;
+    const double *c = pl_ephem_granule(eph, i, jde, &x, &dxdt);
+    double ch[PL_EPHEM_CHANNELS];
+    double vx, vy, vz;
+
+    ch[PL_EPHEM_PX] = pl_ephem_eval(c + PL_EPHEM_PX * PL_EPHEM_COEFS, x, &vx);
+    ch[PL_EPHEM_PY] = pl_ephem_eval(c + PL_EPHEM_PY * PL_EPHEM_COEFS, x, &vy);
+    ch[PL_EPHEM_PZ] = pl_ephem_eval(c + PL_EPHEM_PZ * PL_EPHEM_COEFS, x, &vz);
+    for (int k = PL_EPHEM_W ; k < PL_EPHEM_CHANNELS ; k ++) {
+      ch[k] = pl_ephem_eval(c + k * PL_EPHEM_COEFS, x, NULL);
+    }
+
+    orbit->p = vd3_set(ch[PL_EPHEM_PX], ch[PL_EPHEM_PY], ch[PL_EPHEM_PZ]);
+    orbit->v = vd3_set(vx, vy, vz) * dxdt;
+    orbit->W = fmod(ch[PL_EPHEM_W], 2.0 * M_PI);
+    if (orbit->W < 0.0) orbit->W += 2.0 * M_PI;
+    orbit->r.x = ch[PL_EPHEM_RX];
+    orbit->r.y = ch[PL_EPHEM_RY];
+
+    double qn = sqrt(ch[PL_EPHEM_QX] * ch[PL_EPHEM_QX]
+                     + ch[PL_EPHEM_QY] * ch[PL_EPHEM_QY]
+                     + ch[PL_EPHEM_QZ] * ch[PL_EPHEM_QZ]
+                     + ch[PL_EPHEM_QW] * ch[PL_EPHEM_QW]);
+    orbit->q.x = ch[PL_EPHEM_QX] / qn;
+    orbit->q.y = ch[PL_EPHEM_QY] / qn;
+    orbit->q.z = ch[PL_EPHEM_QZ] / qn;
+    orbit->q.w = ch[PL_EPHEM_QW] / qn;
+  }
+
+  return true;
+}
+
+uint64_t
+pl_ephemeris_hash_file(const char *path)
+{
+  if (path == NULL) return 0;
+
+  mapped_file_t mf = map_file(path);
+  if (mf.data == NULL || mf.data == MAP_FAILED) return 0;
+
+  uint64_t h = UINT64_C(14695981039346656037);
+  const unsigned char *c = mf.data;
+  for (off_t i = 0 ; i < mf.fileLenght ; i ++) {
+    h ^= c[i];
+    h *= UINT64_C(1099511628211);
+  }
+  unmap_file(&mf);
+  return h;
+}
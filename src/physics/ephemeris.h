@@ -0,0 +1,110 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_ephemeris_h
+#define orbit_ephemeris_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common/mapped-file.h"
+#include "physics/reftypes.h"
+
+// Precomputed ephemeris of the celestial objects.
+//
+// The celestial mechanics model is sampled into Chebyshev series in the style
+// of the JPL DE files. Time is divided in records of PL_EPHEM_RECORD_DAYS, and
+// within a record each body has a power of two number of granules, chosen from
+// its orbital and rotation periods. Each granule holds the coefficients of all
+// channels of the body, so evaluating the state of a body is a few polynomial
+// evaluations instead of the full analytic series.
+//
+// The cache is stored in a file in native byte order that is mapped directly,
+// it is regenerated if the source data, the bodies or the model changes, or if
+// it does not cover the requested time span.
+
+#define PL_EPHEM_VERSION 1
+#define PL_EPHEM_RECORD_DAYS 8.0
+#define PL_EPHEM_DEGREE 12 // Coefficients per channel is degree + 1
+#define PL_EPHEM_MAX_GRANULES 64
+#define PL_EPHEM_NAME_LEN 32
+
+// Channels of each body, the velocity is the derivative of the position
+typedef enum {
+  PL_EPHEM_PX, PL_EPHEM_PY, PL_EPHEM_PZ,
+  PL_EPHEM_W, // Rotation angle, unwrapped so that it is continuous
+  PL_EPHEM_RX, PL_EPHEM_RY, // Pole direction
+  PL_EPHEM_QX, PL_EPHEM_QY, PL_EPHEM_QZ, PL_EPHEM_QW, // Sign continuous
+  PL_EPHEM_CHANNELS
+} pl_ephem_channel_t;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t body_count;
+  uint32_t degree;
+  uint32_t channels;
+  uint64_t source_hash;
+  double record_days;
+  double jd_start;
+  uint32_t record_count;
+  uint32_t record_size; // Doubles per record
+} pl_ephem_header_t;
+
+typedef struct {
+  char name[PL_EPHEM_NAME_LEN];
+  double GM;
+  uint32_t granules; // Granules per record
+  uint32_t offset; // Offset of the body coefficients in a record, in doubles
+} pl_ephem_body_t;
+
+typedef struct {
+  pl_world_t *world;
+  mapped_file_t file; // Mapped cache file
+  void *mem; // Cache data if it could not be written to a file, else NULL
+
+  const pl_ephem_header_t *header;
+  const pl_ephem_body_t *bodies;
+  const double *records;
+  pl_celobject_t **celobjs; // Celestial object of each body in the cache
+
+  double jd_end;
+  bool generated; // True if the cache was regenerated when opened
+  bool warned; // Set when evaluation outside the cache has been reported
+} pl_ephemeris_t;
+
+/*! Open the ephemeris cache at path for the celestial objects of world,
+    covering at least the julian dates jd0 to jd1. The cache is regenerated if
+    needed, which samples the celestial mechanics model and may take a while.
+    If the file cannot be written the cache is kept in memory.
+    \param source_hash Hash of the data the celestial objects were created
+                       from, the cache is regenerated if it differs
+ */
+pl_ephemeris_t* pl_ephemeris_open(pl_world_t *world, const char *path,
+                                  uint64_t source_hash, double jd0, double jd1);
+void pl_ephemeris_close(pl_ephemeris_t *eph);
+
+/*! Set the state of all celestial objects at jde from the cache
+    \return False if jde is outside the cache, the state is then not changed
+ */
+bool pl_ephemeris_update(pl_ephemeris_t *eph, double jde);
+
+/*! FNV-1a hash of the contents of a file, 0 if it cannot be read */
+uint64_t pl_ephemeris_hash_file(const char *path);
+
+#endif
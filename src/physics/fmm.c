@@ -0,0 +1,545 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "physics/fmm.h"
+#include "physics/octtree.h"
+#include "physics/object.h"
+#include "physics/celestial-object.h"
+#include "common/palloc.h"
+
+// Notation, for a multi index n = (nx, ny, nz):
+//   d^n = dx^nx dy^ny dz^nz
+//   C(n, m) = c(nx, mx) c(ny, my) c(nz, mz)
+//   a_n(R) = 1/n! D^n (1/|R|), the Taylor coefficients of 1/|R|
+//
+// A cell with centre c holds the multipole M_n = sum GM_j (c - x_j)^n and the
+// local expansion L_k, giving the potential sum GM_j / |x - x_j| as
+// sum L_k (x - c)^k. The field is the gradient of the potential.
+
+static inline int
+pl_fmm_degree(const pl_fmm_t *fmm, size_t t)
+{
+  return fmm->exps[t][0] + fmm->exps[t][1] + fmm->exps[t][2];
+}
+
+static inline double
+pl_fmm_binom(const pl_fmm_t *fmm, const unsigned char *n, const unsigned char *m)
+{
+  return fmm->binom[n[0]][m[0]] * fmm->binom[n[1]][m[1]]
+       * fmm->binom[n[2]][m[2]];
+}
+
+pl_fmm_t*
+pl_new_fmm(int order)
+{
+  if (order < 1) order = 1;
+  if (order > PL_FMM_MAX_ORDER) order = PL_FMM_MAX_ORDER;
+
+  pl_fmm_t *fmm = smalloc(sizeof(pl_fmm_t));
+  fmm->order = order;
+  fmm->theta = 0.5;
+  fmm->terms = (order + 1) * (order + 2) * (order + 3) / 6;
+  fmm->exps = smalloc(fmm->terms * sizeof(fmm->exps[0]));
+  fmm->deriv = smalloc(fmm->terms * sizeof(double));
+  fmm->powers = smalloc(fmm->terms * sizeof(double));
+
+  memset(fmm->lookup, -1, sizeof(fmm->lookup));
+  size_t t = 0;
+  for (int n = 0 ; n <= order ; n ++) {
+    for (int x = n ; x >= 0 ; x --) {
+      for (int y = n - x ; y >= 0 ; y --) {
+        int z = n - x - y;
+        fmm->exps[t][0] = x;
+        fmm->exps[t][1] = y;
+        fmm->exps[t][2] = z;
+        fmm->lookup[x][y][z] = t;
+        t ++;
+      }
+    }
+  }
+  assert(t == fmm->terms);
+
+  for (int n = 0 ; n <= PL_FMM_MAX_ORDER ; n ++) {
+    fmm->binom[n][0] = 1.0;
+    for (int k = 1 ; k <= n ; k ++) {
+      fmm->binom[n][k] = fmm->binom[n][k-1] * (n - k + 1) / k;
+    }
+  }
+
+  size_t entries = 0;
+  for (size_t k = 0 ; k < fmm->terms ; k ++) {
+    for (size_t n = 0 ; n < fmm->terms ; n ++) {
+      if (pl_fmm_degree(fmm, n) + pl_fmm_degree(fmm, k) > order) break;
+      entries ++;
+    }
+  }
+
+  fmm->m2l_start = smalloc((fmm->terms + 1) * sizeof(size_t));
+  fmm->m2l_idx = smalloc(entries * sizeof(fmm->m2l_idx[0]));
+  fmm->m2l_coeff = smalloc(entries * sizeof(double));
+
+  size_t e = 0;
+  for (size_t k = 0 ; k < fmm->terms ; k ++) {
+    const unsigned char *ke = fmm->exps[k];
+    fmm->m2l_start[k] = e;
+    for (size_t n = 0 ; n < fmm->terms ; n ++) {
+      if (pl_fmm_degree(fmm, n) + pl_fmm_degree(fmm, k) > order) break;
+      const unsigned char *ne = fmm->exps[n];
+      unsigned char nk[3] = {ne[0] + ke[0], ne[1] + ke[1], ne[2] + ke[2]};
+      fmm->m2l_idx[e][0] = n;
+      fmm->m2l_idx[e][1] = fmm->lookup[nk[0]][nk[1]][nk[2]];
+      fmm->m2l_coeff[e] = pl_fmm_binom(fmm, nk, ne);
+      e ++;
+    }
+  }
+  fmm->m2l_start[fmm->terms] = e;
+
+  return fmm;
+}
+
+void
+pl_fmm_delete(pl_fmm_t *fmm)
+{
+  free(fmm->m2l_start);
+  free(fmm->m2l_idx);
+  free(fmm->m2l_coeff);
+  free(fmm->exps);
+  free(fmm->deriv);
+  free(fmm->powers);
+  free(fmm);
+}
+
+void
+pl_fmm_set_theta(pl_fmm_t *fmm, double theta)
+{
+  fmm->theta = theta;
+}
+
+// Monomials d^n for all terms up to the given degree
+static void
+pl_fmm_powers(const pl_fmm_t *fmm, double3 d, int degree, double *out)
+{
+  double px[PL_FMM_MAX_ORDER+1], py[PL_FMM_MAX_ORDER+1], pz[PL_FMM_MAX_ORDER+1];
+  px[0] = py[0] = pz[0] = 1.0;
+  for (int i = 1 ; i <= degree ; i ++) {
+    px[i] = px[i-1] * d.x;
+    py[i] = py[i-1] * d.y;
+    pz[i] = pz[i-1] * d.z;
+  }
+
+  for (size_t t = 0 ; t < fmm->terms && pl_fmm_degree(fmm, t) <= degree ; t ++) {
+    out[t] = px[fmm->exps[t][0]] * py[fmm->exps[t][1]] * pz[fmm->exps[t][2]];
+  }
+}
+
+// Taylor coefficients of 1/|R| using the recurrence
+//   |k| |R|^2 a_k + (2|k| - 1) sum_i R_i a_{k-e_i} + (|k| - 1) sum_i a_{k-2e_i} = 0
+static void
+pl_fmm_derivs(const pl_fmm_t *fmm, double3 R, double *a)
+{
+  double r2 = vd3_dot(R, R);
+  double inv_r2 = 1.0 / r2;
+  double Ri[3] = {R.x, R.y, R.z};
+
+  a[0] = sqrt(inv_r2);
+  for (size_t t = 1 ; t < fmm->terms ; t ++) {
+    const unsigned char *k = fmm->exps[t];
+    int n = k[0] + k[1] + k[2];
+    double s1 = 0.0, s2 = 0.0;
+    for (int i = 0 ; i < 3 ; i ++) {
+      if (k[i] >= 1) {
+        unsigned char km[3] = {k[0], k[1], k[2]};
+        km[i] -= 1;
+        s1 += Ri[i] * a[fmm->lookup[km[0]][km[1]][km[2]]];
+        if (k[i] >= 2) {
+          km[i] -= 1;
+          s2 += a[fmm->lookup[km[0]][km[1]][km[2]]];
+        }
+      }
+    }
+    a[t] = -((2 * n - 1) * s1 + (n - 1) * s2) * inv_r2 / n;
+  }
+}
+
+// Source cell B to local expansion of target cell A
+static void
+pl_fmm_m2l(pl_fmm_t *fmm, pl_octtree_t *A, const pl_octtree_t *B)
+{
+  const double *a = fmm->deriv;
+  const double *M = B->fmm_cell.multipole;
+  double *L = A->fmm_cell.local;
+
+  pl_fmm_derivs(fmm, A->center - B->center, fmm->deriv);
+
+  for (size_t k = 0 ; k < fmm->terms ; k ++) {
+    double sum = 0.0;
+    for (size_t e = fmm->m2l_start[k] ; e < fmm->m2l_start[k+1] ; e ++) {
+      sum += fmm->m2l_coeff[e] * a[fmm->m2l_idx[e][1]] * M[fmm->m2l_idx[e][0]];
+    }
+    L[k] += sum;
+  }
+}
+
+// Point source to local expansion of target cell A
+static void
+pl_fmm_p2l(pl_fmm_t *fmm, pl_octtree_t *A, double3 p, double GM)
+{
+  double *a = fmm->deriv;
+  pl_fmm_derivs(fmm, A->center - p, a);
+  for (size_t k = 0 ; k < fmm->terms ; k ++) {
+    A->fmm_cell.local[k] += a[k] * GM;
+  }
+}
+
+// Field of source cell B at point p
+static double3
+pl_fmm_m2p(pl_fmm_t *fmm, const pl_octtree_t *B, double3 p)
+{
+  double *a = fmm->deriv;
+  pl_fmm_derivs(fmm, p - B->center, a);
+
+  double g[3] = {0.0, 0.0, 0.0};
+  for (size_t n = 0 ; n < fmm->terms ; n ++) {
+    if (pl_fmm_degree(fmm, n) + 1 > fmm->order) break;
+    const unsigned char *ne = fmm->exps[n];
+    for (int i = 0 ; i < 3 ; i ++) {
+      unsigned char ni[3] = {ne[0], ne[1], ne[2]};
+      ni[i] += 1;
+      g[i] += ni[i] * a[fmm->lookup[ni[0]][ni[1]][ni[2]]]
+            * B->fmm_cell.multipole[n];
+    }
+  }
+  return vd3_set(g[0], g[1], g[2]);
+}
+
+static inline double3
+pl_fmm_p2p(double3 p, double3 src, double GM)
+{
+  double3 dv = p - src;
+  double d2 = vd3_dot(dv, dv);
+  if (d2 == 0.0) return vd3_set(0.0, 0.0, 0.0);
+  return dv * (-GM / (d2 * sqrt(d2)));
+}
+
+void
+pl_fmm_cell_dispose(pl_fmm_cell_t *cell)
+{
+  free(cell->multipole);
+  free(cell->local);
+  cell->multipole = NULL;
+  cell->local = NULL;
+  cell->terms = 0;
+  obj_array_dispose(&cell->sources);
+  obj_array_dispose(&cell->targets);
+}
+
+// Allocate expansions and clear the cell assignments
+static void
+pl_fmm_prepare(pl_fmm_t *fmm, pl_octtree_t *tree)
+{
+  pl_fmm_cell_t *cell = &tree->fmm_cell;
+
+  if (cell->terms != fmm->terms) {
+    pl_fmm_cell_dispose(cell);
+    cell->multipole = smalloc(fmm->terms * sizeof(double));
+    cell->local = smalloc(fmm->terms * sizeof(double));
+    cell->terms = fmm->terms;
+    obj_array_init(&cell->sources);
+    obj_array_init(&cell->targets);
+  }
+
+  cell->sources.length = 0;
+  cell->targets.length = 0;
+
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i]) pl_fmm_prepare(fmm, tree->children[i]);
+  }
+}
+
+static pl_octtree_t*
+pl_fmm_deepest(pl_octtree_t *tree, double3 p)
+{
+  pl_octtree_t *child;
+  while ((child = tree->children[vd3_octant(tree->center, p)])) {
+    tree = child;
+  }
+  return tree;
+}
+
+// Assign bodies to the deepest cell containing them
+static void
+pl_fmm_assign(pl_fmm_t *fmm, pl_octtree_t *tree)
+{
+  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(tree->rigid_bodies, i);
+    pl_octtree_t *cell = pl_fmm_deepest(tree, lwc_globald(&obj->p));
+    obj_array_push(&cell->fmm_cell.targets, obj);
+    obj->g_field = vd3_set(0.0, 0.0, 0.0);
+  }
+
+  ARRAY_FOR_EACH(i, tree->celestial_bodies) {
+    pl_celobject_t *celobj = ARRAY_ELEM(tree->celestial_bodies, i);
+    pl_octtree_t *cell = pl_fmm_deepest(tree, celobj->cm_orbit->p);
+    obj_array_push(&cell->fmm_cell.sources, celobj);
+  }
+
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i]) pl_fmm_assign(fmm, tree->children[i]);
+  }
+}
+
+// Compute multipoles, radii and target counts, and clear the local expansions.
+static void
+pl_fmm_upward(pl_fmm_t *fmm, pl_octtree_t *tree)
+{
+  pl_fmm_cell_t *cell = &tree->fmm_cell;
+  double *M = cell->multipole;
+  double *s = fmm->powers;
+  double3 cog = vd3_set(0.0, 0.0, 0.0);
+
+  memset(cell->local, 0, fmm->terms * sizeof(double));
+  memset(M, 0, fmm->terms * sizeof(double));
+  cell->target_count = ARRAY_LEN(cell->targets);
+  cell->src_radius = 0.0;
+  cell->tgt_radius = 0.0;
+
+  ARRAY_FOR_EACH(i, cell->targets) {
+    pl_object_t *obj = ARRAY_ELEM(cell->targets, i);
+    double r = vd3_abs(lwc_globald(&obj->p) - tree->center);
+    if (r > cell->tgt_radius) cell->tgt_radius = r;
+  }
+
+  ARRAY_FOR_EACH(i, cell->sources) {
+    pl_celobject_t *celobj = ARRAY_ELEM(cell->sources, i);
+    double GM = celobj->cm_orbit->GM;
+    double3 d = tree->center - celobj->cm_orbit->p;
+    double r = vd3_abs(d);
+    if (r > cell->src_radius) cell->src_radius = r;
+    pl_fmm_powers(fmm, d, fmm->order, s);
+    for (size_t n = 0 ; n < fmm->terms ; n ++) M[n] += GM * s[n];
+    cog += celobj->cm_orbit->p * GM;
+  }
+
+  // M'_n = sum_{m <= n} C(n, m) M_m s^{n-m}, s = parent centre - child centre
+  for (int c = 0 ; c < 8 ; c ++) {
+    pl_octtree_t *child = tree->children[c];
+    if (child == NULL) continue;
+
+    pl_fmm_upward(fmm, child);
+
+    pl_fmm_cell_t *ccell = &child->fmm_cell;
+    double dist = vd3_abs(child->center - tree->center);
+    cell->target_count += ccell->target_count;
+    if (ccell->target_count > 0 && ccell->tgt_radius + dist > cell->tgt_radius) {
+      cell->tgt_radius = ccell->tgt_radius + dist;
+    }
+
+    if (ccell->multipole[0] <= 0.0) continue;
+    if (ccell->src_radius + dist > cell->src_radius) {
+      cell->src_radius = ccell->src_radius + dist;
+    }
+
+    pl_fmm_powers(fmm, tree->center - child->center, fmm->order, s);
+    for (size_t n = 0 ; n < fmm->terms ; n ++) {
+      const unsigned char *ne = fmm->exps[n];
+      double sum = 0.0;
+      for (int mx = 0 ; mx <= ne[0] ; mx ++) {
+        for (int my = 0 ; my <= ne[1] ; my ++) {
+          for (int mz = 0 ; mz <= ne[2] ; mz ++) {
+            unsigned char me[3] = {mx, my, mz};
+            sum += pl_fmm_binom(fmm, ne, me)
+                 * ccell->multipole[fmm->lookup[mx][my][mz]]
+                 * s[fmm->lookup[ne[0]-mx][ne[1]-my][ne[2]-mz]];
+          }
+        }
+      }
+      M[n] += sum;
+    }
+    cog += child->cog * child->GM;
+  }
+
+  // Keep the Barnes-Hut data valid, so the backend can be switched
+  tree->GM = M[0];
+  tree->cog = (M[0] > 0.0) ? cog / M[0] : cog;
+  tree->dirty = false;
+}
+
+// Field of cell B and its subtree at point p
+static double3
+pl_fmm_eval_point(pl_fmm_t *fmm, const pl_octtree_t *B, double3 p)
+{
+  const pl_fmm_cell_t *cell = &B->fmm_cell;
+  if (cell->multipole[0] <= 0.0) return vd3_set(0.0, 0.0, 0.0);
+
+  if (cell->src_radius < fmm->theta * vd3_abs(p - B->center)) {
+    return pl_fmm_m2p(fmm, B, p);
+  }
+
+  double3 g = vd3_set(0.0, 0.0, 0.0);
+  ARRAY_FOR_EACH(i, cell->sources) {
+    pl_celobject_t *celobj = ARRAY_ELEM(cell->sources, i);
+    g += pl_fmm_p2p(p, celobj->cm_orbit->p, celobj->cm_orbit->GM);
+  }
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (B->children[i]) g += pl_fmm_eval_point(fmm, B->children[i], p);
+  }
+  return g;
+}
+
+// Point source to all targets in cell A and its subtree
+static void
+pl_fmm_source_point(pl_fmm_t *fmm, pl_octtree_t *A, double3 p, double GM)
+{
+  pl_fmm_cell_t *cell = &A->fmm_cell;
+  if (cell->target_count == 0) return;
+
+  if (cell->tgt_radius < fmm->theta * vd3_abs(A->center - p)) {
+    pl_fmm_p2l(fmm, A, p, GM);
+    return;
+  }
+
+  ARRAY_FOR_EACH(i, cell->targets) {
+    pl_object_t *obj = ARRAY_ELEM(cell->targets, i);
+    obj->g_field += pl_fmm_p2p(lwc_globald(&obj->p), p, GM);
+  }
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (A->children[i]) pl_fmm_source_point(fmm, A->children[i], p, GM);
+  }
+}
+
+static bool
+pl_fmm_has_children(const pl_octtree_t *tree)
+{
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i]) return true;
+  }
+  return false;
+}
+
+// Dual tree walk, A is the target cell and B the source cell
+static void
+pl_fmm_interact(pl_fmm_t *fmm, pl_octtree_t *A, pl_octtree_t *B)
+{
+  pl_fmm_cell_t *acell = &A->fmm_cell;
+  pl_fmm_cell_t *bcell = &B->fmm_cell;
+  if (acell->target_count == 0 || bcell->multipole[0] <= 0.0) return;
+
+  double rA = acell->tgt_radius;
+  double rB = bcell->src_radius;
+
+  if (A != B && rA + rB < fmm->theta * vd3_abs(A->center - B->center)) {
+    pl_fmm_m2l(fmm, A, B);
+    return;
+  }
+
+  bool splitA = pl_fmm_has_children(A);
+  bool splitB = pl_fmm_has_children(B);
+
+  if (splitA && (rA >= rB || !splitB)) {
+    for (int i = 0 ; i < 8 ; i ++) {
+      if (A->children[i]) pl_fmm_interact(fmm, A->children[i], B);
+    }
+    ARRAY_FOR_EACH(i, acell->targets) {
+      pl_object_t *obj = ARRAY_ELEM(acell->targets, i);
+      obj->g_field += pl_fmm_eval_point(fmm, B, lwc_globald(&obj->p));
+    }
+  } else if (splitB) {
+    for (int i = 0 ; i < 8 ; i ++) {
+      if (B->children[i]) pl_fmm_interact(fmm, A, B->children[i]);
+    }
+    ARRAY_FOR_EACH(i, bcell->sources) {
+      pl_celobject_t *celobj = ARRAY_ELEM(bcell->sources, i);
+      pl_fmm_source_point(fmm, A, celobj->cm_orbit->p, celobj->cm_orbit->GM);
+    }
+  } else {
+    ARRAY_FOR_EACH(i, acell->targets) {
+      pl_object_t *obj = ARRAY_ELEM(acell->targets, i);
+      double3 p = lwc_globald(&obj->p);
+      ARRAY_FOR_EACH(j, bcell->sources) {
+        pl_celobject_t *celobj = ARRAY_ELEM(bcell->sources, j);
+        obj->g_field += pl_fmm_p2p(p, celobj->cm_orbit->p,
+                                   celobj->cm_orbit->GM);
+      }
+    }
+  }
+}
+
+// Shift local expansions to the children and evaluate them at the targets
+static void
+pl_fmm_downward(pl_fmm_t *fmm, pl_octtree_t *tree)
+{
+  pl_fmm_cell_t *cell = &tree->fmm_cell;
+  if (cell->target_count == 0) return;
+
+  const double *L = cell->local;
+  double *s = fmm->powers;
+
+  ARRAY_FOR_EACH(i, cell->targets) {
+    pl_object_t *obj = ARRAY_ELEM(cell->targets, i);
+    pl_fmm_powers(fmm, lwc_globald(&obj->p) - tree->center, fmm->order - 1, s);
+
+    double g[3] = {0.0, 0.0, 0.0};
+    for (size_t k = 1 ; k < fmm->terms ; k ++) {
+      const unsigned char *ke = fmm->exps[k];
+      for (int j = 0 ; j < 3 ; j ++) {
+        if (ke[j] == 0) continue;
+        unsigned char km[3] = {ke[0], ke[1], ke[2]};
+        km[j] -= 1;
+        g[j] += ke[j] * L[k] * s[fmm->lookup[km[0]][km[1]][km[2]]];
+      }
+    }
+    obj->g_field += vd3_set(g[0], g[1], g[2]);
+  }
+
+  // L'_j = sum_{k >= j} C(k, j) t^{k-j} L_k, t = child centre - parent centre
+  for (int c = 0 ; c < 8 ; c ++) {
+    pl_octtree_t *child = tree->children[c];
+    if (child == NULL || child->fmm_cell.target_count == 0) continue;
+
+    pl_fmm_powers(fmm, child->center - tree->center, fmm->order, s);
+    for (size_t j = 0 ; j < fmm->terms ; j ++) {
+      const unsigned char *je = fmm->exps[j];
+      double sum = 0.0;
+      for (size_t k = j ; k < fmm->terms ; k ++) {
+        const unsigned char *ke = fmm->exps[k];
+        if (ke[0] < je[0] || ke[1] < je[1] || ke[2] < je[2]) continue;
+        sum += pl_fmm_binom(fmm, ke, je) * L[k]
+             * s[fmm->lookup[ke[0]-je[0]][ke[1]-je[1]][ke[2]-je[2]]];
+      }
+      child->fmm_cell.local[j] += sum;
+    }
+
+    pl_fmm_downward(fmm, child);
+  }
+}
+
+void
+pl_fmm_compute(pl_fmm_t *fmm, pl_octtree_t *tree)
+{
+  pl_fmm_prepare(fmm, tree);
+  pl_fmm_assign(fmm, tree);
+  pl_fmm_upward(fmm, tree);
+  pl_fmm_interact(fmm, tree, tree);
+  pl_fmm_downward(fmm, tree);
+}
@@ -0,0 +1,87 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_fmm_h
+#define orbit_fmm_h
+
+#include <stddef.h>
+#include <vmath/vmath.h>
+#include <gencds/array.h>
+
+#include "physics/reftypes.h"
+
+// Fast multipole gravity solver working on the octtree.
+//
+// The celestial bodies are the sources and the rigid bodies the targets.
+// Expansions are Cartesian Taylor series around the geometric centres of the
+// octtree cells. Cells are expanded to multipoles in an upward pass, cell to
+// cell interactions are converted to local expansions in a dual tree walk and
+// the local expansions are pushed down and evaluated at every rigid body.
+//
+// The octtree keeps bodies in internal nodes when the node is not full. For the
+// expansions, bodies are instead assigned to the deepest existing cell that
+// contains their position, this keeps most bodies in the leafs.
+
+#define PL_FMM_MAX_ORDER 8
+
+// Per octtree node data owned by the solver
+typedef struct {
+  size_t terms; // Allocated expansion size
+  double *multipole;
+  double *local;
+  obj_array_t sources; // Celestial bodies assigned to this cell
+  obj_array_t targets; // Rigid bodies assigned to this cell
+  size_t target_count; // Targets in this subtree
+  double src_radius; // Bound of source distances from the centre
+  double tgt_radius; // Bound of target distances from the centre
+} pl_fmm_cell_t;
+
+void pl_fmm_cell_dispose(pl_fmm_cell_t *cell);
+
+struct pl_fmm_t {
+  int order; // Highest total degree of the expansions
+  double theta; // Opening criterion, (rA + rB) / distance
+  size_t terms; // Number of coefficients in an expansion
+
+  unsigned char (*exps)[3]; // Exponents of each term, sorted on total degree
+  short lookup[PL_FMM_MAX_ORDER+1][PL_FMM_MAX_ORDER+1][PL_FMM_MAX_ORDER+1];
+  double binom[PL_FMM_MAX_ORDER+1][PL_FMM_MAX_ORDER+1];
+
+  // Translation of multipoles to local expansions, for every local term k the
+  // entries m2l_start[k] to m2l_start[k+1] hold the multipole term n, the
+  // derivative term n+k and the binomial C(n+k, n).
+  size_t *m2l_start;
+  unsigned short (*m2l_idx)[2];
+  double *m2l_coeff;
+
+  double *deriv; // Scratch for the derivatives of 1/r
+  double *powers; // Scratch for monomials
+};
+
+/*! Create solver with expansions up to the given order, 1 is a pure monopole
+    solver, order is clamped to [1, PL_FMM_MAX_ORDER] */
+pl_fmm_t* pl_new_fmm(int order);
+void pl_fmm_delete(pl_fmm_t *fmm);
+void pl_fmm_set_theta(pl_fmm_t *fmm, double theta);
+
+/*! Compute the gravitational field at every rigid body in the tree, the
+    result is stored in the g_field member of the objects. */
+void pl_fmm_compute(pl_fmm_t *fmm, pl_octtree_t *tree);
+
+#endif
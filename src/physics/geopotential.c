@@ -0,0 +1,211 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <openorbit/log.h>
+
+#include "common/palloc.h"
+#include "physics/geopotential.h"
+
+#define PL_GEOPOTENTIAL_TERMS \
+  PL_GEOPOTENTIAL_IDX(PL_GEOPOTENTIAL_MAX_DEGREE + 2, 0)
+
+// Factor converting a fully normalised coefficient to an unnormalised one
+static double
+pl_geopotential_norm(unsigned n, unsigned m)
+{
+  // (n - m)! / (n + m)!
+  double ratio = 1.0;
+  for (unsigned k = n - m + 1 ; k <= n + m ; k ++) ratio /= k;
+  return sqrt((m == 0 ? 1.0 : 2.0) * (2 * n + 1) * ratio);
+}
+
+pl_geopotential_t*
+pl_new_geopotential(unsigned degree, unsigned order, double R,
+                    const double *C, const double *S)
+{
+  if (degree > PL_GEOPOTENTIAL_MAX_DEGREE) {
+    log_warn("gravity field of degree %u truncated to %d", degree,
+             PL_GEOPOTENTIAL_MAX_DEGREE);
+    degree = PL_GEOPOTENTIAL_MAX_DEGREE;
+  }
+  if (order > degree) order = degree;
+
+  pl_geopotential_t *geo = smalloc(sizeof(pl_geopotential_t));
+  geo->degree = degree;
+  geo->order = order;
+  geo->R = R;
+
+  size_t terms = PL_GEOPOTENTIAL_IDX(degree + 1, 0);
+  geo->C = smalloc(terms * sizeof(double));
+  geo->S = smalloc(terms * sizeof(double));
+  for (unsigned n = 0 ; n <= degree ; n ++) {
+    for (unsigned m = 0 ; m <= n && m <= order ; m ++) {
+      size_t i = PL_GEOPOTENTIAL_IDX(n, m);
+      double f = pl_geopotential_norm(n, m);
+      geo->C[i] = C[i] * f;
+      geo->S[i] = S ? S[i] * f : 0.0;
+    }
+  }
+
+  size_t rterms = PL_GEOPOTENTIAL_IDX(degree + 2, 0);
+  geo->a = smalloc(rterms * sizeof(double));
+  geo->b = smalloc(rterms * sizeof(double));
+  for (unsigned n = 2 ; n <= degree + 1 ; n ++) {
+    for (unsigned m = 0 ; m + 2 <= n ; m ++) {
+      size_t i = PL_GEOPOTENTIAL_IDX(n, m);
+      geo->a[i] = (2.0 * n - 1.0) / (n - m);
+      geo->b[i] = (n + m - 1.0) / (n - m);
+    }
+  }
+
+  geo->GM = 0.0;
+  geo->rot[0] = vd3_set(1.0, 0.0, 0.0);
+  geo->rot[1] = vd3_set(0.0, 1.0, 0.0);
+  geo->rot[2] = vd3_set(0.0, 0.0, 1.0);
+  return geo;
+}
+
+void
+pl_geopotential_delete(pl_geopotential_t *geo)
+{
+  free(geo->C);
+  free(geo->S);
+  free(geo->a);
+  free(geo->b);
+  free(geo);
+}
+
+void
+pl_geopotential_update(pl_geopotential_t *geo, double GM, quatd_t q)
+{
+  geo->GM = GM;
+  qd_md3_convert(geo->rot, q);
+}
+
+void
+pl_geopotential_acc(const pl_geopotential_t *geo, unsigned degree,
+                    unsigned order, size_t n, const double3 *r, double3 *acc)
+{
+  if (degree > geo->degree) degree = geo->degree;
+  if (order > geo->order) order = geo->order;
+  if (order > degree) order = degree;
+
+  if (degree < 2) {
+    for (size_t i = 0 ; i < n ; i ++) acc[i] = vd3_set(0.0, 0.0, 0.0);
+    return;
+  }
+
+  // The acceleration of degree n needs the harmonics of degree n + 1
+  const unsigned N = degree + 1;
+  const unsigned M = order + 1;
+  const double R = geo->R;
+  const double scale = geo->GM / (R * R);
+
+  double V[PL_GEOPOTENTIAL_TERMS][PL_GEOPOTENTIAL_LANES];
+  double W[PL_GEOPOTENTIAL_TERMS][PL_GEOPOTENTIAL_LANES];
+  double x0[PL_GEOPOTENTIAL_LANES], y0[PL_GEOPOTENTIAL_LANES];
+  double z0[PL_GEOPOTENTIAL_LANES], rho[PL_GEOPOTENTIAL_LANES];
+  double ax[PL_GEOPOTENTIAL_LANES], ay[PL_GEOPOTENTIAL_LANES];
+  double az[PL_GEOPOTENTIAL_LANES];
+
+  for (size_t first = 0 ; first < n ; first += PL_GEOPOTENTIAL_LANES) {
+    size_t len = n - first;
+    if (len > PL_GEOPOTENTIAL_LANES) len = PL_GEOPOTENTIAL_LANES;
+
+    // Body fixed coordinates, unused lanes repeat the first body
+    for (size_t l = 0 ; l < PL_GEOPOTENTIAL_LANES ; l ++) {
+      double3 p = r[first + (l < len ? l : 0)];
+      double3 b = geo->rot[0] * p.x + geo->rot[1] * p.y + geo->rot[2] * p.z;
+      double r2 = vd3_dot(b, b);
+      x0[l] = R * b.x / r2;
+      y0[l] = R * b.y / r2;
+      z0[l] = R * b.z / r2;
+      rho[l] = R * R / r2;
+      V[0][l] = R / sqrt(r2);
+      W[0][l] = 0.0;
+      ax[l] = ay[l] = az[l] = 0.0;
+    }
+
+    for (unsigned m = 0 ; m <= M ; m ++) {
+      size_t mm = PL_GEOPOTENTIAL_IDX(m, m);
+      if (m > 0) {
+        size_t pm = PL_GEOPOTENTIAL_IDX(m - 1, m - 1);
+        double f = 2.0 * m - 1.0;
+        for (size_t l = 0 ; l < PL_GEOPOTENTIAL_LANES ; l ++) {
+          V[mm][l] = f * (x0[l] * V[pm][l] - y0[l] * W[pm][l]);
+          W[mm][l] = f * (x0[l] * W[pm][l] + y0[l] * V[pm][l]);
+        }
+      }
+      if (m < N) {
+        size_t i = PL_GEOPOTENTIAL_IDX(m + 1, m);
+        double f = 2.0 * m + 1.0;
+        for (size_t l = 0 ; l < PL_GEOPOTENTIAL_LANES ; l ++) {
+          V[i][l] = f * z0[l] * V[mm][l];
+          W[i][l] = f * z0[l] * W[mm][l];
+        }
+      }
+      for (unsigned k = m + 2 ; k <= N ; k ++) {
+        size_t i = PL_GEOPOTENTIAL_IDX(k, m);
+        size_t i1 = PL_GEOPOTENTIAL_IDX(k - 1, m);
+        size_t i2 = PL_GEOPOTENTIAL_IDX(k - 2, m);
+        double a = geo->a[i], b = geo->b[i];
+        for (size_t l = 0 ; l < PL_GEOPOTENTIAL_LANES ; l ++) {
+          V[i][l] = a * z0[l] * V[i1][l] - b * rho[l] * V[i2][l];
+          W[i][l] = a * z0[l] * W[i1][l] - b * rho[l] * W[i2][l];
+        }
+      }
+    }
+
+    for (unsigned k = 2 ; k <= degree ; k ++) {
+      for (unsigned m = 0 ; m <= k && m <= order ; m ++) {
+        double C = geo->C[PL_GEOPOTENTIAL_IDX(k, m)];
+        double S = geo->S[PL_GEOPOTENTIAL_IDX(k, m)];
+        size_t up = PL_GEOPOTENTIAL_IDX(k + 1, m + 1);
+        size_t same = PL_GEOPOTENTIAL_IDX(k + 1, m);
+        double fz = k - m + 1.0;
+
+        if (m == 0) {
+          for (size_t l = 0 ; l < PL_GEOPOTENTIAL_LANES ; l ++) {
+            ax[l] -= C * V[up][l];
+            ay[l] -= C * W[up][l];
+            az[l] -= fz * C * V[same][l];
+          }
+        } else {
+          size_t down = PL_GEOPOTENTIAL_IDX(k + 1, m - 1);
+          double fac = 0.5 * (k - m + 1.0) * (k - m + 2.0);
+          for (size_t l = 0 ; l < PL_GEOPOTENTIAL_LANES ; l ++) {
+            ax[l] += 0.5 * (-C * V[up][l] - S * W[up][l])
+                   + fac * (C * V[down][l] + S * W[down][l]);
+            ay[l] += 0.5 * (-C * W[up][l] + S * V[up][l])
+                   + fac * (-C * W[down][l] + S * V[down][l]);
+            az[l] += fz * (-C * V[same][l] - S * W[same][l]);
+          }
+        }
+      }
+    }
+
+    for (size_t l = 0 ; l < len ; l ++) {
+      double3 a = vd3_set(ax[l], ay[l], az[l]) * scale;
+      acc[first + l] = vd3_set(vd3_dot(geo->rot[0], a), vd3_dot(geo->rot[1], a),
+                               vd3_dot(geo->rot[2], a));
+    }
+  }
+}
@@ -0,0 +1,83 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_geopotential_h
+#define orbit_geopotential_h
+
+#include <stddef.h>
+#include <vmath/vmath.h>
+
+// Non-spherical gravity of celestial bodies as a spherical harmonic series.
+//
+// The potential is evaluated with the Cunningham recurrences for the solid
+// harmonics V_nm and W_nm, which give the acceleration in body fixed axes
+// without any trigonometric functions. The coefficients are given fully
+// normalised and are converted to unnormalised form once, together with the
+// recurrence factors. The rotation of the body is cached once per step with
+// pl_geopotential_update.
+//
+// Bodies are evaluated in blocks of PL_GEOPOTENTIAL_LANES, the recurrences
+// run over (n, m) in the outer loops and over the bodies of the block in the
+// inner loops so that the compiler can vectorise them.
+
+#define PL_GEOPOTENTIAL_MAX_DEGREE 20
+#define PL_GEOPOTENTIAL_LANES 8
+
+// Index of degree n and order m in the packed coefficient arrays
+#define PL_GEOPOTENTIAL_IDX(n, m) ((n) * ((n) + 1) / 2 + (m))
+
+typedef struct {
+  unsigned degree, order; // Of the coefficients
+  double R; // Reference radius in m
+  double *C, *S; // Unnormalised coefficients, packed by PL_GEOPOTENTIAL_IDX
+
+  // Recurrence factors V_nm = a_nm z V_n-1,m - b_nm rho V_n-2,m, packed by
+  // PL_GEOPOTENTIAL_IDX up to degree + 1
+  double *a, *b;
+
+  // Cached by pl_geopotential_update
+  double GM;
+  double3x3 rot; // Body fixed to world axes
+} pl_geopotential_t;
+
+/*! Create a gravity field from fully normalised coefficients, packed by
+    PL_GEOPOTENTIAL_IDX up to degree. Terms of order above order are ignored.
+    The degree is limited to PL_GEOPOTENTIAL_MAX_DEGREE.
+    \param R Reference radius of the coefficients
+    \param S May be NULL for zonal fields
+ */
+pl_geopotential_t* pl_new_geopotential(unsigned degree, unsigned order,
+                                       double R, const double *C,
+                                       const double *S);
+void pl_geopotential_delete(pl_geopotential_t *geo);
+
+/*! Cache the gravitational parameter and the orientation of the body for the
+    current step, q rotates body fixed axes to world axes */
+void pl_geopotential_update(pl_geopotential_t *geo, double GM, quatd_t q);
+
+/*! Non-spherical part of the gravitational acceleration, degrees 2 and up,
+    for n positions. The series is truncated at the given degree and order.
+    \param r Positions relative to the centre of the body, world axes
+    \param acc Set to the accelerations, world axes
+ */
+void pl_geopotential_acc(const pl_geopotential_t *geo, unsigned degree,
+                         unsigned order, size_t n, const double3 *r,
+                         double3 *acc);
+
+#endif
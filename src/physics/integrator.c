@@ -0,0 +1,259 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <openorbit/log.h>
+
+#include "physics/integrator.h"
+#include "physics/object.h"
+
+#define PL_RKF_MAX_SUBSTEPS 1000 // Accepted and rejected substeps per step
+#define PL_RKF_MIN_STEP 1.0e-9 // Smallest substep, relative to the step
+#define PL_RKF_SAFETY 0.9
+
+static const char *integrator_names[PL_INTEGRATOR_COUNT] = {
+  [PL_INTEGRATOR_EULER] = "euler",
+  [PL_INTEGRATOR_VERLET] = "verlet",
+  [PL_INTEGRATOR_RK4] = "rk4",
+  [PL_INTEGRATOR_RKF45] = "rkf45",
+};
+
+void
+pl_integrator_init(pl_integrator_t *integrator)
+{
+  integrator->kind = PL_INTEGRATOR_EULER;
+  integrator->field = NULL;
+  integrator->field_data = NULL;
+  integrator->tolerance = 1.0e-2;
+  integrator->h = 0.0;
+  integrator->substeps = 0;
+  integrator->field_evals = 0;
+}
+
+pl_integrator_kind_t
+pl_integrator_from_name(const char *name)
+{
+  for (int i = 0 ; i < PL_INTEGRATOR_COUNT ; i ++) {
+    if (!strcmp(name, integrator_names[i])) return i;
+  }
+  return PL_INTEGRATOR_COUNT;
+}
+
+const char*
+pl_integrator_name(pl_integrator_kind_t kind)
+{
+  assert(kind < PL_INTEGRATOR_COUNT);
+  return integrator_names[kind];
+}
+
+// Acceleration at p0 displaced by dp
+static double3
+pl_integrator_accel(pl_object_t *obj, const lwcoord_t *p0, double3 dp)
+{
+  pl_integrator_t *integrator = &obj->integrator;
+  double3 a = obj->f_ack / obj->m.m;
+
+  if (integrator->field) {
+    lwcoord_t p = *p0;
+    lwc_translate3dv(&p, dp);
+    integrator->field_evals ++;
+    return a + integrator->field(integrator->field_data, &p);
+  }
+
+  return a + obj->g_ack / obj->m.m;
+}
+
+static void
+pl_integrator_euler(pl_object_t *obj, double dt)
+{
+  double3 fm = ((obj->f_ack + obj->g_ack)/ obj->m.m);
+
+  obj->v += fm * dt; // Update velocity from force
+  double3 dv = vd3_s_mul(obj->v, dt);
+  lwc_translate3dv(&obj->p, dv); // Update position from velocity
+  obj->integrator.substeps = 1;
+}
+
+static void
+pl_integrator_verlet(pl_object_t *obj, double dt)
+{
+  double3 a0 = (obj->f_ack + obj->g_ack) / obj->m.m;
+  double3 v_half = obj->v + a0 * (0.5 * dt);
+  double3 dp = v_half * dt;
+  double3 a1 = pl_integrator_accel(obj, &obj->p, dp);
+
+  lwc_translate3dv(&obj->p, dp);
+  obj->v = v_half + a1 * (0.5 * dt);
+  obj->integrator.substeps = 1;
+}
+
+static void
+pl_integrator_rk4(pl_object_t *obj, double dt)
+{
+  const double3 v0 = obj->v;
+  const double h2 = 0.5 * dt;
+
+  double3 k1v = (obj->f_ack + obj->g_ack) / obj->m.m;
+  double3 k1p = v0;
+  double3 k2v = pl_integrator_accel(obj, &obj->p, k1p * h2);
+  double3 k2p = v0 + k1v * h2;
+  double3 k3v = pl_integrator_accel(obj, &obj->p, k2p * h2);
+  double3 k3p = v0 + k2v * h2;
+  double3 k4v = pl_integrator_accel(obj, &obj->p, k3p * dt);
+  double3 k4p = v0 + k3v * dt;
+
+  lwc_translate3dv(&obj->p, (k1p + 2.0 * k2p + 2.0 * k3p + k4p) * (dt / 6.0));
+  obj->v += (k1v + 2.0 * k2v + 2.0 * k3v + k4v) * (dt / 6.0);
+  obj->integrator.substeps = 1;
+}
+
+// Runge-Kutta-Fehlberg 4(5) tableau
+static const double rkf_a[6][5] = {
+  {0.0},
+  {1.0/4.0},
+  {3.0/32.0, 9.0/32.0},
+  {1932.0/2197.0, -7200.0/2197.0, 7296.0/2197.0},
+  {439.0/216.0, -8.0, 3680.0/513.0, -845.0/4104.0},
+  {-8.0/27.0, 2.0, -3544.0/2565.0, 1859.0/4104.0, -11.0/40.0},
+};
+static const double rkf_b5[6] = {
+  16.0/135.0, 0.0, 6656.0/12825.0, 28561.0/56430.0, -9.0/50.0, 2.0/55.0
+};
+static const double rkf_b4[6] = {
+  25.0/216.0, 0.0, 1408.0/2565.0, 2197.0/4104.0, -1.0/5.0, 0.0
+};
+
+// One embedded step of length h from p + dp0, v. The fifth order solution is
+// propagated and the difference to the fourth order one is returned as error
+// estimate.
+static double
+pl_integrator_rkf_substep(pl_object_t *obj, double3 a0, double3 dp0, double3 v,
+                          double h, double3 *dp, double3 *dv)
+{
+  double3 kp[6], kv[6];
+
+  kp[0] = v;
+  kv[0] = a0;
+  for (int s = 1 ; s < 6 ; s ++) {
+    double3 sp = dp0, sv = v;
+    for (int j = 0 ; j < s ; j ++) {
+      sp += kp[j] * (rkf_a[s][j] * h);
+      sv += kv[j] * (rkf_a[s][j] * h);
+    }
+    kp[s] = sv;
+    kv[s] = pl_integrator_accel(obj, &obj->p, sp);
+  }
+
+  double3 ep = vd3_set(0.0, 0.0, 0.0), ev = vd3_set(0.0, 0.0, 0.0);
+  *dp = vd3_set(0.0, 0.0, 0.0);
+  *dv = vd3_set(0.0, 0.0, 0.0);
+  for (int s = 0 ; s < 6 ; s ++) {
+    *dp += kp[s] * (rkf_b5[s] * h);
+    *dv += kv[s] * (rkf_b5[s] * h);
+    ep += kp[s] * ((rkf_b5[s] - rkf_b4[s]) * h);
+    ev += kv[s] * ((rkf_b5[s] - rkf_b4[s]) * h);
+  }
+
+  // Velocity errors are weighted by the step, as they turn into position errors
+  return fmax(vd3_abs(ep), vd3_abs(ev) * h) / obj->integrator.tolerance;
+}
+
+static void
+pl_integrator_rkf45(pl_object_t *obj, double dt)
+{
+  pl_integrator_t *integrator = &obj->integrator;
+  double3 dp = vd3_set(0.0, 0.0, 0.0); // Displacement from obj->p
+  double3 v = obj->v;
+  double3 a = (obj->f_ack + obj->g_ack) / obj->m.m;
+  double t = 0.0;
+  double h = (integrator->h > 0.0) ? integrator->h : dt;
+  double h_min = dt * PL_RKF_MIN_STEP;
+  unsigned substeps = 0, attempts = 0;
+
+  while (t < dt) {
+    // Once the substep limit is reached, the rest of the step is taken at once
+    bool limit = (attempts >= PL_RKF_MAX_SUBSTEPS);
+    bool last = limit || (t + h >= dt);
+    double step = last ? dt - t : h;
+    double3 sdp, sdv;
+    double err = pl_integrator_rkf_substep(obj, a, dp, v, step, &sdp, &sdv);
+    attempts ++;
+
+    // A non-finite state gives no error estimate to adapt the step to
+    if (!isfinite(err)) {
+      log_warn("%s: rkf45 error estimate is not finite, using euler",
+               obj->name ? obj->name : "object");
+      pl_integrator_euler(obj, dt);
+      integrator->h = 0.0;
+      return;
+    }
+
+    if (err <= 1.0 || limit) {
+      if (err > 1.0) {
+        log_warn("%s: rkf45 substep limit reached, accepting error %f",
+                 obj->name ? obj->name : "object", err);
+      }
+      dp += sdp;
+      v += sdv;
+      t += step;
+      substeps ++;
+
+      // Grow the step, but do not let the short final step shrink it
+      double scale = (err > 0.0) ? PL_RKF_SAFETY * pow(err, -0.2) : 4.0;
+      if (!last || scale < 1.0) {
+        h = fmax(h_min, step * fmin(4.0, fmax(0.1, scale)));
+      }
+
+      if (t < dt) a = pl_integrator_accel(obj, &obj->p, dp);
+    } else {
+      h = fmax(h_min, step * fmax(0.1, PL_RKF_SAFETY * pow(err, -0.25)));
+    }
+  }
+
+  lwc_translate3dv(&obj->p, dp);
+  obj->v = v;
+  integrator->h = h;
+  integrator->substeps = substeps;
+}
+
+void
+pl_integrator_step(pl_object_t *obj, double dt)
+{
+  obj->integrator.field_evals = 0;
+
+  switch (obj->integrator.kind) {
+  case PL_INTEGRATOR_EULER:
+    pl_integrator_euler(obj, dt);
+    break;
+  case PL_INTEGRATOR_VERLET:
+    pl_integrator_verlet(obj, dt);
+    break;
+  case PL_INTEGRATOR_RK4:
+    pl_integrator_rk4(obj, dt);
+    break;
+  case PL_INTEGRATOR_RKF45:
+    pl_integrator_rkf45(obj, dt);
+    break;
+  default:
+    assert(0 && "invalid integrator");
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_integrator_h
+#define orbit_integrator_h
+
+#include <vmath/vmath.h>
+#include <vmath/lwcoord.h>
+
+#include "physics/reftypes.h"
+
+// Translational integrators used by pl_object_step.
+//
+// The accumulated force (f_ack) is held constant over a step, while gravity is
+// re-evaluated at the intermediate positions of the higher order schemes using
+// the field function of the integrator. The first evaluation always uses the
+// gravity already accumulated in g_ack. Rotation is always integrated with the
+// semi-implicit Euler method.
+
+typedef enum {
+  PL_INTEGRATOR_EULER, // Semi-implicit (symplectic) Euler
+  PL_INTEGRATOR_VERLET, // Velocity Verlet, kick-drift-kick leapfrog
+  PL_INTEGRATOR_RK4, // Classical fourth order Runge-Kutta
+  PL_INTEGRATOR_RKF45, // Runge-Kutta-Fehlberg with adaptive substeps
+  PL_INTEGRATOR_COUNT
+} pl_integrator_kind_t;
+
+/*! Gravitational acceleration at p */
+typedef double3 (*pl_field_fn_t)(void *data, const lwcoord_t *p);
+
+typedef struct {
+  pl_integrator_kind_t kind;
+  pl_field_fn_t field; // NULL keeps the gravity constant during a step
+  void *field_data;
+
+  double tolerance; // Position error allowed per adaptive substep in m
+  double h; // Next adaptive substep length, 0 if unknown
+
+  // Statistics from the last step, for profiling
+  unsigned substeps;
+  unsigned field_evals;
+} pl_integrator_t;
+
+void pl_integrator_init(pl_integrator_t *integrator);
+
+/*! Look up integrator by name ("euler", "verlet", "rk4" or "rkf45")
+    \return The integrator kind or PL_INTEGRATOR_COUNT if the name is unknown
+ */
+pl_integrator_kind_t pl_integrator_from_name(const char *name);
+const char* pl_integrator_name(pl_integrator_kind_t kind);
+
+/*! Advance position and velocity of obj by dt using obj->integrator */
+void pl_integrator_step(pl_object_t *obj, double dt);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <openorbit/log.h>
+
+#include "physics/kepler.h"
+
+#define PL_KEPLER_PARABOLIC 1.0e-6 // Eccentricities closer to 1 are rejected
+#define PL_KEPLER_CIRCULAR 1.0e-10 // Eccentricities below are treated as 0
+#define PL_KEPLER_MAX_ITERS 50
+#define PL_KEPLER_BATCH_ITERS 2 // One correction converges, one verifies
+#define PL_KEPLER_BATCH_TOL 1.0e-12 // Largest accepted residual in rad
+
+/*!
+  Computes the estimate of the next eccentric anomaly
+ \param E_i Eccentric anomaly of previous step
+ \param ecc Eccentricity of orbital ellipse
+ \param m Mean anomaly
+ */
+static inline long double
+pl_ecc_anomaly_step(long double E_i, long double ecc, long double m)
+{
+  return E_i - ( (E_i-ecc*sinl(E_i)-m) / (1-ecc*cosl(E_i)) );
+}
+
+/*!
+  The method solves this by making a few iterations with newton-rapson, for
+  equations, see celestial mechanics chapter in Fortescue, Stark and Swinerd's
+  Spacecraft Systems Engineering.
+
+  The mean anomaly is reduced to [-pi, pi] and the iteration is started with
+  Danby's estimate, which converges in a handful of steps also for highly
+  eccentric orbits. The returned anomaly is therefore in the same range.
+ */
+long double
+pl_ecc_anomaly(long double ecc, long double n, long double t)
+{
+  // 7.37 mm accuracy for an object at the distance of the dwarf-planet Pluto
+#define ERR_LIMIT 0.000000000001l
+  long double meanAnomaly = fmodl(n * t, 2.0l * M_PI);
+  if (meanAnomaly > M_PI) meanAnomaly -= 2.0l * M_PI;
+  else if (meanAnomaly < -M_PI) meanAnomaly += 2.0l * M_PI;
+
+  long double E_i = meanAnomaly
+                  + copysignl(0.85l * ecc, sinl(meanAnomaly));
+  long double E_i1 = pl_ecc_anomaly_step(E_i, ecc, meanAnomaly);
+  int i = 0;
+
+  while (fabsl(E_i1-E_i) > ERR_LIMIT) {
+    E_i = E_i1;
+    E_i1 = pl_ecc_anomaly_step(E_i, ecc, meanAnomaly);
+    i ++;
+
+    if (i > PL_KEPLER_MAX_ITERS) {
+      log_warn("ecc anomaly did not converge in %d iters, err = %.16f", i,
+               (double)fabsl(E_i1-E_i));
+      break;
+    }
+  }
+
+  return E_i1;
+#undef ERR_LIMIT
+}
+
+/*!
+  Markley's starter (Celestial Mechanics and Dynamical Astronomy 63, 1995)
+  solves a cubic approximation of Kepler's equation for M in [0, pi], the
+  result is within 1e-3 rad of the solution for all e < 1.
+ */
+static inline double
+pl_ecc_anomaly_markley(double ecc, double M)
+{
+  const double pi2 = M_PI * M_PI;
+  double alpha = (3.0 * pi2 + 1.6 * M_PI * (M_PI - M) / (1.0 + ecc))
+               / (pi2 - 6.0);
+  double d = 3.0 * (1.0 - ecc) + alpha * ecc;
+  double q = 2.0 * alpha * d * (1.0 - ecc) - M * M;
+  double r = 3.0 * alpha * d * (d - 1.0 + ecc) * M + M * M * M;
+  double w = cbrt(fabs(r) + sqrt(q * q * q + r * r));
+  w *= w;
+  return (2.0 * r * w / (w * w + w * q + q * q) + M) / d;
+}
+
+size_t
+pl_ecc_anomaly_batch(size_t n, const double *ecc, const double *M,
+                     double *E, bool *converged)
+{
+  size_t failed = 0;
+
+  for (size_t i = 0 ; i < n ; i ++) {
+    double e = ecc[i];
+
+    // Solve for |M| in [0, pi] and restore the sign, E is odd in M
+    double m = M[i] - 2.0 * M_PI * nearbyint(M[i] / (2.0 * M_PI));
+    double sign = copysign(1.0, m);
+    m = fabs(m);
+
+    double E_i = pl_ecc_anomaly_markley(e, m);
+    double f0 = 0.0;
+    for (int k = 0 ; k < PL_KEPLER_BATCH_ITERS ; k ++) {
+      // Fifth order correction, using the derivatives of f = E - e sin E - M
+      double es = e * sin(E_i);
+      double ec = e * cos(E_i);
+      f0 = E_i - es - m;
+      double f1 = 1.0 - ec;
+      double d3 = -f0 / (f1 - 0.5 * f0 * es / f1);
+      double d4 = -f0 / (f1 + 0.5 * d3 * es + d3 * d3 * ec / 6.0);
+      double d5 = -f0 / (f1 + 0.5 * d4 * es + d4 * d4 * ec / 6.0
+                         - d4 * d4 * d4 * es / 24.0);
+      E_i += d5;
+    }
+
+    // f0 is the residual before the last correction, so this is conservative
+    bool ok = fabs(f0) <= PL_KEPLER_BATCH_TOL && e >= 0.0 && e < 1.0;
+    if (converged) converged[i] = ok;
+    failed += !ok;
+    E[i] = sign * E_i;
+  }
+
+  return failed;
+}
+
+double
+pl_hyp_anomaly(double ecc, double M)
+{
+  double H = copysign(log(2.0 * fabs(M) / ecc + 1.8), M);
+
+  for (int i = 0 ; i < PL_KEPLER_MAX_ITERS ; i ++) {
+    double dH = (ecc * sinh(H) - H - M) / (ecc * cosh(H) - 1.0);
+    H -= dH;
+    if (fabs(dH) <= 1.0e-12 * (1.0 + fabs(H))) return H;
+  }
+
+  log_warn("hyperbolic anomaly did not converge, M = %f, e = %f", M, ecc);
+  return H;
+}
+
+bool
+pl_kepler_from_state(pl_kepler_orbit_t *orbit, double GM,
+                     double3 r, double3 v, double t)
+{
+  double r_abs = vd3_abs(r);
+  double3 h = vd3_cross(r, v);
+  double h_abs = vd3_abs(h);
+
+  if (r_abs == 0.0 || h_abs <= 1.0e-9 * r_abs * vd3_abs(v)) {
+    return false; // Radial trajectory
+  }
+
+  double3 e_vec = vd3_cross(v, h) / GM - r / r_abs;
+  double ecc = vd3_abs(e_vec);
+  if (fabs(ecc - 1.0) < PL_KEPLER_PARABOLIC) return false;
+
+  double energy = 0.5 * vd3_dot(v, v) - GM / r_abs;
+
+  orbit->GM = GM;
+  orbit->a = -GM / (2.0 * energy);
+  orbit->t0 = t;
+
+  if (ecc < PL_KEPLER_CIRCULAR) {
+    ecc = 0.0;
+    orbit->P = r / r_abs;
+  } else {
+    orbit->P = e_vec / ecc;
+  }
+  orbit->ecc = ecc;
+  orbit->Q = vd3_cross(h / h_abs, orbit->P);
+
+  double x = vd3_dot(r, orbit->P);
+  double y = vd3_dot(r, orbit->Q);
+
+  if (ecc < 1.0) {
+    double a = orbit->a;
+    double E = atan2(y / sqrt(1.0 - ecc * ecc), x + a * ecc);
+    orbit->M0 = E - ecc * sin(E);
+    orbit->n = sqrt(GM / (a * a * a));
+  } else {
+    double a = -orbit->a;
+    double H = asinh(y / (a * sqrt(ecc * ecc - 1.0)));
+    orbit->M0 = ecc * sinh(H) - H;
+    orbit->n = sqrt(GM / (a * a * a));
+  }
+
+  return true;
+}
+
+void
+pl_kepler_state_at(const pl_kepler_orbit_t *orbit, double t,
+                   double3 *r, double3 *v)
+{
+  double ecc = orbit->ecc;
+  double M = orbit->M0 + orbit->n * (t - orbit->t0);
+
+  if (ecc < 1.0) {
+    double a = orbit->a;
+    double s = sqrt(1.0 - ecc * ecc);
+    double E = pl_ecc_anomaly(ecc, 1.0, M);
+    double sE = sin(E), cE = cos(E);
+    double r_abs = a * (1.0 - ecc * cE);
+    double k = sqrt(orbit->GM * a) / r_abs;
+
+    *r = a * (cE - ecc) * orbit->P + a * s * sE * orbit->Q;
+    *v = -k * sE * orbit->P + k * s * cE * orbit->Q;
+  } else {
+    double a = -orbit->a;
+    double s = sqrt(ecc * ecc - 1.0);
+    double H = pl_hyp_anomaly(ecc, M);
+    double sH = sinh(H), cH = cosh(H);
+    double r_abs = a * (ecc * cH - 1.0);
+    double k = sqrt(orbit->GM * a) / r_abs;
+
+    *r = a * (ecc - cH) * orbit->P + a * s * sH * orbit->Q;
+    *v = -k * sH * orbit->P + k * s * cH * orbit->Q;
+  }
+}
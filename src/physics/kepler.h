@@ -0,0 +1,86 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_kepler_h
+#define orbit_kepler_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <vmath/vmath.h>
+
+// Two-body propagation of objects on rails.
+//
+// The orbit is stored as eccentricity, semi-major axis and the perifocal basis
+// (P towards periapsis, Q 90 degrees ahead in the direction of motion), which
+// avoids the singularities of the classical angles for circular and equatorial
+// orbits. Elliptic orbits are propagated with the eccentric anomaly and
+// hyperbolic orbits with the hyperbolic anomaly. Near parabolic and radial
+// orbits are rejected and must be integrated numerically.
+
+typedef struct {
+  double GM; // Gravitational parameter of the central body
+  double ecc; // Eccentricity
+  double a; // Semi-major axis, negative for hyperbolic orbits
+  double n; // Mean motion in rad / s
+  double M0; // Mean anomaly at epoch
+  double t0; // Epoch in s
+  double3 P; // Unit vector towards periapsis
+  double3 Q; // Unit vector in orbital plane, 90 degrees ahead of P
+} pl_kepler_orbit_t;
+
+/*! Solve Kepler's equation E - e sin E = n t for the eccentric anomaly, t = 0
+    is when the object passes periapsis.
+    \param ecc Eccentricity of orbit, must be less than one
+    \param n Mean motion around object
+    \param t Time since periapsis passage
+ */
+long double pl_ecc_anomaly(long double ecc, long double n, long double t);
+
+/*! Solve Kepler's equation E - e sin E = M for n elliptic orbits at once.
+
+    The solver uses Markley's starter followed by a fixed number of fifth
+    order corrections, so every lane does the same work and the loop has no
+    data dependent branches. This makes it suitable for vectorisation and for
+    solving thousands of orbits per frame.
+    \param ecc Eccentricities, in [0, 1)
+    \param M Mean anomalies, any range
+    \param E Output eccentric anomalies in [-pi, pi]
+    \param converged Optional, set per lane to false if the residual did not
+                     reach the tolerance or the eccentricity is out of range
+    \return Number of lanes that did not converge
+ */
+size_t pl_ecc_anomaly_batch(size_t n, const double *ecc, const double *M,
+                            double *E, bool *converged);
+
+/*! Solve e sinh H - H = M for the hyperbolic anomaly H */
+double pl_hyp_anomaly(double ecc, double M);
+
+/*! Compute orbit from position and velocity relative to the central body
+    \param t Time of the state vectors in s
+    \return False if the orbit is degenerate (radial or near parabolic), in
+            which case the orbit is left undefined.
+ */
+bool pl_kepler_from_state(pl_kepler_orbit_t *orbit, double GM,
+                          double3 r, double3 v, double t);
+
+/*! Evaluate position and velocity relative to the central body at time t */
+void pl_kepler_state_at(const pl_kepler_orbit_t *orbit, double t,
+                        double3 *r, double3 *v);
+
+#endif
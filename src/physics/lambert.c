@@ -0,0 +1,187 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include "physics/lambert.h"
+
+#define PL_LAMBERT_MAX_ITERS 15
+#define PL_LAMBERT_TOL 1.0e-11 // Tolerance on x
+#define PL_LAMBERT_BATTIN 0.01 // Use the series when x is this close to 1
+#define PL_LAMBERT_LAGRANGE 0.2 // Use Lagrange's equation this close to 1
+
+// Gauss' hypergeometric function 2F1(3, 1, 5/2, z), used in Battin's series
+static double
+pl_lambert_hypergeometric(double z)
+{
+  double s = 1.0, c = 1.0;
+  for (int j = 0 ; j < 100 ; j ++) {
+    c *= (3.0 + j) * (1.0 + j) / (2.5 + j) * z / (j + 1.0);
+    s += c;
+    if (fabs(c) < PL_LAMBERT_TOL) break;
+  }
+  return s;
+}
+
+// Non dimensional time of flight as function of x with Lagrange's equation
+static double
+pl_lambert_tof_lagrange(double x, double lambda)
+{
+  double a = 1.0 / (1.0 - x * x);
+  if (a > 0.0) {
+    double alpha = 2.0 * acos(x);
+    double beta = 2.0 * asin(sqrt(lambda * lambda / a));
+    if (lambda < 0.0) beta = -beta;
+    return a * sqrt(a) * ((alpha - sin(alpha)) - (beta - sin(beta))) * 0.5;
+  } else {
+    double alpha = 2.0 * acosh(x);
+    double beta = 2.0 * asinh(sqrt(-lambda * lambda / a));
+    if (lambda < 0.0) beta = -beta;
+    return -a * sqrt(-a) * ((beta - sinh(beta)) - (alpha - sinh(alpha))) * 0.5;
+  }
+}
+
+// Non dimensional time of flight as function of x. The expressions lose
+// precision near x = 1 (the parabola), where Battin's series is used instead.
+static double
+pl_lambert_tof(double x, double lambda)
+{
+  double dist = fabs(x - 1.0);
+  if (dist < PL_LAMBERT_LAGRANGE && dist > PL_LAMBERT_BATTIN) {
+    return pl_lambert_tof_lagrange(x, lambda);
+  }
+
+  double k = lambda * lambda;
+  double e = x * x - 1.0;
+  double rho = fabs(e);
+  double z = sqrt(1.0 + k * e);
+
+  if (dist < PL_LAMBERT_BATTIN) {
+    double eta = z - lambda * x;
+    double s1 = 0.5 * (1.0 - lambda - x * eta);
+    double q = 4.0 / 3.0 * pl_lambert_hypergeometric(s1);
+    return (eta * eta * eta * q + 4.0 * lambda * eta) * 0.5;
+  }
+
+  double y = sqrt(rho);
+  double g = x * z - lambda * e;
+  double d;
+  if (e < 0.0) {
+    d = acos(g);
+  } else {
+    double f = y * (z - lambda * x);
+    d = log(f + g);
+  }
+  return (x - lambda * z - d / y) / e;
+}
+
+// Householder iterations on T(x) = T
+static bool
+pl_lambert_householder(double T, double lambda, double *x)
+{
+  double l2 = lambda * lambda;
+  double l3 = l2 * lambda;
+  double l5 = l3 * l2;
+  double x0 = *x;
+
+  for (int i = 0 ; i < PL_LAMBERT_MAX_ITERS ; i ++) {
+    double tof = pl_lambert_tof(x0, lambda);
+    double u = 1.0 - x0 * x0;
+    double y = sqrt(1.0 - l2 * u);
+    double dT = (3.0 * tof * x0 - 2.0 + 2.0 * l3 * x0 / y) / u;
+    double ddT = (3.0 * tof + 5.0 * x0 * dT
+                  + 2.0 * (1.0 - l2) * l3 / (y * y * y)) / u;
+    double dddT = (7.0 * x0 * ddT + 8.0 * dT
+                   - 6.0 * (1.0 - l2) * l5 * x0 / (y * y * y * y * y)) / u;
+
+    double delta = tof - T;
+    double dT2 = dT * dT;
+    double x1 = x0 - delta * (dT2 - delta * ddT * 0.5)
+                / (dT * (dT2 - delta * ddT) + dddT * delta * delta / 6.0);
+    if (!isfinite(x1)) return false;
+    if (fabs(x1 - x0) < PL_LAMBERT_TOL) {
+      *x = x1;
+      return true;
+    }
+    x0 = x1;
+  }
+  return false;
+}
+
+bool
+pl_lambert(double GM, double3 r1, double3 r2, double tof, double3 normal,
+           double3 *v1, double3 *v2)
+{
+  if (!(tof > 0.0)) return false;
+
+  double3 c = r2 - r1;
+  double cn = vd3_abs(c);
+  double r1n = vd3_abs(r1);
+  double r2n = vd3_abs(r2);
+  double s = (r1n + r2n + cn) * 0.5;
+
+  double3 ir1 = r1 / r1n;
+  double3 ir2 = r2 / r2n;
+  double3 ih = vd3_cross(ir1, ir2);
+  double hn = vd3_abs(ih);
+  if (hn < 1.0e-12) return false; // Collinear, the plane is undefined
+  ih = ih / hn;
+
+  double lambda = sqrt(fmax(1.0 - cn / s, 0.0));
+  double3 it1, it2;
+  if (vd3_dot(ih, normal) < 0.0) {
+    // Long way, more than half a revolution
+    lambda = -lambda;
+    it1 = vd3_cross(ir1, ih);
+    it2 = vd3_cross(ir2, ih);
+  } else {
+    it1 = vd3_cross(ih, ir1);
+    it2 = vd3_cross(ih, ir2);
+  }
+
+  double T = sqrt(2.0 * GM / (s * s * s)) * tof;
+
+  // Initial guess
+  double l2 = lambda * lambda;
+  double T0 = acos(lambda) + lambda * sqrt(1.0 - l2);
+  double T1 = 2.0 / 3.0 * (1.0 - l2 * lambda);
+  double x;
+  if (T >= T0) {
+    x = -(T - T0) / (T - T0 + 4.0);
+  } else if (T <= T1) {
+    x = T1 * (T1 - T) / (0.4 * (1.0 - l2 * l2 * lambda) * T) + 1.0;
+  } else {
+    x = pow(T / T0, M_LN2 / log(T1 / T0)) - 1.0;
+  }
+
+  if (!pl_lambert_householder(T, lambda, &x)) return false;
+
+  // Velocities from x
+  double gamma = sqrt(GM * s * 0.5);
+  double rho = (r1n - r2n) / cn;
+  double sigma = sqrt(fmax(1.0 - rho * rho, 0.0));
+  double y = sqrt(1.0 - l2 + l2 * x * x);
+  double vr1 = gamma * ((lambda * y - x) - rho * (lambda * y + x)) / r1n;
+  double vr2 = -gamma * ((lambda * y - x) + rho * (lambda * y + x)) / r2n;
+  double vt = gamma * sigma * (y + lambda * x);
+
+  *v1 = ir1 * vr1 + it1 * (vt / r1n);
+  *v2 = ir2 * vr2 + it2 * (vt / r2n);
+  return true;
+}
@@ -0,0 +1,50 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_lambert_h
+#define orbit_lambert_h
+
+#include <stdbool.h>
+#include <vmath/vmath.h>
+
+// Lambert's problem, the two-body orbit from r1 to r2 in a given time.
+//
+// The solver follows Izzo (2015, "Revisiting Lambert's problem"). The problem
+// is reduced to finding x in the time of flight equation T(x, lambda), which
+// only depends on the geometry through lambda. It starts from Izzo's initial
+// guess and converges with Householder iterations in two to three steps for
+// all geometries. Only transfers of less than one revolution are solved.
+
+/*! Solve Lambert's problem
+    \param GM Gravitational parameter of the central body
+    \param r1 Position at departure
+    \param r2 Position at arrival
+    \param tof Time of flight in s, positive
+    \param normal Reference direction, the transfer is prograde about it. This
+           is typically the orbit normal of the departure body. The long way is
+           taken when r1 x r2 points away from it.
+    \param v1 Velocity at departure
+    \param v2 Velocity at arrival
+    \return False if there is no solution, if r1 and r2 are collinear or the
+            iterations failed to converge
+ */
+bool pl_lambert(double GM, double3 r1, double3 r2, double tof, double3 normal,
+                double3 *v1, double3 *v2);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <openorbit/log.h>
+
+#include "physics/linear-octtree.h"
+#include "common/palloc.h"
+
+#define PL_LINTREE_LEAF_SIZE 4
+#define PL_LINTREE_LEVELS 21 // 3 * 21 bits fits in the 64 bit key
+
+typedef struct {
+  uint64_t key;
+  size_t idx;
+} pl_lintree_sortkey_t;
+
+// Spread the low 21 bits of x so that there are two zero bits between each bit
+static inline uint64_t
+pl_morton_spread(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & UINT64_C(0x001f00000000ffff);
+  x = (x | x << 16) & UINT64_C(0x001f0000ff0000ff);
+  x = (x | x << 8)  & UINT64_C(0x100f00f00f00f00f);
+  x = (x | x << 4)  & UINT64_C(0x10c30c30c30c30c3);
+  x = (x | x << 2)  & UINT64_C(0x1249249249249249);
+  return x;
+}
+
+static inline int
+pl_morton_octant(uint64_t key, int level)
+{
+  return (key >> (3 * (PL_LINTREE_LEVELS - 1 - level))) & 7;
+}
+
+static int
+pl_lintree_sortkey_cmp(const void *a, const void *b)
+{
+  const pl_lintree_sortkey_t *ka = a;
+  const pl_lintree_sortkey_t *kb = b;
+  if (ka->key < kb->key) return -1;
+  if (ka->key > kb->key) return 1;
+  return 0;
+}
+
+// Length of a segment in metres, derived from lwc so we do not need to know
+// the segment size used by vmath.
+static double
+pl_lwc_segment_length(void)
+{
+  lwcoord_t unit;
+  lwc_set(&unit, 0.0, 0.0, 0.0);
+  unit.seg.x += 1;
+  return lwc_globald(&unit).x;
+}
+
+pl_lintree_t*
+pl_new_lintree(void)
+{
+  pl_lintree_t *tree = smalloc(sizeof(pl_lintree_t));
+  tree->theta = 0.5;
+  return tree;
+}
+
+void
+pl_lintree_delete(pl_lintree_t *tree)
+{
+  free(tree->src_p);
+  free(tree->src_GM);
+  free(tree->key);
+  free(tree->p);
+  free(tree->GM);
+  free(tree->nodes);
+  free(tree);
+}
+
+void
+pl_lintree_set_theta(pl_lintree_t *tree, double theta)
+{
+  tree->theta = theta;
+}
+
+void
+pl_lintree_clear(pl_lintree_t *tree)
+{
+  tree->len = 0;
+  tree->node_count = 0;
+}
+
+void
+pl_lintree_add(pl_lintree_t *tree, const lwcoord_t *p, double GM)
+{
+  if (tree->len >= tree->cap) {
+    size_t cap = tree->cap ? tree->cap * 2 : 16;
+    tree->src_p = realloc(tree->src_p, cap * sizeof(lwcoord_t));
+    tree->src_GM = realloc(tree->src_GM, cap * sizeof(double));
+    free(tree->key);
+    free(tree->p);
+    free(tree->GM);
+    tree->key = smalloc(cap * sizeof(uint64_t));
+    tree->p = smalloc(cap * sizeof(double3));
+    tree->GM = smalloc(cap * sizeof(double));
+    if (!tree->src_p || !tree->src_GM) {
+      log_fatal("out of memory when growing linear octtree");
+    }
+    tree->cap = cap;
+  }
+
+  tree->src_p[tree->len] = *p;
+  tree->src_GM[tree->len] = GM;
+  tree->len ++;
+}
+
+static size_t
+pl_lintree_new_node(pl_lintree_t *tree)
+{
+  if (tree->node_count >= tree->node_cap) {
+    size_t cap = tree->node_cap ? tree->node_cap * 2 : 64;
+    tree->nodes = realloc(tree->nodes, cap * sizeof(pl_lintree_node_t));
+    if (!tree->nodes) {
+      log_fatal("out of memory when growing linear octtree");
+    }
+    tree->node_cap = cap;
+  }
+  return tree->node_count ++;
+}
+
+static void
+pl_lintree_build_node(pl_lintree_t *tree, uint32_t first, uint32_t count,
+                      int level, double width)
+{
+  size_t idx = pl_lintree_new_node(tree);
+  tree->nodes[idx].first = first;
+  tree->nodes[idx].count = count;
+  tree->nodes[idx].width = width;
+
+  if (count > PL_LINTREE_LEAF_SIZE && level < PL_LINTREE_LEVELS) {
+    // Children are contiguous sub ranges, as the keys are sorted
+    uint32_t end = first + count;
+    uint32_t i = first;
+    while (i < end) {
+      int octant = pl_morton_octant(tree->key[i], level);
+      uint32_t j = i + 1;
+      while (j < end && pl_morton_octant(tree->key[j], level) == octant) j ++;
+      pl_lintree_build_node(tree, i, j - i, level + 1, width * 0.5);
+      i = j;
+    }
+  }
+
+  tree->nodes[idx].next = tree->node_count;
+}
+
+void
+pl_lintree_build(pl_lintree_t *tree)
+{
+  tree->node_count = 0;
+  if (tree->len == 0) return;
+
+  // Quantise the segments to 21 bits per axis relative to the lowest segment
+  int64_t lo[3] = {INT64_MAX, INT64_MAX, INT64_MAX};
+  int64_t hi[3] = {INT64_MIN, INT64_MIN, INT64_MIN};
+  for (size_t i = 0 ; i < tree->len ; i ++) {
+    int64_t s[3] = {tree->src_p[i].seg.x, tree->src_p[i].seg.y,
+                    tree->src_p[i].seg.z};
+    for (int j = 0 ; j < 3 ; j ++) {
+      if (s[j] < lo[j]) lo[j] = s[j];
+      if (s[j] > hi[j]) hi[j] = s[j];
+    }
+  }
+
+  int64_t span = 0;
+  for (int j = 0 ; j < 3 ; j ++) {
+    if (hi[j] - lo[j] > span) span = hi[j] - lo[j];
+  }
+
+  int shift = 0;
+  while ((span >> shift) >= (INT64_C(1) << PL_LINTREE_LEVELS)) shift ++;
+
+  pl_lintree_sortkey_t *keys = smalloc(tree->len * sizeof(pl_lintree_sortkey_t));
+  for (size_t i = 0 ; i < tree->len ; i ++) {
+    const lwcoord_t *p = &tree->src_p[i];
+    keys[i].key = pl_morton_spread((p->seg.x - lo[0]) >> shift) << 2
+                | pl_morton_spread((p->seg.y - lo[1]) >> shift) << 1
+                | pl_morton_spread((p->seg.z - lo[2]) >> shift);
+    keys[i].idx = i;
+  }
+
+  qsort(keys, tree->len, sizeof(pl_lintree_sortkey_t), pl_lintree_sortkey_cmp);
+
+  for (size_t i = 0 ; i < tree->len ; i ++) {
+    tree->key[i] = keys[i].key;
+    tree->p[i] = lwc_globald(&tree->src_p[keys[i].idx]);
+    tree->GM[i] = tree->src_GM[keys[i].idx];
+  }
+  free(keys);
+
+  double root_width = pl_lwc_segment_length()
+                    * (double)(INT64_C(1) << (PL_LINTREE_LEVELS + shift));
+  pl_lintree_build_node(tree, 0, tree->len, 0, root_width);
+
+  // Nodes are stored depth first, so walking backwards visits all children
+  // before their parent.
+  for (size_t i = tree->node_count ; i-- > 0 ; ) {
+    pl_lintree_node_t *node = &tree->nodes[i];
+    double3 cog = vd3_set(0.0, 0.0, 0.0);
+    double GM = 0.0;
+
+    if (node->next == i + 1) {
+      for (uint32_t j = node->first ; j < node->first + node->count ; j ++) {
+        cog += tree->p[j] * tree->GM[j];
+        GM += tree->GM[j];
+      }
+    } else {
+      for (size_t c = i + 1 ; c < node->next ; c = tree->nodes[c].next) {
+        cog += tree->nodes[c].cog * tree->nodes[c].GM;
+        GM += tree->nodes[c].GM;
+      }
+    }
+
+    node->cog = (GM > 0.0) ? cog / GM : cog;
+    node->GM = GM;
+  }
+}
+
+double3
+pl_lintree_compute_gravity(const pl_lintree_t *tree, const lwcoord_t *p,
+                           double m)
+{
+  double3 g = vd3_set(0.0, 0.0, 0.0);
+  double3 body_p = lwc_globald(p);
+
+  size_t i = 0;
+  while (i < tree->node_count) {
+    const pl_lintree_node_t *node = &tree->nodes[i];
+
+    if (node->GM <= 0.0) {
+      i = node->next;
+      continue;
+    }
+
+    if (node->next == i + 1) {
+      for (uint32_t j = node->first ; j < node->first + node->count ; j ++) {
+        double3 dv = body_p - tree->p[j];
+        double d2 = vd3_dot(dv, dv);
+        if (d2 > 0.0) {
+          g -= dv * (tree->GM[j] * m / (d2 * sqrt(d2)));
+        }
+      }
+      i = node->next;
+    } else {
+      double3 dv = body_p - node->cog;
+      double d2 = vd3_dot(dv, dv);
+      double d = sqrt(d2);
+      if (node->width < tree->theta * d) {
+        g -= dv * (node->GM * m / (d2 * d));
+        i = node->next;
+      } else {
+        i ++; // Open the cell, first child follows directly
+      }
+    }
+  }
+
+  return g;
+}
@@ -0,0 +1,80 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_linear_octtree_h
+#define orbit_linear_octtree_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vmath/vmath.h>
+#include <vmath/lwcoord.h>
+
+#include "physics/reftypes.h"
+
+// Pointer free Barnes-Hut tree.
+//
+// The mass sources are sorted on a Morton code computed from the integer
+// segment of their large world coordinates. Every octtree cell then covers a
+// contiguous range of the sorted sources, and the cells are stored depth first
+// in one array. Each node knows the index of the node following its subtree,
+// so the tree can be walked without a stack and without following pointers.
+
+typedef struct {
+  double3 cog;
+  double GM;
+  double width; // Side of the cell in metres
+  uint32_t first; // First source in the cell
+  uint32_t count; // Number of sources in the cell
+  uint32_t next; // Index of the node after this subtree, i+1 for leafs
+} pl_lintree_node_t;
+
+struct pl_lintree_t {
+  double theta; // Opening threshold, cell width / distance
+
+  size_t len; // Number of sources
+  size_t cap;
+  lwcoord_t *src_p; // Sources as added
+  double *src_GM;
+
+  uint64_t *key; // Sorted Morton keys
+  double3 *p; // Sorted source positions in metres
+  double *GM; // Sorted source GM
+
+  size_t node_count;
+  size_t node_cap;
+  pl_lintree_node_t *nodes;
+};
+
+pl_lintree_t* pl_new_lintree(void);
+void pl_lintree_delete(pl_lintree_t *tree);
+
+void pl_lintree_set_theta(pl_lintree_t *tree, double theta);
+
+/*! Remove all sources, the node array is kept for reuse. */
+void pl_lintree_clear(pl_lintree_t *tree);
+/*! Add mass source, takes effect on the next build */
+void pl_lintree_add(pl_lintree_t *tree, const lwcoord_t *p, double GM);
+/*! Sort the sources and rebuild nodes and their mass distribution */
+void pl_lintree_build(pl_lintree_t *tree);
+
+/*! Gravitational force on a body of mass m at p */
+double3 pl_lintree_compute_gravity(const pl_lintree_t *tree,
+                                   const lwcoord_t *p, double m);
+
+#endif
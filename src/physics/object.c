@@ -49,6 +49,8 @@ pl_object_init(pl_object_t *obj)
             0.0f, 0.0f, 0.0f,
             1.0f, 1.0f, 1.0f,
             0.0f, 0.0f, 0.0f);
+  obj->m_offset = obj->m;
+  obj->mass_dirty = false;
 
   lwc_set(&obj->p, 0.0, 0.0, 0.0);
 
@@ -58,7 +60,10 @@ pl_object_init(pl_object_t *obj)
 
   obj->f_ack = vd3_set(0.0, 0.0, 0.0);
   obj->t_ack = vd3_set(0.0, 0.0, 0.0);
+  obj->f_thrust = vd3_set(0.0, 0.0, 0.0);
+  obj->t_thrust = vd3_set(0.0, 0.0, 0.0);
   obj->g_ack = vd3_set(0.0, 0.0, 0.0);
+  obj->g_harmonic = vd3_set(0.0, 0.0, 0.0);
 
   obj->v = vd3_set(0.0, 0.0, 0.0);
   pl_object_set_angular_vel3f(obj, 0.0f, 0.0f, 0.0f);
@@ -70,6 +75,14 @@ pl_object_init(pl_object_t *obj)
   obj->dragCoef = 0.0;
   obj->area = 0.0;
   obj->radius = 1.0;
+  obj->sunlight = 1.0f;
+  obj->occluder = NULL;
+
+  pl_integrator_init(&obj->integrator);
+  obj->step_rate = 1;
+  obj->on_rails = false;
+  obj->lod = PL_LOD_FULL;
+  obj->lod_dt = 0.0;
 
   obj_array_init(&obj->children);
   obj_array_init(&obj->psystem);
@@ -87,6 +100,9 @@ pl_new_object(pl_world_t *world, const char *name)
   pl_object_init(obj);
   obj->name = strdup(name);
   obj->world = world;
+  obj->integrator.kind = world->integrator;
+  obj->integrator.field = pl_world_object_gravity_at;
+  obj->integrator.field_data = obj;
 
   obj_array_push(&world->rigid_bodies, obj);
   obj_array_push(&world->root_bodies, obj);
@@ -132,10 +148,14 @@ pl_new_sub_object3f(pl_world_t *world, pl_object_t *parent, const char * name,
   obj->name = strdup(name);
   obj->world = parent->world;
   obj->parent = parent;
+  obj->integrator.kind = world->integrator;
+  obj->integrator.field = pl_world_object_gravity_at;
+  obj->integrator.field_data = obj;
 
   obj->p_offset = vd3_set(x, y, z);
   obj_array_push(&world->rigid_bodies, obj);
   obj_array_push(&parent->children, obj);
+  pl_object_invalidate_mass(obj);
   return obj;
 }
 
@@ -148,6 +168,7 @@ pl_object_detatch(pl_object_t *obj)
   pl_object_t *parent = obj->parent;
 
   obj->parent = NULL;
+  obj->dominator = parent->dominator;
   //obj->sys = parent->sys;
   for (int i = 0 ; i < parent->children.length ; ++i) {
     if (parent->children.elems[i] == obj) {
@@ -157,34 +178,81 @@ pl_object_detatch(pl_object_t *obj)
     }
   }
 
+  pl_object_invalidate_mass(parent);
   pl_object_update_mass(parent);
   pl_object_compute_derived(obj);
   pl_collide_insert_object(obj->world->coll_ctxt, obj);
   pl_octtree_insert_rbody(obj->world->octtree, obj);
 }
 
-void
-pl_object_update_mass(pl_object_t *obj)
+// Sum up the masses of the children, the translated masses are cached in the
+// children so only the dirty ones are translated again
+static void
+pl_object_combine_mass(pl_object_t *obj)
 {
-  memset(&obj->m, 0, sizeof(pl_mass_t));
-
-  pl_mass_set(&obj->m, 0.0,
-            0.0, 0.0, 0.0,
-            0.0, 0.0, 0.0,
-            0.0, 0.0, 0.0);
+  pl_mass_t m;
+  memset(&m, 0, sizeof(pl_mass_t));
 
+  double3 moment = vd3_set(0.0, 0.0, 0.0);
   for (int i = 0 ; i < obj->children.length ; ++ i) {
     pl_object_t *child = obj->children.elems[i];
-    pl_mass_t tmp = child->m;
-    pl_mass_translate(&tmp,
-                    child->p_offset.x,
-                    child->p_offset.y,
-                    child->p_offset.z);
-    pl_mass_add(&obj->m, &tmp);
+    pl_object_update_mass(child);
+
+    m.m += child->m_offset.m;
+    moment += child->m_offset.cog * child->m_offset.m;
+    for (int j = 0 ; j < 3 ; ++ j) {
+      m.In[j] += child->m_offset.In[j];
+    }
+  }
+
+  if (m.m > 0.0) {
+    m.cog = moment / m.m;
   }
+  md3_inv2(m.I_inv, m.In);
+  obj->m = m;
   pl_object_compute_derived(obj);
 }
 
+void
+pl_object_update_mass(pl_object_t *obj)
+{
+  if (!obj->mass_dirty) return;
+
+  if (obj->children.length > 0) {
+    pl_object_combine_mass(obj);
+  }
+
+  if (obj->parent) {
+    obj->m_offset = obj->m;
+    pl_mass_translate(&obj->m_offset,
+                      obj->p_offset.x, obj->p_offset.y, obj->p_offset.z);
+  }
+  obj->mass_dirty = false;
+}
+
+// A dirty object always has dirty parents, so we can stop at the first one
+void
+pl_object_invalidate_mass(pl_object_t *obj)
+{
+  for ( ; obj && !obj->mass_dirty ; obj = obj->parent) {
+    obj->mass_dirty = true;
+  }
+}
+
+void
+pl_object_mod_mass(pl_object_t *obj, double m)
+{
+  pl_mass_mod(&obj->m, m);
+  pl_object_invalidate_mass(obj);
+}
+
+void
+pl_object_set_offset3dv(pl_object_t *obj, double3 p)
+{
+  obj->p_offset = p;
+  pl_object_invalidate_mass(obj);
+}
+
 
 void
 pl_object_set_pos3d(pl_object_t *obj, double x, double y, double z)
@@ -192,6 +260,8 @@ pl_object_set_pos3d(pl_object_t *obj, double x, double y, double z)
   PL_CHECK_OBJ(obj);
 
   lwc_set(&obj->p, x, y, z);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
 
   PL_CHECK_OBJ(obj);
 }
@@ -207,6 +277,8 @@ pl_object_set_pos_ext3f(pl_object_t *obj,
   obj->p.seg = vl3_set(i, j, k);
   obj->p.offs = vd3_set(x, y, z);
   lwc_normalise(&obj->p);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
 
   PL_CHECK_OBJ(obj);
 }
@@ -219,6 +291,8 @@ pl_object_set_pos_rel3d(pl_object_t * restrict obj, const pl_object_t * restrict
 
   obj->p = otherObj->p;
   lwc_translate3f(&obj->p, x, y, z);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
 
   PL_CHECK_OBJ(obj);
 }
@@ -232,6 +306,8 @@ pl_object_set_pos_rel3fv(pl_object_t * restrict obj,
 
   obj->p = otherObj->p;
   lwc_translate3fv(&obj->p, rp);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
   lwc_dump(&otherObj->p);
   lwc_dump(&obj->p);
 
@@ -248,6 +324,8 @@ pl_object_set_pos_celobj_rel(pl_object_t * restrict obj,
   double3 celobj_p = otherObj->cm_orbit->p;
   lwc_set(&obj->p, celobj_p.x, celobj_p.y, celobj_p.z);
   lwc_translate3dv(&obj->p, rp);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
   lwc_dump(&obj->p);
 
   obj->dominator = otherObj;
@@ -363,6 +441,59 @@ pl_object_force_relative_pos3fv(pl_object_t *obj, float3 f, float3 p)
   obj->t_ack += t_rot;
 }
 
+void
+pl_object_thrust_relative_pos3fv(pl_object_t *obj, float3 f, float3 p)
+{
+  double3 fd = vf3_to_vd3(f);
+  obj->f_thrust += fd;
+  obj->t_thrust += vd3_cross(vf3_to_vd3(p), fd);
+}
+
+void
+pl_object_thrust_torque3fv(pl_object_t *obj, float3 t)
+{
+  obj->t_thrust += vf3_to_vd3(t);
+}
+
+// Sum the thrust of obj and its children in the frame of the root body, with
+// torques about the root origin. offset is the position of obj in that frame.
+static void
+pl_object_collect_thrust(pl_object_t *obj, double3 offset,
+                         double3 *f, double3 *t)
+{
+  *f += obj->f_thrust;
+  *t += obj->t_thrust + vd3_cross(offset, obj->f_thrust);
+  obj->f_thrust = vd3_set(0.0, 0.0, 0.0);
+  obj->t_thrust = vd3_set(0.0, 0.0, 0.0);
+
+  ARRAY_FOR_EACH(i, obj->children) {
+    pl_object_t *child = ARRAY_ELEM(obj->children, i);
+    pl_object_collect_thrust(child, offset + child->p_offset, f, t);
+  }
+}
+
+void
+pl_object_apply_thrust(pl_object_t *obj)
+{
+  while (obj->parent) obj = obj->parent;
+  PL_CHECK_OBJ(obj);
+
+  double3 f = vd3_set(0.0, 0.0, 0.0);
+  double3 t = vd3_set(0.0, 0.0, 0.0);
+  pl_object_collect_thrust(obj, vd3_set(0.0, 0.0, 0.0), &f, &t);
+  if (vd3_dot(f, f) == 0.0 && vd3_dot(t, t) == 0.0) return;
+
+  // Move the torques to the centre of gravity, and rotate the sums with the
+  // same convention as pl_object_force_relative_pos3fv
+  t -= vd3_cross(obj->m.cog, f);
+  double3x3 Rt;
+  md3_transpose2(Rt, obj->R);
+  obj->f_ack += md3_v_mul(Rt, f);
+  obj->t_ack += md3_v_mul(Rt, t);
+
+  PL_CHECK_OBJ(obj);
+}
+
 void
 pl_object_set_gravity3f(pl_object_t *obj, float x, float y, float z)
 {
@@ -397,17 +528,9 @@ pl_object_dump(pl_object_t *obj)
 void
 pl_object_step(pl_object_t *obj, float dt)
 {
-  // TOOD: Fix air pressure computations
-#if 0
-  obj->airPressure = pl_object_compute_airpressure(obj);
-  obj->airDensity = pl_object_compute_airdensity(obj);
-#endif
   PL_CHECK_OBJ(obj);
-  double3 fm = ((obj->f_ack + obj->g_ack)/ obj->m.m);
 
-  obj->v += fm * dt; // Update velocity from force
-  double3 dv = vd3_s_mul(obj->v, dt);
-  lwc_translate3dv(&obj->p, dv); // Update position from velocity
+  pl_integrator_step(obj, dt); // Update velocity and position
 
   obj->angVel += md3_v_mul(obj->I_inv_world, obj->t_ack) * dt; // Update angular velocity with torque
   obj->q = qd_normalise(qd_vd3_rot(obj->q, obj->angVel, dt));    // Update quaternion with rotational velocity
@@ -474,17 +597,23 @@ void
 pl_object_set_vel3f(pl_object_t *obj, float dx, float dy, float dz)
 {
   obj->v = vd3_set(dx, dy, dz);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
 }
 void
 pl_object_set_vel3fv(pl_object_t *obj, float3 dp)
 {
   obj->v = vf3_to_vd3(dp);
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
 }
 
 void
 pl_object_set_vel3dv(pl_object_t *obj, double3 dp)
 {
   obj->v = dp;
+  obj->on_rails = false;
+  obj->lod_dt = 0.0;
 }
 
 
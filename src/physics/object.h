@@ -25,6 +25,8 @@
 
 #include "physics/world.h"
 #include "physics/mass.h"
+#include "physics/integrator.h"
+#include "physics/kepler.h"
 #include "physics/reftypes.h"
 
 #include <vmath/lwcoord.h>
@@ -32,10 +34,13 @@
 struct pl_object_t {
   pl_world_t *world;
   pl_octtree_t *tree;
+  size_t tree_slot; // Index in tree->rigid_bodies
   struct pl_object_t *parent;
   pl_celobject_t *dominator;
   char *name;
-  pl_mass_t m;
+  pl_mass_t m; // Own mass, or the aggregate of the children if there are any
+  pl_mass_t m_offset; // m translated by p_offset, cached for the parent
+  bool mass_dirty; // m or m_offset is stale, see pl_object_invalidate_mass
 
   lwcoord_t p; // Large world coordinates
   quatd_t q; // Rotation quaternion
@@ -48,8 +53,12 @@ struct pl_object_t {
   double3 angVel; // Angular velocity
   double3 f_ack; // Force accumulator
   double3 t_ack; // Torque accumulator
+  double3 f_thrust; // Body frame force of engines, see pl_object_apply_thrust
+  double3 t_thrust; // Body frame torque of engines about the object origin
 
   double3 g_ack; // Gravitational force accumulator
+  double3 g_field; // Gravitational acceleration from the last multipole pass
+  double3 g_harmonic; // Non-spherical acceleration from the dominator
 
 
   double radius; // For simple collission detection
@@ -60,6 +69,9 @@ struct pl_object_t {
               // a callback function to calculate the area
   double temperature; // Temperature of object in K
 
+  float sunlight; // Visible fraction of the solar disc, 0 in umbra
+  pl_celobject_t *occluder; // Body shadowing the sun, NULL in full sunlight
+
   obj_array_t psystem;// Optionally attatched particle systems
   obj_array_t children;
 
@@ -68,6 +80,14 @@ struct pl_object_t {
   double3 g; // Previous g_ack
   double3 t; // Previous t_ack
   double3 f; // Previous f_ack
+
+  pl_integrator_t integrator;
+  unsigned step_rate; // Substeps taken in the last world step, 0 if on rails
+
+  bool on_rails; // Propagated analytically about the dominator
+  pl_lod_t lod; // Level of detail tier, see pl_world_set_lod
+  double lod_dt; // Time drifted since the last integration in the reduced tier
+  pl_kepler_orbit_t rails; // Orbit relative to the dominator when on rails
 };
 
 // Create standard object
@@ -95,9 +115,22 @@ void pl_object_dump(pl_object_t *obj);
 /*! Detatch object from parent */
 void pl_object_detatch(pl_object_t *obj);
 
-/*! Compute aggregate object mass from children */
+/*! Compute aggregate object mass from children. Only the subtrees marked by
+    pl_object_invalidate_mass are recomputed, so this is cheap to call every
+    step. */
 void pl_object_update_mass(pl_object_t *obj);
 
+/*! Mark the mass of obj as changed, marking all its parents as well. Needed
+    after modifying obj->m directly. */
+void pl_object_invalidate_mass(pl_object_t *obj);
+
+/*! Set the mass of obj, scaling its inertia, and invalidate the aggregate
+    masses of its parents */
+void pl_object_mod_mass(pl_object_t *obj, double m);
+
+/*! Set offset of a subobject relative to its parent */
+void pl_object_set_offset3dv(pl_object_t *obj, double3 p);
+
 /*! Assigns an SGdrawable pointer to the object. */
 //void plSetDrawableForObject(pl_object_t *obj, SGdrawable *drawable);
 
@@ -113,6 +146,18 @@ void pl_object_force_relative_pos3f(pl_object_t *obj,
                           float px, float py, float pz);
 void pl_object_force_relative_pos3fv(pl_object_t *obj, float3 f, float3 p);
 
+/*! Add body frame force f acting at p, relative to the origin of obj, to the
+    thrust accumulators of obj. Unlike pl_object_force_relative_pos3fv this
+    neither walks to the root body nor transforms the force, that is done once
+    for all engines by pl_object_apply_thrust. */
+void pl_object_thrust_relative_pos3fv(pl_object_t *obj, float3 f, float3 p);
+/*! Add body frame torque t to the thrust accumulators of obj */
+void pl_object_thrust_torque3fv(pl_object_t *obj, float3 t);
+/*! Reduce the thrust accumulators of all objects in the tree of obj into the
+    force and torque accumulators of the root body and clear them. Call once
+    per step after the engines have been stepped. */
+void pl_object_apply_thrust(pl_object_t *obj);
+
 /*! Apply gravity vector */
 void pl_object_set_gravity3f(pl_object_t *obj, float x, float y, float z);
 /*! Apply gravity vector */
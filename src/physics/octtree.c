@@ -18,6 +18,7 @@
  */
 
 
+#include <assert.h>
 #include <stdio.h>
 #include "physics/octtree.h"
 #include "physics/object.h"
@@ -66,6 +67,7 @@ pl_new_octtree(double3 center, double width)
 
   otree->width = width;
   otree->center = center;
+  otree->dirty = true;
 
   obj_array_init(&otree->rigid_bodies);
   obj_array_init(&otree->celestial_bodies);
@@ -83,12 +85,89 @@ pl_octtree_delete(pl_octtree_t *tree)
     }
   }
 
+  if (tree->linear) pl_lintree_delete(tree->linear);
+  if (tree->fmm) pl_fmm_delete(tree->fmm);
+  pl_fmm_cell_dispose(&tree->fmm_cell);
+
   obj_array_dispose(&tree->rigid_bodies);
   obj_array_dispose(&tree->celestial_bodies);
   free(tree);
 }
 
 
+// Mark the node and its ancestors as needing a mass distribution update. The
+// walk does not stop at dirty nodes, the linear backend only clears the root.
+static void
+pl_octtree_mark_dirty(pl_octtree_t *tree)
+{
+  while (tree) {
+    tree->dirty = true;
+    tree = tree->parent;
+  }
+}
+
+// Move the centre of gravity of the node and its ancestors along with a source
+// that moved by dp within the node, dirty nodes are recomputed anyway. The
+// linear tree is built from the source positions and has to be rebuilt.
+static void
+pl_octtree_move_source(pl_octtree_t *tree, double GM, double3 dp)
+{
+  if (GM == 0.0) return;
+
+  for ( ; tree ; tree = tree->parent) {
+    if (tree->parent == NULL && tree->linear) {
+      tree->dirty = true;
+    } else if (!tree->dirty) {
+      tree->cog += dp * (GM / tree->GM);
+    }
+  }
+}
+
+// Objects keep their index in the node array, so removal is a swap with the
+// last element followed by a slot update of the swapped object.
+static void
+pl_octtree_push_rbody(pl_octtree_t *tree, pl_object_t *body)
+{
+  body->tree_slot = ARRAY_LEN(tree->rigid_bodies);
+  obj_array_push(&tree->rigid_bodies, body);
+  body->tree = tree;
+}
+
+static void
+pl_octtree_remove_rbody(pl_octtree_t *tree, pl_object_t *body)
+{
+  assert(ARRAY_ELEM(tree->rigid_bodies, body->tree_slot) == body);
+  pl_object_t *last = obj_array_pop(&tree->rigid_bodies);
+  if (last != body) {
+    ARRAY_ELEM(tree->rigid_bodies, body->tree_slot) = last;
+    last->tree_slot = body->tree_slot;
+  }
+  body->tree = NULL;
+}
+
+static void
+pl_octtree_push_celbody(pl_octtree_t *tree, pl_celobject_t *body)
+{
+  body->tree_slot = ARRAY_LEN(tree->celestial_bodies);
+  body->tree_p = body->cm_orbit->p;
+  obj_array_push(&tree->celestial_bodies, body);
+  body->tree = tree;
+  pl_octtree_mark_dirty(tree);
+}
+
+static void
+pl_octtree_remove_celbody(pl_octtree_t *tree, pl_celobject_t *body)
+{
+  assert(ARRAY_ELEM(tree->celestial_bodies, body->tree_slot) == body);
+  pl_celobject_t *last = obj_array_pop(&tree->celestial_bodies);
+  if (last != body) {
+    ARRAY_ELEM(tree->celestial_bodies, body->tree_slot) = last;
+    last->tree_slot = body->tree_slot;
+  }
+  body->tree = NULL;
+  pl_octtree_mark_dirty(tree);
+}
+
 void
 pl_octtree_insert_rbody(pl_octtree_t *tree, pl_object_t *body)
 {
@@ -102,18 +181,17 @@ pl_octtree_insert_rbody(pl_octtree_t *tree, pl_object_t *body)
                                                                tree->width,
                                                                octant),
                                               tree->width/2.0);
+      tree->children[octant]->parent = tree;
     }
 
     if (pl_octtree_can_fit_rbody(tree->children[octant], body)) {
       pl_octtree_insert_rbody(tree->children[octant], body);
     } else {
       // Does not fit in child, put in this place anyway
-      obj_array_push(&tree->rigid_bodies, body);
-      body->tree = tree;
+      pl_octtree_push_rbody(tree, body);
     }
   } else {
-    obj_array_push(&tree->rigid_bodies, body);
-    body->tree = tree;
+    pl_octtree_push_rbody(tree, body);
   }
 }
 
@@ -130,24 +208,92 @@ pl_octtree_insert_celbody(pl_octtree_t *tree, pl_celobject_t *body)
                                                                tree->width,
                                                                octant),
                                               tree->width/2.0);
+      tree->children[octant]->parent = tree;
     }
 
     if (pl_octtree_can_fit_celbody(tree->children[octant], body)) {
       pl_octtree_insert_celbody(tree->children[octant], body);
     } else {
       // Does not fit in child, put in this place anyway
-      obj_array_push(&tree->celestial_bodies, body);
-      body->tree = tree;
+      pl_octtree_push_celbody(tree, body);
     }
   } else {
-    obj_array_push(&tree->celestial_bodies, body);
-    body->tree = tree;
+    pl_octtree_push_celbody(tree, body);
+  }
+}
+
+void
+pl_octtree_set_linear(pl_octtree_t *tree, const obj_array_t *celestial_bodies)
+{
+  if (celestial_bodies && tree->linear == NULL) {
+    tree->linear = pl_new_lintree();
+    pl_lintree_set_theta(tree->linear, PL_BHUT_THREASHOLD);
+  } else if (celestial_bodies == NULL && tree->linear) {
+    pl_lintree_delete(tree->linear);
+    tree->linear = NULL;
+  }
+  tree->linear_sources = celestial_bodies;
+  tree->dirty = true;
+}
+
+// Drop all expansions, they are recomputed on the next update
+static void
+pl_octtree_clear_fmm(pl_octtree_t *tree)
+{
+  pl_fmm_cell_dispose(&tree->fmm_cell);
+
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i]) pl_octtree_clear_fmm(tree->children[i]);
   }
 }
 
+void
+pl_octtree_set_fmm(pl_octtree_t *tree, int order)
+{
+  if (tree->fmm) {
+    pl_fmm_delete(tree->fmm);
+    tree->fmm = NULL;
+  }
+
+  // Multipoles are not maintained by the other backends
+  pl_octtree_clear_fmm(tree);
+
+  if (order > 0) {
+    tree->fmm = pl_new_fmm(order);
+  }
+  tree->dirty = true;
+}
+
+static void
+pl_octtree_update_linear(pl_octtree_t *tree)
+{
+  pl_lintree_clear(tree->linear);
+  ARRAY_FOR_EACH(i, *tree->linear_sources) {
+    pl_celobject_t *celobj = ARRAY_ELEM(*tree->linear_sources, i);
+    lwcoord_t p = pl_celobject_get_lwc(celobj);
+    pl_lintree_add(tree->linear, &p, celobj->cm_orbit->GM);
+  }
+  pl_lintree_build(tree->linear);
+}
+
 void
 pl_octtree_update_gravity(pl_octtree_t *tree)
 {
+  // Targets move every step, so the multipole pass always runs
+  if (tree->fmm) {
+    pl_fmm_compute(tree->fmm, tree);
+    return;
+  }
+
+  if (!tree->dirty) return;
+
+  if (tree->linear) {
+    // The linear tree is rebuilt from scratch, but only when something moved
+    pl_octtree_update_linear(tree);
+    tree->dirty = false;
+    return;
+  }
+
   double3 cog = vd3_set(0.0, 0.0, 0.0);
   double GM = 0.0;
 
@@ -165,23 +311,23 @@ pl_octtree_update_gravity(pl_octtree_t *tree)
     GM += celobj->cm_orbit->GM;
   }
 
-  cog = cog / GM;
-  tree->cog = cog;
+  tree->cog = (GM > 0.0) ? cog / GM : cog;
   tree->GM = GM;
+  tree->dirty = false;
 }
 
-double3
-pl_octtree_compute_gravity(pl_octtree_t *tree, pl_object_t *body)
+// Barnes-Hut field, the acceleration at p
+static double3
+pl_octtree_bhut_field(const pl_octtree_t *tree, double3 p)
 {
   double3 g = vd3_set(0, 0, 0);
-  double3 body_p = lwc_globald(&body->p);
 
   // First add the gravity for all the celestial bodies in this cell
   ARRAY_FOR_EACH(i, tree->celestial_bodies) {
     pl_celobject_t *celobj = ARRAY_ELEM(tree->celestial_bodies, i);
-    double3 dv = body_p - celobj->cm_orbit->p;
+    double3 dv = p - celobj->cm_orbit->p;
     double d = vd3_abs(dv);
-    g += vd3_s_mul(vd3_normalise(dv), -celobj->cm_orbit->GM * body->m.m / (d * d));
+    g += vd3_s_mul(vd3_normalise(dv), -celobj->cm_orbit->GM / (d * d));
   }
 
   // Secondly, check each subnode and add gravity, either the aggregate for the
@@ -189,15 +335,14 @@ pl_octtree_compute_gravity(pl_octtree_t *tree, pl_object_t *body)
   // recurse if GM of the child is 0.
   for (int i = 0 ; i < 8 ; i ++) {
     if (tree->children[i] != NULL) {
-      double3 dv = body_p - tree->children[i]->cog;
+      double3 dv = p - tree->children[i]->cog;
       double d = vd3_abs(dv);
 
       if (tree->children[i]->GM > 0.0) {
         if (tree->children[i]->width / d < PL_BHUT_THREASHOLD) {
-          g += vd3_s_mul(vd3_normalise(dv),
-                         -tree->children[i]->GM * body->m.m / (d * d));
+          g += vd3_s_mul(vd3_normalise(dv), -tree->children[i]->GM / (d * d));
         } else {
-          g += pl_octtree_compute_gravity(tree->children[i], body);
+          g += pl_octtree_bhut_field(tree->children[i], p);
         }
       }
     }
@@ -206,29 +351,71 @@ pl_octtree_compute_gravity(pl_octtree_t *tree, pl_object_t *body)
   return g;
 }
 
+double3
+pl_octtree_compute_gravity(pl_octtree_t *tree, pl_object_t *body)
+{
+  if (tree->linear) {
+    return pl_lintree_compute_gravity(tree->linear, &body->p, body->m.m);
+  }
+
+  if (tree->fmm) {
+    return body->g_field * body->m.m;
+  }
+
+  return pl_octtree_bhut_field(tree, lwc_globald(&body->p)) * body->m.m;
+}
+
+double3
+pl_octtree_gravity_at(pl_octtree_t *tree, const lwcoord_t *p)
+{
+  if (tree->linear) {
+    return pl_lintree_compute_gravity(tree->linear, p, 1.0);
+  }
+
+  // The multipole pass keeps the Barnes-Hut data valid, so this works for
+  // arbitrary points in the FMM mode as well
+  return pl_octtree_bhut_field(tree, lwc_globald(p));
+}
+
+
+// True if obj fits in the child of tree in the octant of its position, the
+// child does not have to exist
+static bool
+pl_octtree_can_fit_octant(const pl_octtree_t *tree, const pl_object_t *obj)
+{
+  double3 p = lwc_globald(&obj->p);
+  double3 dist = p - vd3_octant_split(tree->center, tree->width,
+                                      vd3_octant(tree->center, p));
+  double w = tree->width * 0.25;
+
+  return fabs(dist.x) + obj->radius <= w
+      && fabs(dist.y) + obj->radius <= w
+      && fabs(dist.z) + obj->radius <= w;
+}
 
 // When an object moves, it may have to move into another octtree node
 void
 pl_object_update_octtree(pl_object_t *obj)
 {
-  // Did not leave the current tree node, we ignore and do nothing
-  if (pl_octtree_can_fit_rbody(obj->tree, obj)) return;
-
-  pl_octtree_t *tree = obj->tree->parent;
-  // Remove from current tree node
-
-  // TODO: We probably want a list here instead of an array, on the other hand
-  //       a list will conflict with parallelization of collission detection.
-  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
-    if (ARRAY_ELEM(tree->rigid_bodies, i) == obj) {
-      obj_array_remove(&tree->rigid_bodies, i);
-      break;
+  pl_octtree_t *tree = obj->tree;
+
+  // Did not leave the current tree node. Objects are inserted before they are
+  // positioned, so sink the object if the node is crowded and it fits in a
+  // child, otherwise the node would keep growing.
+  if (pl_octtree_can_fit_rbody(tree, obj)) {
+    if (ARRAY_LEN(tree->rigid_bodies) > PL_OCTTREE_MAX_OBJS
+        && pl_octtree_can_fit_octant(tree, obj)) {
+      pl_octtree_remove_rbody(tree, obj);
+      pl_octtree_insert_rbody(tree, obj);
     }
+    return;
   }
 
-  // Insert in parent where it fits
-  // If an object does not fit in the root we crash at the moment
-  while (!pl_octtree_can_fit_rbody(tree, obj)) {
+  pl_octtree_remove_rbody(tree, obj);
+
+  // Insert in parent where it fits, objects that do not fit in the root are
+  // kept in the root
+  while (tree->parent && !pl_octtree_can_fit_rbody(tree, obj)) {
     tree = tree->parent;
   }
   pl_octtree_insert_rbody(tree, obj);
@@ -239,26 +426,297 @@ pl_object_update_octtree(pl_object_t *obj)
 void
 pl_celobject_update_octtree(pl_celobject_t *obj)
 {
-  // Did not leave the current tree node, we ignore and do nothing
-  if (pl_octtree_can_fit_celbody(obj->tree, obj)) return;
-
-  pl_octtree_t *tree = obj->tree->parent;
-  // Remove from current tree node
-
-  // TODO: We probably want a list here instead of an array, on the other hand
-  //       a list will conflict with parallelization of collission detection.
-  ARRAY_FOR_EACH(i, tree->celestial_bodies) {
-    if (ARRAY_ELEM(tree->celestial_bodies, i) == obj) {
-      obj_array_remove(&tree->celestial_bodies, i);
-      break;
+  // Did not leave the current tree node, only the node mass distribution need
+  // to be updated
+  if (pl_octtree_can_fit_celbody(obj->tree, obj)) {
+    double3 dp = obj->cm_orbit->p - obj->tree_p;
+    if (vd3_abs(dp) > 0.0) {
+      obj->tree_p = obj->cm_orbit->p;
+      pl_octtree_move_source(obj->tree, obj->cm_orbit->GM, dp);
     }
+    return;
   }
 
-  // Insert in parent where it fits
-  // If an object does not fit in the root we crash at the moment
-  while (!pl_octtree_can_fit_celbody(tree, obj)) {
+  pl_octtree_t *tree = obj->tree;
+  pl_octtree_remove_celbody(tree, obj);
+
+  // Insert in parent where it fits, objects that do not fit in the root are
+  // kept in the root
+  while (tree->parent && !pl_octtree_can_fit_celbody(tree, obj)) {
     tree = tree->parent;
   }
   pl_octtree_insert_celbody(tree, obj);
 }
 
+// Squared distance from p to the cube of tree, zero if p is inside
+static double
+pl_octtree_box_dist2(const pl_octtree_t *tree, double3 p)
+{
+  double3 d = p - tree->center;
+  double w = tree->width * 0.5;
+  double dx = fmax(fabs(d.x) - w, 0.0);
+  double dy = fmax(fabs(d.y) - w, 0.0);
+  double dz = fmax(fabs(d.z) - w, 0.0);
+  return dx * dx + dy * dy + dz * dz;
+}
+
+// The objects in a node are inside its cube, except for the root which keeps
+// the objects that do not fit anywhere, so the root objects are always tested
+// and only the children are culled.
+
+static void
+pl_octtree_query_radius_node(const pl_octtree_t *tree, const lwcoord_t *p,
+                             double3 gp, double r, obj_array_t *result)
+{
+  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(tree->rigid_bodies, i);
+    double3 d = lwc_dist(&obj->p, p);
+    if (vd3_dot(d, d) <= r * r) {
+      obj_array_push(result, obj);
+    }
+  }
+
+  for (int i = 0 ; i < 8 ; i ++) {
+    const pl_octtree_t *child = tree->children[i];
+    if (child && pl_octtree_box_dist2(child, gp) <= r * r) {
+      pl_octtree_query_radius_node(child, p, gp, r, result);
+    }
+  }
+}
+
+size_t
+pl_octtree_query_radius(const pl_octtree_t *tree, const lwcoord_t *p,
+                        double r, obj_array_t *result)
+{
+  size_t len = ARRAY_LEN(*result);
+  pl_octtree_query_radius_node(tree, p, lwc_globald(p), r, result);
+  return ARRAY_LEN(*result) - len;
+}
+
+static void
+pl_octtree_query_box_node(const pl_octtree_t *tree, const lwcoord_t *centre,
+                          double3 gc, double3 half, obj_array_t *result)
+{
+  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(tree->rigid_bodies, i);
+    double3 d = lwc_dist(&obj->p, centre);
+    if (fabs(d.x) <= half.x && fabs(d.y) <= half.y && fabs(d.z) <= half.z) {
+      obj_array_push(result, obj);
+    }
+  }
+
+  for (int i = 0 ; i < 8 ; i ++) {
+    const pl_octtree_t *child = tree->children[i];
+    if (child == NULL) continue;
+
+    double3 d = child->center - gc;
+    double w = child->width * 0.5;
+    if (fabs(d.x) <= half.x + w && fabs(d.y) <= half.y + w
+        && fabs(d.z) <= half.z + w) {
+      pl_octtree_query_box_node(child, centre, gc, half, result);
+    }
+  }
+}
+
+size_t
+pl_octtree_query_box(const pl_octtree_t *tree, const lwcoord_t *centre,
+                     double3 half, obj_array_t *result)
+{
+  size_t len = ARRAY_LEN(*result);
+  pl_octtree_query_box_node(tree, centre, lwc_globald(centre), half, result);
+  return ARRAY_LEN(*result) - len;
+}
+
+// Bounded max-heap of the k nearest objects found so far
+typedef struct {
+  size_t k, len;
+  double *d2;
+  pl_object_t **objs;
+} pl_octtree_knn_t;
+
+static void
+pl_octtree_knn_sift_down(pl_octtree_knn_t *knn, size_t i)
+{
+  for (;;) {
+    size_t largest = i;
+    size_t l = 2 * i + 1, r = 2 * i + 2;
+    if (l < knn->len && knn->d2[l] > knn->d2[largest]) largest = l;
+    if (r < knn->len && knn->d2[r] > knn->d2[largest]) largest = r;
+    if (largest == i) return;
+
+    double d2 = knn->d2[i];
+    pl_object_t *obj = knn->objs[i];
+    knn->d2[i] = knn->d2[largest];
+    knn->objs[i] = knn->objs[largest];
+    knn->d2[largest] = d2;
+    knn->objs[largest] = obj;
+    i = largest;
+  }
+}
+
+static void
+pl_octtree_knn_add(pl_octtree_knn_t *knn, pl_object_t *obj, double d2)
+{
+  if (knn->len < knn->k) {
+    size_t i = knn->len ++;
+    while (i > 0 && knn->d2[(i - 1) / 2] < d2) {
+      knn->d2[i] = knn->d2[(i - 1) / 2];
+      knn->objs[i] = knn->objs[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    knn->d2[i] = d2;
+    knn->objs[i] = obj;
+  } else if (d2 < knn->d2[0]) {
+    knn->d2[0] = d2;
+    knn->objs[0] = obj;
+    pl_octtree_knn_sift_down(knn, 0);
+  }
+}
+
+static void
+pl_octtree_query_nearest_node(const pl_octtree_t *tree, const lwcoord_t *p,
+                              double3 gp, pl_octtree_knn_t *knn)
+{
+  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(tree->rigid_bodies, i);
+    double3 d = lwc_dist(&obj->p, p);
+    pl_octtree_knn_add(knn, obj, vd3_dot(d, d));
+  }
+
+  // Visit the closest children first, so the search radius shrinks fast
+  int order[8];
+  double dist[8];
+  int n = 0;
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i] == NULL) continue;
+    double d2 = pl_octtree_box_dist2(tree->children[i], gp);
+    int j = n ++;
+    while (j > 0 && dist[j - 1] > d2) {
+      dist[j] = dist[j - 1];
+      order[j] = order[j - 1];
+      j --;
+    }
+    dist[j] = d2;
+    order[j] = i;
+  }
+
+  for (int i = 0 ; i < n ; i ++) {
+    if (knn->len == knn->k && dist[i] >= knn->d2[0]) break;
+    pl_octtree_query_nearest_node(tree->children[order[i]], p, gp, knn);
+  }
+}
+
+size_t
+pl_octtree_query_nearest(const pl_octtree_t *tree, const lwcoord_t *p,
+                         size_t k, obj_array_t *result)
+{
+  if (k == 0) return 0;
+
+  pl_octtree_knn_t knn;
+  knn.k = k;
+  knn.len = 0;
+  knn.d2 = smalloc(k * sizeof(double));
+  knn.objs = smalloc(k * sizeof(pl_object_t*));
+
+  pl_octtree_query_nearest_node(tree, p, lwc_globald(p), &knn);
+
+  // Popping the heap gives the objects farthest first
+  size_t found = knn.len;
+  size_t len = ARRAY_LEN(*result);
+  for (size_t i = 0 ; i < found ; i ++) {
+    obj_array_push(result, NULL);
+  }
+  while (knn.len > 0) {
+    ARRAY_ELEM(*result, len + knn.len - 1) = knn.objs[0];
+    knn.len --;
+    knn.d2[0] = knn.d2[knn.len];
+    knn.objs[0] = knn.objs[knn.len];
+    pl_octtree_knn_sift_down(&knn, 0);
+  }
+
+  free(knn.d2);
+  free(knn.objs);
+  return found;
+}
+
+typedef struct {
+  const lwcoord_t *origin;
+  double3 go; // Global origin
+  double3 dir;
+  double3 inv_dir;
+  const pl_object_t *ignore;
+  pl_object_t *hit;
+  double t; // Distance to the hit, or the maximum distance if none
+} pl_octtree_ray_t;
+
+// True if the ray enters the cube of tree before the current hit
+static bool
+pl_octtree_ray_box(const pl_octtree_t *tree, const pl_octtree_ray_t *ray)
+{
+  double w = tree->width * 0.5;
+  double3 half = vd3_set(w, w, w);
+  double3 lo = (tree->center - half - ray->go) * ray->inv_dir;
+  double3 hi = (tree->center + half - ray->go) * ray->inv_dir;
+  double t0 = 0.0, t1 = ray->t;
+
+  t0 = fmax(t0, fmin(lo.x, hi.x));
+  t1 = fmin(t1, fmax(lo.x, hi.x));
+  t0 = fmax(t0, fmin(lo.y, hi.y));
+  t1 = fmin(t1, fmax(lo.y, hi.y));
+  t0 = fmax(t0, fmin(lo.z, hi.z));
+  t1 = fmin(t1, fmax(lo.z, hi.z));
+  return t0 <= t1;
+}
+
+static void
+pl_octtree_query_ray_node(const pl_octtree_t *tree, pl_octtree_ray_t *ray)
+{
+  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(tree->rigid_bodies, i);
+    if (obj == ray->ignore) continue;
+
+    double3 d = lwc_dist(&obj->p, ray->origin);
+    double tca = vd3_dot(d, ray->dir);
+    double h2 = obj->radius * obj->radius - (vd3_dot(d, d) - tca * tca);
+    if (h2 < 0.0) continue;
+
+    double h = sqrt(h2);
+    double t = tca - h;
+    if (t < 0.0) {
+      if (tca + h < 0.0) continue; // Behind the origin
+      t = 0.0; // The origin is inside the object
+    }
+    if (t < ray->t) {
+      ray->t = t;
+      ray->hit = obj;
+    }
+  }
+
+  for (int i = 0 ; i < 8 ; i ++) {
+    const pl_octtree_t *child = tree->children[i];
+    if (child && pl_octtree_ray_box(child, ray)) {
+      pl_octtree_query_ray_node(child, ray);
+    }
+  }
+}
+
+pl_object_t*
+pl_octtree_query_ray(const pl_octtree_t *tree, const lwcoord_t *origin,
+                     double3 dir, double max_dist, const pl_object_t *ignore,
+                     double *dist)
+{
+  pl_octtree_ray_t ray;
+  ray.origin = origin;
+  ray.go = lwc_globald(origin);
+  ray.dir = dir / vd3_abs(dir);
+  // Infinite along the axes the ray is parallel to
+  ray.inv_dir = vd3_set(1.0 / ray.dir.x, 1.0 / ray.dir.y, 1.0 / ray.dir.z);
+  ray.ignore = ignore;
+  ray.hit = NULL;
+  ray.t = max_dist;
+
+  pl_octtree_query_ray_node(tree, &ray);
+
+  if (ray.hit && dist) *dist = ray.t;
+  return ray.hit;
+}
@@ -21,12 +21,15 @@
 #ifndef orbit_octtree_h
 #define orbit_octtree_h
 
+#include <stdbool.h>
 #include <vmath/vmath.h>
 #include <gencds/array.h>
 
 #include "physics/reftypes.h"
 #include "physics/object.h"
 #include "physics/celestial-object.h"
+#include "physics/linear-octtree.h"
+#include "physics/fmm.h"
 
 // There are two things to keep in mind here. Firstly, the octtrees are used
 // for two things. One is for spatial partitioning of objects. This helps with
@@ -43,20 +46,77 @@ struct pl_octtree_t {
   double3 center;
   double3 cog;
   double GM;
+  bool dirty; // The mass distribution of this node must be recomputed
 
   obj_array_t celestial_bodies;
   obj_array_t rigid_bodies;
 
   struct pl_octtree_t *parent;
   struct pl_octtree_t *children[8];
+
+  // Only set in the root, when non-NULL gravity is computed with the linear
+  // tree built from the celestial bodies in linear_sources.
+  pl_lintree_t *linear;
+  const obj_array_t *linear_sources;
+
+  // Only set in the root, when non-NULL gravity is computed with the fast
+  // multipole solver.
+  pl_fmm_t *fmm;
+
+  pl_fmm_cell_t fmm_cell;
 };
 
 pl_octtree_t* pl_new_octtree(double3 center, double width);
 void pl_octtree_delete(pl_octtree_t *tree);
 
+/*! Select the pointer free Barnes-Hut tree as gravity backend.
+    \param tree Root of the octtree
+    \param celestial_bodies Array of all celestial bodies, or NULL to switch
+           back to the pointer based tree.
+ */
+void pl_octtree_set_linear(pl_octtree_t *tree,
+                           const obj_array_t *celestial_bodies);
+
+/*! Select the fast multipole solver as gravity backend.
+    \param tree Root of the octtree
+    \param order Expansion order, or 0 to switch back to Barnes-Hut.
+ */
+void pl_octtree_set_fmm(pl_octtree_t *tree, int order);
+
+/*! Recompute cog and GM of the nodes marked as dirty. Nodes are marked when
+    celestial bodies are inserted or removed, and a dirty node always has dirty
+    ancestors, so clean subtrees are skipped entirely. Bodies moving within
+    their node update the cog of the node and its ancestors in place. The
+    linear backend is still rebuilt whenever a body moves.
+ */
 void pl_octtree_update_gravity(pl_octtree_t *tree);
 
 double3 pl_octtree_compute_gravity(pl_octtree_t *tree, pl_object_t *body);
+/*! Gravitational acceleration at an arbitrary point */
+double3 pl_octtree_gravity_at(pl_octtree_t *tree, const lwcoord_t *p);
+
+/*! Append the rigid bodies with their centre within r of p to result
+    \return Number of bodies found */
+size_t pl_octtree_query_radius(const pl_octtree_t *tree, const lwcoord_t *p,
+                               double r, obj_array_t *result);
+/*! Append the k rigid bodies closest to p to result, closest first
+    \return Number of bodies found, less than k if there are fewer bodies */
+size_t pl_octtree_query_nearest(const pl_octtree_t *tree, const lwcoord_t *p,
+                                size_t k, obj_array_t *result);
+/*! Append the rigid bodies with their centre in the box with the given centre
+    and half extents to result
+    \return Number of bodies found */
+size_t pl_octtree_query_box(const pl_octtree_t *tree, const lwcoord_t *centre,
+                            double3 half, obj_array_t *result);
+/*! Find the first rigid body hit by a ray, bodies are spheres of their radius
+    \param ignore Body not tested, typically the one casting the ray, or NULL
+    \param dist Set to the distance to the hit, if there is one
+    \return The body hit within max_dist, or NULL
+ */
+pl_object_t* pl_octtree_query_ray(const pl_octtree_t *tree,
+                                  const lwcoord_t *origin, double3 dir,
+                                  double max_dist, const pl_object_t *ignore,
+                                  double *dist);
 
 void pl_octtree_insert_rbody(pl_octtree_t *tree, pl_object_t *body);
 void pl_octtree_insert_celbody(pl_octtree_t *tree, pl_celobject_t *body);
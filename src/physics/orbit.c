@@ -22,6 +22,7 @@
 #include <string.h>
 
 #include "physics/orbit.h"
+#include "physics/kepler.h"
 
 #include "physics/physics.h"
 
@@ -101,66 +102,6 @@ plMeanMotion(long double u, long double a)
   return sqrtl(u/(a*a*a));
 }
 
-/*!
-  Computes the estimate of the next eccentric anomaly
- \param E_i Eccentric anomaly of previous step, initialise to n*t.
- \param ecc Eccentricity of orbital ellipse
- \param m Mean anomaly
- */
-long double
-plEccAnomalityStep(long double E_i, long double ecc, long double m)
-{
-  return E_i - ( (E_i-ecc*sinl(E_i)-m) / (1-ecc*cosl(E_i)) );
-}
-
-/*!
-  Computes the eccentric anomaly for time t, t = 0 is assumed to be when the
-  object pass through its periapsis.
-
-  The method solves this by making a few iterations with newton-rapson, for
-  equations, see celestial mechanics chapter in Fortescue, Stark and Swinerd's
-  Spacecraft Systems Engineering.
-
-  The eccentric anomaly can be used to solve the position of an orbiting object.
-
-  Note on units: n and t should be compatible, n is composed of the GM and a, GM
-  in terms is defined in distance / time, and a is the orbits semi-major axis.
-  Thus good units for usage are for example: time = earth days or years, and
-  distance = m, km or au.
-
-  \param ecc Eccentricity of orbit
-  \param n Mean motion around object
-  \param t Absolute time for which we want the eccentric anomaly.
- */
-long double
-pl_ecc_anomaly(long double ecc, long double n, long double t)
-{
-  // 7.37 mm accuracy for an object at the distance of the dwarf-planet Pluto
-#define ERR_LIMIT 0.000000000001l
-  long double meanAnomaly = n * t;
-
-  long double E_1 = plEccAnomalityStep(meanAnomaly, ecc, meanAnomaly);
-  long double E_2 = plEccAnomalityStep(E_1, ecc, meanAnomaly);
-
-  long double E_i = E_1;
-  long double E_i1 = E_2;
-  int i = 0;
-
-  while (fabsl(E_i1-E_i) > ERR_LIMIT) {
-    E_i = E_i1;
-    E_i1 = plEccAnomalityStep(E_i, ecc, meanAnomaly);
-    i ++;
-
-    if (i > 10) {
-      log_warn("ecc anomaly did not converge in %d iters, err = %.16f", i, fabs(E_i1-E_i));
-      break;
-    }
-  }
-
-  log_trace("ecc anomaly solved in %d iters", i);
-  return E_i1;
-#undef ERR_LIMIT
-}
 quaternion_t
 pl_orbital_quaternion(pl_keplerelems_t *kepler)
 {
@@ -22,25 +22,56 @@
 
 #include <stdlib.h>
 #include <assert.h>
-#include "physics/orbit.h"
+#include <math.h>
 #include "common/palloc.h"
 
-static float3
-random_direction(float ra, float dec, float maxOffsetAngle)
+// Per system xorshift64* generator, much cheaper than random() and keeps
+// particle systems independent of each other and of other random() users.
+static inline uint64_t
+pl_particles_rand(pl_particles_t *ps)
 {
-  // TODO: Generate direction with gaussian distribution?
-
-  // Random direction
-  long dir = (random() % 1000) + 1;
-  float dirf = (float)(2.0f * M_PI / (float)dir);
+  uint64_t x = ps->rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  ps->rng = x;
+  return x * UINT64_C(2685821657736338717);
+}
 
-  // Random offset angle in direction
-  float offsetAngle = maxOffsetAngle / (float)((random() % 99) + 1);
+// Uniform float in [0, 1)
+static inline float
+pl_particles_randf(pl_particles_t *ps)
+{
+  return (float)(pl_particles_rand(ps) >> 40) * (1.0f / 16777216.0f);
+}
 
-  return equ2cart_f(ra + offsetAngle * sinf(dirf),
-                    dec + offsetAngle * cosf(dirf));
+// Uniform offset in [-a, a) percent, as a fraction
+static inline float
+pl_particles_rand_percent(pl_particles_t *ps, float a)
+{
+  return (2.0f * pl_particles_randf(ps) - 1.0f) * a * 0.01f;
 }
 
+// Number of particle systems created, mixed into the seeds so that systems
+// with the same name emit different streams
+static uint64_t pl_particles_created;
+
+// Seed from the name (FNV-1a) and the creation order, so that systems are
+// reproducible between runs
+static uint64_t
+pl_particles_seed(const char *name)
+{
+  uint64_t h = UINT64_C(14695981039346656037);
+  for (const char *c = name ? name : "" ; *c ; c ++) {
+    h ^= (unsigned char)*c;
+    h *= UINT64_C(1099511628211);
+  }
+  h ^= ++ pl_particles_created * UINT64_C(0x9e3779b97f4a7c15);
+  h ^= h >> 33;
+  h *= UINT64_C(0xff51afd7ed558ccd);
+  h ^= h >> 33;
+  return h ? h : 1;
+}
 
 pl_particles_t*
 pl_new_particle_system(const char *name, size_t particleCount)
@@ -49,14 +80,15 @@ pl_new_particle_system(const char *name, size_t particleCount)
   ps->enabled = false;
   ps->autoDisable = false;
   ps->particleCount = particleCount;
+  ps->alive = 0;
   ps->obj = NULL;
-  // Note: calloc initialise all fields to 0
-  ps->particles = calloc(particleCount, sizeof(pl_particle_t));
+  ps->rng = pl_particles_seed(name);
 
-  int_array_init(&ps->freeParticles);
-  for (int i = 0 ; i < particleCount ; ++ i) {
-    int_array_push(&ps->freeParticles, i);
-  }
+  ps->part_age = smalloc(particleCount * sizeof(float));
+  ps->part_lifetime = smalloc(particleCount * sizeof(float));
+  ps->part_rgb = smalloc(particleCount * sizeof(float3));
+  ps->part_p = smalloc(particleCount * sizeof(double3));
+  ps->part_v = smalloc(particleCount * sizeof(double3));
 
   return ps;
 }
@@ -88,7 +120,11 @@ void
 pl_particles_delete(pl_particles_t *ps)
 {
   assert(ps != NULL);
-  free(ps->particles);
+  free(ps->part_age);
+  free(ps->part_lifetime);
+  free(ps->part_rgb);
+  free(ps->part_p);
+  free(ps->part_v);
   free(ps);
 }
 
@@ -121,9 +157,16 @@ pl_particles_disable(pl_particles_t *ps)
   ps->enabled = false;
 }
 
-float rand_percent(int a)
+// Move the last alive particle into slot i
+static inline void
+pl_particles_retire(pl_particles_t *ps, size_t i)
 {
-  return ((float)(random() % a*2 - a)) * 0.01;
+  size_t last = -- ps->alive;
+  ps->part_age[i] = ps->part_age[last];
+  ps->part_lifetime[i] = ps->part_lifetime[last];
+  ps->part_rgb[i] = ps->part_rgb[last];
+  ps->part_p[i] = ps->part_p[last];
+  ps->part_v[i] = ps->part_v[last];
 }
 
 void
@@ -132,24 +175,22 @@ pl_particles_step(pl_particles_t *ps, float dt)
   assert(ps != NULL);
   if (ps->enabled == false) return;
 
-  size_t activeParticles = 0;
-  for (size_t i = 0 ; i < ps->particleCount ; ++i) {
-    if (ps->particles[i].active) {
-      ps->particles[i].p += vd3_s_mul(ps->particles[i].v, dt) + vd3_s_mul(ps->obj->v, dt);
-      ps->particles[i].age += dt;
-      activeParticles++;
-
-      if (ps->particles[i].age > ps->particles[i].lifeTime) {
-        ps->particles[i].active = false;
-        int_array_push(&ps->freeParticles, i);
-        activeParticles --;
-      }
+  double3 drift = ps->obj->v;
+  for (size_t i = 0 ; i < ps->alive ; ) {
+    ps->part_p[i] += (ps->part_v[i] + drift) * dt;
+    ps->part_age[i] += dt;
+
+    if (ps->part_age[i] > ps->part_lifetime[i]) {
+      // Slot i now holds a particle that has not been stepped yet
+      pl_particles_retire(ps, i);
+    } else {
+      i ++;
     }
   }
 
   // Auto disable
   if (ps->autoDisable) {
-    if (activeParticles == 0) {
+    if (ps->alive == 0) {
       ps->enabled = false;
     }
 
@@ -157,27 +198,30 @@ pl_particles_step(pl_particles_t *ps, float dt)
   }
 
   // Not off or disabled, emitt new particles
-  float newPartCount = ps->emissionRate * dt * (1.0 + rand_percent(10));
+  float newPartCount = ps->emissionRate * dt
+                     * (1.0f + pl_particles_rand_percent(ps, 10.0f));
   float intPart;
   float frac = modff(newPartCount, &intPart);
-  unsigned newParticles = (unsigned) intPart;
+  size_t newParticles = (size_t) intPart;
 
   // The fraction is handled with randomisation
-  int rval = random() % 128;
-  if ((float)rval/128.0f < frac) newParticles ++;
-
-  for (unsigned i = 0 ; i < newParticles ; ++i) {
-    if (ps->freeParticles.length > 0) {
-      int i = int_array_remove(&ps->freeParticles, 0);
-      ps->particles[i].active = true;
-      ps->particles[i].age = 0.0;
-      // Adjust lifetime by +-20 %
-      ps->particles[i].lifeTime = ps->lifeTime + ps->lifeTime * rand_percent(20);
-      ps->particles[i].p = vd3_qd_rot(ps->p, ps->obj->q);
-      ps->particles[i].v = vd3_qd_rot(ps->v * vd3_set(rand_percent(10), rand_percent(10), rand_percent(10)), ps->obj->q);
-      ps->particles[i].rgb = ps->rgb;
-    } else {
-      break;
-    }
+  if (pl_particles_randf(ps) < frac) newParticles ++;
+
+  size_t free_slots = ps->particleCount - ps->alive;
+  if (newParticles > free_slots) newParticles = free_slots;
+
+  double3 p = vd3_qd_rot(ps->p, ps->obj->q);
+  for (size_t n = 0 ; n < newParticles ; ++n) {
+    size_t i = ps->alive ++;
+    ps->part_age[i] = 0.0f;
+    // Adjust lifetime by +-20 %
+    ps->part_lifetime[i] = ps->lifeTime
+                         + ps->lifeTime * pl_particles_rand_percent(ps, 20.0f);
+    ps->part_p[i] = p;
+    double3 scale = vd3_set(pl_particles_rand_percent(ps, 10.0f),
+                            pl_particles_rand_percent(ps, 10.0f),
+                            pl_particles_rand_percent(ps, 10.0f));
+    ps->part_v[i] = vd3_qd_rot(ps->v * scale, ps->obj->q);
+    ps->part_rgb[i] = ps->rgb;
   }
 }
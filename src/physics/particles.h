@@ -20,6 +20,7 @@
 #ifndef PL_PARTICLES_H
 #define PL_PARTICLES_H
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "rendering/scenegraph.h"
@@ -27,17 +28,6 @@
 #include <vmath/vmath.h>
 #include "physics/object.h"
 
-struct pl_particle_t {
-  bool active;
-  float	age; // Age of particles
-  float	lifeTime; // lifetime
-  float fadeFactor;
-  float3 rgb; // Colour
-  double3 p; // Position
-  double3 v; // Velocity
-  float3 s; // Size
-};
-
 struct pl_particles_t {
   pl_object_t *obj; // Object the particle generator is attached to
   //GLuint texture;
@@ -47,17 +37,22 @@ struct pl_particles_t {
   double3 v; // Default velocity vector for new particle
   float emissionRate; // Emmission rate of particles
   float lifeTime; // Average life of paticles
-  size_t particleCount; // Maximum particles in system, old particles are simply
-                        // deleted if they are needed.
-  size_t particleMask; // Particle count mask, particle count must be power of
-                       // two
-  size_t oldestParticleIdx;
-  size_t newestParticleIdx;
+  size_t particleCount; // Maximum particles in system, no new particles are
+                        // emitted when all are alive.
+  size_t alive; // Particles 0 to alive - 1 are alive, the rest are free
   bool enabled; // Should we simulate the particle system at all?
   bool autoDisable; // Do not emit new particles, and disable when no particles are alive
 
-  pl_particle_t *particles;
-  int_array_t freeParticles;
+  uint64_t rng; // Random number generator state, never zero
+
+  // Particle state as structure of arrays, each particleCount long. Retired
+  // particles are swapped with the last alive one, so the alive particles are
+  // always dense.
+  float *part_age; // Age of particles
+  float *part_lifetime; // Lifetime of particles
+  float3 *part_rgb; // Colour
+  double3 *part_p; // Position
+  double3 *part_v; // Velocity
 };
 
 
@@ -69,6 +64,9 @@ void pl_particles_set_emitter_direction3f(pl_particles_t *ps, float x, float y,
 
 void pl_particles_enable(pl_particles_t *ps);
 void pl_particles_disable(pl_particles_t *ps);
+/*! Stop emitting particles, the system is disabled once all particles have
+    expired. */
+void pl_particles_turn_off(pl_particles_t *ps);
 
 void pl_particles_set_emission_rate(pl_particles_t *ps, float er);
 
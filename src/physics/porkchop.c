@@ -0,0 +1,205 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openorbit/log.h>
+
+#include "common/palloc.h"
+#include "physics/physics.h"
+#include "physics/porkchop.h"
+#include "physics/lambert.h"
+#include "physics/celestial-object.h"
+
+pl_porkchop_t*
+pl_new_porkchop(double dep_jd0, double dep_jd1, size_t dep_count,
+                double arr_jd0, double arr_jd1, size_t arr_count)
+{
+  pl_porkchop_t *pc = smalloc(sizeof(pl_porkchop_t));
+  pc->dep_count = dep_count;
+  pc->arr_count = arr_count;
+
+  pc->dep_jd = smalloc(dep_count * sizeof(double));
+  pc->arr_jd = smalloc(arr_count * sizeof(double));
+  pc->dep_r = smalloc(dep_count * sizeof(double3));
+  pc->dep_v = smalloc(dep_count * sizeof(double3));
+  pc->arr_r = smalloc(arr_count * sizeof(double3));
+  pc->arr_v = smalloc(arr_count * sizeof(double3));
+  pc->dv_dep = smalloc(dep_count * arr_count * sizeof(float));
+  pc->dv_arr = smalloc(dep_count * arr_count * sizeof(float));
+
+  for (size_t i = 0 ; i < dep_count ; i ++) {
+    pc->dep_jd[i] = dep_count > 1
+                  ? dep_jd0 + (dep_jd1 - dep_jd0) * i / (dep_count - 1)
+                  : dep_jd0;
+  }
+  for (size_t i = 0 ; i < arr_count ; i ++) {
+    pc->arr_jd[i] = arr_count > 1
+                  ? arr_jd0 + (arr_jd1 - arr_jd0) * i / (arr_count - 1)
+                  : arr_jd0;
+  }
+  return pc;
+}
+
+void
+pl_porkchop_delete(pl_porkchop_t *pc)
+{
+  free(pc->dep_jd);
+  free(pc->arr_jd);
+  free(pc->dep_r);
+  free(pc->dep_v);
+  free(pc->arr_r);
+  free(pc->arr_v);
+  free(pc->dv_dep);
+  free(pc->dv_arr);
+  free(pc);
+}
+
+void
+pl_porkchop_set_tasks(pl_porkchop_t *pc, task_pool_t *tasks)
+{
+  pc->tasks = tasks;
+}
+
+// Move the celestial objects to jd, from the ephemeris cache if possible
+static void
+pl_porkchop_set_time(pl_world_t *world, double jd)
+{
+  if (world->ephemeris == NULL || !pl_ephemeris_update(world->ephemeris, jd)) {
+    cm_orbit_compute(jd);
+  }
+}
+
+void
+pl_porkchop_sample(pl_porkchop_t *pc, pl_world_t *world,
+                   pl_celobject_t *dep, pl_celobject_t *arr,
+                   pl_celobject_t *central)
+{
+  pc->GM = central->cm_orbit->GM;
+
+  for (size_t i = 0 ; i < pc->dep_count ; i ++) {
+    pl_porkchop_set_time(world, pc->dep_jd[i]);
+    pc->dep_r[i] = dep->cm_orbit->p - central->cm_orbit->p;
+    pc->dep_v[i] = dep->cm_orbit->v - central->cm_orbit->v;
+  }
+  for (size_t i = 0 ; i < pc->arr_count ; i ++) {
+    pl_porkchop_set_time(world, pc->arr_jd[i]);
+    pc->arr_r[i] = arr->cm_orbit->p - central->cm_orbit->p;
+    pc->arr_v[i] = arr->cm_orbit->v - central->cm_orbit->v;
+  }
+
+  // Queries made before the next step must see the planets at the right date
+  if (world->jde != 0.0) pl_porkchop_set_time(world, world->jde);
+}
+
+static void
+pl_porkchop_rows(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_porkchop_t *pc = arg;
+
+  for (size_t i = begin ; i < end ; i ++) {
+    double3 normal = vd3_cross(pc->dep_r[i], pc->dep_v[i]);
+    float *dv_dep = pc->dv_dep + i * pc->arr_count;
+    float *dv_arr = pc->dv_arr + i * pc->arr_count;
+
+    for (size_t j = 0 ; j < pc->arr_count ; j ++) {
+      double tof = (pc->arr_jd[j] - pc->dep_jd[i]) * PL_SEC_PER_DAY;
+      double3 v1, v2;
+      if (pl_lambert(pc->GM, pc->dep_r[i], pc->arr_r[j], tof, normal,
+                     &v1, &v2)) {
+        dv_dep[j] = vd3_abs(v1 - pc->dep_v[i]);
+        dv_arr[j] = vd3_abs(v2 - pc->arr_v[j]);
+      } else {
+        dv_dep[j] = NAN;
+        dv_arr[j] = NAN;
+      }
+    }
+  }
+}
+
+size_t
+pl_porkchop_compute(pl_porkchop_t *pc)
+{
+  if (pc->tasks) {
+    task_pool_parallel_for(pc->tasks, pc->dep_count, 0, pl_porkchop_rows, pc);
+  } else {
+    pl_porkchop_rows(pc, 0, pc->dep_count, 0);
+  }
+
+  size_t solved = 0;
+  for (size_t i = 0 ; i < pc->dep_count * pc->arr_count ; i ++) {
+    if (!isnan(pc->dv_dep[i])) solved ++;
+  }
+  return solved;
+}
+
+bool
+pl_porkchop_write_binary(const pl_porkchop_t *pc, const char *path)
+{
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    log_warn("porkchop: could not open '%s'", path);
+    return false;
+  }
+
+  pl_porkchop_header_t header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, PL_PORKCHOP_MAGIC, sizeof(header.magic));
+  header.dep_count = pc->dep_count;
+  header.arr_count = pc->arr_count;
+
+  size_t cells = pc->dep_count * pc->arr_count;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+         && fwrite(pc->dep_jd, sizeof(double), pc->dep_count, file)
+              == pc->dep_count
+         && fwrite(pc->arr_jd, sizeof(double), pc->arr_count, file)
+              == pc->arr_count
+         && fwrite(pc->dv_dep, sizeof(float), cells, file) == cells
+         && fwrite(pc->dv_arr, sizeof(float), cells, file) == cells;
+  if (fclose(file) != 0) ok = false;
+
+  if (!ok) log_warn("porkchop: could not write '%s'", path);
+  return ok;
+}
+
+bool
+pl_porkchop_write_csv(const pl_porkchop_t *pc, const char *path)
+{
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    log_warn("porkchop: could not open '%s'", path);
+    return false;
+  }
+
+  bool ok = fprintf(file, "departure,arrival,dv_departure,dv_arrival\n") > 0;
+  for (size_t i = 0 ; ok && i < pc->dep_count ; i ++) {
+    for (size_t j = 0 ; ok && j < pc->arr_count ; j ++) {
+      size_t k = i * pc->arr_count + j;
+      if (isnan(pc->dv_dep[k])) continue;
+      ok = fprintf(file, "%.6f,%.6f,%.3f,%.3f\n", pc->dep_jd[i], pc->arr_jd[j],
+                   pc->dv_dep[k], pc->dv_arr[k]) > 0;
+    }
+  }
+  if (fclose(file) != 0) ok = false;
+
+  if (!ok) log_warn("porkchop: could not write '%s'", path);
+  return ok;
+}
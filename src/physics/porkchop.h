@@ -0,0 +1,94 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_porkchop_h
+#define orbit_porkchop_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vmath/vmath.h>
+#include "common/task-pool.h"
+#include "physics/reftypes.h"
+
+// Porkchop plots, the delta-v of transfers between two bodies over a grid of
+// departure and arrival dates.
+//
+// The states of the bodies are sampled once per grid date, then every cell is
+// a Lambert problem. Cells are computed in rows of one departure date spread
+// over the task pool. The delta-v is the hyperbolic excess speed relative to
+// the departure and the arrival body, cells without a transfer are NaN.
+
+#define PL_PORKCHOP_MAGIC "OOPORK1"
+
+// Header of the binary format. The header is followed by the departure and
+// arrival dates as doubles and the departure and arrival delta-v as floats,
+// departure date major. All values are in native byte order.
+typedef struct {
+  char magic[8];
+  uint32_t dep_count;
+  uint32_t arr_count;
+} pl_porkchop_header_t;
+
+typedef struct {
+  double GM; // Gravitational parameter of the central body
+  task_pool_t *tasks; // Non-NULL if the grid is computed multi-threaded
+
+  size_t dep_count, arr_count;
+  double *dep_jd, *arr_jd; // Grid dates, julian days
+
+  // States relative to the central body at the grid dates
+  double3 *dep_r, *dep_v;
+  double3 *arr_r, *arr_v;
+
+  // Delta-v in m/s per cell, at index dep * arr_count + arr
+  float *dv_dep;
+  float *dv_arr;
+} pl_porkchop_t;
+
+/*! Create a grid with evenly spaced departure and arrival dates */
+pl_porkchop_t* pl_new_porkchop(double dep_jd0, double dep_jd1, size_t dep_count,
+                               double arr_jd0, double arr_jd1, size_t arr_count);
+void pl_porkchop_delete(pl_porkchop_t *pc);
+
+/*! Set task pool used for computing the grid, NULL runs it on the calling
+    thread */
+void pl_porkchop_set_tasks(pl_porkchop_t *pc, task_pool_t *tasks);
+
+/*! Sample the states of the departure and arrival bodies relative to central
+    at the grid dates. The celestial objects of the world are moved to each
+    date and back to the date of the last world step.
+ */
+void pl_porkchop_sample(pl_porkchop_t *pc, pl_world_t *world,
+                        pl_celobject_t *dep, pl_celobject_t *arr,
+                        pl_celobject_t *central);
+
+/*! Compute delta-v of all cells from the sampled states, or from states
+    filled in by the caller
+    \return Number of cells with a transfer
+ */
+size_t pl_porkchop_compute(pl_porkchop_t *pc);
+
+/*! Write the grid in the binary format, see pl_porkchop_header_t */
+bool pl_porkchop_write_binary(const pl_porkchop_t *pc, const char *path);
+/*! Write the cells with a transfer as CSV with the columns departure date,
+    arrival date, departure delta-v and arrival delta-v */
+bool pl_porkchop_write_csv(const pl_porkchop_t *pc, const char *path);
+
+#endif
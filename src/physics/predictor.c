@@ -0,0 +1,262 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openorbit/log.h>
+
+#include "common/monotonic-time.h"
+#include "common/palloc.h"
+#include "physics/predictor.h"
+#include "physics/object.h"
+#include "physics/celestial-object.h"
+
+static double3
+pl_predictor_acc(const pl_predict_request_t *req, double t, double3 r)
+{
+  double d = vd3_abs(r);
+  double3 a = r * (-req->GM / (d * d * d));
+
+  for (unsigned i = 0 ; i < req->perturber_count ; i ++) {
+    const pl_predict_perturber_t *pert = &req->perturbers[i];
+    double3 s, sv;
+    pl_kepler_state_at(&pert->orbit, t, &s, &sv);
+
+    // Direct pull on the object and indirect pull on the dominator
+    double3 dr = s - r;
+    double ddr = vd3_abs(dr);
+    double ds = vd3_abs(s);
+    a += dr * (pert->GM / (ddr * ddr * ddr)) - s * (pert->GM / (ds * ds * ds));
+  }
+
+  for (unsigned i = 0 ; i < req->burn_count ; i ++) {
+    const pl_predict_burn_t *burn = &req->burns[i];
+    if (t >= burn->t0 && t < burn->t1) a += burn->acc;
+  }
+  return a;
+}
+
+static void
+pl_predictor_propagate(const pl_predict_request_t *req, double horizon,
+                       size_t samples, pl_trajectory_t *traj)
+{
+  if (samples + 1 > traj->cap) {
+    free(traj->p);
+    traj->cap = samples + 1;
+    traj->p = smalloc(traj->cap * sizeof(double3));
+  }
+
+  traj->dominator = req->dominator;
+  traj->t0 = req->t;
+  traj->dt = horizon / samples;
+  traj->len = 0;
+
+  double h = traj->dt / PL_PREDICT_SUBSTEPS;
+  double t = req->t;
+  double3 r = req->r, v = req->v;
+  traj->p[traj->len ++] = r;
+
+  for (size_t i = 0 ; i < samples ; i ++) {
+    for (int k = 0 ; k < PL_PREDICT_SUBSTEPS ; k ++) {
+      double3 a1 = pl_predictor_acc(req, t, r);
+      double3 r2 = r + v * (0.5 * h), v2 = v + a1 * (0.5 * h);
+      double3 a2 = pl_predictor_acc(req, t + 0.5 * h, r2);
+      double3 r3 = r + v2 * (0.5 * h), v3 = v + a2 * (0.5 * h);
+      double3 a3 = pl_predictor_acc(req, t + 0.5 * h, r3);
+      double3 r4 = r + v3 * h, v4 = v + a3 * h;
+      double3 a4 = pl_predictor_acc(req, t + h, r4);
+
+      r += (v + v2 * 2.0 + v3 * 2.0 + v4) * (h / 6.0);
+      v += (a1 + a2 * 2.0 + a3 * 2.0 + a4) * (h / 6.0);
+      t += h;
+    }
+    traj->p[traj->len ++] = r;
+  }
+}
+
+static void*
+pl_predictor_main(void *arg)
+{
+  pl_predictor_t *pred = arg;
+  pl_predict_request_t req;
+
+  for (;;) {
+    pthread_mutex_lock(&pred->lock);
+    while (!pred->pending && !pred->shutdown) {
+      pthread_cond_wait(&pred->cond, &pred->lock);
+    }
+    if (pred->shutdown) {
+      pthread_mutex_unlock(&pred->lock);
+      break;
+    }
+    req = pred->request;
+    double horizon = pred->horizon;
+    size_t samples = pred->samples;
+    pred->pending = false;
+    pthread_mutex_unlock(&pred->lock);
+
+    // Only this thread changes front, so the back buffer is ours
+    pl_trajectory_t *back = &pred->buffers[1 - pred->front];
+    uint64_t start = getmonotimestamp();
+    pl_predictor_propagate(&req, horizon, samples, back);
+    uint64_t end = getmonotimestamp();
+    back->latency = subtractmonotime(end, req.stamp) * 1.0e-9;
+
+    pthread_mutex_lock(&pred->front_lock);
+    pred->front = 1 - pred->front;
+    pred->latency = back->latency;
+    pred->compute_time = subtractmonotime(end, start) * 1.0e-9;
+    pred->published ++;
+    pthread_mutex_unlock(&pred->front_lock);
+  }
+
+  return NULL;
+}
+
+pl_predictor_t*
+pl_new_predictor(double horizon, size_t samples)
+{
+  pl_predictor_t *pred = smalloc(sizeof(pl_predictor_t));
+  pred->horizon = horizon;
+  pred->samples = samples > 0 ? samples : 1;
+
+  pthread_mutex_init(&pred->lock, NULL);
+  pthread_cond_init(&pred->cond, NULL);
+  pthread_mutex_init(&pred->front_lock, NULL);
+
+  if (pthread_create(&pred->thread, NULL, pl_predictor_main, pred)) {
+    log_fatal("predictor: could not create worker thread");
+  }
+  return pred;
+}
+
+void
+pl_predictor_delete(pl_predictor_t *pred)
+{
+  pthread_mutex_lock(&pred->lock);
+  pred->shutdown = true;
+  pthread_cond_signal(&pred->cond);
+  pthread_mutex_unlock(&pred->lock);
+  pthread_join(pred->thread, NULL);
+
+  pthread_mutex_destroy(&pred->lock);
+  pthread_cond_destroy(&pred->cond);
+  pthread_mutex_destroy(&pred->front_lock);
+  free(pred->buffers[0].p);
+  free(pred->buffers[1].p);
+  free(pred);
+}
+
+void
+pl_predictor_configure(pl_predictor_t *pred, double horizon, size_t samples)
+{
+  pthread_mutex_lock(&pred->lock);
+  pred->horizon = horizon;
+  pred->samples = samples > 0 ? samples : 1;
+  pthread_mutex_unlock(&pred->lock);
+}
+
+void
+pl_predictor_set_plan(pl_predictor_t *pred, const pl_predict_burn_t *burns,
+                      size_t count)
+{
+  if (count > PL_PREDICT_MAX_BURNS) {
+    log_warn("predictor: %zu burns planned, only %d are used", count,
+             PL_PREDICT_MAX_BURNS);
+    count = PL_PREDICT_MAX_BURNS;
+  }
+
+  pthread_mutex_lock(&pred->lock);
+  memcpy(pred->burns, burns, count * sizeof(pl_predict_burn_t));
+  pred->burn_count = count;
+  pthread_mutex_unlock(&pred->lock);
+}
+
+static void
+pl_predictor_add_perturber(pl_predict_request_t *req, pl_celobject_t *cel,
+                           double t)
+{
+  if (req->perturber_count >= PL_MAX_PERTURBERS + 1) return;
+
+  pl_celobject_t *dom = req->dominator;
+  pl_predict_perturber_t *pert = &req->perturbers[req->perturber_count];
+  pert->GM = cel->cm_orbit->GM;
+  if (pl_kepler_from_state(&pert->orbit, dom->cm_orbit->GM + pert->GM,
+                           cel->cm_orbit->p - dom->cm_orbit->p,
+                           cel->cm_orbit->v - dom->cm_orbit->v, t)) {
+    req->perturber_count ++;
+  }
+}
+
+void
+pl_predictor_request(pl_predictor_t *pred, const pl_object_t *obj, double t,
+                     double3 acc)
+{
+  pl_celobject_t *dom = obj->dominator;
+  if (dom == NULL) return;
+
+  pl_predict_request_t req;
+  req.dominator = dom;
+  req.GM = dom->cm_orbit->GM;
+  req.t = t;
+  req.r = lwc_globald(&obj->p) - dom->cm_orbit->p;
+  req.v = obj->v - dom->cm_orbit->v;
+  req.stamp = getmonotimestamp();
+  req.perturber_count = 0;
+
+  // The perturbers of the patched conic mode if known, else the primary of
+  // the dominator and its satellites
+  if (dom->perturber_count > 0) {
+    for (unsigned i = 0 ; i < dom->perturber_count ; i ++) {
+      pl_predictor_add_perturber(&req, dom->perturbers[i], t);
+    }
+  } else {
+    if (dom->primary) pl_predictor_add_perturber(&req, dom->primary, t);
+    ARRAY_FOR_EACH(i, obj->world->celestial_objects) {
+      pl_celobject_t *cel = ARRAY_ELEM(obj->world->celestial_objects, i);
+      if (cel->primary == dom) pl_predictor_add_perturber(&req, cel, t);
+    }
+  }
+
+  pthread_mutex_lock(&pred->lock);
+  req.burn_count = pred->burn_count;
+  memcpy(req.burns, pred->burns, pred->burn_count * sizeof(pl_predict_burn_t));
+  if (vd3_dot(acc, acc) > 0.0) {
+    pl_predict_burn_t current = {t, t + pred->horizon, acc};
+    req.burns[req.burn_count ++] = current;
+  }
+  pred->request = req;
+  pred->pending = true;
+  pthread_cond_signal(&pred->cond);
+  pthread_mutex_unlock(&pred->lock);
+}
+
+const pl_trajectory_t*
+pl_predictor_acquire(pl_predictor_t *pred)
+{
+  pthread_mutex_lock(&pred->front_lock);
+  return &pred->buffers[pred->front];
+}
+
+void
+pl_predictor_release(pl_predictor_t *pred)
+{
+  pthread_mutex_unlock(&pred->front_lock);
+}
@@ -0,0 +1,137 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef orbit_predictor_h
+#define orbit_predictor_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vmath/vmath.h>
+#include "physics/kepler.h"
+#include "physics/reftypes.h"
+#include "physics/world.h"
+
+// Background trajectory prediction.
+//
+// Every step the simulation posts a request holding a snapshot of the focused
+// object, its dominator and the bodies perturbing it. A worker thread picks up
+// the latest request, propagates the object with RK4 and publishes the result
+// in one of two buffers. Requests posted while the worker is busy replace the
+// pending one, so the simulation never waits on the worker.
+//
+// The trajectory is relative to the dominator. Perturbers are moved along
+// two-body orbits about the dominator, with the indirect term of the
+// acceleration of the dominator included.
+
+#define PL_PREDICT_MAX_BURNS 8
+#define PL_PREDICT_SUBSTEPS 4 // RK4 steps per published sample
+
+// Planned burn, a constant acceleration between t0 and t1
+typedef struct {
+  double t0, t1; // Simulation time in s
+  double3 acc; // Acceleration in m/s^2, world axes
+} pl_predict_burn_t;
+
+typedef struct {
+  pl_celobject_t *dominator; // Centre of the trajectory, NULL if empty
+  double t0; // Simulation time of the first sample
+  double dt; // Time between samples
+  size_t len, cap;
+  double3 *p; // Positions relative to the dominator
+  double latency; // Time from the request to publication, in s
+} pl_trajectory_t;
+
+typedef struct {
+  double GM;
+  pl_kepler_orbit_t orbit; // Relative to the dominator
+} pl_predict_perturber_t;
+
+typedef struct {
+  pl_celobject_t *dominator;
+  double GM; // Of the dominator
+  double t; // Simulation time of the state
+  double3 r, v; // Relative to the dominator
+  uint64_t stamp; // Monotonic time when the request was posted
+
+  unsigned perturber_count;
+  pl_predict_perturber_t perturbers[PL_MAX_PERTURBERS + 1];
+  unsigned burn_count;
+  pl_predict_burn_t burns[PL_PREDICT_MAX_BURNS + 1]; // Plan and current thrust
+} pl_predict_request_t;
+
+typedef struct {
+  pthread_t thread;
+
+  // Request slot, guarded by lock
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pl_predict_request_t request;
+  bool pending;
+  bool shutdown;
+  double horizon; // In s
+  size_t samples;
+  unsigned burn_count;
+  pl_predict_burn_t burns[PL_PREDICT_MAX_BURNS];
+
+  // Published trajectory, buffers[front] is guarded by front_lock
+  pthread_mutex_t front_lock;
+  pl_trajectory_t buffers[2];
+  unsigned front;
+
+  // Statistics, guarded by front_lock
+  double latency; // Of the last published trajectory, in s
+  double compute_time; // Propagation time of the last trajectory, in s
+  size_t published;
+} pl_predictor_t;
+
+/*! Create a predictor and start its worker thread
+    \param horizon Time span predicted, in s
+    \param samples Number of samples published over the horizon
+ */
+pl_predictor_t* pl_new_predictor(double horizon, size_t samples);
+/*! Stop the worker thread and delete the predictor */
+void pl_predictor_delete(pl_predictor_t *pred);
+
+/*! Change horizon and sample density, used from the next request */
+void pl_predictor_configure(pl_predictor_t *pred, double horizon,
+                            size_t samples);
+
+/*! Replace the planned burns, at most PL_PREDICT_MAX_BURNS are kept */
+void pl_predictor_set_plan(pl_predictor_t *pred, const pl_predict_burn_t *burns,
+                           size_t count);
+
+/*! Post a prediction request for obj at simulation time t. The object must
+    have a dominator. This only copies the state and never waits for the
+    worker.
+    \param acc Acceleration obj applies at t, e.g. from its engines, in world
+                axes. It is held over the whole horizon on top of the plan.
+ */
+void pl_predictor_request(pl_predictor_t *pred, const pl_object_t *obj,
+                          double t, double3 acc);
+
+/*! Lock and return the latest published trajectory. The trajectory stays
+    valid until pl_predictor_release is called, which must be soon as the
+    worker cannot publish in the meantime.
+ */
+const pl_trajectory_t* pl_predictor_acquire(pl_predictor_t *pred);
+void pl_predictor_release(pl_predictor_t *pred);
+
+#endif
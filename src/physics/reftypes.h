@@ -25,7 +25,6 @@ typedef struct pl_world_t pl_world_t;
 typedef struct pl_system_t pl_system_t;
 typedef struct pl_astrobody_t pl_astrobody_t;
 typedef struct pl_object_t pl_object_t;
-typedef struct pl_particle_t pl_particle_t;
 typedef struct pl_particles_t pl_particles_t;
 typedef struct pl_recgrid_t pl_recgrid_t;
 typedef struct pl_collisioncontext_t pl_collisioncontext_t;
@@ -33,5 +32,8 @@ typedef struct pl_celobject_t pl_celobject_t;
 typedef struct pl_octtree_t pl_octtree_t;
 typedef struct pl_atm_template_t pl_atm_template_t;
 typedef struct pl_atm_layer_t pl_atm_layer_t;
+typedef struct pl_bodystore_t pl_bodystore_t;
+typedef struct pl_lintree_t pl_lintree_t;
+typedef struct pl_fmm_t pl_fmm_t;
 
 #endif /* !PL_REFTYPES_H */
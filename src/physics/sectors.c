@@ -17,21 +17,48 @@
   along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <math.h>
 #include "physics.h"
+#include "physics/collision.h"
 #include <vmath/lwcoord.h>
 
 
 // Computes whether two lines with radius w both having their origin in some LW coord
 // intersects at some point. This can be used for implementing a sweeping collission
 // detection system in a large world
-void
-pl_lwc_intersection_point(const lwcoord_t * restrict a, float3 da, float wa,
-                       const lwcoord_t * restrict b, float3 db, float wb)
+bool
+pl_lwc_intersection_point(const lwcoord_t * restrict a, double3 da, double wa,
+                          const lwcoord_t * restrict b, double3 db, double wb,
+                          double *t)
 {
-  // Transform b to a's segment and compute the intersection point
-  //  float3 bPosInASeg = ooLwcRelVec(b, a->seg);
-  //float3 bNext = vf3_add(bPosInASeg, db);
-  //float3 aNext = vf3_add(a->offs, da);
-  
-  
+  // Work in the frame of a, the relative position is small when the objects
+  // are close, even if they are far from the origin
+  double3 p = lwc_dist(b, a);
+  double3 v = db - da;
+  double r = wa + wb;
+
+  // Solve |p + v t| = r for the first t in [0, 1]
+  double c = vd3_dot(p, p) - r * r;
+  double pv = vd3_dot(p, v);
+
+  if (c <= 0.0) {
+    // Already touching, only a hit if they are approaching
+    if (pv < 0.0) {
+      *t = 0.0;
+      return true;
+    }
+    return false;
+  }
+
+  if (pv >= 0.0) return false; // Moving apart
+
+  double vv = vd3_dot(v, v);
+  double disc = pv * pv - vv * c;
+  if (disc < 0.0) return false; // Closest approach is outside the spheres
+
+  double toi = (-pv - sqrt(disc)) / vv;
+  if (toi > 1.0) return false;
+
+  *t = toi;
+  return true;
 }
@@ -17,19 +17,25 @@
  along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <ctype.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <openorbit/log.h>
+
 #include "common/palloc.h"
 #include "physics/world.h"
+#include "physics/areodynamics.h"
+#include "physics/celestial-object.h"
 
 pl_world_t*
 pl_new_world(double size)
 {
   pl_world_t *world = smalloc(sizeof(pl_world_t));
 
-  world->coll_ctxt = pl_new_collision_context(size);
+  world->coll_ctxt = pl_new_collision_context(size, PL_BROADPHASE_RECGRID);
   world->octtree = pl_new_octtree(vd3_set(0, 0, 0), size);
 
   obj_array_init(&world->celestial_objects);
@@ -37,6 +43,25 @@ pl_new_world(double size)
   obj_array_init(&world->root_bodies);
   obj_array_init(&world->particle_systems);
 
+  world->bodystore = NULL;
+  world->tasks = NULL;
+  world->ephemeris = NULL;
+  world->eclipse = NULL;
+  world->integrator = PL_INTEGRATOR_EULER;
+  world->gravity_mode = PL_GRAVITY_OCTTREE;
+  world->fmm_order = 4;
+  world->perturbers = 2;
+  world->harmonics_degree = 0;
+  world->harmonics_order = 0;
+  world->max_substeps = 1;
+  world->substep_eta = 0.01;
+  world->substep_dv = 1.0;
+  world->rails = false;
+  world->t = 0.0;
+  world->jde = 0.0;
+  world->lod = false;
+  lwc_set(&world->lod_focus, 0.0, 0.0, 0.0);
+
   world->celestial_dict = avl_str_new();
 
   pl_celinit(world);
@@ -47,47 +72,750 @@ pl_new_world(double size)
 void
 pl_world_delete(pl_world_t *world)
 {
-  // TODO: Delete collission context
+  pl_collision_context_delete(world->coll_ctxt);
 
   obj_array_dispose(&world->celestial_objects);
   obj_array_dispose(&world->rigid_bodies);
   obj_array_dispose(&world->root_bodies);
   obj_array_dispose(&world->particle_systems);
 
+  if (world->bodystore) pl_bodystore_delete(world->bodystore);
+  if (world->tasks) task_pool_delete(world->tasks);
+
+  if (world->ephemeris) pl_ephemeris_close(world->ephemeris);
+  if (world->eclipse) pl_eclipse_delete(world->eclipse);
+
+  free(world->atm_obj);
+  free(world->atm_h);
+  free(world->atm_P);
+  free(world->atm_p);
+
+  free(world->harm_obj);
+  free(world->harm_r);
+  free(world->harm_acc);
+
   pl_octtree_delete(world->octtree);
   avl_delete(world->celestial_dict);
 
   free(world);
 }
 
+typedef struct {
+  pl_world_t *world;
+  double dt;
+} pl_world_step_ctxt_t;
+
+// The body store implements the Euler integrator only
+static inline bool
+pl_world_is_batched(const pl_world_t *world)
+{
+  return world->bodystore && world->integrator == PL_INTEGRATOR_EULER;
+}
+
+static inline bool
+pl_world_is_unpowered(const pl_object_t *obj)
+{
+  return vd3_dot(obj->f_ack, obj->f_ack) == 0.0
+      && vd3_dot(obj->t_ack, obj->t_ack) == 0.0;
+}
+
+static int
+pl_world_celobject_gm_cmp(const void *a, const void *b)
+{
+  const pl_celobject_t *ca = *(pl_celobject_t * const *)a;
+  const pl_celobject_t *cb = *(pl_celobject_t * const *)b;
+  if (ca->cm_orbit->GM > cb->cm_orbit->GM) return -1;
+  if (ca->cm_orbit->GM < cb->cm_orbit->GM) return 1;
+  return 0;
+}
+
+// Find the primary of each celestial body and its Laplace sphere of influence
+// r = d (GM / GM_p)^(2/5). Bodies are visited from the most massive one and
+// the primary is the more massive body with the smallest sphere of influence
+// containing the body. Moons thus get their planet as primary, even though
+// the sun pulls harder on most of them.
+void
+pl_world_update_soi(pl_world_t *world)
+{
+  size_t n = ARRAY_LEN(world->celestial_objects);
+  if (n == 0) return;
+
+  pl_celobject_t *order[n];
+  memcpy(order, world->celestial_objects.elems, n * sizeof(pl_celobject_t*));
+  qsort(order, n, sizeof(pl_celobject_t*), pl_world_celobject_gm_cmp);
+
+  for (size_t i = 0 ; i < n ; i ++) {
+    pl_celobject_t *cel = order[i];
+    cel->primary = NULL;
+    cel->soi_radius = INFINITY;
+
+    for (size_t j = 0 ; j < i ; j ++) {
+      pl_celobject_t *other = order[j];
+      if (other->cm_orbit->GM <= cel->cm_orbit->GM) break;
+
+      double d = vd3_abs(other->cm_orbit->p - cel->cm_orbit->p);
+      if (d < other->soi_radius
+          && (cel->primary == NULL
+              || other->soi_radius < cel->primary->soi_radius)) {
+        cel->primary = other;
+        cel->soi_radius = d * pow(cel->cm_orbit->GM / other->cm_orbit->GM,
+                                  0.4);
+      }
+    }
+  }
+}
+
+// True if obj is inside the sphere of influence of its dominator, but not
+// inside the one of any body orbiting the dominator
+static bool
+pl_world_in_soi(pl_world_t *world, pl_object_t *obj)
+{
+  pl_celobject_t *dom = obj->dominator;
+  double3 p = lwc_globald(&obj->p);
+
+  if (vd3_abs(p - dom->cm_orbit->p) > dom->soi_radius) return false;
+
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    if (cel->primary == dom && vd3_abs(p - cel->cm_orbit->p) < cel->soi_radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Pick the perturbers of the bodies dominated by each celestial object, the
+// objects with the strongest tidal pull GM / d^3 at it. The pull of the other
+// objects is summed up in patched_acc, as it hardly varies within the sphere
+// of influence.
+static void
+pl_world_update_patched_conic(pl_world_t *world)
+{
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    double tidal[PL_MAX_PERTURBERS];
+    unsigned n = 0;
+
+    ARRAY_FOR_EACH(j, world->celestial_objects) {
+      pl_celobject_t *other = ARRAY_ELEM(world->celestial_objects, j);
+      if (other == cel || other->cm_orbit->GM <= 0.0) continue;
+
+      double d = vd3_abs(other->cm_orbit->p - cel->cm_orbit->p);
+      double t = other->cm_orbit->GM / (d * d * d);
+
+      // Insertion sort, strongest first, the weakest drops out when full
+      unsigned k = n;
+      if (n < world->perturbers) n ++;
+      while (k > 0 && tidal[k - 1] < t) {
+        if (k < n) {
+          tidal[k] = tidal[k - 1];
+          cel->perturbers[k] = cel->perturbers[k - 1];
+        }
+        k --;
+      }
+      if (k < n) {
+        tidal[k] = t;
+        cel->perturbers[k] = other;
+      }
+    }
+    cel->perturber_count = n;
+
+    double3 a = vd3_set(0.0, 0.0, 0.0);
+    ARRAY_FOR_EACH(j, world->celestial_objects) {
+      pl_celobject_t *other = ARRAY_ELEM(world->celestial_objects, j);
+      bool perturber = other == cel;
+      for (unsigned k = 0 ; k < n ; k ++) {
+        if (cel->perturbers[k] == other) perturber = true;
+      }
+      if (perturber) continue;
+
+      double3 d = other->cm_orbit->p - cel->cm_orbit->p;
+      double d2 = vd3_dot(d, d);
+      a += d * (other->cm_orbit->GM / (d2 * sqrt(d2)));
+    }
+    cel->patched_acc = a;
+  }
+}
+
+// Move obj to the sphere of influence it is in, climbing towards the primaries
+// when it has left the one of its dominator and descending into the ones of
+// bodies orbiting the dominator
+static void
+pl_world_update_dominator(pl_world_t *world, pl_object_t *obj)
+{
+  double3 p = lwc_globald(&obj->p);
+  pl_celobject_t *dom = obj->dominator;
+
+  while (dom && dom->primary
+         && vd3_abs(p - dom->cm_orbit->p) > dom->soi_radius) {
+    dom = dom->primary;
+  }
+
+  if (dom == NULL) {
+    ARRAY_FOR_EACH(i, world->celestial_objects) {
+      pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+      if (cel->primary == NULL
+          && (dom == NULL || cel->cm_orbit->GM > dom->cm_orbit->GM)) {
+        dom = cel;
+      }
+    }
+  }
+
+  bool entered = dom != NULL;
+  while (entered) {
+    entered = false;
+    ARRAY_FOR_EACH(i, world->celestial_objects) {
+      pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+      if (cel->primary == dom
+          && vd3_abs(p - cel->cm_orbit->p) < cel->soi_radius) {
+        dom = cel;
+        entered = true;
+        break;
+      }
+    }
+  }
+
+  if (dom != obj->dominator) {
+    log_trace("%s: entered sphere of influence of %s", obj->name,
+              dom->cm_orbit->name);
+    obj->dominator = dom;
+    obj->on_rails = false;
+  }
+}
+
+static inline bool
+pl_world_is_patched(const pl_world_t *world, const pl_object_t *obj)
+{
+  return world->gravity_mode == PL_GRAVITY_PATCHED_CONIC
+      && obj->dominator != NULL;
+}
+
+// Patched conic acceleration at p in the sphere of influence of dom
+static double3
+pl_world_patched_field(const pl_celobject_t *dom, double3 p)
+{
+  double3 r = p - dom->cm_orbit->p;
+  double d2 = vd3_dot(r, r);
+  double3 g = dom->patched_acc - r * (dom->cm_orbit->GM / (d2 * sqrt(d2)));
+
+  for (unsigned k = 0 ; k < dom->perturber_count ; k ++) {
+    const pl_celobject_t *pert = dom->perturbers[k];
+    double3 rk = pert->cm_orbit->p - p;
+    double dk2 = vd3_dot(rk, rk);
+    g += rk * (pert->cm_orbit->GM / (dk2 * sqrt(dk2)));
+  }
+  return g;
+}
+
+// Two-body orbits ignore the non-spherical gravity of the dominator, so bodies
+// that feel it are integrated instead. Sleeping bodies do not feel it.
+static inline bool
+pl_world_feels_harmonics(const pl_world_t *world, const pl_object_t *obj)
+{
+  return world->harmonics_degree >= 2 && obj->lod != PL_LOD_SLEEPING
+      && obj->dominator && obj->dominator->geopotential;
+}
+
+// Put obj on rails if it was unpowered during the last step, the forces of the
+// last step are saved in obj->f and obj->t by pl_object_clear
+static void
+pl_world_enter_rails(pl_world_t *world, pl_object_t *obj)
+{
+  // Drifting bodies are not on their integrated trajectory
+  if (obj->on_rails || obj->dominator == NULL || obj->lod_dt > 0.0) return;
+  if (pl_world_feels_harmonics(world, obj)) return;
+  if (vd3_dot(obj->f, obj->f) != 0.0 || vd3_dot(obj->t, obj->t) != 0.0) return;
+  if (!pl_world_in_soi(world, obj)) return;
+
+  pl_celobject_t *dom = obj->dominator;
+  double3 r = lwc_globald(&obj->p) - dom->cm_orbit->p;
+  double3 v = obj->v - dom->cm_orbit->v;
+  obj->on_rails = pl_kepler_from_state(&obj->rails, dom->cm_orbit->GM,
+                                       r, v, world->t);
+}
+
+// Move obj along its orbit, returns false if obj has left the rails and must
+// be integrated
+static bool
+pl_world_step_rails(pl_world_t *world, pl_object_t *obj, double dt)
+{
+  if (!obj->on_rails) return false;
+  if (!pl_world_is_unpowered(obj) || !pl_world_in_soi(world, obj)
+      || pl_world_feels_harmonics(world, obj)) {
+    obj->on_rails = false;
+    return false;
+  }
+
+  pl_celobject_t *dom = obj->dominator;
+  double3 r, v;
+  pl_kepler_state_at(&obj->rails, world->t, &r, &v);
+
+  double3 dom_p = dom->cm_orbit->p;
+  lwc_set(&obj->p, dom_p.x, dom_p.y, dom_p.z);
+  lwc_translate3dv(&obj->p, r);
+  obj->v = dom->cm_orbit->v + v;
+
+  double d = vd3_abs(r);
+  obj->g_ack = r * (-obj->rails.GM * obj->m.m / (d * d * d));
+
+  // Torque free, so the angular velocity is constant
+  obj->q = qd_normalise(qd_vd3_rot(obj->q, obj->angVel, dt));
+  pl_object_compute_derived(obj);
+  pl_object_clear(obj);
+
+  for (int i = 0 ; i < obj->children.length ; ++ i) {
+    pl_object_step_child(obj->children.elems[i], dt);
+  }
+
+  obj->step_rate = 0;
+  return true;
+}
+
+// Compute air pressure, density and drag of the root bodies. Bodies inside an
+// atmosphere are gathered per atmosphere so that the table lookups are done in
+// one batch, bodies outside are in vacuum.
+static void
+pl_world_update_atmosphere(pl_world_t *world)
+{
+  size_t n = ARRAY_LEN(world->root_bodies);
+  if (n > world->atm_cap) {
+    free(world->atm_obj);
+    free(world->atm_h);
+    free(world->atm_P);
+    free(world->atm_p);
+    world->atm_obj = smalloc(n * sizeof(pl_object_t*));
+    world->atm_h = smalloc(n * sizeof(float));
+    world->atm_P = smalloc(n * sizeof(float));
+    world->atm_p = smalloc(n * sizeof(float));
+    world->atm_cap = n;
+  }
+
+  ARRAY_FOR_EACH(i, world->root_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+    obj->airPressure = 0.0;
+    obj->airDensity = 0.0;
+  }
+
+  world->atm_count = 0;
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    if (cel->atm == NULL) continue;
+
+    size_t count = 0;
+    ARRAY_FOR_EACH(j, world->root_bodies) {
+      pl_object_t *obj = ARRAY_ELEM(world->root_bodies, j);
+      if (obj->dominator != cel) continue;
+
+      double h = pl_object_compute_altitude(obj);
+      if (h >= cel->atm->h_max) continue;
+
+      world->atm_obj[count] = obj;
+      world->atm_h[count] = h;
+      count ++;
+    }
+
+    pl_atmosphere_lookup(cel->atm, count, world->atm_h,
+                         world->atm_P, world->atm_p);
+
+    for (size_t k = 0 ; k < count ; k ++) {
+      pl_object_t *obj = world->atm_obj[k];
+      obj->airPressure = world->atm_P[k];
+      obj->airDensity = world->atm_p[k];
+
+      if (obj->dragCoef > 0.0 && obj->area > 0.0) {
+        obj->f_ack += pl_compute_drag(pl_compute_airvelocity(obj),
+                                      obj->airDensity, obj->dragCoef,
+                                      obj->area);
+      }
+    }
+    world->atm_count += count;
+  }
+}
+
+typedef struct {
+  pl_world_t *world;
+  const pl_geopotential_t *geo;
+} pl_world_harmonics_ctxt_t;
+
+static void
+pl_world_harmonics_range(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_world_harmonics_ctxt_t *ctxt = arg;
+  pl_world_t *world = ctxt->world;
+  pl_geopotential_acc(ctxt->geo, world->harmonics_degree,
+                      world->harmonics_order, end - begin,
+                      world->harm_r + begin, world->harm_acc + begin);
+}
+
+// Non-spherical gravity of the dominators. Bodies are gathered per dominator
+// so that each field is evaluated in one batch, like the atmosphere pass.
+// Bodies on rails and sleeping bodies do not use gravity and are skipped.
+static void
+pl_world_update_harmonics(pl_world_t *world)
+{
+  ARRAY_FOR_EACH(i, world->root_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+    obj->g_harmonic = vd3_set(0.0, 0.0, 0.0);
+  }
+  if (world->harmonics_degree < 2) return;
+
+  size_t n = ARRAY_LEN(world->root_bodies);
+  if (n > world->harm_cap) {
+    free(world->harm_obj);
+    free(world->harm_r);
+    free(world->harm_acc);
+    world->harm_obj = smalloc(n * sizeof(pl_object_t*));
+    world->harm_r = smalloc(n * sizeof(double3));
+    world->harm_acc = smalloc(n * sizeof(double3));
+    world->harm_cap = n;
+  }
+
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    if (cel->geopotential == NULL) continue;
+
+    size_t count = 0;
+    ARRAY_FOR_EACH(j, world->root_bodies) {
+      pl_object_t *obj = ARRAY_ELEM(world->root_bodies, j);
+      // Bodies on rails around cel leave them in this step
+      if (obj->dominator != cel || !pl_world_feels_harmonics(world, obj)) {
+        continue;
+      }
+
+      world->harm_obj[count] = obj;
+      world->harm_r[count] = lwc_globald(&obj->p) - cel->cm_orbit->p;
+      count ++;
+    }
+    if (count == 0) continue;
+
+    // The orientation is cached once per step for all bodies
+    pl_geopotential_update(cel->geopotential, cel->cm_orbit->GM,
+                           pl_celobject_get_body_quat(cel));
+
+    pl_world_harmonics_ctxt_t ctxt = {world, cel->geopotential};
+    if (world->tasks) {
+      task_pool_parallel_for(world->tasks, count, PL_GEOPOTENTIAL_LANES,
+                             pl_world_harmonics_range, &ctxt);
+    } else {
+      pl_world_harmonics_range(&ctxt, 0, count, 0);
+    }
+
+    for (size_t k = 0 ; k < count ; k ++) {
+      world->harm_obj[k]->g_harmonic = world->harm_acc[k];
+    }
+  }
+}
+
+// Number of substeps needed for obj, from the gravity gradient and the thrust
+static unsigned
+pl_world_choose_substeps(pl_world_t *world, pl_object_t *obj, double dt)
+{
+  if (world->max_substeps <= 1) return 1;
+
+  double grad;
+  if (obj->dominator) {
+    double3 r = lwc_globald(&obj->p) - obj->dominator->cm_orbit->p;
+    double d = vd3_abs(r);
+    grad = 2.0 * obj->dominator->cm_orbit->GM / (d * d * d);
+  } else {
+    // Finite difference along the field direction
+    const double delta = 1000.0;
+    double3 g0 = pl_octtree_gravity_at(world->octtree, &obj->p);
+    double g0_abs = vd3_abs(g0);
+    if (g0_abs == 0.0) {
+      grad = 0.0;
+    } else {
+      lwcoord_t p1 = obj->p;
+      lwc_translate3dv(&p1, g0 * (delta / g0_abs));
+      grad = vd3_abs(pl_octtree_gravity_at(world->octtree, &p1) - g0) / delta;
+    }
+  }
+
+  double n_grav = dt * sqrt(grad) / world->substep_eta;
+  double n_thrust = vd3_abs(obj->f_ack) / obj->m.m * dt / world->substep_dv;
+  double n = ceil(fmax(n_grav, n_thrust));
+
+  if (n < 1.0) return 1;
+  if (n > world->max_substeps) return world->max_substeps;
+  return (unsigned)n;
+}
+
+// Step body in obj->step_rate substeps, forces and torques are held constant
+// while gravity is recomputed for every substep.
+static void
+pl_world_step_object(pl_world_t *world, pl_object_t *obj, double dt)
+{
+  unsigned n = obj->step_rate;
+  if (n <= 1) {
+    pl_object_step(obj, dt);
+    return;
+  }
+
+  double h = dt / n;
+  double3 f = obj->f_ack;
+  double3 t = obj->t_ack;
+  for (unsigned s = 0 ; s < n ; s ++) {
+    if (s > 0) {
+      obj->f_ack = f;
+      obj->t_ack = t;
+      obj->g_ack = pl_world_object_gravity_at(obj, &obj->p) * obj->m.m;
+    }
+    pl_object_step(obj, h);
+  }
+}
+
+static inline pl_lod_t
+pl_world_lod_at(const pl_world_t *world, double d, double scale)
+{
+  if (d > world->lod_sleep * scale) return PL_LOD_SLEEPING;
+  if (d > world->lod_reduced * scale) return PL_LOD_REDUCED;
+  return PL_LOD_FULL;
+}
+
+// Tier of obj for this step. A body moves to a coarser tier when it is beyond
+// the outer edge of the hysteresis band and to a finer one when it is inside
+// the inner edge.
+static pl_lod_t
+pl_world_choose_lod(const pl_world_t *world, const pl_object_t *obj)
+{
+  if (!world->lod || !pl_world_is_unpowered(obj)) return PL_LOD_FULL;
+
+  double d = vd3_abs(lwc_dist(&obj->p, &world->lod_focus));
+  pl_lod_t coarser = pl_world_lod_at(world, d, 1.0 + world->lod_hysteresis);
+  pl_lod_t finer = pl_world_lod_at(world, d, 1.0 - world->lod_hysteresis);
+  if (coarser > obj->lod) return coarser;
+  if (finer < obj->lod) return finer;
+  return obj->lod;
+}
+
+// Sub objects share the tier of their root body, so that collision detection
+// treats them alike
+static void
+pl_world_set_lod_tier(pl_object_t *obj, pl_lod_t lod)
+{
+  obj->lod = lod;
+  ARRAY_FOR_EACH(i, obj->children) {
+    pl_world_set_lod_tier(ARRAY_ELEM(obj->children, i), lod);
+  }
+}
+
+// Move obj along its velocity without integrating it, gravity and collisions
+// are ignored
+static void
+pl_world_drift(pl_object_t *obj, double dt)
+{
+  lwc_translate3dv(&obj->p, obj->v * dt);
+  obj->q = qd_normalise(qd_vd3_rot(obj->q, obj->angVel, dt));
+  pl_object_compute_derived(obj);
+  pl_object_clear(obj);
+
+  for (int i = 0 ; i < obj->children.length ; ++ i) {
+    pl_object_step_child(obj->children.elems[i], dt);
+  }
+
+  obj->step_rate = 0;
+}
+
+// Update the tier of obj and return the length of the step to integrate it
+// with, or zero if it has been moved already
+static double
+pl_world_step_lod(pl_world_t *world, pl_object_t *obj, size_t i, double dt)
+{
+  pl_lod_t lod = pl_world_choose_lod(world, obj);
+
+  if (obj->lod != lod) {
+    // Move back to the end of the last integration and integrate the time
+    // drifted since then in this step. Full bodies may be stepped by the body
+    // store, which uses the world step length, so they keep the drift instead.
+    if (lod == PL_LOD_FULL && pl_world_is_batched(world)) {
+      obj->lod_dt = 0.0;
+    } else if (obj->lod_dt > 0.0) {
+      lwc_translate3dv(&obj->p, obj->v * -obj->lod_dt);
+      dt += obj->lod_dt;
+      obj->lod_dt = 0.0;
+    }
+    // Sleeping bodies use rails even if the world does not
+    if (obj->lod == PL_LOD_SLEEPING && !world->rails) obj->on_rails = false;
+    pl_world_set_lod_tier(obj, lod);
+  }
+
+  if (pl_world_step_rails(world, obj, dt)) return 0.0;
+
+  switch (obj->lod) {
+  case PL_LOD_FULL:
+    return dt;
+  case PL_LOD_REDUCED:
+    // Bodies are integrated in different steps depending on their index
+    if ((world->lod_frame + i) % world->lod_rate == 0) {
+      lwc_translate3dv(&obj->p, obj->v * -obj->lod_dt);
+      dt += obj->lod_dt;
+      obj->lod_dt = 0.0;
+      return dt;
+    }
+    obj->lod_dt += dt;
+    pl_world_drift(obj, dt);
+    return 0.0;
+  case PL_LOD_SLEEPING:
+    pl_world_drift(obj, dt);
+    return 0.0;
+  default:
+    assert(0 && "invalid level of detail");
+  }
+  return dt;
+}
+
+// Gravity queries only read the octtree and each root body owns its children,
+// so ranges of root bodies can be processed in parallel.
+static void
+pl_world_step_bodies(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_world_step_ctxt_t *ctxt = arg;
+  pl_world_t *world = ctxt->world;
+
+  // Compute gravity for object, drag has been added by
+  // pl_world_update_atmosphere
+  for (size_t i = begin ; i < end ; i ++) {
+    pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+    double dt = pl_world_step_lod(world, obj, i, ctxt->dt);
+    if (dt == 0.0) continue;
+
+    double3 G;
+    if (pl_world_is_patched(world, obj)) {
+      G = pl_world_patched_field(obj->dominator, lwc_globald(&obj->p))
+        * obj->m.m;
+    } else {
+      G = pl_octtree_compute_gravity(world->octtree, obj);
+    }
+    G += obj->g_harmonic * obj->m.m;
+    pl_object_set_gravity3fv(obj, vf3_set(G.x, G.y, G.z));
+
+    obj->step_rate = pl_world_choose_substeps(world, obj, dt);
+
+    // Single rate bodies are left to the body store in batched mode
+    if (!pl_world_is_batched(world) || obj->step_rate > 1
+        || obj->lod != PL_LOD_FULL) {
+      pl_world_step_object(world, obj, dt);
+    } else {
+      pl_bodystore_load(world->bodystore, i, obj, dt);
+    }
+  }
+}
+
+static void
+pl_world_set_sunlight(pl_object_t *obj, float sunlight,
+                      pl_celobject_t *occluder)
+{
+  obj->sunlight = sunlight;
+  obj->occluder = occluder;
+  ARRAY_FOR_EACH(i, obj->children) {
+    pl_world_set_sunlight(ARRAY_ELEM(obj->children, i), sunlight, occluder);
+  }
+}
+
+static void
+pl_world_update_sunlight(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  pl_world_t *world = arg;
+  for (size_t i = begin ; i < end ; i ++) {
+    pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+    pl_celobject_t *occluder;
+    float sunlight = pl_eclipse_sunlight(world->eclipse, lwc_globald(&obj->p),
+                                         &occluder);
+    pl_world_set_sunlight(obj, sunlight, occluder);
+  }
+}
+
 void
 pl_world_step(pl_world_t *world, double jde, double dt)
 {
-  cm_orbit_compute(jde);
+  if (world->ephemeris == NULL
+      || !pl_ephemeris_update(world->ephemeris, jde)) {
+    cm_orbit_compute(jde);
+  }
+  world->jde = jde;
+  world->t += dt;
+
+  bool patched = world->gravity_mode == PL_GRAVITY_PATCHED_CONIC;
+  bool harmonics = world->harmonics_degree >= 2;
+  if (world->rails || patched || world->eclipse || world->lod || harmonics) {
+    pl_world_update_soi(world);
+  }
+  if (world->rails || patched || world->lod || harmonics) {
+    ARRAY_FOR_EACH(i, world->root_bodies) {
+      pl_world_update_dominator(world, ARRAY_ELEM(world->root_bodies, i));
+    }
+  }
+  if (patched) {
+    pl_world_update_patched_conic(world);
+  }
 
   ARRAY_FOR_EACH(i, world->celestial_objects) {
     pl_celobject_update_octtree(ARRAY_ELEM(world->celestial_objects, i));
   }
   ARRAY_FOR_EACH(i, world->root_bodies) {
-    pl_object_update_octtree(ARRAY_ELEM(world->root_bodies, i));
+    pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+    pl_object_update_mass(obj);
+    pl_object_update_octtree(obj);
   }
   pl_octtree_update_gravity(world->octtree);
 
-  // Compute drag and gravity for object
+  pl_world_update_atmosphere(world);
+  pl_world_update_harmonics(world);
+
+  if (pl_world_is_batched(world)) {
+    pl_bodystore_resize(world->bodystore, ARRAY_LEN(world->root_bodies));
+  }
+
+  pl_world_step_ctxt_t ctxt = {world, dt};
+  if (world->tasks) {
+    task_pool_parallel_for(world->tasks, ARRAY_LEN(world->root_bodies), 0,
+                           pl_world_step_bodies, &ctxt);
+  } else {
+    pl_world_step_bodies(&ctxt, 0, ARRAY_LEN(world->root_bodies), 0);
+  }
+
+  if (pl_world_is_batched(world)) {
+    pl_bodystore_step(world->bodystore);
+  }
+
+  world->substeps_total = 0;
+  world->substeps_max = 0;
+  world->rails_count = 0;
+  memset(world->lod_count, 0, sizeof(world->lod_count));
   ARRAY_FOR_EACH(i, world->root_bodies) {
     pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
-    double3 G = pl_octtree_compute_gravity(world->octtree, obj);
-    pl_object_set_gravity3fv(obj, vf3_set(G.x, G.y, G.z));
+    if (pl_world_is_batched(world)) pl_bodystore_store(world->bodystore, i);
+    if (obj->on_rails) world->rails_count ++;
+    world->lod_count[obj->lod] ++;
+    if (world->rails || obj->lod == PL_LOD_SLEEPING) {
+      pl_world_enter_rails(world, obj);
+    }
 
-    // TODO: drag computation
-    //float3 drag = pl_object_compute_drag(obj);
-    //pl_object_force3fv(obj, drag);
-
-    pl_object_step(obj, dt);
+    world->substeps_total += obj->step_rate;
+    if (obj->step_rate > world->substeps_max) {
+      world->substeps_max = obj->step_rate;
+    }
   }
 
+  if (world->lod) world->lod_frame ++;
+
   // Do collissions
-  pl_collide_step(world->coll_ctxt);
+  pl_collide_step(world->coll_ctxt, dt);
+
+  // Keep the tree current for spatial queries made between steps
+  ARRAY_FOR_EACH(i, world->root_bodies) {
+    pl_object_update_octtree(ARRAY_ELEM(world->root_bodies, i));
+  }
+
+  if (world->eclipse) {
+    pl_eclipse_build(world->eclipse, world);
+    if (world->tasks) {
+      task_pool_parallel_for(world->tasks, ARRAY_LEN(world->root_bodies), 0,
+                             pl_world_update_sunlight, world);
+    } else {
+      pl_world_update_sunlight(world, 0, ARRAY_LEN(world->root_bodies), 0);
+    }
+  }
 }
 
 void
@@ -98,6 +826,225 @@ pl_world_clear(pl_world_t *world)
   }
 }
 
+void
+pl_world_set_batched(pl_world_t *world, bool batched)
+{
+  if (batched && world->bodystore == NULL) {
+    world->bodystore = pl_new_bodystore(world->root_bodies.length);
+  } else if (!batched && world->bodystore) {
+    pl_bodystore_delete(world->bodystore);
+    world->bodystore = NULL;
+  }
+}
+
+void
+pl_world_set_threads(pl_world_t *world, unsigned threads)
+{
+  if (world->tasks) {
+    task_pool_delete(world->tasks);
+    world->tasks = NULL;
+  }
+
+  if (threads != 1) {
+    world->tasks = task_pool_new(threads);
+  }
+  pl_collide_set_tasks(world->coll_ctxt, world->tasks);
+}
+
+void
+pl_world_set_gravity_mode(pl_world_t *world, pl_gravity_mode_t mode)
+{
+  pl_octtree_set_linear(world->octtree, NULL);
+  pl_octtree_set_fmm(world->octtree, 0);
+
+  switch (mode) {
+  case PL_GRAVITY_OCTTREE:
+    break;
+  case PL_GRAVITY_LINEAR_OCTTREE:
+    pl_octtree_set_linear(world->octtree, &world->celestial_objects);
+    break;
+  case PL_GRAVITY_FMM:
+    pl_octtree_set_fmm(world->octtree, world->fmm_order);
+    break;
+  case PL_GRAVITY_PATCHED_CONIC:
+    break;
+  default:
+    assert(0 && "invalid gravity mode");
+  }
+  world->gravity_mode = mode;
+}
+
+void
+pl_world_set_fmm_order(pl_world_t *world, int order)
+{
+  world->fmm_order = order;
+  if (world->gravity_mode == PL_GRAVITY_FMM) {
+    pl_octtree_set_fmm(world->octtree, order);
+  }
+}
+
+void
+pl_world_set_perturbers(pl_world_t *world, unsigned n)
+{
+  if (n > PL_MAX_PERTURBERS) {
+    log_warn("%u perturbers requested, using %d", n, PL_MAX_PERTURBERS);
+    n = PL_MAX_PERTURBERS;
+  }
+  world->perturbers = n;
+}
+
+void
+pl_world_set_harmonics(pl_world_t *world, unsigned degree, unsigned order)
+{
+  if (degree > PL_GEOPOTENTIAL_MAX_DEGREE) {
+    log_warn("gravity field degree %u requested, using %d", degree,
+             PL_GEOPOTENTIAL_MAX_DEGREE);
+    degree = PL_GEOPOTENTIAL_MAX_DEGREE;
+  }
+  world->harmonics_degree = degree;
+  world->harmonics_order = order > degree ? degree : order;
+}
+
+void
+pl_world_set_broadphase(pl_world_t *world, pl_broadphase_t broadphase)
+{
+  pl_collide_set_broadphase(world->coll_ctxt, broadphase);
+}
+
+void
+pl_world_set_integrator(pl_world_t *world, pl_integrator_kind_t kind)
+{
+  assert(kind < PL_INTEGRATOR_COUNT);
+  world->integrator = kind;
+  ARRAY_FOR_EACH(i, world->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(world->rigid_bodies, i);
+    obj->integrator.kind = kind;
+    obj->integrator.h = 0.0;
+  }
+}
+
+void
+pl_world_set_substeps(pl_world_t *world, unsigned max_substeps,
+                      double eta, double dv)
+{
+  world->max_substeps = max_substeps ? max_substeps : 1;
+  world->substep_eta = eta;
+  world->substep_dv = dv;
+}
+
+void
+pl_world_set_lod(pl_world_t *world, double reduced, double sleep,
+                 unsigned rate, double hysteresis)
+{
+  world->lod = reduced > 0.0;
+  world->lod_reduced = reduced;
+  world->lod_sleep = sleep > reduced ? sleep : reduced;
+  world->lod_rate = rate ? rate : 1;
+  world->lod_hysteresis = hysteresis;
+  world->lod_frame = 0;
+}
+
+void
+pl_world_set_lod_focus(pl_world_t *world, const lwcoord_t *p)
+{
+  world->lod_focus = *p;
+}
+
+void
+pl_world_set_ephemeris(pl_world_t *world, pl_ephemeris_t *eph)
+{
+  if (world->ephemeris) pl_ephemeris_close(world->ephemeris);
+  world->ephemeris = eph;
+}
+
+void
+pl_world_set_eclipses(pl_world_t *world, bool eclipses)
+{
+  if (eclipses && world->eclipse == NULL) {
+    world->eclipse = pl_new_eclipse();
+  } else if (!eclipses && world->eclipse) {
+    pl_eclipse_delete(world->eclipse);
+    world->eclipse = NULL;
+  }
+}
+
+void
+pl_world_set_rails(pl_world_t *world, bool rails)
+{
+  world->rails = rails;
+  if (!rails) {
+    ARRAY_FOR_EACH(i, world->root_bodies) {
+      pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+      obj->on_rails = false;
+    }
+  }
+}
+
+double3
+pl_world_gravity_at(void *data, const lwcoord_t *p)
+{
+  pl_world_t *world = data;
+  return pl_octtree_gravity_at(world->octtree, p);
+}
+
+double3
+pl_world_object_gravity_at(void *data, const lwcoord_t *p)
+{
+  pl_object_t *obj = data;
+
+  // The non-spherical part is held constant over the step
+  if (pl_world_is_patched(obj->world, obj)) {
+    return pl_world_patched_field(obj->dominator, lwc_globald(p))
+         + obj->g_harmonic;
+  }
+  return pl_octtree_gravity_at(obj->world->octtree, p) + obj->g_harmonic;
+}
+
+size_t
+pl_world_query_radius(pl_world_t *world, const lwcoord_t *p, double r,
+                      obj_array_t *result)
+{
+  return pl_octtree_query_radius(world->octtree, p, r, result);
+}
+
+size_t
+pl_world_query_nearest(pl_world_t *world, const lwcoord_t *p, size_t k,
+                       obj_array_t *result)
+{
+  return pl_octtree_query_nearest(world->octtree, p, k, result);
+}
+
+size_t
+pl_world_query_box(pl_world_t *world, const lwcoord_t *centre, double3 half,
+                   obj_array_t *result)
+{
+  return pl_octtree_query_box(world->octtree, centre, half, result);
+}
+
+pl_object_t*
+pl_world_query_ray(pl_world_t *world, const lwcoord_t *origin, double3 dir,
+                   double max_dist, const pl_object_t *ignore, double *dist)
+{
+  return pl_octtree_query_ray(world->octtree, origin, dir, max_dist, ignore,
+                              dist);
+}
+
+pl_object_t*
+pl_world_query_segment(pl_world_t *world, const lwcoord_t *a,
+                       const lwcoord_t *b, const pl_object_t *ignore,
+                       double *t)
+{
+  double3 d = lwc_dist(b, a);
+  double len = vd3_abs(d);
+  double dist;
+
+  if (len == 0.0) return NULL;
+
+  pl_object_t *hit = pl_octtree_query_ray(world->octtree, a, d, len, ignore,
+                                          &dist);
+  if (hit && t) *t = dist / len;
+  return hit;
+}
 
 pl_celobject_t*
 pl_world_get_celobject(pl_world_t *world, const char *celobj)
@@ -115,6 +1062,7 @@ void
 pl_world_add_celobject(pl_world_t *world, pl_celobject_t *celobj)
 {
   avl_insert(world->celestial_dict, celobj->cm_orbit->name, celobj);
+  obj_array_push(&world->celestial_objects, celobj);
 }
 
 void
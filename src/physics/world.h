@@ -20,12 +20,35 @@
 #ifndef orbit_pl_world_h
 #define orbit_pl_world_h
 
+#include <stdbool.h>
 #include <gencds/array.h>
 #include <gencds/avl-tree.h>
+#include "common/task-pool.h"
 #include "physics/reftypes.h"
 #include "physics/barneshut.h"
+#include "physics/bodystore.h"
 #include "physics/collision.h"
+#include "physics/eclipse.h"
+#include "physics/ephemeris.h"
 #include "physics/octtree.h"
+#include "physics/integrator.h"
+
+typedef enum {
+  PL_GRAVITY_OCTTREE, // Pointer based Barnes-Hut octtree
+  PL_GRAVITY_LINEAR_OCTTREE, // Morton ordered Barnes-Hut tree
+  PL_GRAVITY_FMM, // Fast multipole method on the octtree
+  PL_GRAVITY_PATCHED_CONIC, // Dominator and its strongest perturbers only
+} pl_gravity_mode_t;
+
+#define PL_MAX_PERTURBERS 4
+
+// Physics level of detail of a root body, see pl_world_set_lod
+typedef enum {
+  PL_LOD_FULL, // Integrated every step
+  PL_LOD_REDUCED, // Integrated every lod_rate steps, drifting in between
+  PL_LOD_SLEEPING, // On rails or drifting, ignored by collision detection
+  PL_LOD_COUNT
+} pl_lod_t;
 
 struct pl_world_t {
   pl_octtree_t *octtree;
@@ -35,6 +58,56 @@ struct pl_world_t {
   obj_array_t celestial_objects;
   obj_array_t particle_systems;
 
+  pl_bodystore_t *bodystore; // Non-NULL if root bodies are stepped in a batch
+  task_pool_t *tasks; // Non-NULL if the world is stepped multi-threaded
+  pl_ephemeris_t *ephemeris; // Non-NULL if celestial objects use the cache
+  pl_eclipse_t *eclipse; // Non-NULL if the sunlight of bodies is computed
+
+  pl_integrator_kind_t integrator; // Integrator of new objects
+  pl_gravity_mode_t gravity_mode;
+  int fmm_order; // Expansion order used in PL_GRAVITY_FMM mode
+  unsigned perturbers; // Perturbers used in PL_GRAVITY_PATCHED_CONIC mode
+  unsigned harmonics_degree; // Of the non-spherical gravity, 0 if disabled
+  unsigned harmonics_order;
+
+  // Multi-rate stepping, see pl_world_set_substeps
+  unsigned max_substeps;
+  double substep_eta;
+  double substep_dv;
+
+  bool rails; // Propagate unpowered root bodies analytically
+  double t; // Simulated time in s, advanced by pl_world_step
+  double jde; // Date of the celestial objects in the last step, 0 if none
+
+  // Distance based level of detail, see pl_world_set_lod
+  bool lod;
+  lwcoord_t lod_focus;
+  double lod_reduced; // Distance from the focus to the reduced tier
+  double lod_sleep; // Distance from the focus to the sleeping tier
+  double lod_hysteresis; // Relative width of the band around the distances
+  unsigned lod_rate; // Steps per integration in the reduced tier
+  unsigned lod_frame; // Steps taken since the level of detail was enabled
+
+  // Substep statistics of the last step, for profiling
+  size_t substeps_total;
+  unsigned substeps_max;
+  size_t rails_count; // Root bodies propagated on rails
+  size_t atm_count; // Root bodies inside an atmosphere
+  size_t lod_count[PL_LOD_COUNT]; // Root bodies in each level of detail
+
+  // Scratch buffers of the batched atmosphere and drag pass
+  size_t atm_cap;
+  pl_object_t **atm_obj;
+  float *atm_h;
+  float *atm_P;
+  float *atm_p;
+
+  // Scratch buffers of the batched non-spherical gravity pass
+  size_t harm_cap;
+  pl_object_t **harm_obj;
+  double3 *harm_r;
+  double3 *harm_acc;
+
   avl_tree_t *celestial_dict;
 };
 
@@ -42,6 +115,145 @@ pl_world_t* pl_new_world(double size);
 void pl_world_delete(pl_world_t *world);
 void pl_world_step(pl_world_t *world, double jde, double dt);
 void pl_world_clear(pl_world_t *world);
+
+/*! Enable or disable batched integration of root bodies. When enabled, the
+    integration state is mirrored in a structure of arrays and all root bodies
+    are stepped in one pass instead of one pl_object_step call per body.
+ */
+void pl_world_set_batched(pl_world_t *world, bool batched);
+
+/*! Set number of threads used for computing gravity, stepping root bodies and
+    testing collision pairs.
+    One thread steps the world on the calling thread only, zero uses one thread
+    per online CPU.
+ */
+void pl_world_set_threads(pl_world_t *world, unsigned threads);
+
+/*! Select how gravity from the celestial bodies is computed */
+void pl_world_set_gravity_mode(pl_world_t *world, pl_gravity_mode_t mode);
+/*! Set expansion order for the fast multipole gravity mode, higher orders
+    are more accurate but more expensive. */
+void pl_world_set_fmm_order(pl_world_t *world, int order);
+/*! Set the number of perturbers used in the patched conic gravity mode.
+
+    In the patched conic mode root bodies are only attracted by their
+    dominator and the n celestial objects with the strongest tidal pull at the
+    dominator, all other celestial objects only contribute through the
+    acceleration of the dominator itself. The dominator is reassigned when a
+    body crosses a sphere of influence. At most PL_MAX_PERTURBERS are used.
+ */
+void pl_world_set_perturbers(pl_world_t *world, unsigned n);
+/*! Set the degree and order of the non-spherical gravity of the celestial
+    objects with a gravity field, see pl_celobject_set_geopotential. Root
+    bodies feel the field of their dominator, which is evaluated for all
+    bodies in one batched pass per step and held constant during the step
+    like the applied forces. A degree below 2 disables the pass.
+ */
+void pl_world_set_harmonics(pl_world_t *world, unsigned degree,
+                            unsigned order);
+/*! Select the broadphase used for collision detection */
+void pl_world_set_broadphase(pl_world_t *world, pl_broadphase_t broadphase);
+/*! Set the integrator of all rigid bodies and of objects created later. The
+    batched body store only implements the Euler integrator, other integrators
+    step the bodies one by one. */
+void pl_world_set_integrator(pl_world_t *world, pl_integrator_kind_t kind);
+
+/*! Configure multi-rate stepping of root bodies. Each body is split in
+    substeps so that a substep is shorter than eta times the dynamical time
+    1/sqrt(|grad g|) of the local gravity field, and so that thrust changes the
+    velocity with at most dv per substep. The chosen rate is stored in the
+    step_rate member of the bodies.
+    \param max_substeps Upper bound on substeps, 1 disables multi-rate stepping
+ */
+void pl_world_set_substeps(pl_world_t *world, unsigned max_substeps,
+                           double eta, double dv);
+
+/*! Enable or disable on-rails propagation. Root bodies with no accumulated
+    force or torque are then moved along a two-body orbit about their
+    dominator instead of being integrated. A body is put back under numeric
+    integration as soon as a force or torque is applied to it, its state is
+    set explicitly, or it leaves the sphere of influence of the dominator or
+    enters the one of a body orbiting the dominator. Bodies dominated by a
+    celestial object with a gravity field are not put on rails while the
+    non-spherical gravity is enabled, see pl_world_set_harmonics.
+ */
+void pl_world_set_rails(pl_world_t *world, bool rails);
+
+/*! Configure the distance based level of detail of root bodies. Bodies within
+    reduced metres of the focus are integrated every step, bodies further away
+    are integrated every rate steps with the accumulated step length and drift
+    along their velocity in between, and bodies beyond sleep metres are put
+    to sleep. Sleeping bodies are moved along a two-body orbit about their
+    dominator if they have one, and drift otherwise, and they are ignored by
+    collision detection.
+
+    A body only changes tier when it is more than hysteresis times the
+    distance on the other side of it, so bodies near a boundary do not flip
+    between tiers every step. Bodies with forces or torques applied always
+    use the full tier. Reduced integration steps are staggered over the
+    bodies so that the work per step stays even.
+    \param reduced Distance to the reduced tier, zero or less disables the
+           level of detail and puts all bodies in the full tier
+    \param sleep Distance to the sleeping tier, at least reduced
+ */
+void pl_world_set_lod(pl_world_t *world, double reduced, double sleep,
+                      unsigned rate, double hysteresis);
+/*! Set the point distances are measured from, typically the position of the
+    active spacecraft or the camera */
+void pl_world_set_lod_focus(pl_world_t *world, const lwcoord_t *p);
+
+/*! Evaluate the celestial objects from an ephemeris cache instead of the
+    celestial mechanics model, the world takes ownership of the cache. Steps
+    outside the cache fall back to the model. Pass NULL to use the model only.
+ */
+void pl_world_set_ephemeris(pl_world_t *world, pl_ephemeris_t *eph);
+
+/*! Enable or disable computation of sunlight. When enabled, the sunlight
+    and occluder members of all rigid bodies are updated at the end of each
+    step. Sub objects get the sunlight of their root body.
+ */
+void pl_world_set_eclipses(pl_world_t *world, bool eclipses);
+
+/*! Update the primary and the sphere of influence of all celestial objects */
+void pl_world_update_soi(pl_world_t *world);
+
+/*! Gravitational acceleration at p, usable as integrator field function */
+double3 pl_world_gravity_at(void *world, const lwcoord_t *p);
+/*! Gravitational acceleration at p acting on the root body obj, usable as
+    integrator field function. Unlike pl_world_gravity_at this respects the
+    patched conic gravity mode. */
+double3 pl_world_object_gravity_at(void *obj, const lwcoord_t *p);
+
+/*! Spatial queries over the root bodies, backed by the octtree. Positions are
+    large world coordinates, distances are in metres. The queries see the
+    positions at the end of the last world step, or as set since.
+
+    The bodies found are appended to result and their number is returned.
+ */
+size_t pl_world_query_radius(pl_world_t *world, const lwcoord_t *p, double r,
+                             obj_array_t *result);
+/*! Find the k bodies closest to p, they are appended closest first */
+size_t pl_world_query_nearest(pl_world_t *world, const lwcoord_t *p, size_t k,
+                              obj_array_t *result);
+/*! Find the bodies with their centre in the box with the given centre and half
+    extents along the world axes */
+size_t pl_world_query_box(pl_world_t *world, const lwcoord_t *centre,
+                          double3 half, obj_array_t *result);
+/*! Cast a ray from origin along dir and return the first body hit within
+    max_dist, or NULL. Bodies are spheres of their collision radius.
+    \param ignore Body not tested, typically the one casting the ray, or NULL
+    \param dist Set to the distance to the hit point, if there is one
+ */
+pl_object_t* pl_world_query_ray(pl_world_t *world, const lwcoord_t *origin,
+                                double3 dir, double max_dist,
+                                const pl_object_t *ignore, double *dist);
+/*! Cast a segment from a to b, see pl_world_query_ray
+    \param t Set to the position of the hit along the segment, in [0, 1]
+ */
+pl_object_t* pl_world_query_segment(pl_world_t *world, const lwcoord_t *a,
+                                    const lwcoord_t *b,
+                                    const pl_object_t *ignore, double *t);
+
 pl_celobject_t* pl_world_get_celobject(pl_world_t *world, const char *celobj);
 void pl_world_add_celobject(pl_world_t *world, pl_celobject_t *celobj);
 
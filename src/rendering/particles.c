@@ -41,10 +41,8 @@ sgDrawParticles(SGparticles *sp)
   // glDisable(GL_LIGHTING);
   //  glBegin(GL_POINTS);
   //glColor3f(sp->ps->rgb.x, sp->ps->rgb.y, sp->ps->rgb.z);
-  //for (int i = 0 ; i < sp->ps->particleCount ; ++ i) {
-  //  if (sp->ps->particles[i].active) {
-  //    glVertex3f(sp->ps->particles[i].p.x, sp->ps->particles[i].p.y, sp->ps->particles[i].p.z);
-  // }
+  //for (size_t i = 0 ; i < sp->ps->alive ; ++ i) {
+  //  glVertex3f(sp->ps->part_p[i].x, sp->ps->part_p[i].y, sp->ps->part_p[i].z);
   //}
   //glEnd();
   //glPopMatrix();
@@ -17,11 +17,15 @@
   along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <errno.h>
 #include <time.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
 #include "sim.h"
@@ -43,7 +47,7 @@
 
 #include <openorbit/log.h>
 
-sim_state_t gSIM_state = {0.0, NULL, NULL, NULL, NULL};
+sim_state_t gSIM_state = {0.0, NULL, NULL, NULL, NULL, NULL};
 
 void sim_setup_menus(sim_state_t *state);
 
@@ -128,8 +132,127 @@ sim_init(void)
   io_init();
 
   gSIM_state.world = sim_load_world(sim_get_scene(), "data/solsystem.hrml");
+
+  bool batched;
+  config_get_bool_def("openorbit/sim/batched", &batched, false);
+  pl_world_set_batched(gSIM_state.world, batched);
+
+  int threads;
+  config_get_int_def("openorbit/sim/threads", &threads, 1);
+  pl_world_set_threads(gSIM_state.world, threads < 0 ? 1 : threads);
+
+  const char *integrator = NULL;
+  config_get_str_def("openorbit/sim/integrator", &integrator, "euler");
+  pl_integrator_kind_t kind = pl_integrator_from_name(integrator);
+  if (kind == PL_INTEGRATOR_COUNT) {
+    log_warn("unknown integrator '%s', using euler", integrator);
+    kind = PL_INTEGRATOR_EULER;
+  }
+  pl_world_set_integrator(gSIM_state.world, kind);
+
+  int max_substeps;
+  float substep_eta, substep_dv;
+  config_get_int_def("openorbit/sim/max-substeps", &max_substeps, 1);
+  config_get_float_def("openorbit/sim/substep-eta", &substep_eta, 0.01);
+  config_get_float_def("openorbit/sim/substep-dv", &substep_dv, 1.0);
+  pl_world_set_substeps(gSIM_state.world, max_substeps < 1 ? 1 : max_substeps,
+                        substep_eta, substep_dv);
+
+  bool rails;
+  config_get_bool_def("openorbit/sim/rails", &rails, false);
+  pl_world_set_rails(gSIM_state.world, rails);
+
+  float lod_reduced, lod_sleep, lod_hysteresis;
+  int lod_rate;
+  config_get_float_def("openorbit/sim/lod-reduced", &lod_reduced, 0.0);
+  config_get_float_def("openorbit/sim/lod-sleep", &lod_sleep, 0.0);
+  config_get_int_def("openorbit/sim/lod-rate", &lod_rate, 4);
+  config_get_float_def("openorbit/sim/lod-hysteresis", &lod_hysteresis, 0.1);
+  pl_world_set_lod(gSIM_state.world, lod_reduced, lod_sleep,
+                   lod_rate < 1 ? 1 : lod_rate, lod_hysteresis);
+
+  int harmonics_degree, harmonics_order;
+  config_get_int_def("openorbit/sim/harmonics-degree", &harmonics_degree, 0);
+  config_get_int_def("openorbit/sim/harmonics-order", &harmonics_order,
+                     harmonics_degree);
+  pl_world_set_harmonics(gSIM_state.world,
+                         harmonics_degree < 0 ? 0 : harmonics_degree,
+                         harmonics_order < 0 ? 0 : harmonics_order);
+
+  bool eclipses;
+  config_get_bool_def("openorbit/sim/eclipses", &eclipses, false);
+  pl_world_set_eclipses(gSIM_state.world, eclipses);
+
+  int fmm_order;
+  config_get_int_def("openorbit/sim/fmm-order", &fmm_order, 4);
+  pl_world_set_fmm_order(gSIM_state.world, fmm_order);
+
+  int perturbers;
+  config_get_int_def("openorbit/sim/perturbers", &perturbers, 2);
+  pl_world_set_perturbers(gSIM_state.world, perturbers < 0 ? 0 : perturbers);
+
+  const char *broadphase = NULL;
+  config_get_str_def("openorbit/sim/broadphase", &broadphase, "recgrid");
+  if (!strcmp(broadphase, "sweep-prune")) {
+    pl_world_set_broadphase(gSIM_state.world, PL_BROADPHASE_SWEEP_PRUNE);
+  } else if (!strcmp(broadphase, "recgrid")) {
+    pl_world_set_broadphase(gSIM_state.world, PL_BROADPHASE_RECGRID);
+  } else {
+    log_warn("unknown broadphase '%s', using recgrid", broadphase);
+  }
+
+  const char *gravity = NULL;
+  config_get_str_def("openorbit/sim/gravity", &gravity, "octtree");
+  if (!strcmp(gravity, "fmm")) {
+    pl_world_set_gravity_mode(gSIM_state.world, PL_GRAVITY_FMM);
+  } else if (!strcmp(gravity, "linear-octtree")) {
+    pl_world_set_gravity_mode(gSIM_state.world, PL_GRAVITY_LINEAR_OCTTREE);
+  } else if (!strcmp(gravity, "patched-conic")) {
+    pl_world_set_gravity_mode(gSIM_state.world, PL_GRAVITY_PATCHED_CONIC);
+  } else if (!strcmp(gravity, "octtree")) {
+    pl_world_set_gravity_mode(gSIM_state.world, PL_GRAVITY_OCTTREE);
+  } else {
+    log_warn("unknown gravity mode '%s', using octtree", gravity);
+  }
+
+  bool ephemeris;
+  config_get_bool_def("openorbit/sim/ephemeris", &ephemeris, false);
+  if (ephemeris) {
+    int days;
+    config_get_int_def("openorbit/sim/ephemeris-days", &days, 64);
+
+    // The cache is regenerated if the system description changes
+    char *source = rsrc_get_path("data/solsystem.hrml");
+    const char *home = getenv("HOME");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.openorbit", home ? home : ".");
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+      log_warn("could not create '%s': %s", path, strerror(errno));
+    }
+    strncat(path, "/ephemeris.cache", sizeof(path) - strlen(path) - 1);
+
+    double jd = sim_time_get_jd();
+    pl_ephemeris_t *eph = pl_ephemeris_open(gSIM_state.world, path,
+                                            pl_ephemeris_hash_file(source),
+                                            jd - 1.0, jd + days);
+    pl_world_set_ephemeris(gSIM_state.world, eph);
+    free(source);
+  }
+
   pl_time_set(sim_time_get_jd());
 
+  bool predict;
+  config_get_bool_def("openorbit/sim/predict", &predict, false);
+  if (predict) {
+    float predict_horizon;
+    int predict_samples;
+    config_get_float_def("openorbit/sim/predict-horizon", &predict_horizon,
+                         5400.0);
+    config_get_int_def("openorbit/sim/predict-samples", &predict_samples, 512);
+    if (predict_samples < 1) predict_samples = 1;
+    gSIM_state.predictor = pl_new_predictor(predict_horizon, predict_samples);
+  }
+
 
   sim_spacecraft_t *sc = sim_new_spacecraft("Mercury", "Mercury I");
   sim_spacecraft_set_sys_and_coords(sc, "Earth",
@@ -217,9 +340,35 @@ sim_step(float dt)
 
   double jde = sim_time_get_jd();
   time_t time = sim_time_get_time();
+  if (gSIM_state.currentSc) {
+    pl_world_set_lod_focus(gSIM_state.world, &gSIM_state.currentSc->obj->p);
+  }
+
+  // The spacecraft has applied its engines, the world step clears the forces
+  double3 sc_acc = vd3_set(0.0, 0.0, 0.0);
+  if (gSIM_state.currentSc) {
+    pl_object_t *obj = gSIM_state.currentSc->obj;
+    sc_acc = obj->f_ack / obj->m.m;
+  }
+
   pl_world_step(gSIM_state.world, jde, dt);
 
   log_trace("sim step %.15f = %lld, delta %.15f", jde, time, dt);
+  log_trace("physics substeps: %zu total, %u max, %zu bodies on rails, "
+            "%zu in atmosphere",
+            gSIM_state.world->substeps_total, gSIM_state.world->substeps_max,
+            gSIM_state.world->rails_count, gSIM_state.world->atm_count);
+  log_trace("physics level of detail: %zu full, %zu reduced, %zu sleeping",
+            gSIM_state.world->lod_count[PL_LOD_FULL],
+            gSIM_state.world->lod_count[PL_LOD_REDUCED],
+            gSIM_state.world->lod_count[PL_LOD_SLEEPING]);
+
+  // Only posts the new state, the predictor runs on its own thread
+  if (gSIM_state.predictor && gSIM_state.currentSc &&
+      gSIM_state.currentSc->obj->dominator) {
+    pl_predictor_request(gSIM_state.predictor, gSIM_state.currentSc->obj,
+                         gSIM_state.world->t, sc_acc);
+  }
 
   sg_scene_sync(sim_get_scene());
 }
@@ -251,6 +400,12 @@ sim_get_world(void)
   return gSIM_state.world;
 }
 
+pl_predictor_t*
+sim_get_predictor(void)
+{
+  return gSIM_state.predictor;
+}
+
 void
 menu_camera(void *arg)
 {
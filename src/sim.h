@@ -28,6 +28,7 @@ extern "C" {
 #include "rendering/types.h"
 #include "physics/physics.h"
 #include "physics/orbit.h"
+#include "physics/predictor.h"
 #include "rendering/scenegraph.h"
 #include "sim/spacecraft.h"
 #include "sim/simtime.h"
@@ -39,6 +40,7 @@ typedef struct {
   pl_system_t *orbSys;   //!< Root orbit system, this will be the sun initially
   pl_world_t *world;
   sg_window_t *win;
+  pl_predictor_t *predictor; //!< Trajectory of the current spacecraft
 } sim_state_t;
 
 void sim_init(void);
@@ -53,6 +55,10 @@ void sim_set_spacecraft(sim_spacecraft_t *sc);
 sim_spacecraft_t* sim_get_spacecraft(void);
 sim_event_queue_t* sim_get_event_queue(void);
 pl_world_t* sim_get_world(void);
+/*! Trajectory predictor of the current spacecraft, readers take its
+    trajectory with pl_predictor_acquire and pl_predictor_release. NULL unless
+    openorbit/sim/predict is set. */
+pl_predictor_t* sim_get_predictor(void);
 
 #ifdef __cplusplus
 }
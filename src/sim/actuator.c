@@ -80,9 +80,9 @@ thruster_step(sim_engine_t *engine, float dt)
 {
   sim_thruster_t *thruster = (sim_thruster_t*)engine;
 
-  pl_object_force_relative_pos3fv(thruster->super.stage->sc->obj,
-                        thruster->fMax * thruster->super.throttle,
-                        thruster->super.pos);
+  pl_object_thrust_relative_pos3fv(thruster->super.stage->obj,
+                                   thruster->fMax * thruster->super.throttle,
+                                   thruster->super.pos);
 }
 
 
@@ -131,10 +131,9 @@ void
 prop_step(sim_engine_t *engine, float dt)
 {
   sim_propengine_t *prop = (sim_propengine_t*)engine;
-  pl_object_force_relative_pos3fv(prop->super.stage->obj, prop->super.dir,
-                        prop->super.pos);
-  pl_object_torque_relative3fv(prop->super.stage->obj,
-                     vf3_set(0.0, 0.0, 0.0), prop->super.pos);
+  pl_object_thrust_relative_pos3fv(prop->super.stage->obj, prop->super.dir,
+                                   prop->super.pos);
+  pl_object_thrust_torque3fv(prop->super.stage->obj, vf3_set(0.0, 0.0, 0.0));
 }
 void
 turboprop_step(sim_engine_t *engine, float dt)
@@ -22,6 +22,7 @@
 #include <openorbit/log.h>
 #include "sim.h"
 #include "sim/spacecraft.h"
+#include "physics/celestial-object.h"
 #include "res-manager.h"
 #include "parsers/hrml.h"
 #include <vmath/vmath.h>
@@ -135,6 +136,11 @@ sim_new_spacecraft(const char *className, const char *scName)
     sim_pubsub_publish_val(rec, SIM_TYPE_FLOAT, "throttle", &sc->axises.throttle);
   }
 
+  if (sc->rec) {
+    sim_pubsub_publish_val(sc->rec, SIM_TYPE_FLOAT, "sunlight", &sc->sunlight);
+    sim_pubsub_publish_val(sc->rec, SIM_TYPE_STR, "occluder", &sc->occluder);
+  }
+
   return sc;
 }
 
@@ -234,7 +240,8 @@ sim_spacecraft_init(sim_spacecraft_t *sc, const char *name)
   sc->detatchSequence = 0;
   sc->obj = pl_new_object(world, name);
   sc->scene = NULL;//sgGetScene(sg, "main"); // Just use any of the existing ones
-  sc->expendedMass = 0.0;
+  SIM_VAL(sc->sunlight) = 1.0f;
+  SIM_VAL(sc->occluder) = "";
   sc->mainEngineOn = false;
   sc->toggleMainEngine = sim_spacecraft_default_engine_toggle;
   sc->axisUpdate = sim_spacecraft_default_axis_update;
@@ -302,9 +309,6 @@ sim_spacecraft_step(sim_spacecraft_t *sc, float dt)
 {
   assert(sc != NULL);
 
-
-  sc->expendedMass = 0.0;
-
   sim_axises_t axises;
   sim_get_axises(&axises);
 
@@ -313,9 +317,29 @@ sim_spacecraft_step(sim_spacecraft_t *sc, float dt)
   for (size_t i = 0 ; i < sc->stages.length ; ++ i) {
     sim_stage_t *stage = sc->stages.elems[i];
     sim_stage_step(stage, &axises, dt);
+    // Detached stages are bodies of their own
+    if (stage->state == SIM_STAGE_DETATCHED) {
+      pl_object_apply_thrust(stage->obj);
+    }
   }
 
-  pl_mass_mod(&sc->obj->m, sc->obj->m.m - sc->expendedMass);
+  // The engines only accumulated their thrust in the stages, reduce it into
+  // the spacecraft in one go
+  pl_object_apply_thrust(sc->obj);
+
+  // The stages have reduced their own masses
+  pl_object_update_mass(sc->obj);
+
+  // Sunlight is computed by the world, republish it when it changes
+  if (SIM_VAL(sc->sunlight) != sc->obj->sunlight) {
+    SIM_VAL(sc->sunlight) = sc->obj->sunlight;
+    SIM_VAL(sc->occluder) = sc->obj->occluder
+                          ? (char*)sc->obj->occluder->cm_orbit->name : "";
+    if (SIM_REF(sc->sunlight)) {
+      sim_pubsub_notify_changed_val(&sc->sunlight);
+      sim_pubsub_notify_changed_val(&sc->occluder);
+    }
+  }
 
   sc->poststep(sc, dt);
 }
@@ -383,8 +407,9 @@ sim_stage_step(sim_stage_t *stage, sim_axises_t *axises, float dt) {
     }
   }
 
-  pl_mass_mod(&stage->obj->m, stage->obj->m.m - stage->expendedMass);
-  stage->sc->expendedMass += stage->expendedMass;
+  if (stage->expendedMass > 0.0f) {
+    pl_object_mod_mass(stage->obj, stage->obj->m.m - stage->expendedMass);
+  }
 }
 
 sim_stage_t*
@@ -423,14 +448,14 @@ void
 sim_stage_set_offset3f(sim_stage_t *stage, float x, float y, float z)
 {
   stage->pos = vf3_set(x, y, z);
-  stage->obj->p_offset = vd3_set(x, y, z);
+  pl_object_set_offset3dv(stage->obj, vd3_set(x, y, z));
 }
 
 void
 sim_stage_set_offset3fv(sim_stage_t *stage, float3 p)
 {
   stage->pos = p;
-  stage->obj->p_offset = vf3_to_vd3(p);
+  pl_object_set_offset3dv(stage->obj, vf3_to_vd3(p));
 }
 
 void
@@ -670,7 +695,6 @@ InitSpacecraft(sim_class_t *cls, void *obj, void *arg)
   sc->detatchSequence = 0;
   sc->obj = pl_new_object(world, args->name);
   sc->scene = sim_get_scene(); // Just use any of the existing ones
-  sc->expendedMass = 0.0;
   sc->mainEngineOn = false;
   sc->toggleMainEngine = sim_spacecraft_default_engine_toggle;
   sc->axisUpdate = sim_spacecraft_default_axis_update;
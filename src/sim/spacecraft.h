@@ -137,7 +137,8 @@ struct sim_spacecraft_t {
 
   sim_sc_action_fn_t axisUpdate;
 
-  float expendedMass;
+  sim_float_t sunlight; // Visible fraction of the sun, published as sunlight
+  sim_str_t occluder; // Name of the body shadowing the sun, "" if none
 
   sg_scene_t *scene;
   sg_object_t *sgobj;
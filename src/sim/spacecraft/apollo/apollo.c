@@ -234,6 +234,7 @@ ApolloInit(sim_spacecraft_t *sc)
   pl_mass_mod(&sat_1c->obj->m, 24000.0 + 2200.0);
   pl_mass_translate(&sat_1c->obj->m, 0.0, 8.9916, 0.0);
   pl_mass_set_min(&sat_1c->obj->m, 4400.0);
+  pl_object_invalidate_mass(sat_1c->obj); // m was edited directly
   pl_object_set_drag_coef(sat_1c->obj, 0.5);
   pl_object_set_area(sat_1c->obj, 2.0*M_PI);
 
@@ -187,6 +187,7 @@ GemeniInit(sim_spacecraft_t *sc)
   pl_mass_mod(&redstone->obj->m, 24000.0 + 2200.0);
   pl_mass_translate(&redstone->obj->m, 0.0, 8.9916, 0.0);
   pl_mass_setmin(&redstone->obj->m, 4400.0);
+  pl_object_invalidate_mass(redstone->obj); // m was edited directly
   plSetDragCoef(redstone->obj, 0.5);
   plSetArea(redstone->obj, 2.0*M_PI);
 
@@ -208,6 +209,7 @@ GemeniInit(sim_spacecraft_t *sc)
   pl_mass_mod(&capsule->obj->m, 1354.0);
   pl_mass_translate(&capsule->obj->m, 0.0, 0.55, 0.0);
   pl_mass_set_min(&capsule->obj->m, 1354.0);
+  pl_object_invalidate_mass(capsule->obj); // m was edited directly
   plSetDragCoef(capsule->obj, 0.5);
   plSetArea(capsule->obj, 2.0*M_PI);
 
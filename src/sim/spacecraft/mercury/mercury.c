@@ -244,6 +244,7 @@ MercuryInit(sim_spacecraft_t *sc)
   pl_mass_mod(&redstone->obj->m, 24000.0 + 2200.0);
   pl_mass_translate(&redstone->obj->m, 0.0, 8.9916, 0.0);
   pl_mass_set_min(&redstone->obj->m, 4400.0);
+  pl_object_invalidate_mass(redstone->obj); // m was edited directly
   pl_object_set_drag_coef(redstone->obj, 0.5);
   pl_object_set_area(redstone->obj, 2.0*M_PI);
 
@@ -265,6 +266,7 @@ MercuryInit(sim_spacecraft_t *sc)
   pl_mass_mod(&capsule->obj->m, 1354.0);
   pl_mass_translate(&capsule->obj->m, 0.0, 0.55, 0.0);
   pl_mass_set_min(&capsule->obj->m, 1354.0);
+  pl_object_invalidate_mass(capsule->obj); // m was edited directly
   pl_object_set_drag_coef(capsule->obj, 0.5);
   pl_object_set_area(capsule->obj, 2.0*M_PI);
 
@@ -23,6 +23,8 @@
 #include "physics/physics.h"
 #include "physics/reftypes.h"
 #include "physics/areodynamics.h"
+#include "physics/celestial-object.h"
+#include "physics/geopotential.h"
 
 #include "parsers/hrml.h"
 #include "res-manager.h"
@@ -259,6 +261,46 @@ load_atm(HRMLobject *obj)
   return atm;
 }
 
+// Fully normalised coefficients packed by degree and then order, the degree
+// follows from the length of the arrays
+pl_geopotential_t*
+load_gravity_field(HRMLobject *obj)
+{
+  double R = NAN;
+  const double *C = NULL, *S = NULL;
+  size_t C_len = 0, S_len = 0;
+  for ( ; obj != NULL; obj = obj->next) {
+    if (!strcmp(obj->name, "reference-radius")) {
+      R = hrmlGetReal(obj);
+    } else if (!strcmp(obj->name, "C")) {
+      C = hrmlGetRealArray(obj);
+      C_len = hrmlGetRealArrayLen(obj);
+    } else if (!strcmp(obj->name, "S")) {
+      S = hrmlGetRealArray(obj);
+      S_len = hrmlGetRealArrayLen(obj);
+    }
+  }
+
+  if (!isfinite(R)) {
+    log_error("gravity field reference-radius not set / finite");
+    return NULL;
+  }
+  if (!C || (S && S_len != C_len)) {
+    log_error("gravity field needs C and optionally S of equal length");
+    return NULL;
+  }
+
+  unsigned degree = 0;
+  while (PL_GEOPOTENTIAL_IDX(degree + 2, 0) <= C_len) degree ++;
+  if (PL_GEOPOTENTIAL_IDX(degree + 1, 0) != C_len) {
+    log_error("gravity field coefficient count %d is not a full degree",
+              (int)C_len);
+    return NULL;
+  }
+
+  return pl_new_geopotential(degree, degree, R, C, S);
+}
+
 void
 ooLoadPlanet__(pl_world_t *world, HRMLobject *obj, sg_scene_t *sc)
 {
@@ -268,6 +310,7 @@ ooLoadPlanet__(pl_world_t *world, HRMLobject *obj, sg_scene_t *sc)
   HRMLvalue planetName = hrmlGetAttrForName(obj, "name");
 
   pl_atm_template_t *atm = NULL;
+  pl_geopotential_t *geo = NULL;
   double semiMajor = NAN, ecc = NAN;
   //double pressure = 0.0, scale_height = 1.0; //TODO
   const char *tex = NULL;
@@ -292,6 +335,8 @@ ooLoadPlanet__(pl_world_t *world, HRMLobject *obj, sg_scene_t *sc)
       }
     } else if (!strcmp(child->name, "atmosphere")) {
       atm = load_atm(child->children);
+    } else if (!strcmp(child->name, "gravity-field")) {
+      geo = load_gravity_field(child->children);
     } else if (!strcmp(child->name, "rendering")) {
       for (HRMLobject *rend = child->children; rend != NULL; rend = rend->next) {
         if (!strcmp(rend->name, "model")) {
@@ -350,8 +395,13 @@ ooLoadPlanet__(pl_world_t *world, HRMLobject *obj, sg_scene_t *sc)
 
 
   sg_scene_add_object(sc, ellipse);
-  //sys->orbitalBody->atm = NULL; // Init as vaccuum
-  //if (atm) sys->orbitalBody->atm = pl_new_atmosphere(1000.0, 100000.0, atm);
+  if (atm) {
+    celbody->atm = pl_new_atmosphere(1000.0, 100000.0, atm);
+    free(atm);
+  }
+  if (geo) {
+    pl_celobject_set_geopotential(celbody, geo);
+  }
 
   sg_object_set_celestial_body(drawable, celbody);
   //sg_object_set_rigid_body(drawable, &sys->orbitalBody->obj);
@@ -17,10 +17,24 @@
   along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <check.h>
+#include "common/task-pool.h"
 #include "physics/physics.h"
+#include "physics/areodynamics.h"
+#include "physics/octtree.h"
+#include "physics/particles.h"
+#include "physics/conjunction.h"
+#include "physics/geopotential.h"
+#include "physics/lambert.h"
+#include "physics/linear-octtree.h"
+#include "physics/porkchop.h"
+#include "physics/predictor.h"
+#include <celmek/celmek.h>
 #include "vmath/vmath.h"
 
 #define IN_RANGE(v, a, b) ((a <= v) && (v <= b))
@@ -45,6 +59,1524 @@ START_TEST(test_create_obj)
 }
 END_TEST
 
+START_TEST(test_bodystore_step)
+{
+  pl_object_t a, b, c;
+
+  pl_object_init(&a);
+  pl_mass_set(&a.m, 10.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  pl_object_compute_derived(&a);
+  a.v = vd3_set(1.0, 2.0, 3.0);
+  a.angVel = vd3_set(0.0, 0.1, 0.0);
+  a.f_ack = vd3_set(10.0, 0.0, 0.0);
+  a.g_ack = vd3_set(0.0, 0.0, -98.1);
+  a.t_ack = vd3_set(0.0, 0.0, 1.0);
+  b = a;
+  obj_array_init(&b.children);
+  c = a;
+  obj_array_init(&c.children);
+
+  pl_object_step(&a, 0.5);
+
+  // Slot 0 is left out of the batch
+  pl_bodystore_t *store = pl_new_bodystore(0);
+  pl_bodystore_resize(store, 2);
+  pl_bodystore_load(store, 1, &b, 0.5);
+  pl_bodystore_step(store);
+  pl_bodystore_store(store, 0);
+  pl_bodystore_store(store, 1);
+
+  fail_unless(vd3_abs(a.v - b.v) < 1.0e-9, "batched velocity differs");
+  fail_unless(vd3_abs(lwc_dist(&a.p, &b.p)) < 1.0e-9,
+              "batched position differs");
+  fail_unless(vd3_abs(a.angVel - b.angVel) < 1.0e-9,
+              "batched angular velocity differs");
+  fail_unless(vd3_abs(c.v - vd3_set(1.0, 2.0, 3.0)) == 0.0,
+              "slot that was not loaded was stepped");
+
+  pl_bodystore_delete(store);
+  obj_array_dispose(&b.children);
+  obj_array_dispose(&c.children);
+}
+END_TEST
+
+static void
+test_visit_range(void *arg, size_t begin, size_t end, unsigned worker)
+{
+  unsigned char *visits = arg;
+  for (size_t i = begin ; i < end ; i ++) visits[i] ++;
+}
+
+START_TEST(test_task_pool)
+{
+  // Uneven count and grain, so the last chunk is a partial one
+  const size_t count = 100003;
+  unsigned char *visits = calloc(count, 1);
+  task_pool_t *pool = task_pool_new(4);
+  fail_unless(task_pool_thread_count(pool) == 4, "wrong thread count");
+
+  size_t grains[] = {0, 1, 37, count + 1};
+  for (int g = 0 ; g < 4 ; g ++) {
+    memset(visits, 0, count);
+    task_pool_parallel_for(pool, count, grains[g], test_visit_range, visits);
+    for (size_t i = 0 ; i < count ; i ++) {
+      fail_unless(visits[i] == 1, "index %zu visited %d times with grain %zu",
+                  i, visits[i], grains[g]);
+    }
+  }
+
+  task_pool_delete(pool);
+  free(visits);
+}
+END_TEST
+
+START_TEST(test_threaded_world)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *worlds[2] = {pl_new_world(1.0e13), pl_new_world(1.0e13)};
+  pl_object_t *objs[2][16];
+  pl_world_set_threads(worlds[1], 4);
+  pl_time_set(jde);
+
+  for (int w = 0 ; w < 2 ; w ++) {
+    pl_celobject_t *earth = pl_world_get_celobject(worlds[w], "earth");
+    fail_unless(earth != NULL, "missing earth");
+    for (int i = 0 ; i < 16 ; i ++) {
+      char name[16];
+      snprintf(name, sizeof(name), "obj%d", i);
+      pl_object_t *obj = pl_new_object(worlds[w], name);
+      pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+      double r = 6.6e6 + i * 1.0e5;
+      pl_object_set_pos_celobj_rel(obj, earth, vd3_set(r, 0.0, i * 1.0e4));
+      pl_object_set_vel3dv(obj, earth->cm_orbit->v +
+                           vd3_set(0.0, sqrt(earth->cm_orbit->GM / r), 0.0));
+      obj->angVel = vd3_set(0.0, 0.01 * i, 0.0);
+      objs[w][i] = obj;
+    }
+  }
+
+  for (int s = 0 ; s < 100 ; s ++) {
+    for (int w = 0 ; w < 2 ; w ++) {
+      pl_world_step(worlds[w], jde + s * 10.0 / 86400.0, 10.0);
+      pl_world_clear(worlds[w]);
+    }
+  }
+
+  // Every body is stepped on its own, so the thread count must not matter
+  for (int i = 0 ; i < 16 ; i ++) {
+    pl_object_t *a = objs[0][i];
+    pl_object_t *b = objs[1][i];
+    double3 pa = lwc_globald(&a->p);
+    double3 pb = lwc_globald(&b->p);
+    for (int k = 0 ; k < 3 ; k ++) {
+      fail_unless(pa[k] == pb[k], "%s position differs", a->name);
+      fail_unless(a->v[k] == b->v[k], "%s velocity differs", a->name);
+      fail_unless(a->angVel[k] == b->angVel[k],
+                  "%s angular velocity differs", a->name);
+    }
+  }
+
+  pl_world_delete(worlds[0]);
+  pl_world_delete(worlds[1]);
+}
+END_TEST
+
+static void
+check_octtree_slots(pl_octtree_t *tree)
+{
+  ARRAY_FOR_EACH(i, tree->rigid_bodies) {
+    pl_object_t *obj = ARRAY_ELEM(tree->rigid_bodies, i);
+    fail_unless(obj->tree == tree, "object has wrong tree node");
+    fail_unless(obj->tree_slot == i, "object has wrong tree slot");
+  }
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i]) check_octtree_slots(tree->children[i]);
+  }
+}
+
+// Exact mass distribution of the subtree, compared with the maintained one
+static double
+check_octtree_cog(pl_octtree_t *tree, double3 *cog)
+{
+  double GM = 0.0;
+  double3 sum = vd3_set(0.0, 0.0, 0.0);
+  for (int i = 0 ; i < 8 ; i ++) {
+    if (tree->children[i]) {
+      double3 child_cog;
+      double child_GM = check_octtree_cog(tree->children[i], &child_cog);
+      sum += child_cog * child_GM;
+      GM += child_GM;
+    }
+  }
+  ARRAY_FOR_EACH(i, tree->celestial_bodies) {
+    pl_celobject_t *celobj = ARRAY_ELEM(tree->celestial_bodies, i);
+    sum += celobj->cm_orbit->p * celobj->cm_orbit->GM;
+    GM += celobj->cm_orbit->GM;
+  }
+  *cog = (GM > 0.0) ? sum / GM : sum;
+
+  fail_unless(!tree->dirty, "node left dirty");
+  fail_unless(fabs(tree->GM - GM) <= 1.0e-12 * GM, "node GM differs");
+  fail_unless(vd3_abs(tree->cog - *cog) <= 1.0e-9 * tree->width,
+              "node cog off by %f m", vd3_abs(tree->cog - *cog));
+  return GM;
+}
+
+START_TEST(test_octtree_moving_sources)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_time_set(jde);
+
+  // Planets move every step, their nodes are updated in place
+  for (int s = 0 ; s < 100 ; s ++) {
+    pl_world_step(world, jde + s, 86400.0);
+    pl_world_clear(world);
+  }
+
+  double3 cog;
+  check_octtree_cog(world->octtree, &cog);
+  pl_world_delete(world);
+}
+END_TEST
+
+START_TEST(test_lintree_field)
+{
+  pl_lintree_t *tree = pl_new_lintree();
+  double3 src[64];
+  double GM[64];
+
+  for (int i = 0 ; i < 64 ; i ++) {
+    src[i] = vd3_set(1.0e9 * cos(i), 1.0e9 * sin(i * 0.7), 1.0e8 * (i % 16));
+    GM[i] = 1.0e15 * (i + 1);
+    lwcoord_t p;
+    lwc_set(&p, src[i].x, src[i].y, src[i].z);
+    pl_lintree_add(tree, &p, GM[i]);
+  }
+
+  // With theta 0 every cell is opened, which is direct summation in a
+  // different order, the default theta of 0.5 is within a few percent
+  static const double theta[] = {0.0, 0.5};
+  static const double tolerance[] = {1.0e-12, 5.0e-2};
+  for (int k = 0 ; k < 2 ; k ++) {
+    pl_lintree_set_theta(tree, theta[k]);
+    pl_lintree_build(tree);
+
+    for (int i = 0 ; i < 64 ; i ++) {
+      double3 p = vd3_set(-1.0e9 * sin(i), 5.0e8 * cos(i), -4.0e7 * i);
+      double3 f = vd3_set(0.0, 0.0, 0.0);
+      for (int j = 0 ; j < 64 ; j ++) {
+        double3 dv = p - src[j];
+        double d = vd3_abs(dv);
+        f -= dv * (GM[j] * 2.0 / (d * d * d));
+      }
+
+      lwcoord_t lp;
+      lwc_set(&lp, p.x, p.y, p.z);
+      double3 tree_f = pl_lintree_compute_gravity(tree, &lp, 2.0);
+      fail_unless(vd3_abs(tree_f - f) < tolerance[k] * vd3_abs(f),
+                  "linear tree force %d off by %g with theta %f", i,
+                  vd3_abs(tree_f - f) / vd3_abs(f), theta[k]);
+    }
+  }
+
+  pl_lintree_delete(tree);
+}
+END_TEST
+
+START_TEST(test_octtree_slots)
+{
+  pl_octtree_t *tree = pl_new_octtree(vd3_set(0.0, 0.0, 0.0), 1000.0);
+  pl_object_t objs[50];
+
+  for (int i = 0 ; i < 50 ; i ++) {
+    pl_object_init(&objs[i]);
+    pl_object_set_pos3d(&objs[i], 100.0 + i, 100.0, 100.0);
+    pl_octtree_insert_rbody(tree, &objs[i]);
+  }
+  check_octtree_slots(tree);
+
+  // Move objects into other octants
+  for (int i = 0 ; i < 50 ; i += 3) {
+    pl_object_set_pos3d(&objs[i], -100.0 - i, 100.0, -100.0);
+    pl_object_update_octtree(&objs[i]);
+  }
+  check_octtree_slots(tree);
+
+  pl_octtree_delete(tree);
+}
+END_TEST
+
+START_TEST(test_fmm_field)
+{
+  pl_octtree_t *tree = pl_new_octtree(vd3_set(0.0, 0.0, 0.0), 4.0e9);
+  cm_orbit_t orbits[40];
+  pl_celobject_t celobjs[40];
+  pl_object_t objs[40];
+
+  memset(orbits, 0, sizeof(orbits));
+  memset(celobjs, 0, sizeof(celobjs));
+  for (int i = 0 ; i < 40 ; i ++) {
+    orbits[i].p = vd3_set(1.0e9 * cos(i), 1.0e9 * sin(i * 0.7), 1.0e8 * i);
+    orbits[i].GM = 1.0e15 * (i + 1);
+    celobjs[i].cm_orbit = &orbits[i];
+    pl_octtree_insert_celbody(tree, &celobjs[i]);
+
+    pl_object_init(&objs[i]);
+    objs[i].m.m = 1.0;
+    pl_object_set_pos3d(&objs[i], -1.0e9 * sin(i), 5.0e8 * cos(i), -4.0e7 * i);
+    pl_octtree_insert_rbody(tree, &objs[i]);
+  }
+
+  pl_octtree_set_fmm(tree, 6);
+  pl_octtree_update_gravity(tree);
+
+  for (int i = 0 ; i < 40 ; i ++) {
+    double3 p = lwc_globald(&objs[i].p);
+    double3 g = vd3_set(0.0, 0.0, 0.0);
+    for (int j = 0 ; j < 40 ; j ++) {
+      double3 dv = p - orbits[j].p;
+      double d = vd3_abs(dv);
+      g -= dv * (orbits[j].GM / (d * d * d));
+    }
+
+    double3 fmm_g = pl_octtree_compute_gravity(tree, &objs[i]);
+    fail_unless(vd3_abs(fmm_g - g) < 1.0e-3 * vd3_abs(g),
+                "multipole field differs from direct summation");
+  }
+
+  pl_octtree_delete(tree);
+}
+END_TEST
+
+static double3
+test_point_mass_field(void *data, const lwcoord_t *p)
+{
+  double3 r = lwc_globald(p);
+  double d = vd3_abs(r);
+  return r * (-3.986e14 / (d * d * d));
+}
+
+START_TEST(test_integrator_kepler)
+{
+  for (int k = 0 ; k < PL_INTEGRATOR_COUNT ; k ++) {
+    pl_object_t obj;
+    pl_object_init(&obj);
+    pl_mass_set(&obj.m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+    pl_object_compute_derived(&obj);
+    pl_object_set_pos3d(&obj, 7.0e6, 0.0, 0.0);
+    obj.v = vd3_set(0.0, sqrt(3.986e14 / 7.0e6), 0.0);
+    obj.integrator.kind = k;
+    obj.integrator.field = test_point_mass_field;
+
+    // One orbit is about 5830 s
+    for (int i = 0 ; i < 583 ; i ++) {
+      obj.g_ack = test_point_mass_field(NULL, &obj.p) * obj.m.m;
+      pl_object_step(&obj, 10.0);
+    }
+
+    double r = vd3_abs(lwc_globald(&obj.p));
+    fail_unless(fabs(r - 7.0e6) < 1.0e4, "%s does not keep circular orbit",
+                pl_integrator_name(k));
+  }
+}
+END_TEST
+
+static double3
+test_nan_field(void *data, const lwcoord_t *p)
+{
+  return vd3_set(NAN, NAN, NAN);
+}
+
+START_TEST(test_integrator_nonfinite)
+{
+  pl_object_t obj;
+  pl_object_init(&obj);
+  pl_mass_set(&obj.m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  pl_object_compute_derived(&obj);
+  pl_object_set_pos3d(&obj, 7.0e6, 0.0, 0.0);
+  obj.integrator.kind = PL_INTEGRATOR_RKF45;
+  obj.integrator.field = test_nan_field;
+
+  // Without an error estimate the step must still terminate
+  obj.g_ack = test_nan_field(NULL, &obj.p) * obj.m.m;
+  pl_object_step(&obj, 10.0);
+  fail_unless(obj.integrator.substeps <= 1000, "unbounded substeps");
+  fail_unless(!isfinite(obj.v.x), "non-finite state was hidden");
+}
+END_TEST
+
+START_TEST(test_substep_rates)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_world_set_substeps(world, 16, 0.01, 1.0);
+  pl_time_set(jde);
+
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  fail_unless(earth != NULL, "missing earth");
+
+  // A body skimming the earth and one far outside its gravity well
+  pl_object_t *close = pl_new_object(world, "close");
+  pl_object_t *far = pl_new_object(world, "far");
+  pl_mass_set(&close->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  pl_mass_set(&far->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  pl_object_set_pos_celobj_rel(close, earth, vd3_set(6.5e6, 0.0, 0.0));
+  pl_object_set_pos_celobj_rel(far, earth, vd3_set(0.0, 5.0e8, 0.0));
+  double v = sqrt(earth->cm_orbit->GM / 6.5e6);
+  pl_object_set_vel3dv(close, earth->cm_orbit->v + vd3_set(0.0, v, 0.0));
+  pl_object_set_vel3dv(far, earth->cm_orbit->v);
+
+  // The dynamical time close to the earth is about 600 s, so a 60 s step
+  // needs about ten substeps with eta 0.01
+  pl_world_step(world, jde, 60.0);
+  fail_unless(close->step_rate >= 8 && close->step_rate <= 16,
+              "close body took %u substeps", close->step_rate);
+  fail_unless(far->step_rate == 1, "far body took %u substeps",
+              far->step_rate);
+  fail_unless(world->substeps_max == close->step_rate,
+              "wrong substep statistics");
+
+  // The number of substeps is bounded
+  pl_world_set_substeps(world, 4, 0.01, 1.0);
+  pl_world_step(world, jde, 60.0);
+  fail_unless(close->step_rate == 4, "close body took %u substeps",
+              close->step_rate);
+
+  pl_world_delete(world);
+}
+END_TEST
+
+START_TEST(test_kepler_rails)
+{
+  const double GM = 3.986e14;
+  double3 r0[] = {vd3_set(7.0e6, 0.0, 0.0), vd3_set(7.0e6, 1.0e5, 3.0e5)};
+  double3 v0[] = {vd3_set(0.0, 8000.0, 1000.0), vd3_set(-100.0, 12000.0, 0.0)};
+
+  for (int k = 0 ; k < 2 ; k ++) {
+    pl_kepler_orbit_t orbit;
+    fail_unless(pl_kepler_from_state(&orbit, GM, r0[k], v0[k], 10.0),
+                "orbit rejected");
+
+    double3 r, v;
+    pl_kepler_state_at(&orbit, 10.0, &r, &v);
+    fail_unless(vd3_abs(r - r0[k]) < 1.0e-3, "position at epoch differs");
+    fail_unless(vd3_abs(v - v0[k]) < 1.0e-6, "velocity at epoch differs");
+
+    // Compare with a finely integrated trajectory
+    pl_object_t obj;
+    pl_object_init(&obj);
+    pl_mass_set(&obj.m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+    pl_object_compute_derived(&obj);
+    pl_object_set_pos3d(&obj, r0[k].x, r0[k].y, r0[k].z);
+    obj.v = v0[k];
+    obj.integrator.kind = PL_INTEGRATOR_RK4;
+    obj.integrator.field = test_point_mass_field;
+    for (int i = 0 ; i < 2000 ; i ++) {
+      obj.g_ack = test_point_mass_field(NULL, &obj.p) * obj.m.m;
+      pl_object_step(&obj, 1.0);
+    }
+
+    pl_kepler_state_at(&orbit, 2010.0, &r, &v);
+    fail_unless(vd3_abs(r - lwc_globald(&obj.p)) < 1.0,
+                "analytic position differs from integration (e = %f)",
+                orbit.ecc);
+    fail_unless(vd3_abs(v - obj.v) < 1.0e-3,
+                "analytic velocity differs from integration (e = %f)",
+                orbit.ecc);
+  }
+}
+END_TEST
+
+START_TEST(test_kepler_batch)
+{
+  enum { N = 512 };
+  double ecc[N], M[N], E[N];
+  bool converged[N];
+
+  for (int i = 0 ; i < N ; i ++) {
+    ecc[i] = (i % 64) / 64.0 + (i % 64 == 63 ? 0.0155 : 0.0); // Up to 0.99988
+    M[i] = -10.0 + 20.0 * i / N;
+  }
+  ecc[N-1] = 1.5; // Out of range lane
+
+  size_t failed = pl_ecc_anomaly_batch(N, ecc, M, E, converged);
+  fail_unless(failed == 1, "%zu lanes did not converge", failed);
+  fail_unless(!converged[N-1], "hyperbolic lane reported as converged");
+
+  for (int i = 0 ; i < N - 1 ; i ++) {
+    fail_unless(converged[i], "lane %d (e = %f) did not converge", i, ecc[i]);
+    double res = remainder(E[i] - ecc[i] * sin(E[i]) - M[i], 2.0 * M_PI);
+    fail_unless(fabs(res) < 1.0e-13, "residual %g for e = %f, M = %f",
+                res, ecc[i], M[i]);
+    fail_unless(fabs(E[i] - (double)pl_ecc_anomaly(ecc[i], 1.0, M[i]))
+                < 1.0e-9, "batch and scalar solvers differ for e = %f",
+                ecc[i]);
+  }
+}
+END_TEST
+
+START_TEST(test_particles)
+{
+  pl_object_t obj;
+  pl_object_init(&obj);
+
+  pl_particles_t *ps = pl_new_particle_system("test", 64);
+  ps->obj = &obj;
+  ps->p = vd3_set(0.0, 0.0, -10.0);
+  ps->v = vd3_set(0.0, 0.0, -100.0);
+  ps->lifeTime = 1.0f;
+  pl_particles_set_emission_rate(ps, 100.0f);
+  pl_particles_enable(ps);
+
+  // About 10 particles per step, +-10 % and the fraction
+  pl_particles_step(ps, 0.1f);
+  fail_unless(ps->alive >= 9 && ps->alive <= 12, "emitted %zu particles",
+              ps->alive);
+  for (size_t i = 0 ; i < ps->alive ; i ++) {
+    fail_unless(ps->part_age[i] == 0.0f, "new particle %zu aged", i);
+    fail_unless(vd3_abs(ps->part_p[i] - ps->p) < 1.0e-9,
+                "particle %zu not emitted at the emitter", i);
+  }
+
+  // The alive range never exceeds the system and only holds live particles
+  for (int k = 0 ; k < 20 ; k ++) {
+    pl_particles_step(ps, 0.1f);
+    fail_unless(ps->alive <= ps->particleCount, "too many particles");
+    for (size_t i = 0 ; i < ps->alive ; i ++) {
+      fail_unless(ps->part_age[i] <= ps->part_lifetime[i],
+                  "expired particle %zu in the alive range", i);
+    }
+  }
+
+  // A retired particle is replaced by the last alive one
+  pl_particles_set_emission_rate(ps, 0.0f);
+  ps->alive = 4;
+  for (size_t i = 0 ; i < 4 ; i ++) {
+    ps->part_age[i] = 0.0f;
+    ps->part_lifetime[i] = i == 1 ? 0.05f : 10.0f;
+    ps->part_p[i] = vd3_set(i, 0.0, 0.0);
+    ps->part_v[i] = vd3_set(0.0, 0.0, 0.0);
+  }
+  pl_particles_step(ps, 0.1f);
+  fail_unless(ps->alive == 3, "%zu particles alive", ps->alive);
+  fail_unless(ps->part_p[0].x == 0.0 && ps->part_p[1].x == 3.0
+              && ps->part_p[2].x == 2.0, "alive particles not compacted");
+
+  // Turned off systems are disabled once the last particle has expired
+  pl_particles_turn_off(ps);
+  for (int k = 0 ; k < 110 ; k ++) pl_particles_step(ps, 0.1f);
+  fail_unless(ps->alive == 0, "%zu particles left", ps->alive);
+  fail_unless(!ps->enabled, "system not disabled");
+
+  pl_particles_delete(ps);
+
+  // Systems with the same name do not emit the same particles
+  pl_particles_t *a = pl_new_particle_system("engine", 64);
+  pl_particles_t *b = pl_new_particle_system("engine", 64);
+  fail_unless(a->rng != b->rng, "systems share a random stream");
+  pl_particles_delete(a);
+  pl_particles_delete(b);
+
+  obj_array_dispose(&obj.children);
+  obj_array_dispose(&obj.psystem);
+  obj_array_dispose(&obj.aerofoils);
+}
+END_TEST
+
+START_TEST(test_atmosphere_table)
+{
+  // Troposphere with lapse rate and isothermal stratosphere
+  const double h_b[] = {0.0, 11000.0};
+  const double P_b[] = {101325.0, 22632.1};
+  const double p_b[] = {1.2250, 0.36391};
+  const double L_b[] = {-0.0065, 0.0};
+  const double T_b[] = {288.15, 216.65};
+  pl_atm_template_t *t = pl_new_atmosphere_template(2, 9.80665, 0.0289644,
+                                                    p_b, P_b, T_b, h_b, L_b);
+  pl_atmosphere_t *atm = pl_new_atmosphere(1000.0, 50000.0, t);
+
+  float h[72], P[72], p[72];
+  for (int i = 0 ; i < 72 ; i ++) {
+    h[i] = -500.0f + i * 800.0f;
+  }
+  pl_atmosphere_lookup(atm, 72, h, P, p);
+
+  for (int i = 0 ; i < 72 ; i ++) {
+    fail_unless(fabsf(P[i] - pl_atmosphere_pressure(atm, h[i])) <= 1.0e-6f * P[i],
+                "batched pressure differs at %f m", h[i]);
+    fail_unless(fabsf(p[i] - pl_atmosphere_density(atm, h[i])) <= 1.0e-6f * p[i],
+                "batched density differs at %f m", h[i]);
+
+    if (h[i] >= atm->h_max) {
+      fail_unless(p[i] == 0.0f, "no vacuum above atmosphere at %f m", h[i]);
+    } else {
+      float ref = pl_atm_template_compute_airdensity(t, fmaxf(h[i], 0.0f));
+      fail_unless(fabsf(p[i] - ref) < 1.0e-3f * ref,
+                  "density %f at %f m, expected %f", p[i], h[i], ref);
+    }
+  }
+
+  pl_atmosphere_delete(atm);
+  free(t);
+}
+END_TEST
+
+START_TEST(test_ephemeris_cache)
+{
+  const char *path = "t004-ephemeris.cache";
+  const double jd0 = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  size_t count = ARRAY_LEN(world->celestial_objects);
+  double3 *ref = calloc(count, sizeof(double3));
+
+  unlink(path);
+  pl_ephemeris_t *eph = pl_ephemeris_open(world, path, 1, jd0, jd0 + 10.0);
+  fail_unless(eph->generated, "missing cache not generated");
+
+  for (int k = 0 ; k < 100 ; k ++) {
+    double jde = jd0 + k * 0.0997;
+    cm_orbit_compute(jde);
+    for (size_t i = 0 ; i < count ; i ++) {
+      pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+      ref[i] = cel->cm_orbit->p;
+    }
+
+    fail_unless(pl_ephemeris_update(eph, jde), "jd %f not in cache", jde);
+    for (size_t i = 0 ; i < count ; i ++) {
+      pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+      fail_unless(vd3_abs(cel->cm_orbit->p - ref[i]) < 100.0,
+                  "%s differs by %f m at jd %f", cel->cm_orbit->name,
+                  vd3_abs(cel->cm_orbit->p - ref[i]), jde);
+    }
+  }
+  fail_unless(!pl_ephemeris_update(eph, jd0 + 1000.0),
+              "evaluated outside cache");
+  pl_ephemeris_close(eph);
+
+  eph = pl_ephemeris_open(world, path, 1, jd0 + 1.0, jd0 + 5.0);
+  fail_unless(!eph->generated, "valid cache regenerated");
+  pl_ephemeris_close(eph);
+
+  eph = pl_ephemeris_open(world, path, 2, jd0 + 1.0, jd0 + 5.0);
+  fail_unless(eph->generated, "cache of other source not regenerated");
+  pl_ephemeris_close(eph);
+
+  unlink(path);
+  free(ref);
+  pl_world_delete(world);
+}
+END_TEST
+
+// Gravity from all celestial objects
+static double3
+test_direct_gravity(pl_world_t *world, double3 p)
+{
+  double3 g = vd3_set(0.0, 0.0, 0.0);
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    double3 d = cel->cm_orbit->p - p;
+    double d2 = vd3_dot(d, d);
+    g += d * (cel->cm_orbit->GM / (d2 * sqrt(d2)));
+  }
+  return g;
+}
+
+START_TEST(test_patched_conic)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_world_set_gravity_mode(world, PL_GRAVITY_PATCHED_CONIC);
+  pl_world_set_perturbers(world, 2);
+  pl_time_set(jde);
+
+  pl_celobject_t *sun = pl_world_get_celobject(world, "sun");
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  pl_celobject_t *moon = pl_world_get_celobject(world, "moon");
+  fail_unless(sun && earth && moon, "missing celestial objects");
+
+  pl_object_t *obj = pl_new_object(world, "test-object");
+  pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+
+  pl_object_set_pos_celobj_rel(obj, earth, vd3_set(7.0e6, 0.0, 0.0));
+  pl_world_step(world, jde, 0.01);
+  fail_unless(moon->primary == earth, "moon does not orbit earth");
+  fail_unless(obj->dominator == earth, "not dominated by earth");
+
+  double3 p = lwc_globald(&obj->p);
+  double3 g = pl_world_object_gravity_at(obj, &obj->p);
+  double3 ref = test_direct_gravity(world, p);
+  fail_unless(vd3_abs(g - ref) < 1.0e-9 * vd3_abs(ref),
+              "patched gravity off by %g m/s^2", vd3_abs(g - ref));
+
+  // Cross into the sphere of influence of the moon and out of the one of the
+  // earth
+  double3 moon_rel = moon->cm_orbit->p - earth->cm_orbit->p;
+  pl_object_set_pos_celobj_rel(obj, earth,
+                               moon_rel + vd3_set(2.0e6, 0.0, 0.0));
+  pl_world_step(world, jde, 0.01);
+  fail_unless(obj->dominator == moon, "not dominated by moon");
+
+  pl_object_set_pos_celobj_rel(obj, earth, vd3_set(0.0, 0.0, 5.0e9));
+  pl_world_step(world, jde, 0.01);
+  fail_unless(obj->dominator == sun, "not dominated by sun");
+
+  pl_world_delete(world);
+}
+END_TEST
+
+// Aggregate mass of obj, recomputed from scratch
+static pl_mass_t
+test_full_mass(pl_object_t *obj)
+{
+  if (obj->children.length == 0) return obj->m;
+
+  pl_mass_t m;
+  pl_mass_set(&m, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+  for (int i = 0 ; i < obj->children.length ; i ++) {
+    pl_object_t *child = obj->children.elems[i];
+    pl_mass_t tmp = test_full_mass(child);
+    pl_mass_translate(&tmp, child->p_offset.x, child->p_offset.y,
+                      child->p_offset.z);
+    pl_mass_add(&m, &tmp);
+  }
+  return m;
+}
+
+static bool
+test_mass_equal(const pl_mass_t *a, const pl_mass_t *b)
+{
+  if (fabs(a->m - b->m) > 1.0e-6 * b->m) return false;
+  if (vd3_abs(a->cog - b->cog) > 1.0e-5) return false;
+  for (int i = 0 ; i < 3 ; i ++) {
+    if (vd3_abs(a->In[i] - b->In[i]) > 1.0e-5 * b->In[i][i]) return false;
+  }
+  return true;
+}
+
+START_TEST(test_mass_aggregate)
+{
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_object_t *root = pl_new_object(world, "root");
+  pl_object_t *stages[3], *tank;
+
+  for (int i = 0 ; i < 3 ; i ++) {
+    stages[i] = pl_new_sub_object3f(world, root, "stage", 0.0f, 0.0f, 0.0f);
+    pl_mass_solid_cylinder(&stages[i]->m, 1000.0f * (3 - i), 2.0f, 10.0f);
+    pl_object_set_offset3dv(stages[i], vd3_set(0.0, 10.0 * i, 0.0));
+  }
+  tank = pl_new_sub_object3f(world, stages[0], "tank", 0.0f, 1.0f, 0.5f);
+  pl_mass_solid_sphere(&tank->m, 500.0f, 1.0f);
+
+  fail_unless(root->mass_dirty, "new subobjects do not invalidate root");
+  pl_object_update_mass(root);
+  pl_mass_t ref = test_full_mass(root);
+  fail_unless(test_mass_equal(&root->m, &ref), "aggregate mass differs");
+  fail_unless(!root->mass_dirty && !tank->mass_dirty, "mass still dirty");
+
+  // Burn fuel in the tank, only its branch is invalidated
+  pl_object_mod_mass(tank, 200.0);
+  fail_unless(root->mass_dirty && stages[0]->mass_dirty,
+              "parents not invalidated");
+  fail_unless(!stages[1]->mass_dirty && !stages[2]->mass_dirty,
+              "siblings invalidated");
+  pl_object_update_mass(root);
+  ref = test_full_mass(root);
+  fail_unless(test_mass_equal(&root->m, &ref),
+              "aggregate mass differs after burn");
+
+  // Drop the last stage
+  pl_object_detatch(stages[2]);
+  pl_world_step(world, 2456293.5, 0.01);
+  ref = test_full_mass(root);
+  fail_unless(!root->mass_dirty, "world step did not update mass");
+  fail_unless(test_mass_equal(&root->m, &ref),
+              "aggregate mass differs after detach");
+
+  pl_world_delete(world);
+}
+END_TEST
+
+START_TEST(test_world_query)
+{
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_object_t *objs[500];
+
+  srandom(1);
+  for (int i = 0 ; i < 500 ; i ++) {
+    objs[i] = pl_new_object(world, "test-object");
+    objs[i]->radius = 1.0e5 * (1 + random() % 10);
+    pl_object_set_pos3d(objs[i], (random() % 2000 - 1000) * 1.0e6,
+                        (random() % 2000 - 1000) * 1.0e6,
+                        (random() % 2000 - 1000) * 1.0e6);
+  }
+  for (int k = 0 ; k < 3 ; k ++) {
+    for (int i = 0 ; i < 500 ; i ++) {
+      pl_object_update_octtree(objs[i]);
+    }
+  }
+
+  obj_array_t result;
+  obj_array_init(&result);
+  for (int q = 0 ; q < 50 ; q ++) {
+    lwcoord_t p;
+    lwc_set(&p, (random() % 2000 - 1000) * 1.0e6,
+            (random() % 2000 - 1000) * 1.0e6,
+            (random() % 2000 - 1000) * 1.0e6);
+
+    // Radius, against a linear scan
+    double r = 1.0e8 + q * 1.0e7;
+    size_t expected = 0;
+    for (int i = 0 ; i < 500 ; i ++) {
+      if (vd3_abs(lwc_dist(&objs[i]->p, &p)) <= r) expected ++;
+    }
+    result.length = 0;
+    fail_unless(pl_world_query_radius(world, &p, r, &result) == expected,
+                "radius query missed objects");
+
+    // Nearest, sorted and with no closer object left out
+    size_t k = 1 + q % 8;
+    result.length = 0;
+    fail_unless(pl_world_query_nearest(world, &p, k, &result) == k,
+                "nearest query found too few objects");
+    double last = 0.0;
+    for (size_t j = 0 ; j < k ; j ++) {
+      pl_object_t *obj = ARRAY_ELEM(result, j);
+      double d = vd3_abs(lwc_dist(&obj->p, &p));
+      fail_unless(d >= last, "nearest objects not sorted");
+      last = d;
+    }
+    size_t closer = 0;
+    for (int i = 0 ; i < 500 ; i ++) {
+      if (vd3_abs(lwc_dist(&objs[i]->p, &p)) < last) closer ++;
+    }
+    fail_unless(closer == k - 1, "nearest query missed objects");
+
+    // A segment to an object hits it or something in front of it
+    pl_object_t *target = objs[q];
+    double t;
+    pl_object_t *hit = pl_world_query_segment(world, &p, &target->p, NULL, &t);
+    fail_unless(hit != NULL && t <= 1.0, "segment missed its target");
+  }
+
+  obj_array_dispose(&result);
+  pl_world_delete(world);
+}
+END_TEST
+
+START_TEST(test_conjunction_screen)
+{
+  const double GM = 3.986e14;
+  const double T = 5000.0;
+  double vc = sqrt(GM / 7.0e6);
+
+  // An equatorial and a polar circular orbit passing 100 m apart at T, and
+  // one orbit far above them
+  double3 r0[] = {vd3_set(7.0e6, 0.0, 0.0), vd3_set(7.0e6 + 100.0, 0.0, 0.0),
+                  vd3_set(8.0e6, 0.0, 0.0)};
+  double3 v0[] = {vd3_set(0.0, vc, 0.0),
+                  vd3_set(0.0, 0.0, sqrt(GM / (7.0e6 + 100.0))),
+                  vd3_set(0.0, sqrt(GM / 8.0e6), 0.0)};
+
+  pl_conj_screen_t *screen = pl_new_conj_screen(1000.0, 30.0);
+  for (int i = 0 ; i < 3 ; i ++) {
+    pl_kepler_orbit_t orbit;
+    fail_unless(pl_kepler_from_state(&orbit, GM, r0[i], v0[i], T),
+                "orbit rejected");
+    fail_unless(pl_conj_add(screen, &orbit, NULL), "orbit not added");
+  }
+
+  size_t n = pl_conj_screen(screen, T - 1000.0, T + 1000.0);
+  fail_unless(screen->apsis_pairs == 1, "apsis filter kept %zu pairs",
+              screen->apsis_pairs);
+  fail_unless(n == 1, "found %zu conjunctions", n);
+
+  pl_conjunction_t *c = &ARRAY_ELEM(screen->results, 0);
+  fail_unless(c->a == 0 && c->b == 1, "wrong pair %u %u", c->a, c->b);
+  fail_unless(fabs(c->tca - T) < 0.1, "tca %f", c->tca);
+  fail_unless(fabs(c->miss - 100.0) < 1.0, "miss distance %f", c->miss);
+
+  // The polar orbit is far outside the threshold half an orbit later
+  n = pl_conj_screen(screen, T + 1500.0, T + 2500.0);
+  fail_unless(n == 0, "found %zu conjunctions", n);
+
+  // Windows starting or ending during the pass have their closest approach
+  // at the edge, the pair moves about 540 m in 0.05 s
+  n = pl_conj_screen(screen, T + 0.05, T + 1000.0);
+  fail_unless(n == 1, "found %zu conjunctions at the start", n);
+  c = &ARRAY_ELEM(screen->results, 0);
+  fail_unless(c->tca == T + 0.05, "tca %f", c->tca);
+  fail_unless(c->miss > 100.0 && c->miss < 1000.0, "miss distance %f",
+              c->miss);
+
+  n = pl_conj_screen(screen, T - 1000.0, T - 0.05);
+  fail_unless(n == 1, "found %zu conjunctions at the end", n);
+  c = &ARRAY_ELEM(screen->results, 0);
+  fail_unless(c->tca == T - 0.05, "tca %f", c->tca);
+
+  pl_conj_screen_delete(screen);
+}
+END_TEST
+
+START_TEST(test_eclipse)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_world_set_eclipses(world, true);
+  pl_time_set(jde);
+
+  pl_celobject_t *sun = pl_world_get_celobject(world, "sun");
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  fail_unless(sun && earth, "missing celestial objects");
+
+  pl_object_t *obj = pl_new_object(world, "test-object");
+  pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  pl_object_t *child = pl_new_sub_object3f(world, obj, "test-child",
+                                           1.0f, 0.0f, 0.0f);
+  pl_mass_set(&child->m, 100.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+
+  double3 to_sun = vd3_normalise(sun->cm_orbit->p - earth->cm_orbit->p);
+  double3 side = vd3_normalise(vd3_cross(to_sun, vd3_set(0.0, 0.0, 1.0)));
+  double R = earth->cm_orbit->radius;
+
+  // Day side
+  pl_object_set_pos_celobj_rel(obj, earth, to_sun * 7.0e6);
+  pl_world_step(world, jde, 0.01);
+  fail_unless(obj->sunlight == 1.0f, "sunlight %f on day side", obj->sunlight);
+  fail_unless(obj->occluder == NULL, "occluded on day side");
+
+  // Umbra
+  pl_object_set_pos_celobj_rel(obj, earth, to_sun * -7.0e6);
+  pl_world_step(world, jde, 0.01);
+  fail_unless(obj->sunlight == 0.0f, "sunlight %f in umbra", obj->sunlight);
+  fail_unless(obj->occluder == earth, "not occluded by earth");
+  fail_unless(child->sunlight == 0.0f, "sunlight of child %f",
+              child->sunlight);
+
+  // Penumbra, just outside the shadow cylinder
+  pl_object_set_pos_celobj_rel(obj, earth, to_sun * -7.0e6 + side * R);
+  pl_world_step(world, jde, 0.01);
+  fail_unless(obj->sunlight > 0.0f && obj->sunlight < 1.0f,
+              "sunlight %f in penumbra", obj->sunlight);
+  fail_unless(obj->occluder == earth, "not occluded by earth");
+
+  // Against the single occluder reference
+  double3 p = lwc_globald(&obj->p);
+  double ref = pl_eclipse_shadow(p, sun->cm_orbit->p, sun->cm_orbit->radius,
+                                 earth->cm_orbit->p, R);
+  fail_unless(fabs(obj->sunlight - ref) < 1.0e-6, "sunlight %f, expected %f",
+              obj->sunlight, ref);
+
+  pl_world_delete(world);
+}
+END_TEST
+
+START_TEST(test_lambert)
+{
+  const double GM = 1.327e20;
+  const double au = 1.496e11;
+
+  // Elliptic short and long way and a hyperbolic transfer, checked against the
+  // propagated orbit
+  double3 r0[] = {vd3_set(au, 0.0, 0.0), vd3_set(au, 0.0, 0.0),
+                  vd3_set(0.0, au, 0.1 * au)};
+  double3 v0[] = {vd3_set(0.0, 32000.0, 0.0), vd3_set(0.0, 32000.0, 1000.0),
+                  vd3_set(-60000.0, 0.0, 0.0)};
+  double tof[] = {1.2e7, 3.0e7, 5.0e6};
+
+  for (int k = 0 ; k < 3 ; k ++) {
+    pl_kepler_orbit_t orbit;
+    fail_unless(pl_kepler_from_state(&orbit, GM, r0[k], v0[k], 0.0),
+                "orbit rejected");
+    double3 r1, v1;
+    pl_kepler_state_at(&orbit, tof[k], &r1, &v1);
+
+    double3 lv0, lv1;
+    fail_unless(pl_lambert(GM, r0[k], r1, tof[k], vd3_cross(r0[k], v0[k]),
+                           &lv0, &lv1), "no solution for case %d", k);
+    fail_unless(vd3_abs(lv0 - v0[k]) < 1.0e-6 * vd3_abs(v0[k]),
+                "departure velocity off by %f m/s", vd3_abs(lv0 - v0[k]));
+    fail_unless(vd3_abs(lv1 - v1) < 1.0e-6 * vd3_abs(v1),
+                "arrival velocity off by %f m/s", vd3_abs(lv1 - v1));
+  }
+
+  double3 v1, v2;
+  fail_unless(!pl_lambert(GM, r0[0], r0[0] * 2.0, 1.0e7,
+                          vd3_set(0.0, 0.0, 1.0), &v1, &v2),
+              "collinear transfer solved");
+}
+END_TEST
+
+START_TEST(test_porkchop)
+{
+  const double GM = 1.327e20;
+  const double au = 1.496e11;
+  pl_kepler_orbit_t dep, arr;
+  double v_dep = sqrt(GM / au), v_arr = sqrt(GM / (1.524 * au));
+  pl_kepler_from_state(&dep, GM, vd3_set(au, 0.0, 0.0),
+                       vd3_set(0.0, v_dep, 0.0), 0.0);
+  pl_kepler_from_state(&arr, GM, vd3_set(0.0, 1.524 * au, 0.0),
+                       vd3_set(-v_arr, 0.0, 0.0), 0.0);
+
+  pl_porkchop_t *pc = pl_new_porkchop(0.0, 100.0, 11, 50.0, 450.0, 21);
+  pc->GM = GM;
+  for (size_t i = 0 ; i < pc->dep_count ; i ++) {
+    pl_kepler_state_at(&dep, pc->dep_jd[i] * PL_SEC_PER_DAY,
+                       &pc->dep_r[i], &pc->dep_v[i]);
+  }
+  for (size_t i = 0 ; i < pc->arr_count ; i ++) {
+    pl_kepler_state_at(&arr, pc->arr_jd[i] * PL_SEC_PER_DAY,
+                       &pc->arr_r[i], &pc->arr_v[i]);
+  }
+
+  task_pool_t *tasks = task_pool_new(4);
+  pl_porkchop_set_tasks(pc, tasks);
+  size_t solved = pl_porkchop_compute(pc);
+  fail_unless(solved > 0 && solved < pc->dep_count * pc->arr_count,
+              "%zu cells solved", solved);
+
+  for (size_t i = 0 ; i < pc->dep_count ; i ++) {
+    for (size_t j = 0 ; j < pc->arr_count ; j ++) {
+      size_t k = i * pc->arr_count + j;
+      double tof = (pc->arr_jd[j] - pc->dep_jd[i]) * PL_SEC_PER_DAY;
+      double3 v1, v2;
+      if (tof <= 0.0) {
+        fail_unless(isnan(pc->dv_dep[k]), "arrival before departure solved");
+      } else if (pl_lambert(GM, pc->dep_r[i], pc->arr_r[j], tof,
+                            vd3_cross(pc->dep_r[i], pc->dep_v[i]),
+                            &v1, &v2)) {
+        fail_unless(fabs(pc->dv_dep[k] - vd3_abs(v1 - pc->dep_v[i])) < 0.01,
+                    "departure delta-v differs in cell %zu", k);
+        fail_unless(fabs(pc->dv_arr[k] - vd3_abs(v2 - pc->arr_v[j])) < 0.01,
+                    "arrival delta-v differs in cell %zu", k);
+      }
+    }
+  }
+
+  char path[] = "/tmp/porkchop-XXXXXX";
+  int fd = mkstemp(path);
+  fail_unless(fd >= 0, "could not create temporary file");
+  close(fd);
+  fail_unless(pl_porkchop_write_binary(pc, path), "binary not written");
+
+  FILE *file = fopen(path, "rb");
+  pl_porkchop_header_t header;
+  fail_unless(fread(&header, sizeof(header), 1, file) == 1, "no header");
+  fail_unless(!strcmp(header.magic, PL_PORKCHOP_MAGIC), "bad magic");
+  fail_unless(header.dep_count == 11 && header.arr_count == 21, "bad size");
+  fclose(file);
+
+  fail_unless(pl_porkchop_write_csv(pc, path), "csv not written");
+  file = fopen(path, "r");
+  size_t lines = 0;
+  for (int c = fgetc(file) ; c != EOF ; c = fgetc(file)) {
+    if (c == '\n') lines ++;
+  }
+  fclose(file);
+  unlink(path);
+  fail_unless(lines == solved + 1, "%zu lines in csv", lines);
+
+  // Sampling a world leaves its planets at the date of the last step
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_world_step(world, jde, 1.0);
+  pl_celobject_t *sun = pl_world_get_celobject(world, "sun");
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  pl_celobject_t *mars = pl_world_get_celobject(world, "mars");
+  fail_unless(sun && earth && mars, "missing celestial objects");
+  double3 p = earth->cm_orbit->p;
+  pl_porkchop_t *sampled = pl_new_porkchop(jde, jde + 100.0, 3,
+                                           jde + 150.0, jde + 300.0, 3);
+  pl_porkchop_sample(sampled, world, earth, mars, sun);
+  fail_unless(vd3_abs(earth->cm_orbit->p - p) == 0.0,
+              "earth left at a sampled date");
+  pl_porkchop_delete(sampled);
+  pl_world_delete(world);
+
+  task_pool_delete(tasks);
+  pl_porkchop_delete(pc);
+}
+END_TEST
+
+START_TEST(test_trajectory_prediction)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_time_set(jde);
+  pl_world_update_soi(world);
+
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  fail_unless(earth != NULL, "missing earth");
+
+  pl_object_t *obj = pl_new_object(world, "test-object");
+  pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+
+  // Circular orbit, predicted over one period it should close on itself
+  const double r = 7.0e6;
+  const double GM = earth->cm_orbit->GM;
+  const double T = 2.0 * M_PI * sqrt(r * r * r / GM);
+  pl_object_set_pos_celobj_rel(obj, earth, vd3_set(r, 0.0, 0.0));
+  pl_object_set_vel3dv(obj, earth->cm_orbit->v
+                            + vd3_set(0.0, sqrt(GM / r), 0.0));
+
+  pl_predictor_t *pred = pl_new_predictor(T, 600);
+  pl_predictor_request(pred, obj, world->t, vd3_set(0.0, 0.0, 0.0));
+
+  size_t published = 0;
+  for (int i = 0 ; i < 200 && published == 0 ; i ++) {
+    usleep(10000);
+    pl_predictor_acquire(pred);
+    published = pred->published;
+    pl_predictor_release(pred);
+  }
+  fail_unless(published > 0, "no trajectory published");
+
+  const pl_trajectory_t *traj = pl_predictor_acquire(pred);
+  fail_unless(traj->dominator == earth, "wrong dominator");
+  fail_unless(traj->len == 601, "%zu samples", traj->len);
+  fail_unless(vd3_abs(traj->p[0] - vd3_set(r, 0.0, 0.0)) < 1.0e-3,
+              "first sample is not the initial state");
+  double closure = vd3_abs(traj->p[traj->len - 1] - traj->p[0]);
+  fail_unless(closure < 1.0e3, "orbit does not close, %f m", closure);
+  fail_unless(traj->latency > 0.0, "latency %f", traj->latency);
+  pl_predictor_release(pred);
+
+  // A prograde burn raises the orbit
+  pl_predict_burn_t burn = {world->t, world->t + 10.0,
+                            vd3_set(0.0, 10.0, 0.0)};
+  pl_predictor_set_plan(pred, &burn, 1);
+  pl_predictor_request(pred, obj, world->t, vd3_set(0.0, 0.0, 0.0));
+  for (int i = 0 ; i < 200 && published == 1 ; i ++) {
+    usleep(10000);
+    pl_predictor_acquire(pred);
+    published = pred->published;
+    pl_predictor_release(pred);
+  }
+  fail_unless(published == 2, "no trajectory published after the burn");
+
+  traj = pl_predictor_acquire(pred);
+  fail_unless(vd3_abs(traj->p[traj->len / 2]) > r + 1.0e5,
+              "apoapsis not raised, %f m", vd3_abs(traj->p[traj->len / 2]));
+  pl_predictor_release(pred);
+
+  pl_predictor_delete(pred);
+  pl_world_delete(world);
+}
+END_TEST
+
+static pl_object_t*
+lod_test_object(pl_world_t *world, pl_celobject_t *earth, double x)
+{
+  pl_object_t *obj = pl_new_object(world, "test-object");
+  pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  pl_object_set_pos_celobj_rel(obj, earth, vd3_set(7.0e6 + x, 0.0, 0.0));
+  pl_object_set_vel3dv(obj, earth->cm_orbit->v);
+  return obj;
+}
+
+START_TEST(test_lod)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_world_set_lod(world, 1.0e5, 1.0e6, 4, 0.1);
+  pl_time_set(jde);
+
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  fail_unless(earth != NULL, "missing earth");
+
+  pl_object_t *near = lod_test_object(world, earth, 0.0);
+  pl_object_t *mid = lod_test_object(world, earth, 3.0e5);
+  pl_object_t *far = lod_test_object(world, earth, 3.0e6);
+
+  // Two far bodies on a collision course
+  pl_object_t *far_b = lod_test_object(world, earth, 3.0e6 + 3.0);
+  pl_object_set_vel3dv(far, earth->cm_orbit->v + vd3_set(10.0, 0.0, 0.0));
+  pl_object_set_vel3dv(far_b, earth->cm_orbit->v + vd3_set(-10.0, 0.0, 0.0));
+
+  lwcoord_t focus = near->p;
+  pl_world_set_lod_focus(world, &focus);
+  pl_world_step(world, jde, 0.1);
+
+  fail_unless(near->lod == PL_LOD_FULL, "near body in tier %d", near->lod);
+  fail_unless(mid->lod == PL_LOD_REDUCED, "mid body in tier %d", mid->lod);
+  fail_unless(far->lod == PL_LOD_SLEEPING, "far body in tier %d", far->lod);
+  fail_unless(world->lod_count[PL_LOD_SLEEPING] == 2, "%zu sleeping",
+              world->lod_count[PL_LOD_SLEEPING]);
+
+  // Sleeping bodies pass through each other
+  for (int i = 0 ; i < 4 ; i ++) pl_world_step(world, jde, 0.1);
+  double3 dv = far->v - far_b->v;
+  fail_unless(dv.x > 19.0, "sleeping bodies collided, dv %f", dv.x);
+
+  // Reduced bodies are integrated at least every fourth step
+  fail_unless(mid->lod_dt < 0.35, "mid body drifted %f s", mid->lod_dt);
+
+  // Inside the hysteresis band the tier is kept, beyond it the body moves
+  pl_object_set_pos_celobj_rel(mid, earth, vd3_set(7.0e6 + 0.95e5, 0.0, 0.0));
+  pl_world_step(world, jde, 0.1);
+  fail_unless(mid->lod == PL_LOD_REDUCED, "mid body in tier %d", mid->lod);
+  pl_object_set_pos_celobj_rel(mid, earth, vd3_set(7.0e6 + 0.85e5, 0.0, 0.0));
+  pl_world_step(world, jde, 0.1);
+  fail_unless(mid->lod == PL_LOD_FULL, "mid body in tier %d", mid->lod);
+  pl_object_set_pos_celobj_rel(mid, earth, vd3_set(7.0e6 + 1.05e5, 0.0, 0.0));
+  pl_world_step(world, jde, 0.1);
+  fail_unless(mid->lod == PL_LOD_FULL, "mid body in tier %d", mid->lod);
+
+  // Powered bodies always use the full tier
+  pl_object_force3f(far, 1000.0f, 0.0f, 0.0f);
+  pl_world_step(world, jde, 0.1);
+  fail_unless(far->lod == PL_LOD_FULL, "powered body in tier %d", far->lod);
+
+  pl_world_delete(world);
+
+  // In batched mode a body returning to the full tier must not lose the time
+  // it drifted, compare it to a body that is always in the full tier
+  pl_world_t *ref_world = pl_new_world(1.0e13);
+  pl_world_set_batched(ref_world, true);
+  pl_celobject_t *ref_earth = pl_world_get_celobject(ref_world, "earth");
+  pl_object_t *ref = lod_test_object(ref_world, ref_earth, 0.0);
+
+  world = pl_new_world(1.0e13);
+  pl_world_set_batched(world, true);
+  pl_world_set_lod(world, 1.0e5, 1.0e7, 4, 0.1);
+  earth = pl_world_get_celobject(world, "earth");
+  pl_object_t *obj = lod_test_object(world, earth, 0.0);
+
+  focus = obj->p;
+  lwc_translate3dv(&focus, vd3_set(0.0, 0.0, 1.0e6));
+  pl_world_set_lod_focus(world, &focus);
+  for (int i = 0 ; i < 6 ; i ++) {
+    if (i == 3) {
+      fail_unless(obj->lod == PL_LOD_REDUCED && obj->lod_dt > 0.0,
+                  "body not drifting in the reduced tier");
+      focus = obj->p;
+      pl_world_set_lod_focus(world, &focus);
+    }
+    pl_world_step(world, jde, 0.1);
+    pl_world_step(ref_world, jde, 0.1);
+  }
+  fail_unless(obj->lod == PL_LOD_FULL, "body in tier %d", obj->lod);
+  double3 err = lwc_dist(&obj->p, &ref->p);
+  fail_unless(vd3_abs(err) < 10.0, "batched body off by %f m", vd3_abs(err));
+
+  pl_world_delete(world);
+  pl_world_delete(ref_world);
+}
+END_TEST
+
+// Degree 2 potential in body axes, from the unnormalised coefficients of
+// orders 0 to 2
+static double
+geopotential_deg2(double GM, double R, const double *C, const double *S,
+                  double3 b)
+{
+  double r2 = vd3_dot(b, b);
+  double r5 = r2 * r2 * sqrt(r2);
+  return GM * R * R / r5
+       * (C[0] * 0.5 * (3.0 * b.z * b.z - r2)
+          + 3.0 * b.z * (C[1] * b.x + S[1] * b.y)
+          + 3.0 * (C[2] * (b.x * b.x - b.y * b.y) + 2.0 * S[2] * b.x * b.y));
+}
+
+START_TEST(test_geopotential)
+{
+  const double GM = 3.986004415e14;
+  const double R = 6378136.3;
+  const double J2 = 1.08262668e-3;
+
+  // Zonal degree 2 field, C20 normalised
+  double C[6] = {1.0, 0.0, 0.0, -J2 / sqrt(5.0), 0.0, 0.0};
+  pl_geopotential_t *geo = pl_new_geopotential(2, 2, R, C, NULL);
+  pl_geopotential_update(geo, GM, qd_rot(1.0, 0.0, 0.0, 0.0));
+
+  // Against the closed form J2 acceleration, with a batch that does not fill
+  // the last block
+  double3 r[PL_GEOPOTENTIAL_LANES + 3];
+  double3 acc[PL_GEOPOTENTIAL_LANES + 3];
+  const size_t n = sizeof(r) / sizeof(r[0]);
+  for (size_t i = 0 ; i < n ; i ++) {
+    double a = 0.7 * i, b = 0.3 * i - 1.0;
+    r[i] = vd3_set(cos(a) * cos(b), sin(a) * cos(b), sin(b))
+         * (6.7e6 + 1.0e5 * i);
+  }
+  pl_geopotential_acc(geo, 2, 0, n, r, acc);
+
+  for (size_t i = 0 ; i < n ; i ++) {
+    double d = vd3_abs(r[i]);
+    double z2 = r[i].z * r[i].z / (d * d);
+    double f = -1.5 * J2 * GM * R * R / pow(d, 5.0);
+    double3 expect = vd3_set(r[i].x * (1.0 - 5.0 * z2),
+                             r[i].y * (1.0 - 5.0 * z2),
+                             r[i].z * (3.0 - 5.0 * z2)) * f;
+    fail_unless(vd3_abs(acc[i] - expect) < 1.0e-12 * vd3_abs(expect) + 1.0e-15,
+                "J2 acceleration %zu off by %g", i,
+                vd3_abs(acc[i] - expect));
+  }
+  pl_geopotential_delete(geo);
+
+  // Tesseral and sectoral terms in a rotated body, against finite differences
+  // of the potential
+  double Ct[6] = {1.0, 0.0, 0.0, -J2 / sqrt(5.0), 2.0e-9, 2.4e-6};
+  double St[6] = {0.0, 0.0, 0.0, 0.0, -1.5e-9, -1.4e-6};
+  double Cu[3] = {Ct[3] * sqrt(5.0), Ct[4] * sqrt(5.0 / 3.0),
+                  Ct[5] * sqrt(5.0 / 12.0)};
+  double Su[3] = {0.0, St[4] * sqrt(5.0 / 3.0), St[5] * sqrt(5.0 / 12.0)};
+  geo = pl_new_geopotential(2, 2, R, Ct, St);
+  pl_geopotential_update(geo, GM, qd_rot(0.6, 0.0, 0.8, 0.6));
+  pl_geopotential_acc(geo, 2, 2, n, r, acc);
+
+  for (size_t i = 0 ; i < n ; i ++) {
+    const double h = 10.0;
+    double3 grad;
+    for (int k = 0 ; k < 3 ; k ++) {
+      double3 e = vd3_set(0.0, 0.0, 0.0);
+      e[k] = h;
+      double3 p1 = r[i] + e, p0 = r[i] - e;
+      double3 b1 = geo->rot[0] * p1.x + geo->rot[1] * p1.y + geo->rot[2] * p1.z;
+      double3 b0 = geo->rot[0] * p0.x + geo->rot[1] * p0.y + geo->rot[2] * p0.z;
+      grad[k] = (geopotential_deg2(GM, R, Cu, Su, b1)
+               - geopotential_deg2(GM, R, Cu, Su, b0)) / (2.0 * h);
+    }
+    fail_unless(vd3_abs(acc[i] - grad) < 1.0e-7 * vd3_abs(grad),
+                "tesseral acceleration %zu off by %g", i,
+                vd3_abs(acc[i] - grad));
+  }
+  pl_geopotential_delete(geo);
+
+  // The world evaluates the field of the dominator for its bodies
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_world_set_harmonics(world, 2, 0);
+  pl_time_set(jde);
+
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+  fail_unless(earth != NULL, "missing earth");
+  pl_celobject_set_geopotential(earth, pl_new_geopotential(2, 2, R, C, NULL));
+
+  pl_object_t *obj = pl_new_object(world, "test-object");
+  pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  double3 rel = vd3_set(5.0e6, 2.0e6, 4.0e6);
+  pl_object_set_pos_celobj_rel(obj, earth, rel);
+  pl_object_set_vel3dv(obj, earth->cm_orbit->v);
+  pl_world_step(world, jde, 0.01);
+
+  double3 expect;
+  pl_geopotential_acc(earth->geopotential, 2, 0, 1, &rel, &expect);
+  fail_unless(vd3_abs(expect) > 1.0e-3, "J2 acceleration %g too small",
+              vd3_abs(expect));
+  fail_unless(vd3_abs(obj->g_harmonic - expect) < 1.0e-9,
+              "world J2 acceleration off by %g",
+              vd3_abs(obj->g_harmonic - expect));
+
+  // Unpowered bodies feeling the field are not put on rails
+  pl_world_set_rails(world, true);
+  for (int i = 0 ; i < 3 ; i ++) {
+    rel = lwc_globald(&obj->p) - earth->cm_orbit->p;
+    pl_world_step(world, jde, 0.01);
+    fail_unless(!obj->on_rails, "body on rails in a gravity field");
+  }
+  pl_geopotential_acc(earth->geopotential, 2, 0, 1, &rel, &expect);
+  fail_unless(vd3_abs(obj->g_harmonic - expect) < 1.0e-9,
+              "J2 acceleration with rails off by %g",
+              vd3_abs(obj->g_harmonic - expect));
+
+  pl_world_delete(world);
+}
+END_TEST
+
+static pl_object_t*
+thrust_test_vehicle(pl_world_t *world, pl_object_t **stages)
+{
+  pl_object_t *root = pl_new_object(world, "test-vehicle");
+  pl_mass_set(&root->m, 1000.0f, 0.0f, 0.5f, 0.0f,
+              1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+  stages[0] = pl_new_sub_object3f(world, root, "lower", 0.0f, -2.0f, 0.0f);
+  stages[1] = pl_new_sub_object3f(world, root, "upper", 0.0f, 3.0f, 0.0f);
+  stages[2] = pl_new_sub_object3f(world, stages[1], "pod", 1.0f, 0.0f, 0.5f);
+  for (int i = 0 ; i < 3 ; i ++) {
+    pl_mass_set(&stages[i]->m, 100.0f * (i + 1), 0.0f, 0.0f, 0.0f,
+                1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+    pl_object_invalidate_mass(stages[i]);
+  }
+  pl_object_update_mass(root);
+  root->q = qd_rot(0.3, 0.4, 0.5, 0.7);
+  pl_object_compute_derived(root);
+  return root;
+}
+
+START_TEST(test_thrust_accumulation)
+{
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_object_t *a_stages[3], *b_stages[3];
+  pl_object_t *a = thrust_test_vehicle(world, a_stages);
+  pl_object_t *b = thrust_test_vehicle(world, b_stages);
+
+  // A cluster of RCS thrusters on each stage, applied one by one to a and
+  // accumulated in the stages of b
+  for (int i = 0 ; i < 3 ; i ++) {
+    for (int j = 0 ; j < 16 ; j ++) {
+      float3 f = vf3_set(sinf(j), cosf(j * 0.5f), 0.25f * j - 2.0f) * 100.0f;
+      float3 p = vf3_set(cosf(j), 0.1f * j, sinf(j * 0.7f));
+      pl_object_force_relative_pos3fv(a_stages[i], f, p);
+      pl_object_thrust_relative_pos3fv(b_stages[i], f, p);
+    }
+  }
+  fail_unless(vd3_abs(b->f_ack) == 0.0, "thrust applied before reduction");
+
+  pl_object_apply_thrust(b_stages[2]);
+  fail_unless(vd3_abs(a->f_ack - b->f_ack) < 1.0e-9 * vd3_abs(a->f_ack),
+              "batched force off by %g", vd3_abs(a->f_ack - b->f_ack));
+  fail_unless(vd3_abs(a->t_ack - b->t_ack) < 1.0e-9 * vd3_abs(a->t_ack),
+              "batched torque off by %g", vd3_abs(a->t_ack - b->t_ack));
+
+  // The accumulators are consumed by the reduction
+  double3 f = b->f_ack;
+  pl_object_apply_thrust(b);
+  fail_unless(vd3_abs(b->f_ack - f) == 0.0, "thrust applied twice");
+  fail_unless(vd3_abs(b_stages[2]->t_thrust) == 0.0, "thrust not cleared");
+
+  pl_world_delete(world);
+}
+END_TEST
+
+START_TEST(test_collide_sweep)
+{
+  lwcoord_t a, b;
+  double toi;
+
+  lwc_set(&a, 0.0, 0.0, 0.0);
+  lwc_set(&b, 500.0, 0.0, 0.0);
+  fail_unless(pl_lwc_intersection_point(&a, vd3_set(1000.0, 0.0, 0.0), 5.0,
+                                        &b, vd3_set(-1000.0, 0.0, 0.0), 5.0,
+                                        &toi), "head on impact missed");
+  fail_unless(fabs(toi - 0.245) < 1.0e-9, "wrong time of impact %f", toi);
+
+  lwc_set(&b, 500.0, 50.0, 0.0);
+  fail_if(pl_lwc_intersection_point(&a, vd3_set(1000.0, 0.0, 0.0), 5.0,
+                                    &b, vd3_set(-1000.0, 0.0, 0.0), 5.0,
+                                    &toi), "passing objects collided");
+
+  // Objects at 10 km/s crossing each other within one 20 Hz step
+  for (int k = 0 ; k < 2 ; k ++) {
+    pl_collisioncontext_t *coll = pl_new_collision_context(1.0e8, k);
+    pl_object_t objs[2];
+    for (int i = 0 ; i < 2 ; i ++) {
+      pl_object_init(&objs[i]);
+      pl_mass_set(&objs[i].m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+      objs[i].radius = 5.0;
+      pl_collide_insert_object(coll, &objs[i]);
+    }
+    pl_object_set_pos3d(&objs[0], 1000.0 + 250.0, 0.0, 0.0);
+    pl_object_set_pos3d(&objs[1], 1000.0 - 250.0, 0.0, 0.0);
+    objs[0].v = vd3_set(10000.0, 0.0, 0.0);
+    objs[1].v = vd3_set(-10000.0, 0.0, 0.0);
+
+    pl_collide_step(coll, 0.05);
+
+    fail_unless(objs[0].v.x < 0.0 && objs[1].v.x > 0.0,
+                "tunnelling objects did not collide");
+    fail_unless(lwc_globald(&objs[0].p).x < lwc_globald(&objs[1].p).x,
+                "objects were not moved back to the impact side");
+
+    pl_collision_context_delete(coll);
+  }
+}
+END_TEST
+
+START_TEST(test_contact_cache)
+{
+  task_pool_t *tasks = task_pool_new(2);
+
+  for (int k = 0 ; k < 2 ; k ++) {
+    pl_collisioncontext_t *coll = pl_new_collision_context(1.0e8, k);
+    pl_collide_set_tasks(coll, k ? tasks : NULL);
+
+    // Docked objects, touching but at rest relative to each other
+    pl_object_t objs[3];
+    for (int i = 0 ; i < 3 ; i ++) {
+      pl_object_init(&objs[i]);
+      pl_mass_set(&objs[i].m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+      objs[i].radius = 5.0;
+      pl_object_set_pos3d(&objs[i], 1000.0 + 9.0 * cos(i * 2.0 * M_PI / 3.0),
+                          9.0 * sin(i * 2.0 * M_PI / 3.0), 0.0);
+      objs[i].v = vd3_set(0.0, 0.0, 7000.0);
+      pl_collide_insert_object(coll, &objs[i]);
+    }
+
+    pl_collide_step(coll, 0.05);
+    fail_unless(coll->pairs_tested == 3, "wrong number of pairs %zu",
+                coll->pairs_tested);
+    fail_unless(coll->pairs_reused == 0, "empty cache reused");
+
+    for (int i = 0 ; i < 3 ; i ++) {
+      lwc_translate3dv(&objs[i].p, objs[i].v * 0.05);
+    }
+    pl_collide_step(coll, 0.05);
+    fail_unless(coll->pairs_tested == 3, "wrong number of pairs %zu",
+                coll->pairs_tested);
+    fail_unless(coll->pairs_reused == 3, "persistent contacts not reused");
+    for (int i = 0 ; i < 3 ; i ++) {
+      fail_unless(objs[i].v.z == 7000.0, "resting contact collided");
+    }
+
+    // Separate the last object, the sweep and prune broadphase no longer
+    // reports its pairs so they must leave the cache
+    if (k == PL_BROADPHASE_SWEEP_PRUNE) {
+      pl_object_set_pos3d(&objs[2], 2000.0, 0.0, 0.0);
+      pl_collide_step(coll, 0.05);
+      fail_unless(coll->pairs_tested == 1, "separated pairs kept");
+    }
+
+    pl_collision_context_delete(coll);
+
+    // Slow approach, the relative state barely changes when the pair is
+    // resolved, but the hit must not be reused after the bounce
+    coll = pl_new_collision_context(1.0e8, k);
+    pl_collide_set_tasks(coll, k ? tasks : NULL);
+    pl_object_t pair[2];
+    for (int i = 0 ; i < 2 ; i ++) {
+      pl_object_init(&pair[i]);
+      pl_mass_set(&pair[i].m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+      pair[i].radius = 5.0;
+      pl_object_set_pos3d(&pair[i], 5000.0 + 9.0 * i, 0.0, 0.0);
+      pair[i].v = vd3_set(i ? -0.2 : 0.2, 0.0, 0.0);
+      pl_collide_insert_object(coll, &pair[i]);
+    }
+
+    pl_collide_step(coll, 0.05);
+    fail_unless(coll->colls.length == 1, "approaching pair not hit");
+    fail_unless(pair[0].v.x < 0.0 && pair[1].v.x > 0.0, "pair not resolved");
+
+    for (int i = 0 ; i < 2 ; i ++) {
+      lwc_translate3dv(&pair[i].p, pair[i].v * 0.05);
+    }
+    pl_collide_step(coll, 0.05);
+    fail_unless(coll->colls.length == 0, "separating pair hit again");
+    fail_unless(pair[0].v.x < 0.0 && pair[1].v.x > 0.0,
+                "pair resolved more than once");
+
+    pl_collision_context_delete(coll);
+  }
+
+  task_pool_delete(tasks);
+}
+END_TEST
+
 Suite
 *test_suite (void)
 {
@@ -54,6 +1586,34 @@ Suite
     TCase *tc_core = tcase_create ("Core");
 
     tcase_add_test(tc_core, test_create_obj);
+    tcase_add_test(tc_core, test_bodystore_step);
+    tcase_add_test(tc_core, test_task_pool);
+    tcase_add_test(tc_core, test_threaded_world);
+    tcase_add_test(tc_core, test_octtree_moving_sources);
+    tcase_add_test(tc_core, test_lintree_field);
+    tcase_add_test(tc_core, test_octtree_slots);
+    tcase_add_test(tc_core, test_fmm_field);
+    tcase_add_test(tc_core, test_integrator_kepler);
+    tcase_add_test(tc_core, test_integrator_nonfinite);
+    tcase_add_test(tc_core, test_substep_rates);
+    tcase_add_test(tc_core, test_kepler_rails);
+    tcase_add_test(tc_core, test_kepler_batch);
+    tcase_add_test(tc_core, test_particles);
+    tcase_add_test(tc_core, test_atmosphere_table);
+    tcase_add_test(tc_core, test_ephemeris_cache);
+    tcase_add_test(tc_core, test_patched_conic);
+    tcase_add_test(tc_core, test_mass_aggregate);
+    tcase_add_test(tc_core, test_world_query);
+    tcase_add_test(tc_core, test_conjunction_screen);
+    tcase_add_test(tc_core, test_eclipse);
+    tcase_add_test(tc_core, test_lambert);
+    tcase_add_test(tc_core, test_porkchop);
+    tcase_add_test(tc_core, test_collide_sweep);
+    tcase_add_test(tc_core, test_contact_cache);
+    tcase_add_test(tc_core, test_trajectory_prediction);
+    tcase_add_test(tc_core, test_lod);
+    tcase_add_test(tc_core, test_geopotential);
+    tcase_add_test(tc_core, test_thrust_accumulation);
 
     suite_add_tcase(s, tc_core);
 
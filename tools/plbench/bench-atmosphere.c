@@ -0,0 +1,89 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/areodynamics.h"
+
+#define LOOKUPS (1 << 20)
+#define REPEATS 20
+
+// Layers of the earth atmosphere from rsrc/data/solsystem.hrml
+static const double h_b[] = {0.0, 11000.0, 20000.0, 32000.0, 47000.0, 51000.0,
+                             71000.0};
+static const double P_b[] = {111325.0, 22632.1, 5474.89, 868.019, 110.906,
+                             66.9389, 3.95642};
+static const double p_b[] = {1.2250, 0.36391, 0.08803, 0.01322, 0.00143,
+                             0.00086, 0.000086};
+static const double L_b[] = {-0.0065, 0.0, 0.001, 0.0028, 0.0, -0.0028,
+                             -0.002};
+static const double T_b[] = {288.15, 216.65, 216.65, 228.65, 270.65, 270.65,
+                             214.65};
+
+void
+bench_atmosphere(void)
+{
+  pl_atm_template_t *t = pl_new_atmosphere_template(7, 9.7986, 28.97e-3,
+                                                    p_b, P_b, T_b, h_b, L_b);
+  pl_atmosphere_t *atm = pl_new_atmosphere(1000.0, 100000.0, t);
+
+  float *h = malloc(LOOKUPS * sizeof(float));
+  float *p = malloc(LOOKUPS * sizeof(float));
+
+  // Reentry altitudes, including some above the atmosphere
+  srandom(1);
+  for (size_t i = 0 ; i < LOOKUPS ; i ++) {
+    h[i] = plbench_rand(-1000.0, 120000.0);
+  }
+
+  double start = plbench_now();
+  for (int r = 0 ; r < REPEATS ; r ++) {
+    for (size_t i = 0 ; i < LOOKUPS ; i ++) {
+      p[i] = pl_atmosphere_density(atm, h[i]);
+    }
+  }
+  double end = plbench_now();
+  plbench_report("density scalar", "lookups", (double)LOOKUPS * REPEATS,
+                 end - start);
+
+  start = plbench_now();
+  for (int r = 0 ; r < REPEATS ; r ++) {
+    pl_atmosphere_lookup(atm, LOOKUPS, h, NULL, p);
+  }
+  end = plbench_now();
+  plbench_report("density batched", "lookups", (double)LOOKUPS * REPEATS,
+                 end - start);
+
+  start = plbench_now();
+  for (int r = 0 ; r < REPEATS ; r ++) {
+    for (size_t i = 0 ; i < LOOKUPS ; i ++) {
+      p[i] = pl_atm_template_compute_airdensity(t, h[i]);
+    }
+  }
+  end = plbench_now();
+  plbench_report("density from layers", "lookups", (double)LOOKUPS * REPEATS,
+                 end - start);
+
+  free(h);
+  free(p);
+  pl_atmosphere_delete(atm);
+  free(t);
+}
@@ -0,0 +1,130 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/bodystore.h"
+
+#define STEPS 100
+#define DT 0.05
+
+static void
+setup_bodies(obj_array_t *bodies, size_t count)
+{
+  obj_array_init(bodies);
+  for (size_t i = 0 ; i < count ; i ++) {
+    pl_object_t *obj = calloc(1, sizeof(pl_object_t));
+    pl_object_init(obj);
+    pl_mass_set(&obj->m, plbench_rand(100.0, 10000.0),
+                0.0f, 0.0f, 0.0f,
+                10.0f, 10.0f, 10.0f,
+                0.0f, 0.0f, 0.0f);
+    pl_object_set_pos3d(obj, plbench_rand(-1.0e7, 1.0e7),
+                        plbench_rand(-1.0e7, 1.0e7),
+                        plbench_rand(-1.0e7, 1.0e7));
+    obj->v = vd3_set(plbench_rand(-8000.0, 8000.0),
+                     plbench_rand(-8000.0, 8000.0),
+                     plbench_rand(-8000.0, 8000.0));
+    obj->angVel = vd3_set(plbench_rand(-0.1, 0.1), 0.0, 0.0);
+    pl_object_compute_derived(obj);
+    obj_array_push(bodies, obj);
+  }
+}
+
+static void
+apply_forces(obj_array_t *bodies)
+{
+  ARRAY_FOR_EACH(i, *bodies) {
+    pl_object_t *obj = ARRAY_ELEM(*bodies, i);
+    obj->g_ack = vd3_set(0.0, 0.0, -9.81 * obj->m.m);
+    obj->f_ack = vd3_set(10.0, 0.0, 0.0);
+    obj->t_ack = vd3_set(0.0, 1.0, 0.0);
+  }
+}
+
+// Same passes as the world in batched mode: the bodies are loaded in the pass
+// that applies their forces and stored back in a second pass
+static void
+apply_forces_load(obj_array_t *bodies, pl_bodystore_t *store)
+{
+  pl_bodystore_resize(store, ARRAY_LEN(*bodies));
+  ARRAY_FOR_EACH(i, *bodies) {
+    pl_object_t *obj = ARRAY_ELEM(*bodies, i);
+    obj->g_ack = vd3_set(0.0, 0.0, -9.81 * obj->m.m);
+    obj->f_ack = vd3_set(10.0, 0.0, 0.0);
+    obj->t_ack = vd3_set(0.0, 1.0, 0.0);
+    pl_bodystore_load(store, i, obj, DT);
+  }
+}
+
+static void
+free_bodies(obj_array_t *bodies)
+{
+  ARRAY_FOR_EACH(i, *bodies) {
+    free(ARRAY_ELEM(*bodies, i));
+  }
+  obj_array_dispose(bodies);
+}
+
+void
+bench_bodystore(void)
+{
+  static const size_t counts[] = {100, 1000, 10000, 100000};
+
+  for (size_t c = 0 ; c < sizeof(counts)/sizeof(counts[0]) ; c ++) {
+    obj_array_t bodies;
+    char name[64];
+
+    setup_bodies(&bodies, counts[c]);
+
+    double start = plbench_now();
+    for (int s = 0 ; s < STEPS ; s ++) {
+      apply_forces(&bodies);
+      ARRAY_FOR_EACH(i, bodies) {
+        pl_object_step(ARRAY_ELEM(bodies, i), DT);
+      }
+    }
+    double end = plbench_now();
+    double aos = end - start;
+    snprintf(name, sizeof(name), "pl_object_step n=%zu", counts[c]);
+    plbench_report(name, "bodies", (double)counts[c] * STEPS, aos);
+
+    // Timed end to end, including loading and storing the bodies
+    pl_bodystore_t *store = pl_new_bodystore(counts[c]);
+    start = plbench_now();
+    for (int s = 0 ; s < STEPS ; s ++) {
+      apply_forces_load(&bodies, store);
+      pl_bodystore_step(store);
+      ARRAY_FOR_EACH(i, bodies) {
+        pl_bodystore_store(store, i);
+      }
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "bodystore n=%zu", counts[c]);
+    plbench_report(name, "bodies", (double)counts[c] * STEPS, end - start);
+    printf("  speedup over pl_object_step n=%zu: %.2fx\n", counts[c],
+           aos / (end - start));
+
+    pl_bodystore_delete(store);
+    free_bodies(&bodies);
+  }
+}
@@ -0,0 +1,119 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/collision.h"
+
+#define STEPS 50
+#define DT 0.05
+#define CLUSTER_SIZE 100 // Vehicles around each station
+#define SPACING 20.0 // Distance between vehicles in a cluster
+
+typedef struct {
+  const char *name;
+  size_t clusters; // 0 for objects spread uniformly
+} scene_t;
+
+static pl_object_t*
+setup_objects(size_t count, size_t clusters)
+{
+  pl_object_t *objs = calloc(count, sizeof(pl_object_t));
+
+  for (size_t i = 0 ; i < count ; i ++) {
+    pl_object_init(&objs[i]);
+    objs[i].radius = 5.0;
+
+    if (clusters == 0) {
+      pl_object_set_pos3d(&objs[i], plbench_rand(-1.0e7, 1.0e7),
+                          plbench_rand(-1.0e7, 1.0e7),
+                          plbench_rand(-1.0e7, 1.0e7));
+    } else {
+      // Vehicles on a lattice around the station, close but not touching
+      size_t station = i % clusters;
+      size_t slot = i / clusters;
+      double3 centre = vd3_set(1.0e6 * station, 2.0e5 * station, 0.0);
+      pl_object_set_pos3d(&objs[i], centre.x + SPACING * (slot % 5),
+                          centre.y + SPACING * (slot / 5 % 5),
+                          centre.z + SPACING * (slot / 25));
+    }
+    objs[i].v = vd3_set(plbench_rand(-1.0, 1.0), plbench_rand(-1.0, 1.0),
+                        plbench_rand(-1.0, 1.0));
+  }
+  return objs;
+}
+
+static void
+free_objects(pl_object_t *objs, size_t count)
+{
+  for (size_t i = 0 ; i < count ; i ++) {
+    obj_array_dispose(&objs[i].children);
+    obj_array_dispose(&objs[i].psystem);
+    obj_array_dispose(&objs[i].aerofoils);
+  }
+  free(objs);
+}
+
+void
+bench_collision(void)
+{
+  static const size_t counts[] = {100, 1000, 10000};
+  static const pl_broadphase_t broadphases[] = {
+    PL_BROADPHASE_RECGRID, PL_BROADPHASE_SWEEP_PRUNE
+  };
+  static const char *broadphase_names[] = {"recgrid", "sweep-prune"};
+  char name[64];
+
+  for (size_t c = 0 ; c < sizeof(counts)/sizeof(counts[0]) ; c ++) {
+    size_t count = counts[c];
+    scene_t scenes[] = {{"uniform", 0},
+                        {"clustered", count / CLUSTER_SIZE}};
+
+    for (int s = 0 ; s < 2 ; s ++) {
+      for (int b = 0 ; b < 2 ; b ++) {
+        srandom(1);
+        pl_object_t *objs = setup_objects(count, scenes[s].clusters);
+        pl_collisioncontext_t *coll = pl_new_collision_context(1.0e8,
+                                                               broadphases[b]);
+        for (size_t i = 0 ; i < count ; i ++) {
+          pl_collide_insert_object(coll, &objs[i]);
+        }
+
+        double start = plbench_now();
+        for (int step = 0 ; step < STEPS ; step ++) {
+          for (size_t i = 0 ; i < count ; i ++) {
+            lwc_translate3dv(&objs[i].p, objs[i].v * DT);
+          }
+          pl_collide_step(coll, DT);
+        }
+        double end = plbench_now();
+
+        snprintf(name, sizeof(name), "%s %s n=%zu", broadphase_names[b],
+                 scenes[s].name, count);
+        plbench_report(name, "steps", STEPS, end - start);
+
+        pl_collision_context_delete(coll);
+        free_objects(objs, count);
+      }
+    }
+  }
+}
@@ -0,0 +1,99 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/conjunction.h"
+
+#define GM_EARTH 3.986004418e14
+#define WINDOW 86400.0
+#define STEP 30.0
+#define THRESHOLD 5000.0
+
+// Random low earth orbit catalogue
+static void
+bench_conj_catalogue(pl_conj_screen_t *screen, size_t n)
+{
+  srandom(1);
+  pl_conj_clear(screen);
+  for (size_t i = 0 ; i < n ; i ++) {
+    double a = plbench_rand(6.7e6, 7.5e6);
+    double ecc = plbench_rand(0.0, 0.02);
+    double inc = plbench_rand(0.0, M_PI);
+    double raan = plbench_rand(0.0, 2.0 * M_PI);
+    double w = plbench_rand(0.0, 2.0 * M_PI);
+
+    double3 n_hat = vd3_set(sin(raan) * sin(inc), -cos(raan) * sin(inc),
+                            cos(inc));
+    double3 node = vd3_set(cos(raan), sin(raan), 0.0);
+    double3 node_q = vd3_cross(n_hat, node);
+
+    pl_kepler_orbit_t orbit;
+    orbit.GM = GM_EARTH;
+    orbit.ecc = ecc;
+    orbit.a = a;
+    orbit.n = sqrt(GM_EARTH / (a * a * a));
+    orbit.M0 = plbench_rand(0.0, 2.0 * M_PI);
+    orbit.t0 = 0.0;
+    orbit.P = node * cos(w) + node_q * sin(w);
+    orbit.Q = vd3_cross(n_hat, orbit.P);
+    pl_conj_add(screen, &orbit, NULL);
+  }
+}
+
+void
+bench_conjunction(void)
+{
+  static const size_t counts[] = {2000, 5000};
+  char name[64];
+
+  pl_conj_screen_t *screen = pl_new_conj_screen(THRESHOLD, STEP);
+  task_pool_t *tasks = task_pool_new(0);
+
+  for (size_t k = 0 ; k < sizeof(counts)/sizeof(counts[0]) ; k ++) {
+    size_t n = counts[k];
+    bench_conj_catalogue(screen, n);
+    double pairs = 0.5 * (double)n * (double)(n - 1);
+
+    pl_conj_set_tasks(screen, NULL);
+    double start = plbench_now();
+    size_t found = pl_conj_screen(screen, 0.0, WINDOW);
+    double end = plbench_now();
+    snprintf(name, sizeof(name), "screen n=%zu 1 thread", n);
+    plbench_report(name, "pairs", pairs, end - start);
+
+    printf("  %.0f pairs, %zu after apsis filter, %zu after path filter, "
+           "%zu refined, %zu conjunctions\n", pairs, screen->apsis_pairs,
+           screen->pair_count, screen->refinements, found);
+
+    pl_conj_set_tasks(screen, tasks);
+    start = plbench_now();
+    pl_conj_screen(screen, 0.0, WINDOW);
+    end = plbench_now();
+    snprintf(name, sizeof(name), "screen n=%zu %u threads", n,
+             task_pool_thread_count(tasks));
+    plbench_report(name, "pairs", pairs, end - start);
+  }
+
+  task_pool_delete(tasks);
+  pl_conj_screen_delete(screen);
+}
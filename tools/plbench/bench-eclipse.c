@@ -0,0 +1,94 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/celestial-object.h"
+
+#define BODIES 10000
+#define REPEATS 20
+
+// Sunlight of bodies in low earth orbit, testing every celestial object
+// against every body versus the system hierarchy
+void
+bench_eclipse(void)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_time_set(jde);
+  pl_world_update_soi(world);
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+
+  pl_eclipse_t *eclipse = pl_new_eclipse();
+  pl_eclipse_build(eclipse, world);
+
+  double3 *p = malloc(BODIES * sizeof(double3));
+  float *light = malloc(BODIES * sizeof(float));
+  srandom(1);
+  for (int i = 0 ; i < BODIES ; i ++) {
+    double3 r = vd3_set(plbench_rand(-1.0, 1.0), plbench_rand(-1.0, 1.0),
+                        plbench_rand(-1.0, 1.0));
+    p[i] = earth->cm_orbit->p + r * (plbench_rand(6.6e6, 8.0e6) / vd3_abs(r));
+  }
+
+  double start = plbench_now();
+  for (int r = 0 ; r < REPEATS ; r ++) {
+    for (int i = 0 ; i < BODIES ; i ++) {
+      double f = 1.0;
+      ARRAY_FOR_EACH(j, world->celestial_objects) {
+        pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, j);
+        if (cel == eclipse->sun) continue;
+        f = fmin(f, pl_eclipse_shadow(p[i], eclipse->sun_p,
+                                      eclipse->sun_radius, cel->cm_orbit->p,
+                                      cel->cm_orbit->radius));
+      }
+      light[i] = f;
+    }
+  }
+  double end = plbench_now();
+  plbench_report("all occluders", "bodies", (double)BODIES * REPEATS,
+                 end - start);
+
+  size_t shadowed = 0, differ = 0;
+  start = plbench_now();
+  for (int r = 0 ; r < REPEATS ; r ++) {
+    for (int i = 0 ; i < BODIES ; i ++) {
+      float f = pl_eclipse_sunlight(eclipse, p[i], NULL);
+      if (r == 0) {
+        shadowed += f < 1.0f;
+        differ += fabsf(f - light[i]) > 1.0e-6f;
+      }
+    }
+  }
+  end = plbench_now();
+  plbench_report("hierarchy", "bodies", (double)BODIES * REPEATS,
+                 end - start);
+  printf("  %zu of %d bodies shadowed, %zu differ\n", shadowed, BODIES, differ);
+
+  free(p);
+  free(light);
+  pl_eclipse_delete(eclipse);
+  pl_world_delete(world);
+}
@@ -0,0 +1,70 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/world.h"
+#include "physics/ephemeris.h"
+
+#define STEPS 10000
+#define DAYS 30.0
+
+void
+bench_ephemeris(void)
+{
+  const char *path = "plbench-ephemeris.cache";
+  const double jd0 = 2456293.5; // 2013-01-01
+  const double dt = DAYS / STEPS;
+
+  pl_world_t *world = pl_new_world(1.0e13);
+  size_t bodies = ARRAY_LEN(world->celestial_objects);
+
+  unlink(path);
+  double start = plbench_now();
+  pl_ephemeris_t *eph = pl_ephemeris_open(world, path, 1, jd0, jd0 + DAYS);
+  double end = plbench_now();
+  plbench_report("generate", "days", DAYS, end - start);
+  pl_ephemeris_close(eph);
+
+  start = plbench_now();
+  eph = pl_ephemeris_open(world, path, 1, jd0, jd0 + DAYS);
+  end = plbench_now();
+  plbench_report("open", "files", 1.0, end - start);
+
+  start = plbench_now();
+  for (int i = 0 ; i < STEPS ; i ++) {
+    cm_orbit_compute(jd0 + i * dt);
+  }
+  end = plbench_now();
+  plbench_report("model", "bodies", (double)STEPS * bodies, end - start);
+
+  start = plbench_now();
+  for (int i = 0 ; i < STEPS ; i ++) {
+    pl_ephemeris_update(eph, jd0 + i * dt);
+  }
+  end = plbench_now();
+  plbench_report("cache", "bodies", (double)STEPS * bodies, end - start);
+
+  pl_ephemeris_close(eph);
+  unlink(path);
+  pl_world_delete(world);
+}
@@ -0,0 +1,135 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/octtree.h"
+
+#define SAMPLES 1000 // Targets checked against direct summation
+#define EXTENT 1.0e12
+
+static double3
+direct_field(const cm_orbit_t *orbits, size_t n, double3 p)
+{
+  double3 g = vd3_set(0.0, 0.0, 0.0);
+  for (size_t i = 0 ; i < n ; i ++) {
+    double3 dv = p - orbits[i].p;
+    double d2 = vd3_dot(dv, dv);
+    if (d2 > 0.0) g -= dv * (orbits[i].GM / (d2 * sqrt(d2)));
+  }
+  return g;
+}
+
+static double
+mean_error(const double3 *exact, const double3 *approx, size_t samples)
+{
+  double err = 0.0;
+  for (size_t i = 0 ; i < samples ; i ++) {
+    double3 diff = approx[i] - exact[i];
+    err += sqrt(vd3_dot(diff, diff) / vd3_dot(exact[i], exact[i]));
+  }
+  return err / samples;
+}
+
+void
+bench_fmm(void)
+{
+  static const size_t counts[] = {1000, 10000, 50000};
+  static const int orders[] = {2, 4, 6, 8};
+  char name[64];
+
+  for (size_t c = 0 ; c < sizeof(counts)/sizeof(counts[0]) ; c ++) {
+    size_t n = counts[c];
+    size_t samples = n < SAMPLES ? n : SAMPLES;
+
+    pl_octtree_t *tree = pl_new_octtree(vd3_set(0, 0, 0), 4.0 * EXTENT);
+    cm_orbit_t *orbits = calloc(n, sizeof(cm_orbit_t));
+    pl_celobject_t *celobjs = calloc(n, sizeof(pl_celobject_t));
+    pl_object_t *objs = calloc(n, sizeof(pl_object_t));
+
+    for (size_t i = 0 ; i < n ; i ++) {
+      orbits[i].p = vd3_set(plbench_rand(-EXTENT, EXTENT),
+                            plbench_rand(-EXTENT, EXTENT),
+                            plbench_rand(-EXTENT, EXTENT));
+      orbits[i].GM = plbench_rand(1.0e9, 1.0e20);
+      celobjs[i].cm_orbit = &orbits[i];
+      pl_octtree_insert_celbody(tree, &celobjs[i]);
+
+      pl_object_init(&objs[i]);
+      objs[i].m.m = 1.0;
+      pl_object_set_pos3d(&objs[i], plbench_rand(-EXTENT, EXTENT),
+                          plbench_rand(-EXTENT, EXTENT),
+                          plbench_rand(-EXTENT, EXTENT));
+      pl_octtree_insert_rbody(tree, &objs[i]);
+    }
+
+    // Direct summation is only run on a sample of the targets
+    double3 *exact = malloc(samples * sizeof(double3));
+    double3 *approx = malloc(samples * sizeof(double3));
+    double start = plbench_now();
+    for (size_t i = 0 ; i < samples ; i ++) {
+      exact[i] = direct_field(orbits, n, lwc_globald(&objs[i].p));
+    }
+    double end = plbench_now();
+    snprintf(name, sizeof(name), "direct n=%zu", n);
+    plbench_report(name, "bodies", samples, end - start);
+
+    start = plbench_now();
+    pl_octtree_update_gravity(tree);
+    for (size_t i = 0 ; i < n ; i ++) {
+      double3 g = pl_octtree_compute_gravity(tree, &objs[i]);
+      if (i < samples) approx[i] = g;
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "barnes-hut n=%zu", n);
+    plbench_report(name, "bodies", n, end - start);
+    printf("%-40s %14.3e\n", "  mean relative error",
+           mean_error(exact, approx, samples));
+
+    for (size_t o = 0 ; o < sizeof(orders)/sizeof(orders[0]) ; o ++) {
+      pl_octtree_set_fmm(tree, orders[o]);
+      pl_octtree_update_gravity(tree); // Allocates the expansions
+
+      start = plbench_now();
+      pl_octtree_update_gravity(tree);
+      for (size_t i = 0 ; i < n ; i ++) {
+        double3 g = pl_octtree_compute_gravity(tree, &objs[i]);
+        if (i < samples) approx[i] = g;
+      }
+      end = plbench_now();
+      snprintf(name, sizeof(name), "fmm n=%zu order=%d", n, orders[o]);
+      plbench_report(name, "bodies", n, end - start);
+      printf("%-40s %14.3e\n", "  mean relative error",
+             mean_error(exact, approx, samples));
+    }
+
+    pl_octtree_delete(tree);
+    free(approx);
+    free(exact);
+    free(objs);
+    free(celobjs);
+    free(orbits);
+  }
+}
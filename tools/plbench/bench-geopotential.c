@@ -0,0 +1,97 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/geopotential.h"
+
+#define BODIES 1000
+#define REPEATS 100
+
+// Non-spherical gravity of bodies in low earth orbit, one body per call
+// against the whole batch in one call, for a few degrees
+void
+bench_geopotential(void)
+{
+  static const unsigned degrees[] = {2, 4, 8, 20};
+  const double R = 6378136.3;
+
+  srandom(1);
+  size_t terms = PL_GEOPOTENTIAL_IDX(PL_GEOPOTENTIAL_MAX_DEGREE + 1, 0);
+  double *C = malloc(terms * sizeof(double));
+  double *S = malloc(terms * sizeof(double));
+  for (size_t i = 0 ; i < terms ; i ++) {
+    C[i] = plbench_rand(-1.0e-6, 1.0e-6);
+    S[i] = plbench_rand(-1.0e-6, 1.0e-6);
+  }
+  C[0] = 1.0;
+
+  pl_geopotential_t *geo = pl_new_geopotential(PL_GEOPOTENTIAL_MAX_DEGREE,
+                                               PL_GEOPOTENTIAL_MAX_DEGREE,
+                                               R, C, S);
+  pl_geopotential_update(geo, 3.986004415e14, qd_rot(1.0, 0.0, 0.0, 0.0));
+
+  double3 *r = malloc(BODIES * sizeof(double3));
+  double3 *acc = malloc(BODIES * sizeof(double3));
+  double3 *ref = malloc(BODIES * sizeof(double3));
+  for (int i = 0 ; i < BODIES ; i ++) {
+    double3 d = vd3_set(plbench_rand(-1.0, 1.0), plbench_rand(-1.0, 1.0),
+                        plbench_rand(-1.0, 1.0));
+    r[i] = d * (plbench_rand(6.6e6, 8.0e6) / vd3_abs(d));
+  }
+
+  char name[64];
+  for (size_t d = 0 ; d < sizeof(degrees)/sizeof(degrees[0]) ; d ++) {
+    unsigned n = degrees[d];
+
+    double start = plbench_now();
+    for (int k = 0 ; k < REPEATS ; k ++) {
+      for (int i = 0 ; i < BODIES ; i ++) {
+        pl_geopotential_acc(geo, n, n, 1, &r[i], &ref[i]);
+      }
+    }
+    double end = plbench_now();
+    snprintf(name, sizeof(name), "single degree %u", n);
+    plbench_report(name, "bodies", (double)BODIES * REPEATS, end - start);
+
+    start = plbench_now();
+    for (int k = 0 ; k < REPEATS ; k ++) {
+      pl_geopotential_acc(geo, n, n, BODIES, r, acc);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "batched degree %u", n);
+    plbench_report(name, "bodies", (double)BODIES * REPEATS, end - start);
+
+    double err = 0.0;
+    for (int i = 0 ; i < BODIES ; i ++) {
+      err = fmax(err, vd3_abs(acc[i] - ref[i]) / vd3_abs(ref[i]));
+    }
+    printf("  largest relative difference %g\n", err);
+  }
+
+  free(r);
+  free(acc);
+  free(ref);
+  free(C);
+  free(S);
+  pl_geopotential_delete(geo);
+}
@@ -0,0 +1,115 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/integrator.h"
+#include "physics/kepler.h"
+
+#define GM_EARTH 3.986004418e14
+#define PERIGEE 6778.0e3 // 400 km altitude
+#define ECC 0.1
+#define ORBITS 10
+
+static double3
+point_mass_field(void *data, const lwcoord_t *p)
+{
+  double3 r = lwc_globald(p);
+  double d = vd3_abs(r);
+  return r * (-GM_EARTH / (d * d * d));
+}
+
+static double
+specific_energy(pl_object_t *obj)
+{
+  double3 r = lwc_globald(&obj->p);
+  return 0.5 * vd3_dot(obj->v, obj->v) - GM_EARTH / vd3_abs(r);
+}
+
+void
+bench_integrator(void)
+{
+  static const double steps[] = {1.0, 5.0, 20.0, 60.0};
+  double a = PERIGEE / (1.0 - ECC);
+  double period = 2.0 * M_PI * sqrt(a * a * a / GM_EARTH);
+  char name[64];
+
+  for (int k = 0 ; k < PL_INTEGRATOR_COUNT ; k ++) {
+    for (size_t s = 0 ; s < sizeof(steps)/sizeof(steps[0]) ; s ++) {
+      double dt = steps[s];
+      long n = (long)(ORBITS * period / dt);
+
+      pl_object_t obj;
+      pl_object_init(&obj);
+      pl_mass_set(&obj.m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  10.0f, 10.0f, 10.0f, 0.0f, 0.0f, 0.0f);
+      pl_object_compute_derived(&obj);
+      pl_object_set_pos3d(&obj, PERIGEE, 0.0, 0.0);
+      obj.v = vd3_set(0.0, sqrt(GM_EARTH * (1.0 + ECC) / PERIGEE), 0.0);
+      obj.integrator.kind = k;
+      obj.integrator.field = point_mass_field;
+
+      double e0 = specific_energy(&obj);
+      unsigned long evals = 0;
+
+      double start = plbench_now();
+      for (long i = 0 ; i < n ; i ++) {
+        obj.g_ack = point_mass_field(NULL, &obj.p) * obj.m.m;
+        pl_object_step(&obj, dt);
+        evals += 1 + obj.integrator.field_evals;
+      }
+      double end = plbench_now();
+
+      snprintf(name, sizeof(name), "%s dt=%.0f", pl_integrator_name(k), dt);
+      plbench_report(name, "steps", n, end - start);
+      printf("%-40s %14.3e (%lu field evaluations)\n", "  energy drift",
+             fabs((specific_energy(&obj) - e0) / e0), evals);
+
+      obj_array_dispose(&obj.children);
+      obj_array_dispose(&obj.psystem);
+      obj_array_dispose(&obj.aerofoils);
+    }
+  }
+
+  // Analytic propagation of the same orbit, as used for bodies on rails
+  for (size_t s = 0 ; s < sizeof(steps)/sizeof(steps[0]) ; s ++) {
+    double dt = steps[s];
+    long n = (long)(ORBITS * period / dt);
+
+    pl_kepler_orbit_t orbit;
+    double3 r = vd3_set(PERIGEE, 0.0, 0.0);
+    double3 v = vd3_set(0.0, sqrt(GM_EARTH * (1.0 + ECC) / PERIGEE), 0.0);
+    pl_kepler_from_state(&orbit, GM_EARTH, r, v, 0.0);
+    double e0 = 0.5 * vd3_dot(v, v) - GM_EARTH / vd3_abs(r);
+
+    double start = plbench_now();
+    for (long i = 0 ; i < n ; i ++) {
+      pl_kepler_state_at(&orbit, (i + 1) * dt, &r, &v);
+    }
+    double end = plbench_now();
+
+    snprintf(name, sizeof(name), "kepler dt=%.0f", dt);
+    plbench_report(name, "steps", n, end - start);
+    printf("%-40s %14.3e\n", "  energy drift",
+           fabs((0.5 * vd3_dot(v, v) - GM_EARTH / vd3_abs(r) - e0) / e0));
+  }
+}
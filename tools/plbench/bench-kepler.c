@@ -0,0 +1,77 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/kepler.h"
+
+#define SOLVES (1 << 16)
+#define REPEATS 20
+
+void
+bench_kepler(void)
+{
+  static const double eccs[] = {0.0, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999};
+  char name[64];
+
+  double *ecc = malloc(SOLVES * sizeof(double));
+  double *M = malloc(SOLVES * sizeof(double));
+  double *E = malloc(SOLVES * sizeof(double));
+  bool *converged = malloc(SOLVES * sizeof(bool));
+
+  for (size_t k = 0 ; k < sizeof(eccs)/sizeof(eccs[0]) ; k ++) {
+    srandom(1);
+    for (size_t i = 0 ; i < SOLVES ; i ++) {
+      ecc[i] = eccs[k];
+      M[i] = plbench_rand(-M_PI, M_PI);
+    }
+
+    double start = plbench_now();
+    for (int r = 0 ; r < REPEATS ; r ++) {
+      for (size_t i = 0 ; i < SOLVES ; i ++) {
+        E[i] = pl_ecc_anomaly(ecc[i], 1.0, M[i]);
+      }
+    }
+    double end = plbench_now();
+    snprintf(name, sizeof(name), "scalar e=%g", eccs[k]);
+    plbench_report(name, "solves", (double)SOLVES * REPEATS, end - start);
+
+    size_t failed = 0;
+    start = plbench_now();
+    for (int r = 0 ; r < REPEATS ; r ++) {
+      failed += pl_ecc_anomaly_batch(SOLVES, ecc, M, E, converged);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "batch e=%g", eccs[k]);
+    plbench_report(name, "solves", (double)SOLVES * REPEATS, end - start);
+
+    if (failed) {
+      printf("  %zu solves did not converge\n", failed);
+    }
+  }
+
+  free(ecc);
+  free(M);
+  free(E);
+  free(converged);
+}
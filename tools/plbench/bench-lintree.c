@@ -0,0 +1,158 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/linear-octtree.h"
+#include "physics/octtree.h"
+
+#define QUERIES 1000
+#define BUILDS 10
+#define EXTENT 1.0e12 // Sources are spread over a box with this half side
+
+static double3
+direct_gravity(const lwcoord_t *src, const double *GM, size_t n,
+               const lwcoord_t *p, double m)
+{
+  double3 g = vd3_set(0.0, 0.0, 0.0);
+  double3 pos = lwc_globald(p);
+  for (size_t i = 0 ; i < n ; i ++) {
+    double3 dv = pos - lwc_globald(&src[i]);
+    double d2 = vd3_dot(dv, dv);
+    if (d2 > 0.0) g -= dv * (GM[i] * m / (d2 * sqrt(d2)));
+  }
+  return g;
+}
+
+static double
+rel_error(double3 approx, double3 exact)
+{
+  double3 diff = approx - exact;
+  return sqrt(vd3_dot(diff, diff)) / sqrt(vd3_dot(exact, exact));
+}
+
+void
+bench_lintree(void)
+{
+  static const size_t counts[] = {100, 1000, 10000, 100000};
+  static const double thetas[] = {0.3, 0.5, 0.7, 1.0};
+  char name[64];
+
+  lwcoord_t *queries = malloc(QUERIES * sizeof(lwcoord_t));
+  for (size_t i = 0 ; i < QUERIES ; i ++) {
+    lwc_set(&queries[i], plbench_rand(-EXTENT, EXTENT),
+            plbench_rand(-EXTENT, EXTENT), plbench_rand(-EXTENT, EXTENT));
+  }
+
+  for (size_t c = 0 ; c < sizeof(counts)/sizeof(counts[0]) ; c ++) {
+    size_t n = counts[c];
+    lwcoord_t *src = malloc(n * sizeof(lwcoord_t));
+    double *GM = malloc(n * sizeof(double));
+    for (size_t i = 0 ; i < n ; i ++) {
+      lwc_set(&src[i], plbench_rand(-EXTENT, EXTENT),
+              plbench_rand(-EXTENT, EXTENT), plbench_rand(-EXTENT, EXTENT));
+      GM[i] = plbench_rand(1.0e9, 1.0e20);
+    }
+
+    // Reference solution
+    double3 *exact = malloc(QUERIES * sizeof(double3));
+    double start = plbench_now();
+    for (size_t i = 0 ; i < QUERIES ; i ++) {
+      exact[i] = direct_gravity(src, GM, n, &queries[i], 1000.0);
+    }
+    double end = plbench_now();
+    snprintf(name, sizeof(name), "direct n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+
+    // Pointer based octtree, fed with stand in celestial bodies
+    pl_octtree_t *otree = pl_new_octtree(vd3_set(0, 0, 0), 4.0 * EXTENT);
+    cm_orbit_t *orbits = calloc(n, sizeof(cm_orbit_t));
+    pl_celobject_t *celobjs = calloc(n, sizeof(pl_celobject_t));
+    start = plbench_now();
+    for (size_t i = 0 ; i < n ; i ++) {
+      orbits[i].p = lwc_globald(&src[i]);
+      orbits[i].GM = GM[i];
+      celobjs[i].cm_orbit = &orbits[i];
+      pl_octtree_insert_celbody(otree, &celobjs[i]);
+    }
+    pl_octtree_update_gravity(otree);
+    end = plbench_now();
+    snprintf(name, sizeof(name), "octtree build n=%zu", n);
+    plbench_report(name, "sources", n, end - start);
+
+    pl_object_t probe;
+    pl_object_init(&probe);
+    probe.m.m = 1000.0;
+    double err = 0.0;
+    start = plbench_now();
+    for (size_t i = 0 ; i < QUERIES ; i ++) {
+      probe.p = queries[i];
+      err += rel_error(pl_octtree_compute_gravity(otree, &probe), exact[i]);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "octtree query n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+    printf("%-40s %14.3e\n", "  mean relative error", err / QUERIES);
+    pl_octtree_delete(otree);
+    free(celobjs);
+    free(orbits);
+
+    // Linear tree
+    pl_lintree_t *tree = pl_new_lintree();
+    start = plbench_now();
+    for (int b = 0 ; b < BUILDS ; b ++) {
+      pl_lintree_clear(tree);
+      for (size_t i = 0 ; i < n ; i ++) {
+        pl_lintree_add(tree, &src[i], GM[i]);
+      }
+      pl_lintree_build(tree);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "lintree build n=%zu", n);
+    plbench_report(name, "sources", (double)n * BUILDS, end - start);
+
+    for (size_t t = 0 ; t < sizeof(thetas)/sizeof(thetas[0]) ; t ++) {
+      pl_lintree_set_theta(tree, thetas[t]);
+      err = 0.0;
+      start = plbench_now();
+      for (size_t i = 0 ; i < QUERIES ; i ++) {
+        err += rel_error(pl_lintree_compute_gravity(tree, &queries[i], 1000.0),
+                         exact[i]);
+      }
+      end = plbench_now();
+      snprintf(name, sizeof(name), "lintree query n=%zu theta=%.1f",
+               n, thetas[t]);
+      plbench_report(name, "queries", QUERIES, end - start);
+      printf("%-40s %14.3e\n", "  mean relative error", err / QUERIES);
+    }
+
+    pl_lintree_delete(tree);
+    free(exact);
+    free(GM);
+    free(src);
+  }
+
+  free(queries);
+}
@@ -0,0 +1,88 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+
+#define BODIES 10000
+#define STEPS 20
+
+// Full world steps of bodies spread around earth, with every body at full
+// detail and with the distance based level of detail focused on one of them
+void
+bench_lod(void)
+{
+  static const struct {
+    const char *name;
+    double reduced, sleep;
+  } tiers[] = {
+    {"all full", 0.0, 0.0},
+    {"lod 100 km / 1000 km", 1.0e5, 1.0e6},
+    {"lod 1000 km / 5000 km", 1.0e6, 5.0e6},
+  };
+  const double jde = 2456293.5; // 2013-01-01
+
+  for (size_t t = 0 ; t < sizeof(tiers)/sizeof(tiers[0]) ; t ++) {
+    pl_world_t *world = pl_new_world(1.0e13);
+    pl_world_set_broadphase(world, PL_BROADPHASE_SWEEP_PRUNE);
+    pl_world_set_lod(world, tiers[t].reduced, tiers[t].sleep, 4, 0.1);
+    pl_time_set(jde);
+    pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+
+    srandom(1);
+    for (int i = 0 ; i < BODIES ; i ++) {
+      pl_object_t *obj = pl_new_object(world, "bench");
+      pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+      double3 r = vd3_set(plbench_rand(-1.0, 1.0), plbench_rand(-1.0, 1.0),
+                          plbench_rand(-1.0, 1.0));
+      r *= plbench_rand(6.6e6, 8.0e6) / vd3_abs(r);
+      pl_object_set_pos_celobj_rel(obj, earth, r);
+
+      // Circular orbit about an axis perpendicular to r
+      double3 axis = vd3_normalise(vd3_cross(r, vd3_set(0.0, 0.0, 1.0)));
+      double3 v = vd3_normalise(vd3_cross(axis, r))
+                * sqrt(earth->cm_orbit->GM / vd3_abs(r));
+      pl_object_set_vel3dv(obj, earth->cm_orbit->v + v);
+    }
+
+    pl_object_t *focus = ARRAY_ELEM(world->root_bodies, 0);
+
+    double start = plbench_now();
+    for (int s = 0 ; s < STEPS ; s ++) {
+      pl_world_set_lod_focus(world, &focus->p);
+      pl_world_step(world, jde + s * 1.0 / 86400.0, 1.0);
+    }
+    double end = plbench_now();
+    plbench_report(tiers[t].name, "bodies", (double)BODIES * STEPS,
+                   end - start);
+    printf("  %zu full, %zu reduced, %zu sleeping, %zu pairs tested\n",
+           world->lod_count[PL_LOD_FULL], world->lod_count[PL_LOD_REDUCED],
+           world->lod_count[PL_LOD_SLEEPING],
+           world->coll_ctxt->pairs_tested);
+
+    pl_world_delete(world);
+  }
+}
@@ -0,0 +1,82 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+
+#define MODULES 32 // Modules per truss, and trusses per station
+#define STEPS 1000
+
+// Mark every object of the tree as changed, as the mass was recomputed on
+// demand before the dirty flags were introduced
+static void
+invalidate_all(pl_object_t *obj)
+{
+  obj->mass_dirty = true;
+  for (int i = 0 ; i < obj->children.length ; i ++) {
+    invalidate_all(obj->children.elems[i]);
+  }
+}
+
+// A station of MODULES trusses with MODULES modules each, where one module
+// burns propellant every step
+void
+bench_mass(void)
+{
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_object_t *station = pl_new_object(world, "station");
+  pl_object_t *modules[MODULES * MODULES];
+
+  srandom(1);
+  for (int i = 0 ; i < MODULES ; i ++) {
+    pl_object_t *truss = pl_new_sub_object3f(world, station, "truss",
+                                             10.0f * i, 0.0f, 0.0f);
+    for (int j = 0 ; j < MODULES ; j ++) {
+      pl_object_t *module = pl_new_sub_object3f(world, truss, "module",
+                                                0.0f, 5.0f * j, 0.0f);
+      pl_mass_solid_cylinder(&module->m, plbench_rand(1.0e3, 2.0e4),
+                             2.0f, 8.0f);
+      modules[i * MODULES + j] = module;
+    }
+  }
+  pl_object_update_mass(station);
+
+  pl_object_t *engine = modules[MODULES * MODULES / 2];
+  double start = plbench_now();
+  for (int s = 0 ; s < STEPS ; s ++) {
+    pl_object_mod_mass(engine, engine->m.m - 1.0);
+    invalidate_all(station);
+    pl_object_update_mass(station);
+  }
+  double end = plbench_now();
+  plbench_report("full", "updates", STEPS, end - start);
+
+  start = plbench_now();
+  for (int s = 0 ; s < STEPS ; s ++) {
+    pl_object_mod_mass(engine, engine->m.m - 1.0);
+    pl_object_update_mass(station);
+  }
+  end = plbench_now();
+  plbench_report("incremental", "updates", STEPS, end - start);
+
+  pl_world_delete(world);
+}
@@ -0,0 +1,74 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/particles.h"
+
+#define STEPS 200
+#define DT 0.02f
+#define LIFETIME 2.0f
+
+void
+bench_particles(void)
+{
+  static const size_t counts[] = {1000, 10000, 100000};
+  char name[64];
+
+  for (size_t c = 0 ; c < sizeof(counts)/sizeof(counts[0]) ; c ++) {
+    size_t count = counts[c];
+    pl_object_t obj;
+    pl_object_init(&obj);
+    obj.v = vd3_set(7500.0, 0.0, 0.0);
+
+    pl_particles_t *ps = pl_new_particle_system("bench", count);
+    ps->obj = &obj;
+    ps->p = vd3_set(0.0, 0.0, -10.0);
+    ps->v = vd3_set(0.0, 0.0, -3000.0);
+    ps->lifeTime = LIFETIME;
+    ps->rgb = vf3_set(1.0f, 0.8f, 0.5f);
+    // Emit slightly faster than particles expire, so the system stays full
+    // and both spawning and retiring are exercised every step.
+    pl_particles_set_emission_rate(ps, 1.2f * count / LIFETIME);
+    pl_particles_enable(ps);
+
+    for (int step = 0 ; step < LIFETIME / DT ; step ++) {
+      pl_particles_step(ps, DT);
+    }
+
+    double particles = 0.0;
+    double start = plbench_now();
+    for (int step = 0 ; step < STEPS ; step ++) {
+      particles += ps->alive;
+      pl_particles_step(ps, DT);
+    }
+    double end = plbench_now();
+
+    snprintf(name, sizeof(name), "particles n=%zu", count);
+    plbench_report(name, "particles", particles, end - start);
+
+    pl_particles_delete(ps);
+    obj_array_dispose(&obj.children);
+    obj_array_dispose(&obj.psystem);
+    obj_array_dispose(&obj.aerofoils);
+  }
+}
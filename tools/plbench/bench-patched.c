@@ -0,0 +1,98 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+
+#define BODIES 10000
+#define STEPS 20
+
+static double3
+direct_field(pl_world_t *world, double3 p)
+{
+  double3 g = vd3_set(0.0, 0.0, 0.0);
+  ARRAY_FOR_EACH(i, world->celestial_objects) {
+    pl_celobject_t *cel = ARRAY_ELEM(world->celestial_objects, i);
+    double3 dv = p - cel->cm_orbit->p;
+    double d2 = vd3_dot(dv, dv);
+    g -= dv * (cel->cm_orbit->GM / (d2 * sqrt(d2)));
+  }
+  return g;
+}
+
+// Full world steps of bodies in low earth orbit with the different gravity
+// modes, the error is measured against direct summation after the last step
+void
+bench_patched(void)
+{
+  static const struct {
+    const char *name;
+    pl_gravity_mode_t mode;
+  } modes[] = {
+    {"octtree", PL_GRAVITY_OCTTREE},
+    {"linear-octtree", PL_GRAVITY_LINEAR_OCTTREE},
+    {"patched-conic", PL_GRAVITY_PATCHED_CONIC},
+  };
+  const double jde = 2456293.5; // 2013-01-01
+
+  for (size_t m = 0 ; m < sizeof(modes)/sizeof(modes[0]) ; m ++) {
+    pl_world_t *world = pl_new_world(1.0e13);
+    pl_world_set_gravity_mode(world, modes[m].mode);
+    pl_time_set(jde);
+    pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+
+    srandom(1);
+    for (int i = 0 ; i < BODIES ; i ++) {
+      pl_object_t *obj = pl_new_object(world, "bench");
+      pl_mass_set(&obj->m, 1000.0f, 0.0f, 0.0f, 0.0f,
+                  1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+      double3 r = vd3_set(plbench_rand(-1.0, 1.0), plbench_rand(-1.0, 1.0),
+                          plbench_rand(-1.0, 1.0));
+      r *= plbench_rand(6.6e6, 8.0e6) / vd3_abs(r);
+      pl_object_set_pos_celobj_rel(obj, earth, r);
+      pl_object_set_vel3dv(obj, earth->cm_orbit->v);
+    }
+
+    double start = plbench_now();
+    for (int s = 0 ; s < STEPS ; s ++) {
+      pl_world_step(world, jde + s * 1.0 / 86400.0, 1.0);
+    }
+    double end = plbench_now();
+    plbench_report(modes[m].name, "bodies", (double)BODIES * STEPS,
+                   end - start);
+
+    double err = 0.0;
+    ARRAY_FOR_EACH(i, world->root_bodies) {
+      pl_object_t *obj = ARRAY_ELEM(world->root_bodies, i);
+      double3 exact = direct_field(world, lwc_globald(&obj->p));
+      double3 g = pl_world_object_gravity_at(obj, &obj->p);
+      err += vd3_abs(g - exact) / vd3_abs(exact);
+    }
+    printf("%-40s %14.3e\n", "  mean relative error",
+           err / ARRAY_LEN(world->root_bodies));
+
+    pl_world_delete(world);
+  }
+}
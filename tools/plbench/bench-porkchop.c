@@ -0,0 +1,81 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/kepler.h"
+#include "physics/porkchop.h"
+
+#define GM_SUN 1.32712440018e20
+#define AU 1.495978707e11
+#define GRID 500
+
+// Earth to Mars grid over two years of departures, with the planets on
+// Keplerian orbits, Mars starting at perihelion
+void
+bench_porkchop(void)
+{
+  char name[64];
+  pl_kepler_orbit_t earth, mars;
+  double inc = 1.85 * M_PI / 180.0;
+  pl_kepler_from_state(&earth, GM_SUN, vd3_set(AU, 0.0, 0.0),
+                       vd3_set(0.0, sqrt(GM_SUN / AU), 0.0), 0.0);
+  pl_kepler_from_state(&mars, GM_SUN, vd3_set(1.381 * AU, 0.0, 0.0),
+                       vd3_set(0.0, cos(inc), sin(inc)) * 26500.0, 0.0);
+
+  pl_porkchop_t *pc = pl_new_porkchop(0.0, 730.0, GRID, 100.0, 1130.0, GRID);
+  pc->GM = GM_SUN;
+  for (size_t i = 0 ; i < GRID ; i ++) {
+    pl_kepler_state_at(&earth, pc->dep_jd[i] * PL_SEC_PER_DAY,
+                       &pc->dep_r[i], &pc->dep_v[i]);
+    pl_kepler_state_at(&mars, pc->arr_jd[i] * PL_SEC_PER_DAY,
+                       &pc->arr_r[i], &pc->arr_v[i]);
+  }
+
+  task_pool_t *tasks = task_pool_new(0);
+  double cells = (double)GRID * GRID;
+
+  double start = plbench_now();
+  size_t solved = pl_porkchop_compute(pc);
+  double end = plbench_now();
+  plbench_report("grid 1 thread", "cells", cells, end - start);
+
+  pl_porkchop_set_tasks(pc, tasks);
+  start = plbench_now();
+  pl_porkchop_compute(pc);
+  end = plbench_now();
+  snprintf(name, sizeof(name), "grid %u threads",
+           task_pool_thread_count(tasks));
+  plbench_report(name, "cells", cells, end - start);
+
+  float best = INFINITY;
+  for (size_t i = 0 ; i < GRID * GRID ; i ++) {
+    float dv = pc->dv_dep[i] + pc->dv_arr[i];
+    if (dv < best) best = dv;
+  }
+  printf("  %zu of %.0f cells solved, lowest total delta-v %.0f m/s\n",
+         solved, cells, best);
+
+  task_pool_delete(tasks);
+  pl_porkchop_delete(pc);
+}
@@ -0,0 +1,87 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <celmek/celmek.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+#include "physics/celestial-object.h"
+#include "physics/predictor.h"
+
+#define REQUESTS 200
+
+// Cost of posting a request on the simulation thread and latency of the
+// published trajectories for a few sample densities over one day
+void
+bench_predict(void)
+{
+  const double jde = 2456293.5; // 2013-01-01
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_time_set(jde);
+  pl_world_update_soi(world);
+  pl_celobject_t *earth = pl_world_get_celobject(world, "earth");
+
+  pl_object_t *obj = pl_new_object(world, "bench-object");
+  pl_object_set_pos_celobj_rel(obj, earth, vd3_set(7.0e6, 0.0, 0.0));
+  pl_object_set_vel3dv(obj, earth->cm_orbit->v + vd3_set(0.0, 7.8e3, 0.0));
+
+  static const size_t samples[] = {256, 1024, 4096};
+  for (size_t i = 0 ; i < sizeof(samples) / sizeof(samples[0]) ; i ++) {
+    pl_predictor_t *pred = pl_new_predictor(PL_SEC_PER_DAY, samples[i]);
+
+    double start = plbench_now();
+    for (int r = 0 ; r < REQUESTS ; r ++) {
+      pl_predictor_request(pred, obj, world->t, vd3_set(0.0, 0.0, 0.0));
+    }
+    double end = plbench_now();
+
+    // Wait until the last request has been picked up and published
+    size_t published = 0, last = 0;
+    double latency = 0.0, compute_time = 0.0;
+    for (int r = 0 ; r < 500 ; r ++) {
+      usleep(20000);
+      pthread_mutex_lock(&pred->lock);
+      bool pending = pred->pending;
+      pthread_mutex_unlock(&pred->lock);
+
+      pl_predictor_acquire(pred);
+      published = pred->published;
+      latency = pred->latency;
+      compute_time = pred->compute_time;
+      pl_predictor_release(pred);
+      if (!pending && published > 0 && published == last) break;
+      last = published;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "request, %zu samples", samples[i]);
+    plbench_report(name, "requests", REQUESTS, end - start);
+    printf("  %zu published, latency %f ms, propagation %f ms\n", published,
+           latency * 1.0e3, compute_time * 1.0e3);
+
+    pl_predictor_delete(pred);
+  }
+
+  pl_world_delete(world);
+}
@@ -0,0 +1,126 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+
+#define QUERIES 10000
+#define EXTENT 1.0e9
+
+static lwcoord_t
+random_point(void)
+{
+  lwcoord_t p;
+  lwc_set(&p, plbench_rand(-EXTENT, EXTENT), plbench_rand(-EXTENT, EXTENT),
+          plbench_rand(-EXTENT, EXTENT));
+  return p;
+}
+
+// Spatial queries over the world against the linear scan over the rigid
+// bodies they replace
+void
+bench_query(void)
+{
+  static const size_t counts[] = {1000, 10000, 100000};
+  const double r = EXTENT * 0.01;
+  char name[64];
+
+  for (size_t c = 0 ; c < sizeof(counts)/sizeof(counts[0]) ; c ++) {
+    size_t n = counts[c];
+    pl_world_t *world = pl_new_world(1.0e13);
+
+    srandom(1);
+    for (size_t i = 0 ; i < n ; i ++) {
+      pl_object_t *obj = pl_new_object(world, "bench");
+      obj->radius = plbench_rand(10.0, 1000.0);
+      pl_object_set_pos3d(obj, plbench_rand(-EXTENT, EXTENT),
+                          plbench_rand(-EXTENT, EXTENT),
+                          plbench_rand(-EXTENT, EXTENT));
+    }
+    // Objects are created at the origin, the updates move them into place
+    for (int k = 0 ; k < 2 ; k ++) {
+      ARRAY_FOR_EACH(i, world->root_bodies) {
+        pl_object_update_octtree(ARRAY_ELEM(world->root_bodies, i));
+      }
+    }
+
+    obj_array_t result;
+    obj_array_init(&result);
+    size_t found = 0;
+
+    double start = plbench_now();
+    for (int q = 0 ; q < QUERIES ; q ++) {
+      lwcoord_t p = random_point();
+      ARRAY_FOR_EACH(i, world->rigid_bodies) {
+        pl_object_t *obj = ARRAY_ELEM(world->rigid_bodies, i);
+        if (vd3_abs(lwc_dist(&obj->p, &p)) <= r) found ++;
+      }
+    }
+    double end = plbench_now();
+    snprintf(name, sizeof(name), "linear radius n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+
+    start = plbench_now();
+    for (int q = 0 ; q < QUERIES ; q ++) {
+      lwcoord_t p = random_point();
+      result.length = 0;
+      found += pl_world_query_radius(world, &p, r, &result);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "radius n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+
+    start = plbench_now();
+    for (int q = 0 ; q < QUERIES ; q ++) {
+      lwcoord_t p = random_point();
+      result.length = 0;
+      found += pl_world_query_nearest(world, &p, 8, &result);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "nearest k=8 n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+
+    start = plbench_now();
+    for (int q = 0 ; q < QUERIES ; q ++) {
+      lwcoord_t p = random_point();
+      result.length = 0;
+      found += pl_world_query_box(world, &p, vd3_set(r, r, r), &result);
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "box n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+
+    start = plbench_now();
+    for (int q = 0 ; q < QUERIES ; q ++) {
+      lwcoord_t a = random_point();
+      lwcoord_t b = random_point();
+      found += pl_world_query_segment(world, &a, &b, NULL, NULL) != NULL;
+    }
+    end = plbench_now();
+    snprintf(name, sizeof(name), "segment n=%zu", n);
+    plbench_report(name, "queries", QUERIES, end - start);
+
+    printf("  %zu objects found\n", found);
+    obj_array_dispose(&result);
+    pl_world_delete(world);
+  }
+}
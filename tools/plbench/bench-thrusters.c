@@ -0,0 +1,88 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "plbench.h"
+#include "physics/physics.h"
+
+#define STAGES 3
+#define THRUSTERS 48 // RCS thrusters per stage
+#define STEPS 10000
+
+// A three stage vehicle with a cluster of RCS thrusters on every stage, all
+// firing every step, applied one by one and accumulated in the stages
+void
+bench_thrusters(void)
+{
+  pl_world_t *world = pl_new_world(1.0e13);
+  pl_object_t *vehicle = pl_new_object(world, "vehicle");
+  pl_object_t *stages[STAGES];
+  float3 f[STAGES][THRUSTERS];
+  float3 p[STAGES][THRUSTERS];
+
+  srandom(1);
+  pl_object_t *parent = vehicle;
+  for (int i = 0 ; i < STAGES ; i ++) {
+    stages[i] = pl_new_sub_object3f(world, parent, "stage", 0.0f, 10.0f, 0.0f);
+    pl_mass_solid_cylinder(&stages[i]->m, 1.0e4, 2.0f, 10.0f);
+    pl_object_invalidate_mass(stages[i]);
+    for (int j = 0 ; j < THRUSTERS ; j ++) {
+      f[i][j] = vf3_set(plbench_rand(-1.0, 1.0), plbench_rand(-1.0, 1.0),
+                        plbench_rand(-1.0, 1.0)) * 500.0f;
+      p[i][j] = vf3_set(plbench_rand(-2.0, 2.0), plbench_rand(-5.0, 5.0),
+                        plbench_rand(-2.0, 2.0));
+    }
+    parent = stages[i];
+  }
+  pl_object_update_mass(vehicle);
+
+  double start = plbench_now();
+  for (int s = 0 ; s < STEPS ; s ++) {
+    for (int i = 0 ; i < STAGES ; i ++) {
+      for (int j = 0 ; j < THRUSTERS ; j ++) {
+        pl_object_force_relative_pos3fv(stages[i], f[i][j], p[i][j]);
+      }
+    }
+  }
+  double end = plbench_now();
+  plbench_report("single", "thrusters", (double)STEPS * STAGES * THRUSTERS,
+                 end - start);
+  double3 ref = vehicle->f_ack;
+  pl_object_clear(vehicle);
+
+  start = plbench_now();
+  for (int s = 0 ; s < STEPS ; s ++) {
+    for (int i = 0 ; i < STAGES ; i ++) {
+      for (int j = 0 ; j < THRUSTERS ; j ++) {
+        pl_object_thrust_relative_pos3fv(stages[i], f[i][j], p[i][j]);
+      }
+    }
+    pl_object_apply_thrust(vehicle);
+  }
+  end = plbench_now();
+  plbench_report("batched", "thrusters", (double)STEPS * STAGES * THRUSTERS,
+                 end - start);
+  printf("  relative force difference %g\n",
+         vd3_abs(vehicle->f_ack - ref) / vd3_abs(ref));
+
+  pl_world_delete(world);
+}
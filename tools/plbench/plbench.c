@@ -0,0 +1,108 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*! Micro benchmarks for the physics system.
+
+    Run without arguments to run all benchmarks, or give the names of the
+    benchmarks that should be run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plbench.h"
+#include "common/monotonic-time.h"
+
+static struct {
+  const char *name;
+  plbench_fn_t fn;
+} benchmarks[] = {
+  {"bodystore", bench_bodystore},
+  {"lintree", bench_lintree},
+  {"fmm", bench_fmm},
+  {"integrator", bench_integrator},
+  {"kepler", bench_kepler},
+  {"collision", bench_collision},
+  {"atmosphere", bench_atmosphere},
+  {"particles", bench_particles},
+  {"ephemeris", bench_ephemeris},
+  {"patched", bench_patched},
+  {"mass", bench_mass},
+  {"query", bench_query},
+  {"conjunction", bench_conjunction},
+  {"eclipse", bench_eclipse},
+  {"porkchop", bench_porkchop},
+  {"predict", bench_predict},
+  {"lod", bench_lod},
+  {"geopotential", bench_geopotential},
+  {"thrusters", bench_thrusters},
+};
+
+#define BENCH_COUNT (sizeof(benchmarks)/sizeof(benchmarks[0]))
+
+double
+plbench_now(void)
+{
+  return (double)monotimetons(getmonotimestamp()) * 1.0e-9;
+}
+
+void
+plbench_report(const char *name, const char *unit, double items, double seconds)
+{
+  printf("%-40s %14.0f %s/s (%.3f s)\n", name, items / seconds, unit, seconds);
+}
+
+double
+plbench_rand(double a, double b)
+{
+  return a + (b - a) * ((double)random() / ((double)RAND_MAX + 1.0));
+}
+
+int
+main(int argc, char **argv)
+{
+  srandom(1);
+
+  if (argc == 1) {
+    for (size_t i = 0 ; i < BENCH_COUNT ; i ++) {
+      printf("%s:\n", benchmarks[i].name);
+      benchmarks[i].fn();
+    }
+    return 0;
+  }
+
+  for (int i = 1 ; i < argc ; i ++) {
+    size_t j;
+    for (j = 0 ; j < BENCH_COUNT ; j ++) {
+      if (!strcmp(argv[i], benchmarks[j].name)) {
+        printf("%s:\n", benchmarks[j].name);
+        benchmarks[j].fn();
+        break;
+      }
+    }
+
+    if (j == BENCH_COUNT) {
+      fprintf(stderr, "unknown benchmark '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  return 0;
+}
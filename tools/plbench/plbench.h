@@ -0,0 +1,57 @@
+/*
+ Copyright 2013 Mattias Holm <lorrden(at)openorbit.org>
+
+ This file is part of Open Orbit.
+
+ Open Orbit is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Open Orbit is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Open Orbit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLBENCH_H
+#define PLBENCH_H
+
+#include <stdint.h>
+
+typedef void (*plbench_fn_t)(void);
+
+/*! Returns the current monotonic time in seconds */
+double plbench_now(void);
+
+/*! Print a throughput line, items processed in the given number of seconds */
+void plbench_report(const char *name, const char *unit,
+                    double items, double seconds);
+
+/*! Uniformly distributed random number in [a, b) */
+double plbench_rand(double a, double b);
+
+void bench_atmosphere(void);
+void bench_bodystore(void);
+void bench_collision(void);
+void bench_conjunction(void);
+void bench_eclipse(void);
+void bench_ephemeris(void);
+void bench_fmm(void);
+void bench_geopotential(void);
+void bench_integrator(void);
+void bench_kepler(void);
+void bench_lintree(void);
+void bench_lod(void);
+void bench_mass(void);
+void bench_particles(void);
+void bench_patched(void);
+void bench_porkchop(void);
+void bench_predict(void);
+void bench_query(void);
+void bench_thrusters(void);
+
+#endif /* !PLBENCH_H */